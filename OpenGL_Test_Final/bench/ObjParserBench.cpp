@@ -0,0 +1,191 @@
+// Compares ObjParser with the getline/sscanf OBJ reader SimpleModel used before it. Not part of any build target,
+// compile it against the headers directory, e.g.
+//   g++ -std=c++20 -O2 -I../headers -I<glm> ObjParserBench.cpp -lpthread -o ObjParserBench
+//
+//   ObjParserBench ../resources/planet/planet.obj ../resources/rock/rock.obj
+//   ObjParserBench --generate synthetic.obj 39000000		(about 1.5 GB)
+//   ObjParserBench synthetic.obj
+//
+// Both readers expand the faces into one vertex per corner, which is what SimpleModel did with the old reader, and
+// print a checksum of the result so it is easy to see they agree. Small files are read 20 times and averaged. The old
+// reader only understands what it was written for: v/vt/vn triangles and three header lines before the data.
+
+#include "ObjParser.h"
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+struct BenchVertex
+{
+	glm::vec3 position;
+	glm::vec3 normal;
+	glm::vec2 texCoord;
+};
+
+static double Checksum(const std::vector<BenchVertex>& vertices)
+{
+	double sum = 0.0;
+	for (const BenchVertex& vertex : vertices)
+		sum += vertex.position.x + vertex.position.y + vertex.position.z + vertex.normal.y + vertex.texCoord.x + vertex.texCoord.y;
+	return sum;
+}
+
+// The reader SimpleModel::LoadModel had before ObjParser
+static bool ReadOld(const std::string& path, std::vector<BenchVertex>& vertices)
+{
+	std::ifstream in(path);
+	if (!in)
+		return false;
+
+	std::vector<glm::vec3> positions, normals;
+	std::vector<glm::vec2> texCoords;
+	std::string line;
+
+	for (int i = 0; i < 3; i++)
+		std::getline(in, line);
+
+	vertices.clear();
+	while (std::getline(in, line))
+	{
+		if (line.rfind("vn", 0) == 0)
+		{
+			glm::vec3 normal;
+			sscanf(line.c_str(), "%*s %f %f %f", &normal.x, &normal.y, &normal.z);
+			normals.push_back(normal);
+		}
+		else if (line.rfind("vt", 0) == 0)
+		{
+			glm::vec2 texCoord;
+			sscanf(line.c_str(), "%*s %f %f", &texCoord.x, &texCoord.y);
+			texCoords.push_back(texCoord);
+		}
+		else if (line.rfind("v", 0) == 0)
+		{
+			glm::vec3 position;
+			sscanf(line.c_str(), "%*s %f %f %f", &position.x, &position.y, &position.z);
+			positions.push_back(position);
+		}
+		else if (line.rfind("f", 0) == 0)
+		{
+			int v[3], t[3], n[3];
+			if (sscanf(line.c_str(), "%*s %d/%d/%d %d/%d/%d %d/%d/%d", &v[0], &t[0], &n[0], &v[1], &t[1], &n[1], &v[2], &t[2], &n[2]) != 9)
+				return false;
+
+			for (int i = 0; i < 3; i++)
+				vertices.push_back({ positions[v[i] - 1], normals[n[i] - 1], texCoords[t[i] - 1] });
+		}
+	}
+
+	return true;
+}
+
+static bool ReadNew(const std::string& path, std::vector<BenchVertex>& vertices)
+{
+	ObjData obj;
+	if (!ObjParser::parse(path, obj))
+		return false;
+
+	vertices.resize(obj.corners.size());
+	for (size_t i = 0; i < obj.corners.size(); i++)
+	{
+		const ObjCorner& corner = obj.corners[i];
+		vertices[i].position = obj.positions[corner.position];
+		vertices[i].normal = corner.normal >= 0 ? obj.normals[corner.normal] : glm::vec3(0.0f);
+		vertices[i].texCoord = corner.texCoord >= 0 ? obj.texCoords[corner.texCoord] : glm::vec2(0.0f);
+	}
+
+	return true;
+}
+
+// A square grid of about vertexCount vertices, two triangles per cell, with the header lines the old reader skips
+static bool Generate(const std::string& path, size_t vertexCount)
+{
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const size_t side = std::max<size_t>(2, static_cast<size_t>(std::sqrt(double(vertexCount))));
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> height(0.0f, 1.0f);
+
+	fprintf(file, "# synthetic\n# grid\nmtllib synthetic.mtl\n");
+
+	for (size_t y = 0; y < side; y++)
+	{
+		for (size_t x = 0; x < side; x++)
+		{
+			fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn 0.000000 1.000000 0.000000\n",
+				x * 0.01, height(random), y * 0.01, double(x) / side, double(y) / side);
+		}
+	}
+
+	for (size_t y = 0; y + 1 < side; y++)
+	{
+		for (size_t x = 0; x + 1 < side; x++)
+		{
+			size_t a = y * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+			fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\nf %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a, a, c, c, c, b, b, b, b, b, b, c, c, c, d, d, d);
+		}
+	}
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc == 4 && std::string(argv[1]) == "--generate")
+	{
+		if (!Generate(argv[2], std::strtoull(argv[3], nullptr, 10)))
+		{
+			std::cerr << "Could not write " << argv[2] << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (argc < 2)
+	{
+		std::cerr << "usage: ObjParserBench file.obj...  |  ObjParserBench --generate file.obj vertexCount" << std::endl;
+		return 1;
+	}
+
+	for (int a = 1; a < argc; a++)
+	{
+		const std::string path = argv[a];
+
+		// Large files once, small ones often enough to measure
+		std::ifstream probe(path, std::ios::ate | std::ios::binary);
+		const int repeats = probe && probe.tellg() < (64 << 20) ? 20 : 1;
+
+		std::vector<BenchVertex> oldVertices, newVertices;
+		bool oldOk = true, newOk = true;
+
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; r++)
+			oldOk = ReadOld(path, oldVertices) && oldOk;
+
+		auto t1 = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; r++)
+			newOk = ReadNew(path, newVertices) && newOk;
+
+		auto t2 = std::chrono::steady_clock::now();
+
+		double oldMs = std::chrono::duration<double, std::milli>(t1 - t0).count() / repeats;
+		double newMs = std::chrono::duration<double, std::milli>(t2 - t1).count() / repeats;
+
+		printf("%s: old %.2f ms%s, new %.2f ms%s, vertices %zu / %zu, checksum %.6g / %.6g\n", path.c_str(),
+			oldMs, oldOk ? "" : " (failed)", newMs, newOk ? "" : " (failed)",
+			oldVertices.size(), newVertices.size(), Checksum(oldVertices), Checksum(newVertices));
+	}
+
+	return 0;
+}
@@ -0,0 +1,506 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Shader.h"
+#include "TextureBindings.h"
+#include "GLState.h"
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANIMATION_SSE2
+#include <emmintrin.h>
+#endif
+
+// Local transforms of every joint, three vec4 per joint: rotation quaternion (x, y, z, w), translation and scale
+// (w unused). Joint j's rotation is at j * 3, its translation at j * 3 + 1 and its scale at j * 3 + 2.
+typedef std::vector<glm::vec4> Pose;
+
+// Joints in an order where parents come before their children
+struct Skeleton
+{
+	std::vector<std::string> names;
+	std::vector<int> parents;				// -1 for the root
+	std::vector<glm::mat4> inverseBind;		// Model space to joint space, Assimp's bone offset matrix
+	Pose bindPose;							// Local transforms of the rest pose
+	glm::mat4 globalInverse = glm::mat4(1.0f);
+
+	unsigned int getJointCount() const { return static_cast<unsigned int>(names.size()); }
+
+	bool empty() const { return names.empty(); }
+
+	// Index of the joint or -1
+	int find(const std::string& name) const;
+};
+
+inline int Skeleton::find(const std::string& name) const
+{
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i] == name)
+			return static_cast<int>(i);
+	}
+
+	return -1;
+}
+
+// Animation resampled at a fixed rate and quantized. Tracks (the rotation, translation or scale of a joint) that never
+// change keep one float value, the others store every frame as four 16 bit integers that map back to floats through a
+// per track offset and scale. The keys of one frame are next to each other, so sampling reads two small contiguous blocks.
+class AnimationClip
+{
+public:
+	std::string name;
+
+private:
+	float m_Duration = 0.0f;
+	float m_SampleRate = 30.0f;
+	uint32_t m_FrameCount = 0;
+	uint32_t m_JointCount = 0;
+
+	Pose m_Constants;						// Value of every track, animated tracks overwrite theirs
+	std::vector<uint32_t> m_Tracks;			// Pose index of each animated track
+	std::vector<glm::vec4> m_Offsets;		// Per animated track, value = offset + key * scale
+	std::vector<glm::vec4> m_Scales;
+	std::vector<int16_t> m_Keys;			// m_FrameCount frames of m_Tracks.size() * 4 keys
+
+public:
+	// frames holds frameCount poses of jointCount joints, sampled sampleRate times a second
+	static AnimationClip compress(const std::string& name, float sampleRate, uint32_t frameCount, uint32_t jointCount, const std::vector<glm::vec4>& frames);
+
+	// Writes the local pose at time (in seconds) into pose. Looping clips wrap around, the others hold their last frame.
+	void sample(float time, bool loop, Pose& pose) const;
+
+	float getDuration() const { return m_Duration; }
+	uint32_t getJointCount() const { return m_JointCount; }
+	uint32_t getFrameCount() const { return m_FrameCount; }
+	size_t getAnimatedTrackCount() const { return m_Tracks.size(); }
+
+	// Bytes of keyframe data, for comparing against the 48 bytes a joint takes per frame uncompressed
+	size_t getMemorySize() const;
+};
+
+AnimationClip AnimationClip::compress(const std::string& name, float sampleRate, uint32_t frameCount, uint32_t jointCount, const std::vector<glm::vec4>& frames)
+{
+	constexpr float CONSTANT_EPSILON = 1e-5f;
+
+	AnimationClip clip;
+	clip.name = name;
+	clip.m_SampleRate = sampleRate;
+	clip.m_FrameCount = frameCount;
+	clip.m_JointCount = jointCount;
+	clip.m_Duration = frameCount > 1 ? (frameCount - 1) / sampleRate : 0.0f;
+
+	const size_t trackCount = size_t(jointCount) * 3;
+	if (frameCount == 0 || frames.size() < frameCount * trackCount)
+		return clip;
+
+	// q and -q are the same rotation, keep every key on the side of the one before it so neighbours interpolate the short way
+	std::vector<glm::vec4> keys(frames.begin(), frames.begin() + frameCount * trackCount);
+	for (uint32_t f = 1; f < frameCount; f++)
+	{
+		for (size_t track = 0; track < trackCount; track += 3)
+		{
+			glm::vec4& current = keys[f * trackCount + track];
+			if (glm::dot(current, keys[(f - 1) * trackCount + track]) < 0.0f)
+				current = current * -1.0f;
+		}
+	}
+
+	clip.m_Constants.assign(keys.begin(), keys.begin() + trackCount);
+
+	for (size_t track = 0; track < trackCount; track++)
+	{
+		glm::vec4 min = keys[track], max = keys[track];
+		for (uint32_t f = 1; f < frameCount; f++)
+		{
+			const glm::vec4& key = keys[f * trackCount + track];
+			for (int c = 0; c < 4; c++)
+			{
+				min[c] = std::min(min[c], key[c]);
+				max[c] = std::max(max[c], key[c]);
+			}
+		}
+
+		bool constant = true;
+		for (int c = 0; c < 4; c++)
+			constant = constant && max[c] - min[c] <= CONSTANT_EPSILON;
+
+		if (constant)
+			continue;
+
+		// Rotations are unit quaternions and use the full range, the rest is fitted to its own range
+		glm::vec4 offset(0.0f), scale(1.0f / 32767.0f);
+		if (track % 3 != 0)
+		{
+			offset = (min + max) * 0.5f;
+			scale = (max - min) * (0.5f / 32767.0f);
+		}
+
+		clip.m_Tracks.push_back(static_cast<uint32_t>(track));
+		clip.m_Offsets.push_back(offset);
+		clip.m_Scales.push_back(scale);
+	}
+
+	const size_t animated = clip.m_Tracks.size();
+	clip.m_Keys.resize(frameCount * animated * 4);
+
+	for (uint32_t f = 0; f < frameCount; f++)
+	{
+		for (size_t k = 0; k < animated; k++)
+		{
+			const glm::vec4& key = keys[f * trackCount + clip.m_Tracks[k]];
+			int16_t* quantized = &clip.m_Keys[(f * animated + k) * 4];
+
+			for (int c = 0; c < 4; c++)
+			{
+				float scale = clip.m_Scales[k][c];
+				float value = scale > 0.0f ? (key[c] - clip.m_Offsets[k][c]) / scale : 0.0f;
+				quantized[c] = static_cast<int16_t>(std::lround(std::clamp(value, -32767.0f, 32767.0f)));
+			}
+		}
+	}
+
+	return clip;
+}
+
+void AnimationClip::sample(float time, bool loop, Pose& pose) const
+{
+	pose.assign(m_Constants.begin(), m_Constants.end());
+
+	if (m_FrameCount == 0 || m_Tracks.empty())
+		return;
+
+	if (loop && m_Duration > 0.0f)
+	{
+		time = std::fmod(time, m_Duration);
+		if (time < 0.0f)
+			time += m_Duration;
+	}
+
+	float frame = std::clamp(time * m_SampleRate, 0.0f, float(m_FrameCount - 1));
+	uint32_t frame0 = std::min(static_cast<uint32_t>(frame), m_FrameCount - 1);
+	uint32_t frame1 = std::min(frame0 + 1, m_FrameCount - 1);
+	float t = frame - float(frame0);
+
+	const size_t animated = m_Tracks.size();
+	const int16_t* keys0 = &m_Keys[frame0 * animated * 4];
+	const int16_t* keys1 = &m_Keys[frame1 * animated * 4];
+
+#ifdef ANIMATION_SSE2
+	const __m128 weight = _mm_set1_ps(t);
+
+	for (size_t k = 0; k < animated; k++)
+	{
+		// Sign extend the four 16 bit keys of both frames to floats
+		__m128i packed0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(keys0 + k * 4));
+		__m128i packed1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(keys1 + k * 4));
+		__m128 a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed0, packed0), 16));
+		__m128 b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed1, packed1), 16));
+
+		__m128 key = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), weight));
+		__m128 value = _mm_add_ps(_mm_loadu_ps(&m_Offsets[k].x), _mm_mul_ps(key, _mm_loadu_ps(&m_Scales[k].x)));
+
+		_mm_storeu_ps(&pose[m_Tracks[k]].x, value);
+	}
+#else
+	for (size_t k = 0; k < animated; k++)
+	{
+		glm::vec4& value = pose[m_Tracks[k]];
+		for (int c = 0; c < 4; c++)
+		{
+			float key = keys0[k * 4 + c] + (keys1[k * 4 + c] - keys0[k * 4 + c]) * t;
+			value[c] = m_Offsets[k][c] + key * m_Scales[k][c];
+		}
+	}
+#endif
+}
+
+size_t AnimationClip::getMemorySize() const
+{
+	return m_Keys.size() * sizeof(int16_t) + (m_Constants.size() + m_Offsets.size() + m_Scales.size()) * sizeof(glm::vec4) + m_Tracks.size() * sizeof(uint32_t);
+}
+
+// out = a + (b - a) * weight, with rotations taking the short way. out may be a.
+inline void BlendPoses(const Pose& a, const Pose& b, float weight, Pose& out)
+{
+	const size_t count = std::min(a.size(), b.size());
+	out.resize(count);
+
+#ifdef ANIMATION_SSE2
+	const __m128 w = _mm_set1_ps(weight);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		__m128 va = _mm_loadu_ps(&a[i].x);
+		__m128 vb = _mm_loadu_ps(&b[i].x);
+
+		if (i % 3 == 0 && glm::dot(a[i], b[i]) < 0.0f)
+			vb = _mm_sub_ps(_mm_setzero_ps(), vb);
+
+		_mm_storeu_ps(&out[i].x, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), w)));
+	}
+#else
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec4 target = (i % 3 == 0 && glm::dot(a[i], b[i]) < 0.0f) ? b[i] * -1.0f : b[i];
+		out[i] = a[i] + (target - a[i]) * weight;
+	}
+#endif
+}
+
+// Skinning matrices of a pose, three rows (the transposed upper 3x4) per joint, ready for the palette texture
+inline void BuildSkinningPalette(const Skeleton& skeleton, const Pose& pose, std::vector<glm::mat4>& modelSpace, glm::vec4* palette)
+{
+	const unsigned int jointCount = skeleton.getJointCount();
+	modelSpace.resize(jointCount);
+
+	for (unsigned int j = 0; j < jointCount; j++)
+	{
+		glm::vec4 q = pose[j * 3];
+		const glm::vec4& t = pose[j * 3 + 1];
+		const glm::vec4& s = pose[j * 3 + 2];
+
+		// Interpolated quaternions are not unit length any more
+		float length = std::sqrt(glm::dot(q, q));
+		q = length > 0.0f ? q * (1.0f / length) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+		glm::mat4 local;
+		local[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x, 0.0f);
+		local[1] = glm::vec4(2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y, 0.0f);
+		local[2] = glm::vec4(2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z, 0.0f);
+		local[3] = glm::vec4(t.x, t.y, t.z, 1.0f);
+
+		// Parents come first, so theirs is done already
+		int parent = skeleton.parents[j];
+		modelSpace[j] = parent >= 0 ? modelSpace[parent] * local : local;
+
+		glm::mat4 skinning = skeleton.globalInverse * modelSpace[j] * skeleton.inverseBind[j];
+		for (int row = 0; row < 3; row++)
+			palette[j * 3 + row] = glm::vec4(skinning[0][row], skinning[1][row], skinning[2][row], skinning[3][row]);
+	}
+}
+
+// Playback state of one animated character: the clip it plays and the clip it is fading to
+class Animator
+{
+public:
+	const Skeleton* skeleton = nullptr;
+	float speed = 1.0f;
+	bool loop = true;
+
+private:
+	const AnimationClip* m_Clip = nullptr;
+	float m_Time = 0.0f;
+
+	const AnimationClip* m_NextClip = nullptr;
+	float m_NextTime = 0.0f;
+	float m_FadeTime = 0.0f;
+	float m_FadeDuration = 0.0f;
+
+	unsigned int m_PaletteOffset = 0;		// First joint in the palette texture, set by AnimationSystem::update()
+
+	friend class AnimationSystem;
+
+public:
+	Animator() = default;
+	explicit Animator(const Skeleton* skeleton) : skeleton(skeleton) {}
+
+	// Starts playing clip, cross fading from the current one over fadeDuration seconds
+	void play(const AnimationClip* clip, float fadeDuration = 0.0f);
+
+	// Moves the clips forward and finishes the fade once it is done
+	void advance(float deltaTime);
+
+	// Writes the blended local pose, scratch holds the pose faded to
+	void evaluate(Pose& pose, Pose& scratch) const;
+
+	const AnimationClip* getClip() const { return m_Clip; }
+	float getTime() const { return m_Time; }
+	unsigned int getPaletteOffset() const { return m_PaletteOffset; }
+};
+
+void Animator::play(const AnimationClip* clip, float fadeDuration)
+{
+	if (clip && skeleton && clip->getJointCount() != skeleton->getJointCount())
+	{
+		std::cerr << "Animation " << clip->name << " was not made for this skeleton" << std::endl;
+		return;
+	}
+
+	if (!m_Clip || fadeDuration <= 0.0f)
+	{
+		m_Clip = clip;
+		m_Time = 0.0f;
+		m_NextClip = nullptr;
+		return;
+	}
+
+	m_NextClip = clip;
+	m_NextTime = 0.0f;
+	m_FadeTime = 0.0f;
+	m_FadeDuration = fadeDuration;
+}
+
+void Animator::advance(float deltaTime)
+{
+	m_Time += deltaTime * speed;
+
+	if (!m_NextClip)
+		return;
+
+	m_NextTime += deltaTime * speed;
+	m_FadeTime += deltaTime;
+
+	if (m_FadeTime >= m_FadeDuration)
+	{
+		m_Clip = m_NextClip;
+		m_Time = m_NextTime;
+		m_NextClip = nullptr;
+	}
+}
+
+void Animator::evaluate(Pose& pose, Pose& scratch) const
+{
+	if (m_Clip)
+		m_Clip->sample(m_Time, loop, pose);
+	else
+		pose = skeleton->bindPose;
+
+	if (m_NextClip)
+	{
+		m_NextClip->sample(m_NextTime, loop, scratch);
+		BlendPoses(pose, scratch, m_FadeTime / m_FadeDuration, pose);
+	}
+}
+
+// Evaluates every animator on the thread pool and uploads all skinning palettes as one texture buffer. Vertex shaders
+// read their character's palette with skinMatrix() (see VertexFormat.h) after bind() set its offset.
+class AnimationSystem
+{
+public:
+	// Far above the units meshes bind their material textures to
+	static constexpr unsigned int PALETTE_TEXTURE_UNIT = 15;
+
+private:
+	std::vector<glm::vec4> m_Palette;
+	unsigned int m_Buffer = 0;
+	unsigned int m_Texture = 0;
+	size_t m_BufferSize = 0;
+
+	// This is a singleton class
+	AnimationSystem() {}
+
+public:
+	AnimationSystem(AnimationSystem const&) = delete;
+	void operator=(AnimationSystem const&) = delete;
+
+	static AnimationSystem& getInstance();
+
+	// Advances, samples and blends every animator and uploads the palettes. Call once a frame on the render thread.
+	void update(const std::vector<Animator*>& animators, float deltaTime);
+
+	// Points the shader at the animator's palette
+	void bind(Shader& shader, const Animator& animator);
+
+	size_t getPaletteJointCount() const { return m_Palette.size() / 3; }
+
+	void free();
+};
+
+inline AnimationSystem& AnimationSystem::getInstance()
+{
+	static AnimationSystem system;
+	return system;
+}
+
+void AnimationSystem::update(const std::vector<Animator*>& animators, float deltaTime)
+{
+	unsigned int jointTotal = 0;
+	for (Animator* animator : animators)
+	{
+		animator->m_PaletteOffset = jointTotal;
+		jointTotal += animator->skeleton ? animator->skeleton->getJointCount() : 0;
+	}
+
+	m_Palette.resize(size_t(jointTotal) * 3);
+
+	ThreadPool::getInstance().parallelFor(animators.size(), [&](size_t begin, size_t end)
+	{
+		// Reused between frames, sampling allocates nothing once these have grown
+		thread_local Pose pose, scratch;
+		thread_local std::vector<glm::mat4> modelSpace;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			Animator& animator = *animators[i];
+			if (!animator.skeleton)
+				continue;
+
+			animator.advance(deltaTime);
+			animator.evaluate(pose, scratch);
+			BuildSkinningPalette(*animator.skeleton, pose, modelSpace, &m_Palette[size_t(animator.m_PaletteOffset) * 3]);
+		}
+	}, 8);
+
+	if (m_Palette.empty())
+		return;
+
+	if (m_Texture == 0)
+	{
+		glGenBuffers(1, &m_Buffer);
+		glGenTextures(1, &m_Texture);
+
+		GLState::getInstance().bindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+		TextureBindings::getInstance().setActiveUnit(PALETTE_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_Buffer);
+	}
+
+	// Orphaned every frame so the driver never waits for last frame's draws to finish reading
+	size_t size = m_Palette.size() * sizeof(glm::vec4);
+	GLState::getInstance().bindBuffer(GL_TEXTURE_BUFFER, m_Buffer);
+	glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, size, m_Palette.data());
+	GLState::getInstance().bindBuffer(GL_TEXTURE_BUFFER, 0);
+	m_BufferSize = size;
+}
+
+void AnimationSystem::bind(Shader& shader, const Animator& animator)
+{
+	// Buffer textures have their own binding point, the texture binding cache only has to know the unit changed
+	TextureBindings::getInstance().setActiveUnit(PALETTE_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, m_Texture);
+
+	glUniform1i(glGetUniformLocation(shader.getID(), "bonePalette"), PALETTE_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(shader.getID(), "boneOffset"), animator.getPaletteOffset());
+}
+
+void AnimationSystem::free()
+{
+	if (m_Texture != 0)
+		glDeleteTextures(1, &m_Texture);
+	if (m_Buffer != 0)
+	{
+		GLState::getInstance().forgetBuffer(m_Buffer);
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	m_Texture = m_Buffer = 0;
+	m_BufferSize = 0;
+	m_Palette.clear();
+}
@@ -14,12 +14,33 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Animation.h"
+#include "NodeHierarchy.h"
+#include "Texture2D.h"
 #include "Shader.h"
+#include "ThreadPool.h"
 
 #include <iostream>
 #include <string>
 #include <vector>
+#include <string_view>
+#include <algorithm>
 
+// Decoded image waiting for its GL texture
+struct TextureImage
+{
+	unsigned char* data = nullptr;
+	int width = 0, height = 0, components = 0;
+	bool flipped = false;		// The stb_image flip flag at decode time, for reloading it the same way
+	bool reloadable = true;		// False for images decoded from memory, filename is then only a name
+	std::string filename;
+};
+
+TextureImage DecodeTextureFile(const char* path, const std::string& directory);
+unsigned int TextureFromImage(TextureImage& image, const char* path, bool gamma);
 unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma);
 
 class Model
@@ -31,215 +52,842 @@ public:
 	std::string directory;
 	bool gammaCorrection = false;
 
+	// Keeps a binary copy of the processed meshes next to the model file (path + ".meshcache")
+	bool useMeshCache = true;
+
+	// How the meshes store their vertices on the GPU. Meshes without bones never get the bone streams.
+	VertexFormat vertexFormat = VertexFormat::full();
+
+	// Whether the meshes keep their vertices and indices on the CPU after upload
+	GeometryRetention geometryRetention = GeometryRetention::Release;
+
+	// Import time clean up of the index and vertex order, part of the mesh cache key
+	MeshOptimizeOptions meshOptimization;
+
+	// LOD chain built for every mesh at import time, part of the mesh cache key
+	MeshLodOptions lodGeneration;
+
+	// What the optimizer did over every mesh of the last Assimp import (left as is when loaded from the cache)
+	MeshOptimizeStats optimizationStats;
+
+	// Joints the meshes are skinned to and the model's animations, resampled and compressed at import. Play them with an
+	// Animator, then call AnimationSystem::bind() before Draw() with a shader that skins (see SkinnedModel.glsl).
+	Skeleton skeleton;
+	std::vector<AnimationClip> animations;
+
+	// The node tree of the file and the bounds of the whole model (the root node's), in model space. The node bounds
+	// are from the file's layout, so they include the node transforms: they fit Draw(shader, model, lod), not
+	// Draw(shader, lod), which draws every mesh without its node transform.
+	std::vector<ModelNode> nodes;
+	AABB bounds;
+	BoundingSphere sphere;
+
+	// Live transforms of the nodes, indexed like nodes. Move parts by setting their local transform here, Draw()
+	// with a model matrix brings the world matrices up to date.
+	NodeHierarchy hierarchy;
+
 	// constructor, expects a filepath to a 3D model.
 	Model() = default;
 
-	void load(const std::string& path, bool gamma = false)
+	// the model owns its meshes and textures, so it can be moved but not copied
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	Model(Model&& other) noexcept
+		: textures_loaded(std::move(other.textures_loaded)), meshes(std::move(other.meshes)), directory(std::move(other.directory)),
+		  gammaCorrection(other.gammaCorrection), useMeshCache(other.useMeshCache), vertexFormat(other.vertexFormat), geometryRetention(other.geometryRetention),
+		  meshOptimization(other.meshOptimization), lodGeneration(other.lodGeneration), optimizationStats(other.optimizationStats),
+		  skeleton(std::move(other.skeleton)), animations(std::move(other.animations)), nodes(std::move(other.nodes)), bounds(other.bounds), sphere(other.sphere),
+		  hierarchy(std::move(other.hierarchy))
+	{
+		other.textures_loaded.clear();
+	}
+
+	Model& operator=(Model&& other) noexcept
+	{
+		if (this != &other)
+		{
+			free();
+			textures_loaded = std::move(other.textures_loaded);
+			meshes = std::move(other.meshes);
+			directory = std::move(other.directory);
+			gammaCorrection = other.gammaCorrection;
+			useMeshCache = other.useMeshCache;
+			vertexFormat = other.vertexFormat;
+			geometryRetention = other.geometryRetention;
+			meshOptimization = other.meshOptimization;
+			lodGeneration = other.lodGeneration;
+			optimizationStats = other.optimizationStats;
+			skeleton = std::move(other.skeleton);
+			animations = std::move(other.animations);
+			nodes = std::move(other.nodes);
+			bounds = other.bounds;
+			sphere = other.sphere;
+			hierarchy = std::move(other.hierarchy);
+			other.textures_loaded.clear();
+		}
+		return *this;
+	}
+
+	~Model()
+	{
+		free();
+	}
+
+	// deletes the meshes and every texture the model loaded
+	void free()
+	{
+		meshes.clear();
+
+		for (const Texture& texture : textures_loaded)
+			DeleteTexture2D(texture.id);
+
+		textures_loaded.clear();
+	}
+
+	// loads .gltf and .glb files with GltfLoader, everything else through Assimp
+	void load(const std::string& path, bool gamma = false);
+
+	// bounds of the whole model in world space when drawn with Draw(shader, model, lod) and this model matrix
+	AABB getWorldBounds(const glm::mat4& model) const { return bounds.transform(model); }
+	BoundingSphere getWorldSphere(const glm::mat4& model) const { return sphere.transform(model); }
+
+	// bounds of a node and everything below it in world space, placed by the hierarchy as of its last update
+	AABB getNodeWorldBounds(unsigned int node, const glm::mat4& model) const
+	{
+		return nodes[node].bounds.transform(model * hierarchy.getWorld(node));
+	}
+
+	BoundingSphere getNodeWorldSphere(unsigned int node, const glm::mat4& model) const
+	{
+		return nodes[node].sphere.transform(model * hierarchy.getWorld(node));
+	}
+
+	// index of the node called name or -1
+	int findNode(const std::string& name) const
+	{
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			if (nodes[i].name == name)
+				return static_cast<int>(i);
+		}
+		return -1;
+	}
+
+	// index of the animation called name or -1
+	int findAnimation(const std::string& name) const
 	{
-		gammaCorrection = gamma;
-		LoadModel(path);
+		for (size_t i = 0; i < animations.size(); i++)
+		{
+			if (animations[i].name == name)
+				return static_cast<int>(i);
+		}
+		return -1;
 	}
 
-	// draws the model by drawing the loaded meshes
-	void Draw(Shader& shader)
+	// draws the model by drawing the loaded meshes, meshes with fewer LODs draw their coarsest. Every mesh is drawn
+	// with the caller's matModel, the node transforms are left out. The model's bounds don't fit this placement when
+	// the file has node transforms, the union of the meshes' bounds does.
+	void Draw(Shader& shader, unsigned int lod = 0)
 	{
 		for (unsigned int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shader);
+			meshes[i].Draw(shader, lod);
+	}
+
+	// draws every mesh where its node puts it, matModel is set to model times the node's world matrix. Skinned meshes
+	// get their placement from the skeleton and are drawn with model alone.
+	void Draw(Shader& shader, const glm::mat4& model, unsigned int lod = 0)
+	{
+		hierarchy.update();
+
+		for (unsigned int n = 0; n < nodes.size(); n++)
+		{
+			const ModelNode& node = nodes[n];
+			if (node.meshCount == 0)
+				continue;
+
+			glm::mat4 nodeModel = model * hierarchy.getWorld(n);
+			for (unsigned int i = node.firstMesh; i < node.firstMesh + node.meshCount; i++)
+			{
+				shader.setMat4("matModel", meshes[i].getFormat().skinned && !skeleton.empty() ? model : nodeModel);
+				meshes[i].Draw(shader, lod);
+			}
+		}
 	}
 
 private:
+	// fills the model from glTF files with the helpers below
+	friend class GltfLoader;
+
 	// loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
 	void LoadModel(std::string const& path)
 	{
+		constexpr unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+		// retrieve the directory path of the filepath
+		directory = path.substr(0, path.find_last_of('/'));
+
+		// try the mesh cache first, it skips Assimp entirely
+		std::string cachePath = path + ".meshcache";
+		MeshCacheKey cacheKey;
+		cacheKey.sourceHash = useMeshCache ? HashFile(path) : 0;
+		cacheKey.importFlags = importFlags;
+		cacheKey.optimizeFlags = meshOptimization.getKey();
+		cacheKey.vertexFormat = vertexFormat.getKey();
+		cacheKey.lodOptions = lodGeneration.getKey();
+
+		if (useMeshCache && cacheKey.sourceHash != 0 && LoadFromCache(cachePath, cacheKey))
+			return;
+
 		// read file via ASSIMP
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+		const aiScene* scene = importer.ReadFile(path, importFlags);
 		// check for errors
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
 		{
 			std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
 			return;
 		}
-		// retrieve the directory path of the filepath
-		directory = path.substr(0, path.find_last_of('/'));
 
-		// process ASSIMP's root node recursively
-		ProcessNode(scene->mRootNode, scene);
+		// CPU phase: gather the meshes of the node tree, then convert them and decode their textures on the thread pool
+		std::vector<const aiMesh*> sceneMeshes;
+		nodes.clear();
+		CollectMeshes(scene->mRootNode, -1, static_cast<unsigned int>(meshes.size()), scene, sceneMeshes);
+
+		// the joints have to be known before the vertices can refer to them
+		skeleton = BuildSkeleton(scene, sceneMeshes);
+
+		std::vector<MeshData> meshData(sceneMeshes.size());
+		ThreadPool::getInstance().parallelFor(sceneMeshes.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				ProcessMesh(sceneMeshes[i], meshOptimization, lodGeneration, skeleton, meshData[i]);
+		});
+
+		animations = ImportAnimations(scene, skeleton);
+
+		optimizationStats = MeshOptimizeStats();
+		for (const MeshData& data : meshData)
+			optimizationStats.accumulate(data.stats);
+
+		std::vector<std::vector<Texture>> materials = ResolveMaterials(scene);
+
+		// GL phase: every mesh is uploaded in one go on this thread
+		meshes.reserve(meshes.size() + meshData.size());
+		for (size_t i = 0; i < meshData.size(); i++)
+		{
+			MeshData& data = meshData[i];
+
+			VertexFormat format = vertexFormat;
+			format.skinned = vertexFormat.skinned && sceneMeshes[i]->HasBones();
+
+			// packed formats address 256 joints, meshes of bigger skeletons that use the rest keep the full format
+			if (!CanPackJoints(data.vertices.data(), data.vertices.size(), format))
+			{
+				std::cout << "WARNING::MODEL:: " << path << " uses joints above " << MAX_PACKED_JOINT << " in mesh " << i << ", it gets the full vertex format" << std::endl;
+				format = VertexFormat::full();
+			}
+
+			meshes.push_back(Mesh(std::move(data.vertices), std::move(data.indices), materials[sceneMeshes[i]->mMaterialIndex], format));
+			meshes.back().bounds = data.bounds;
+			meshes.back().sphere = data.sphere;
+			meshes.back().lods = std::move(data.lods);
+		}
+
+		ComputeNodeBounds();
+		BuildHierarchy();
+
+		// the cache holds neither the skeleton nor the animations, skinned models always come from Assimp
+		if (useMeshCache && cacheKey.sourceHash != 0 && skeleton.empty())
+			MeshCache::write(cachePath, cacheKey, meshes, nodes);
+
+		// the cache was the last thing that needed the CPU copy
+		if (geometryRetention == GeometryRetention::Release)
+		{
+			for (Mesh& mesh : meshes)
+				mesh.releaseGeometry();
+		}
 	}
 
-	// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-	void ProcessNode(aiNode* node, const aiScene* scene)
+	// builds the meshes straight out of the mapped cache file, the vertex data is never copied on the CPU
+	bool LoadFromCache(const std::string& cachePath, const MeshCacheKey& cacheKey)
 	{
-		// process each mesh located at the current node
-		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		MeshCache cache;
+		if (!cache.open(cachePath, cacheKey))
+			return false;
+
+		// decode every texture the cache refers to up front, in parallel
+		std::vector<std::string> paths;
+		for (uint32_t i = 0; i < cache.getMeshCount(); i++)
 		{
-			// the node object only contains indices to index the actual objects in the scene. 
-			// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(ProcessMesh(mesh, scene));
+			const MeshCacheEntry& entry = cache.getMesh(i);
+			for (uint32_t t = entry.firstTexture; t < entry.firstTexture + entry.textureCount; t++)
+				paths.emplace_back(cache.getTexturePath(t));
 		}
-		// after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-		for (unsigned int i = 0; i < node->mNumChildren; i++)
+		LoadTextures(paths);
+
+		const unsigned int firstMesh = static_cast<unsigned int>(meshes.size());
+		meshes.reserve(meshes.size() + cache.getMeshCount());
+
+		for (uint32_t i = 0; i < cache.getMeshCount(); i++)
+		{
+			const MeshCacheEntry& entry = cache.getMesh(i);
+
+			std::vector<Texture> textures;
+			textures.reserve(entry.textureCount);
+			for (uint32_t t = entry.firstTexture; t < entry.firstTexture + entry.textureCount; t++)
+				textures.push_back(FindTexture(cache.getTexturePath(t), cache.getTextureType(t)));
+
+			meshes.push_back(Mesh(cache.getVertices(entry), entry.vertexCount, cache.getIndices(entry), entry.indexCount, cache.getIndexType(entry), std::move(textures), cache.getVertexFormat(entry)));
+
+			// the mapping goes away with the cache, copy the geometry out only if it is wanted
+			if (geometryRetention == GeometryRetention::Keep)
+			{
+				meshes.back().vertices = UnpackVertices(cache.getVertices(entry), entry.vertexCount, cache.getVertexFormat(entry));
+				if (cache.getIndexType(entry) == GL_UNSIGNED_SHORT)
+				{
+					const uint16_t* indices = static_cast<const uint16_t*>(cache.getIndices(entry));
+					meshes.back().indices.assign(indices, indices + entry.indexCount);
+				}
+				else
+				{
+					const unsigned int* indices = static_cast<const unsigned int*>(cache.getIndices(entry));
+					meshes.back().indices.assign(indices, indices + entry.indexCount);
+				}
+			}
+
+			meshes.back().lods = cache.getLods(entry);
+			meshes.back().bounds.min = glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+			meshes.back().bounds.max = glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+			meshes.back().sphere.center = glm::vec3(entry.sphere[0], entry.sphere[1], entry.sphere[2]);
+			meshes.back().sphere.radius = entry.sphere[3];
+		}
+
+		nodes = cache.getNodes();
+		for (ModelNode& node : nodes)
+			node.firstMesh += firstMesh;
+		BuildHierarchy();
+
+		if (!nodes.empty())
 		{
-			ProcessNode(node->mChildren[i], scene);
+			bounds = nodes[0].bounds.transform(nodes[0].transform);
+			sphere = nodes[0].sphere.transform(nodes[0].transform);
 		}
 
+		return true;
 	}
 
-	Mesh ProcessMesh(aiMesh* mesh, const aiScene* scene)
+	// CPU side data of a mesh, filled on the thread pool
+	struct MeshData
 	{
-		// data to fill
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
-		std::vector<Texture> textures;
+		AABB bounds;
+		BoundingSphere sphere;
+		std::vector<MeshLod> lods;
+		MeshOptimizeStats stats;
+	};
+
+	// gathers the meshes of a node and its children (if any) in the order the old recursive walk processed them,
+	// and records the node with the range of meshes it owns. firstMesh is where this load's meshes start in meshes.
+	void CollectMeshes(const aiNode* node, int parent, unsigned int firstMesh, const aiScene* scene, std::vector<const aiMesh*>& sceneMeshes)
+	{
+		int index = static_cast<int>(nodes.size());
+		nodes.emplace_back();
+		nodes[index].name = node->mName.C_Str();
+		nodes[index].parent = parent;
+		nodes[index].transform = ToGlm(node->mTransformation);
+		nodes[index].firstMesh = firstMesh + static_cast<unsigned int>(sceneMeshes.size());
+		nodes[index].meshCount = node->mNumMeshes;
+
+		// the node object only contains indices to index the actual objects in the scene. 
+		// the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+			sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			CollectMeshes(node->mChildren[i], index, firstMesh, scene, sceneMeshes);
+	}
+
+	// bounds of every node from its meshes and its children, children come after their parents so a backwards walk
+	// finishes every child before its parent needs it
+	void ComputeNodeBounds()
+	{
+		std::vector<bool> empty(nodes.size(), true);
+
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			ModelNode& node = nodes[i];
+			for (unsigned int m = node.firstMesh; m < node.firstMesh + node.meshCount; m++)
+			{
+				if (empty[i])
+				{
+					node.bounds = meshes[m].bounds;
+					node.sphere = meshes[m].sphere;
+					empty[i] = false;
+				}
+				else
+				{
+					node.bounds.expand(meshes[m].bounds);
+					node.sphere.expand(meshes[m].sphere);
+				}
+			}
+
+			if (empty[i] || node.parent < 0)
+				continue;
+
+			ModelNode& parent = nodes[node.parent];
+			AABB childBounds = node.bounds.transform(node.transform);
+			BoundingSphere childSphere = node.sphere.transform(node.transform);
+
+			if (empty[node.parent])
+			{
+				parent.bounds = childBounds;
+				parent.sphere = childSphere;
+				empty[node.parent] = false;
+			}
+			else
+			{
+				parent.bounds.expand(childBounds);
+				parent.sphere.expand(childSphere);
+			}
+		}
+
+		if (!nodes.empty())
+		{
+			bounds = nodes[0].bounds.transform(nodes[0].transform);
+			sphere = nodes[0].sphere.transform(nodes[0].transform);
+		}
+	}
+
+	// live transforms start out at the file's layout, the nodes are already in depth first order
+	void BuildHierarchy()
+	{
+		hierarchy.clear();
+		for (const ModelNode& node : nodes)
+			hierarchy.addNode(node.parent, node.transform);
+		hierarchy.update();
+	}
+
+	// converts an assimp mesh. No GL calls and no shared state, so any number of these run at once.
+	static void ProcessMesh(const aiMesh* mesh, const MeshOptimizeOptions& options, const MeshLodOptions& lodOptions, const Skeleton& skeleton, MeshData& data)
+	{
+		std::vector<Vertex>& vertices = data.vertices;
+		std::vector<unsigned int>& indices = data.indices;
 
 		// walk through each of the mesh's vertices
+		vertices.resize(mesh->mNumVertices);
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
-			Vertex vertex;
-			glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
+			Vertex& vertex = vertices[i];
 			// positions
-			vector.x = mesh->mVertices[i].x;
-			vector.y = mesh->mVertices[i].y;
-			vector.z = mesh->mVertices[i].z;
-			vertex.vPosition = vector;
+			vertex.vPosition = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 			// normals
 			if (mesh->HasNormals())
-			{
-				vector.x = mesh->mNormals[i].x;
-				vector.y = mesh->mNormals[i].y;
-				vector.z = mesh->mNormals[i].z;
-				vertex.vNormal = vector;
-			}
+				vertex.vNormal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
 			// texture coordinates
 			if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
 			{
-				glm::vec2 vec;
 				// a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
 				// use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-				vec.x = mesh->mTextureCoords[0][i].x;
-				vec.y = mesh->mTextureCoords[0][i].y;
-				vertex.vTexCoords = vec;
+				vertex.vTexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 				// tangent
-				vector.x = mesh->mTangents[i].x;
-				vector.y = mesh->mTangents[i].y;
-				vector.z = mesh->mTangents[i].z;
-				vertex.vTangent = vector;
+				vertex.vTangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
 				// bitangent
-				vector.x = mesh->mBitangents[i].x;
-				vector.y = mesh->mBitangents[i].y;
-				vector.z = mesh->mBitangents[i].z;
-				vertex.vBitangent = vector;
+				vertex.vBitangent = glm::vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
 			}
 			else
 				vertex.vTexCoords = glm::vec2(0.0f, 0.0f);
-
-			vertices.push_back(vertex);
 		}
-		// now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+		// now walk through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+		size_t indexCount = 0;
+		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+			indexCount += mesh->mFaces[i].mNumIndices;
+
+		indices.resize(indexCount);
+		unsigned int* index = indices.data();
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			aiFace face = mesh->mFaces[i];
+			const aiFace& face = mesh->mFaces[i];
 			// retrieve all indices of the face and store them in the indices vector
 			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
+				*index++ = face.mIndices[j];
+		}
+		// the (up to) four strongest joints of every vertex
+		if (mesh->HasBones() && !skeleton.empty())
+			ReadBoneWeights(mesh, skeleton, vertices);
+		// weld, reorder and renumber before anything depends on the vertex order
+		data.stats = MeshOptimizer::optimize(vertices, indices, options);
+		// simplified versions of the mesh go behind its own indices
+		data.lods = MeshSimplifier::generateLods(vertices, indices, lodOptions);
+		// bounding box and sphere of the mesh, stored in the mesh cache
+		data.bounds = ComputeBounds(&vertices.data()->vPosition, vertices.size(), sizeof(Vertex));
+		data.sphere = ComputeBoundingSphere(&vertices.data()->vPosition, vertices.size(), sizeof(Vertex), data.bounds);
+	}
+
+	static glm::mat4 ToGlm(const aiMatrix4x4& m)
+	{
+		// assimp matrices are row major
+		return glm::mat4(m.a1, m.b1, m.c1, m.d1, m.a2, m.b2, m.c2, m.d2, m.a3, m.b3, m.c3, m.d3, m.a4, m.b4, m.c4, m.d4);
+	}
+
+	// the nodes the bones of the meshes hang on and all of their ancestors, parents before children
+	static Skeleton BuildSkeleton(const aiScene* scene, const std::vector<const aiMesh*>& sceneMeshes)
+	{
+		Skeleton skeleton;
+
+		std::vector<std::pair<std::string, aiMatrix4x4>> bones;
+		for (const aiMesh* mesh : sceneMeshes)
+		{
+			for (unsigned int i = 0; i < mesh->mNumBones; i++)
+				bones.emplace_back(mesh->mBones[i]->mName.C_Str(), mesh->mBones[i]->mOffsetMatrix);
+		}
+
+		if (bones.empty())
+			return skeleton;
+
+		std::vector<const aiNode*> nodes;
+		AddJoints(scene->mRootNode, -1, bones, skeleton, nodes);
+
+		skeleton.bindPose.resize(skeleton.getJointCount() * 3);
+		for (size_t j = 0; j < nodes.size(); j++)
+		{
+			aiVector3D scale, position;
+			aiQuaternion rotation;
+			nodes[j]->mTransformation.Decompose(scale, rotation, position);
+
+			skeleton.bindPose[j * 3] = glm::vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+			skeleton.bindPose[j * 3 + 1] = glm::vec4(position.x, position.y, position.z, 0.0f);
+			skeleton.bindPose[j * 3 + 2] = glm::vec4(scale.x, scale.y, scale.z, 0.0f);
+		}
+
+		skeleton.globalInverse = glm::inverse(ToGlm(scene->mRootNode->mTransformation));
+		return skeleton;
+	}
+
+	// adds node if it or anything below it is a bone, returns whether it did
+	static bool AddJoints(const aiNode* node, int parent, const std::vector<std::pair<std::string, aiMatrix4x4>>& bones, Skeleton& skeleton, std::vector<const aiNode*>& nodes)
+	{
+		// added up front to keep parents first, taken out again if no bone is found below
+		int joint = static_cast<int>(skeleton.names.size());
+		skeleton.names.emplace_back(node->mName.C_Str());
+		skeleton.parents.push_back(parent);
+		skeleton.inverseBind.push_back(glm::mat4(1.0f));
+		nodes.push_back(node);
+
+		bool used = false;
+		for (const auto& [name, offset] : bones)
+		{
+			if (name == skeleton.names[joint])
+			{
+				skeleton.inverseBind[joint] = ToGlm(offset);
+				used = true;
+				break;
+			}
+		}
+
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			used = AddJoints(node->mChildren[i], joint, bones, skeleton, nodes) || used;
+
+		if (!used)
+		{
+			skeleton.names.pop_back();
+			skeleton.parents.pop_back();
+			skeleton.inverseBind.pop_back();
+			nodes.pop_back();
+		}
+
+		return used;
+	}
+
+	// keeps the four largest weights of every vertex and makes them add up to one
+	static void ReadBoneWeights(const aiMesh* mesh, const Skeleton& skeleton, std::vector<Vertex>& vertices)
+	{
+		for (unsigned int b = 0; b < mesh->mNumBones; b++)
+		{
+			const aiBone* bone = mesh->mBones[b];
+			int joint = skeleton.find(bone->mName.C_Str());
+			if (joint < 0)
+				continue;
+
+			for (unsigned int w = 0; w < bone->mNumWeights; w++)
+			{
+				const aiVertexWeight& weight = bone->mWeights[w];
+				if (weight.mVertexId >= vertices.size())
+					continue;
+
+				// replace the smallest influence if this one is larger
+				Vertex& vertex = vertices[weight.mVertexId];
+				int smallest = 0;
+				for (int i = 1; i < MAX_BONE_INFLUENCE; i++)
+				{
+					if (vertex.m_Weights[i] < vertex.m_Weights[smallest])
+						smallest = i;
+				}
+
+				if (weight.mWeight > vertex.m_Weights[smallest])
+				{
+					vertex.m_BoneIDs[smallest] = joint;
+					vertex.m_Weights[smallest] = weight.mWeight;
+				}
+			}
+		}
+
+		for (Vertex& vertex : vertices)
+		{
+			float total = 0.0f;
+			for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+				total += vertex.m_Weights[i];
+
+			if (total > 0.0f)
+			{
+				for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+					vertex.m_Weights[i] /= total;
+			}
 		}
-		// process materials
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+	}
+
+	// key before time and how far time is towards the next one
+	template<typename Key>
+	static unsigned int FindKey(const Key* keys, unsigned int count, double time, float& t)
+	{
+		t = 0.0f;
+		if (count < 2 || time <= keys[0].mTime)
+			return 0;
+
+		const Key* next = std::upper_bound(keys, keys + count, time, [](double value, const Key& key) { return value < key.mTime; });
+		if (next == keys + count)
+			return count - 1;
+
+		const Key* key = next - 1;
+		double span = next->mTime - key->mTime;
+		t = span > 0.0 ? static_cast<float>((time - key->mTime) / span) : 0.0f;
+		return static_cast<unsigned int>(key - keys);
+	}
+
+	static glm::vec4 SampleVectorKeys(const aiVectorKey* keys, unsigned int count, double time)
+	{
+		float t;
+		unsigned int i = FindKey(keys, count, time, t);
+		const aiVector3D& a = keys[i].mValue;
+		const aiVector3D& b = keys[std::min(i + 1, count - 1)].mValue;
+		return glm::vec4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, 0.0f);
+	}
+
+	static glm::vec4 SampleQuatKeys(const aiQuatKey* keys, unsigned int count, double time)
+	{
+		float t;
+		unsigned int i = FindKey(keys, count, time, t);
+		const aiQuaternion& qa = keys[i].mValue;
+		const aiQuaternion& qb = keys[std::min(i + 1, count - 1)].mValue;
+
+		// normalized lerp the short way, the keys are close enough together for it to match a slerp
+		glm::vec4 a(qa.x, qa.y, qa.z, qa.w), b(qb.x, qb.y, qb.z, qb.w);
+		if (glm::dot(a, b) < 0.0f)
+			b = b * -1.0f;
+
+		glm::vec4 q = a + (b - a) * t;
+		float length = std::sqrt(glm::dot(q, q));
+		return length > 0.0f ? q * (1.0f / length) : a;
+	}
+
+	// resamples every animation to a fixed rate for the skeleton's joints and compresses it
+	static std::vector<AnimationClip> ImportAnimations(const aiScene* scene, const Skeleton& skeleton)
+	{
+		constexpr float sampleRate = 30.0f;
+
+		if (skeleton.empty() || !scene->HasAnimations())
+			return {};
+
+		const unsigned int jointCount = skeleton.getJointCount();
+		std::vector<AnimationClip> clips(scene->mNumAnimations);
+
+		ThreadPool::getInstance().parallelFor(scene->mNumAnimations, [&](size_t begin, size_t end)
+		{
+			for (size_t a = begin; a < end; a++)
+			{
+				const aiAnimation* animation = scene->mAnimations[a];
+
+				// files that leave the rate out are meant to play at 25 ticks a second
+				double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+				double duration = animation->mDuration / ticksPerSecond;
+				uint32_t frameCount = static_cast<uint32_t>(std::ceil(duration * sampleRate)) + 1;
+
+				// joints without a channel hold their bind pose
+				std::vector<glm::vec4> frames(size_t(frameCount) * jointCount * 3);
+				for (uint32_t f = 0; f < frameCount; f++)
+					std::copy(skeleton.bindPose.begin(), skeleton.bindPose.end(), frames.begin() + size_t(f) * jointCount * 3);
+
+				for (unsigned int c = 0; c < animation->mNumChannels; c++)
+				{
+					const aiNodeAnim* channel = animation->mChannels[c];
+					int joint = skeleton.find(channel->mNodeName.C_Str());
+					if (joint < 0)
+						continue;
+
+					for (uint32_t f = 0; f < frameCount; f++)
+					{
+						double tick = std::min(f / double(sampleRate) * ticksPerSecond, animation->mDuration);
+						glm::vec4* pose = &frames[(size_t(f) * jointCount + joint) * 3];
+
+						if (channel->mNumRotationKeys > 0)
+							pose[0] = SampleQuatKeys(channel->mRotationKeys, channel->mNumRotationKeys, tick);
+						if (channel->mNumPositionKeys > 0)
+							pose[1] = SampleVectorKeys(channel->mPositionKeys, channel->mNumPositionKeys, tick);
+						if (channel->mNumScalingKeys > 0)
+							pose[2] = SampleVectorKeys(channel->mScalingKeys, channel->mNumScalingKeys, tick);
+					}
+				}
+
+				clips[a] = AnimationClip::compress(animation->mName.C_Str(), sampleRate, frameCount, jointCount, frames);
+			}
+		});
+
+		return clips;
+	}
+
+	// returns the textures of every material in the scene, indexed like scene->mMaterials.
+	std::vector<std::vector<Texture>> ResolveMaterials(const aiScene* scene)
+	{
 		// we assume a convention for sampler names in the shaders. Each diffuse texture should be named
 		// as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
 		// Same applies to other texture as the following list summarizes:
 		// diffuse: texture_diffuseN
 		// specular: texture_specularN
 		// normal: texture_normalN
+		static const std::pair<aiTextureType, const char*> textureTypes[] = {
+			{ aiTextureType_DIFFUSE, "texture_diffuse" },
+			{ aiTextureType_SPECULAR, "texture_specular" },
+			{ aiTextureType_HEIGHT, "texture_normal" },
+			{ aiTextureType_AMBIENT, "texture_height" }
+		};
+
+		std::vector<std::vector<std::pair<std::string, const char*>>> references(scene->mNumMaterials);
+		std::vector<std::string> paths;
+
+		for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+		{
+			const aiMaterial* material = scene->mMaterials[m];
 
-		// 1. diffuse maps
-		std::vector<Texture> diffuseMaps = LoadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		// 2. specular maps
-		std::vector<Texture> specularMaps = LoadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-		// 3. normal maps
-		std::vector<Texture> normalMaps = LoadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-		textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-		// 4. height maps
-		std::vector<Texture> heightMaps = LoadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-		textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-
-		// return a mesh object created from the extracted mesh data
-		return Mesh(vertices, indices, textures);
-	}
-
-	// checks all material textures of a given type and loads the textures if they're not loaded yet.
-	// the required info is returned as a Texture struct.
-	std::vector<Texture> LoadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
-	{
-		std::vector<Texture> textures;
-		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
-		{
-			aiString str;
-			mat->GetTexture(type, i, &str);
-			// check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
+			for (const auto& [type, typeName] : textureTypes)
 			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+				for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
 				{
-					textures.push_back(textures_loaded[j]);
-					skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-					break;
+					aiString str;
+					material->GetTexture(type, i, &str);
+					references[m].emplace_back(str.C_Str(), typeName);
+					paths.emplace_back(str.C_Str());
 				}
 			}
-			if (!skip)
-			{   // if texture hasn't been loaded already, load it
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory, gammaCorrection);
+		}
+
+		// the expensive part, decoding the images, happens on the thread pool
+		LoadTextures(paths);
+
+		std::vector<std::vector<Texture>> materials(scene->mNumMaterials);
+		for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+		{
+			materials[m].reserve(references[m].size());
+			for (const auto& [path, typeName] : references[m])
+				materials[m].push_back(FindTexture(path, typeName));
+		}
+
+		return materials;
+	}
+
+	// loads every texture in paths that hasn't been loaded before. The images are decoded in parallel,
+	// the GL textures are then created on this thread.
+	void LoadTextures(std::vector<std::string> paths)
+	{
+		std::sort(paths.begin(), paths.end());
+		paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+		// check if texture was loaded before and if so, skip loading a new texture
+		paths.erase(std::remove_if(paths.begin(), paths.end(), [this](const std::string& path)
+		{
+			return std::any_of(textures_loaded.begin(), textures_loaded.end(), [&path](const Texture& texture) { return texture.path == path; });
+		}), paths.end());
+
+		std::vector<TextureImage> images(paths.size());
+		ThreadPool::getInstance().parallelFor(paths.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				images[i] = DecodeTextureFile(paths[i].c_str(), this->directory);
+		});
+
+		for (size_t i = 0; i < paths.size(); i++)
+		{
+			Texture texture;
+			texture.id = TextureFromImage(images[i], paths[i].c_str(), gammaCorrection);
+			texture.path = paths[i];
+			textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+		}
+	}
+
+	// returns an already loaded texture with the type it is used as
+	Texture FindTexture(std::string_view path, std::string_view typeName)
+	{
+		for (unsigned int j = 0; j < textures_loaded.size(); j++)
+		{
+			if (textures_loaded[j].path == path)
+			{
+				Texture texture = textures_loaded[j];
 				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+				return texture;
 			}
 		}
-		return textures;
+
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = path;
+		return texture;
 	}
 };
 
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma)
+// Decodes an image file without touching GL, safe to call from any thread
+TextureImage DecodeTextureFile(const char* path, const std::string& directory)
 {
-	std::string filename = std::string(path);
-	filename = directory + '/' + filename;
+	TextureImage image;
+	image.filename = directory + '/' + std::string(path);
+	image.flipped = GetFlipVerticallyOnLoad();
+	image.data = stbi_load(image.filename.c_str(), &image.width, &image.height, &image.components, 0);
+	return image;
+}
 
+// Creates the GL texture for a decoded image and frees the image data
+unsigned int TextureFromImage(TextureImage& image, const char* path, bool gamma)
+{
 	unsigned int textureID;
-	glGenTextures(1, &textureID);
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
+	if (image.data)
 	{
 		GLenum format;
-		if (nrComponents == 1)
+		if (image.components == 1)
 			format = GL_RED;
-		else if (nrComponents == 3)
+		else if (image.components == 3)
 			format = GL_RGB;
-		else if (nrComponents == 4)
+		else if (image.components == 4)
 			format = GL_RGBA;
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		textureID = CreateTexture2D(image.data, image.width, image.height, image.components, { image.filename, image.flipped, (GLint)format, format, image.reloadable }, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
+		stbi_image_free(image.data);
+		image.data = nullptr;
 	}
 	else
 	{
 		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		glGenTextures(1, &textureID);
 	}
 
 	return textureID;
-}
\ No newline at end of file
+}
+
+unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma)
+{
+	TextureImage image = DecodeTextureFile(path, directory);
+	return TextureFromImage(image, path, gamma);
+}
+// Model::load() hands glTF files to GltfLoader, which is defined there
+#include "GltfModelLoader.h"
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+
+// Runs resource creation on a second thread that owns a GL context sharing objects with the renderer's.
+// Each job uploads on the loader context and is followed by a fence; its publish callback only runs on the
+// render thread (in poll()) once that fence has signalled, so the renderer never sees half uploaded data.
+//
+//     loader.submit([&]() { model.load("resources/rock/rock.obj"); },
+//                   [&]() { Renderer::getInstance().addModel(&model, &shader); });
+//
+// Buffers, textures, samplers, shaders and programs are shared between the contexts, vertex arrays are not:
+// meshes built on the loader thread create their vertex array on the render thread when first drawn.
+class AsyncLoader
+{
+private:
+	struct Job
+	{
+		std::function<void()> upload;
+		std::function<void()> publish;
+	};
+
+	struct PendingJob
+	{
+		GLsync fence;
+		std::function<void()> publish;
+	};
+
+	GLFWwindow* m_Context = nullptr;
+	std::thread m_Thread;
+	std::atomic<bool> m_bRunning = false;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAvailable;
+	std::deque<Job> m_Jobs;
+	std::vector<PendingJob> m_Uploaded;		// Filled by the loader thread, guarded by m_Mutex
+	std::vector<PendingJob> m_Waiting;		// Owned by the render thread
+	std::atomic<size_t> m_Outstanding = 0;
+
+	static inline thread_local bool s_bLoaderThread = false;
+
+public:
+	AsyncLoader() = default;
+
+	AsyncLoader(const AsyncLoader&) = delete;
+	AsyncLoader& operator=(const AsyncLoader&) = delete;
+
+	// Takes a hidden window whose context shares objects with the renderer's, it has to be created on the main thread
+	void start(GLFWwindow* sharedContext);
+
+	void stop();
+
+	// Queues upload to run on the loader context, publish runs on the render thread once the GPU is done with it.
+	// If the loader is not running both run immediately on the calling thread.
+	void submit(std::function<void()> upload, std::function<void()> publish = nullptr);
+
+	// Publishes every finished job whose fence has signalled, never blocks. Call once per frame on the render thread.
+	void poll();
+
+	// True when every submitted job has been published
+	bool isIdle() const { return m_Outstanding == 0; }
+
+	bool isRunning() const { return m_bRunning; }
+
+	static bool isLoaderThread() { return s_bLoaderThread; }
+
+	~AsyncLoader();
+
+private:
+	void LoaderThread();
+};
+
+void AsyncLoader::start(GLFWwindow* sharedContext)
+{
+	if (m_bRunning || !sharedContext)
+		return;
+
+	m_Context = sharedContext;
+	m_bRunning = true;
+	m_Thread = std::thread(&AsyncLoader::LoaderThread, this);
+}
+
+void AsyncLoader::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bRunning = false;
+	}
+	m_JobAvailable.notify_all();
+
+	if (m_Thread.joinable())
+		m_Thread.join();
+
+	// Nothing will publish these anymore, the objects themselves are cleaned up with the context
+	for (auto& job : m_Uploaded)
+		glDeleteSync(job.fence);
+	for (auto& job : m_Waiting)
+		glDeleteSync(job.fence);
+
+	m_Uploaded.clear();
+	m_Waiting.clear();
+	m_Jobs.clear();
+	m_Outstanding = 0;
+}
+
+void AsyncLoader::submit(std::function<void()> upload, std::function<void()> publish)
+{
+	// Without a loader context everything runs right away on the calling thread
+	if (!m_bRunning)
+	{
+		if (upload)
+			upload();
+		if (publish)
+			publish();
+		return;
+	}
+
+	m_Outstanding++;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Jobs.push_back({ std::move(upload), std::move(publish) });
+	}
+	m_JobAvailable.notify_one();
+}
+
+void AsyncLoader::poll()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (auto& job : m_Uploaded)
+			m_Waiting.push_back(std::move(job));
+		m_Uploaded.clear();
+	}
+
+	// Fences signal in submission order, so stop at the first one that is not done yet
+	size_t published = 0;
+	for (; published < m_Waiting.size(); published++)
+	{
+		PendingJob& job = m_Waiting[published];
+
+		GLenum status = glClientWaitSync(job.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(job.fence);
+
+		if (job.publish)
+			job.publish();
+
+		m_Outstanding--;
+	}
+
+	m_Waiting.erase(m_Waiting.begin(), m_Waiting.begin() + published);
+}
+
+AsyncLoader::~AsyncLoader()
+{
+	if (m_Thread.joinable())
+		stop();
+}
+
+void AsyncLoader::LoaderThread()
+{
+	s_bLoaderThread = true;
+	glfwMakeContextCurrent(m_Context);
+
+	while (true)
+	{
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobAvailable.wait(lock, [this]() { return !m_Jobs.empty() || !m_bRunning; });
+
+			if (!m_bRunning)
+				break;
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+		}
+
+		if (job.upload)
+			job.upload();
+
+		// The flush makes sure the fence actually reaches the GPU, otherwise the render thread could wait forever
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Uploaded.push_back({ fence, std::move(job.publish) });
+	}
+
+	glfwMakeContextCurrent(nullptr);
+}
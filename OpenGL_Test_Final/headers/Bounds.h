@@ -0,0 +1,212 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Axis aligned bounding box in model space
+struct AABB {
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	glm::vec3 getCenter() const { return (min + max) * 0.5f; }
+	glm::vec3 getExtent() const { return (max - min) * 0.5f; }
+
+	// Box around this one and other
+	void expand(const AABB& other);
+
+	// Box around this one after transforming it by matrix, rotated boxes grow to stay axis aligned
+	AABB transform(const glm::mat4& matrix) const;
+};
+
+struct BoundingSphere {
+	glm::vec3 center = glm::vec3(0.0f);
+	float radius = 0.0f;
+
+	// Smallest sphere around this one and other
+	void expand(const BoundingSphere& other);
+
+	// Sphere around this one after transforming it by matrix, non uniform scales use their largest axis
+	BoundingSphere transform(const glm::mat4& matrix) const;
+};
+
+// Six planes of a view volume, xyz the normal pointing inwards and w the distance, so points inside give dot >= 0
+struct Frustum {
+	glm::vec4 planes[6];
+
+	// Planes of the clip volume of a projection * view matrix, in the space the matrix transforms from (Gribb/Hartmann)
+	static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+	// False only if the box is entirely outside one of the planes, boxes near the corners can pass without touching
+	bool intersects(const AABB& box) const;
+};
+
+// Bounds of count positions that are stride bytes apart, like the vPosition of a Vertex array
+AABB ComputeBounds(const glm::vec3* positions, size_t count, size_t stride);
+
+// Sphere around the center of box reaching the farthest position, never larger than the box's own sphere
+BoundingSphere ComputeBoundingSphere(const glm::vec3* positions, size_t count, size_t stride, const AABB& box);
+
+inline void AABB::expand(const AABB& other)
+{
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+inline AABB AABB::transform(const glm::mat4& matrix) const
+{
+	// Every axis of the matrix moves the new box by its contribution from min or max, whichever is further out (Arvo)
+	AABB result;
+	result.min = result.max = glm::vec3(matrix[3]);
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		glm::vec3 a = glm::vec3(matrix[axis]) * min[axis];
+		glm::vec3 b = glm::vec3(matrix[axis]) * max[axis];
+		result.min += glm::min(a, b);
+		result.max += glm::max(a, b);
+	}
+
+	return result;
+}
+
+inline void BoundingSphere::expand(const BoundingSphere& other)
+{
+	glm::vec3 offset = other.center - center;
+	float distance = glm::length(offset);
+
+	// One already holds the other
+	if (distance + other.radius <= radius)
+		return;
+	if (distance + radius <= other.radius)
+	{
+		*this = other;
+		return;
+	}
+
+	float newRadius = (distance + radius + other.radius) * 0.5f;
+	center += offset * ((newRadius - radius) / distance);
+	radius = newRadius;
+}
+
+inline BoundingSphere BoundingSphere::transform(const glm::mat4& matrix) const
+{
+	float scale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+
+	BoundingSphere result;
+	result.center = glm::vec3(matrix * glm::vec4(center, 1.0f));
+	result.radius = radius * scale;
+	return result;
+}
+
+inline Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+	// GLM is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	auto row = [&viewProjection](int i) { return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]); };
+
+	Frustum frustum;
+	frustum.planes[0] = row(3) + row(0);		// Left
+	frustum.planes[1] = row(3) - row(0);		// Right
+	frustum.planes[2] = row(3) + row(1);		// Bottom
+	frustum.planes[3] = row(3) - row(1);		// Top
+	frustum.planes[4] = row(3) + row(2);		// Near
+	frustum.planes[5] = row(3) - row(2);		// Far
+
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+inline bool Frustum::intersects(const AABB& box) const
+{
+	// The corner furthest along the plane's normal is the last one to leave
+	for (const glm::vec4& plane : planes)
+	{
+		glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y, plane.z >= 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
+
+AABB ComputeBounds(const glm::vec3* positions, size_t count, size_t stride)
+{
+	AABB box;
+	if (count == 0)
+		return box;
+
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(positions);
+
+#ifdef BOUNDS_SSE2
+	// Two independent min/max chains so neither waits on the other, x, y and z in the low three lanes
+	auto load = [](const unsigned char* p)
+	{
+		const float* xyz = reinterpret_cast<const float*>(p);
+		return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(xyz))), _mm_load_ss(xyz + 2));
+	};
+
+	__m128 min0 = load(bytes), max0 = min0;
+	__m128 min1 = min0, max1 = min0;
+
+	size_t i = 1;
+	for (; i + 1 < count; i += 2)
+	{
+		__m128 a = load(bytes + i * stride);
+		__m128 b = load(bytes + (i + 1) * stride);
+		min0 = _mm_min_ps(min0, a);
+		max0 = _mm_max_ps(max0, a);
+		min1 = _mm_min_ps(min1, b);
+		max1 = _mm_max_ps(max1, b);
+	}
+	if (i < count)
+	{
+		__m128 a = load(bytes + i * stride);
+		min0 = _mm_min_ps(min0, a);
+		max0 = _mm_max_ps(max0, a);
+	}
+
+	alignas(16) float minimum[4], maximum[4];
+	_mm_store_ps(minimum, _mm_min_ps(min0, min1));
+	_mm_store_ps(maximum, _mm_max_ps(max0, max1));
+	box.min = glm::vec3(minimum[0], minimum[1], minimum[2]);
+	box.max = glm::vec3(maximum[0], maximum[1], maximum[2]);
+#else
+	box.min = box.max = *positions;
+	for (size_t i = 1; i < count; i++)
+	{
+		const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(bytes + i * stride);
+		box.min = glm::min(box.min, position);
+		box.max = glm::max(box.max, position);
+	}
+#endif
+
+	return box;
+}
+
+BoundingSphere ComputeBoundingSphere(const glm::vec3* positions, size_t count, size_t stride, const AABB& box)
+{
+	BoundingSphere sphere;
+	sphere.center = box.getCenter();
+
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(positions);
+
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 offset = *reinterpret_cast<const glm::vec3*>(bytes + i * stride) - sphere.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+
+	sphere.radius = std::sqrt(radiusSquared);
+	return sphere;
+}
@@ -5,6 +5,7 @@
 #include "VertexArray.h"
 #include "VertexBuffer.h"
 #include "IndexBuffer.h"
+#include "DSA.h"
 
 enum class BufferType
 {
@@ -17,7 +18,7 @@ class BufferLayout
 private:
 	int location;
 	int stride;
-	VertexArray m_va;
+	unsigned int m_VertexArrayID = 0;	// Not owned, the vertex array belongs to the caller
 
 public:
 	BufferLayout() : stride{ 0 }, location{ 0 }
@@ -34,20 +35,34 @@ public:
 
 private:
 	int getSizeFromType(BufferType type);
+
+	// Same layout as glVertexAttribPointer gives, without binding anything: every attribute gets
+	// its own binding point with the buffer offset set to the attribute's offset
+	void SetAttributeDSA(unsigned int bufferID, int count, BufferType type, int vertexStride);
 };
 
 template<typename T>
 void BufferLayout::setBufferLayout(VertexArray& va, VertexBuffer<T>& buffer, IndexBuffer& indexBuffer, int count, BufferType type, bool resetStride)
 {
-	m_va = va;
-	m_va.bind();
-
-	buffer.bind();
-	indexBuffer.bind();
+	m_VertexArrayID = va.getID();
 
 	int sz = buffer.getVertexCount() * buffer.typeSize;
-	glVertexAttribPointer(location, count, (GLenum)type, GL_FALSE, sz, (const void*)stride);
-	glEnableVertexAttribArray(location);
+
+	if (DSA::isAvailable())
+	{
+		DSA::VertexArrayElementBuffer(m_VertexArrayID, indexBuffer.getID());
+		SetAttributeDSA(buffer.getID(), count, type, sz);
+	}
+	else
+	{
+		va.bind();
+
+		buffer.bind();
+		indexBuffer.bind();
+
+		glVertexAttribPointer(location, count, (GLenum)type, GL_FALSE, sz, (const void*)stride);
+		glEnableVertexAttribArray(location);
+	}
 
 	if (!resetStride)
 		stride += count * getSizeFromType(type);
@@ -58,19 +73,38 @@ void BufferLayout::setBufferLayout(VertexArray& va, VertexBuffer<T>& buffer, Ind
 template<typename T>
 void BufferLayout::setBufferLayout(VertexArray& va, VertexBuffer<T>& buffer, int count, BufferType type)
 {
-	m_va = va;
-	m_va.bind();
-
-	buffer.bind();
+	m_VertexArrayID = va.getID();
 
 	int sz = buffer.getVertexCount() * buffer.typeSize;
-	glVertexAttribPointer(location, count, (GLenum)type, GL_FALSE, sz, (const void*)stride);
-	glEnableVertexAttribArray(location);
+
+	if (DSA::isAvailable())
+	{
+		SetAttributeDSA(buffer.getID(), count, type, sz);
+	}
+	else
+	{
+		va.bind();
+
+		buffer.bind();
+
+		glVertexAttribPointer(location, count, (GLenum)type, GL_FALSE, sz, (const void*)stride);
+		glEnableVertexAttribArray(location);
+	}
 
 	stride += count * getSizeFromType(type);
 	location++;
 }
 
+void BufferLayout::SetAttributeDSA(unsigned int bufferID, int count, BufferType type, int vertexStride)
+{
+	unsigned int vao = m_VertexArrayID;
+
+	DSA::VertexArrayVertexBuffer(vao, location, bufferID, stride, vertexStride);
+	DSA::VertexArrayAttribFormat(vao, location, count, (GLenum)type, GL_FALSE, 0);
+	DSA::VertexArrayAttribBinding(vao, location, location);
+	DSA::EnableVertexArrayAttrib(vao, location);
+}
+
 int BufferLayout::getSizeFromType(BufferType type)
 {
 	switch (type)
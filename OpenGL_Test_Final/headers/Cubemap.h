@@ -0,0 +1,598 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// GLM math library
+#include <glm/glm.hpp>
+
+#include "stb_image_impl.h"
+#include "MappedFile.h"
+#include "TextureBindings.h"
+#include "GLState.h"
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+// Binary cubemap cache: a header, a table with one entry per face and mip level
+// (level major, faces in GL order), and then the image data itself
+struct CubemapCacheHeader
+{
+	char magic[4];				// "CUBE"
+	uint32_t version;
+	uint64_t sourceStamp;		// Hash of the face paths, sizes and modification times
+	uint32_t faceSize;
+	uint32_t mipLevels;
+	uint32_t components;
+	uint32_t flags;				// Options the cache was built with
+	uint32_t internalFormat;	// Format the images are stored in, compressed formats are chosen by the driver
+	uint32_t compressedData;
+};
+
+struct CubemapCacheImage
+{
+	uint64_t offset;
+	uint32_t size;
+	uint32_t width;
+};
+
+class Cubemap
+{
+private:
+	unsigned int m_TextureID = 0;
+	int m_FaceSize = 0;
+	int m_MipLevels = 0;
+
+	static constexpr uint32_t CACHE_VERSION = 1;
+	static constexpr uint32_t CACHE_COMPRESSED = 1;
+	static constexpr uint32_t CACHE_PREFILTERED = 2;
+	static constexpr int PREFILTER_SAMPLES = 32;
+
+	// Tightly packed pixels of the six faces of one mip level
+	using FaceImages = std::array<std::vector<unsigned char>, 6>;
+
+public:
+	Cubemap() = default;
+
+	// Faces are expected in the order right, left, top, bottom, front, back.
+	// If cachePath is given, the mip chain is written there once and later loads upload straight from the
+	// memory-mapped cache. Compressed caches let the driver pick the compressed format. Prefiltered caches
+	// store GGX filtered radiance in the mip levels, roughness r lives at level r * (getMipLevels() - 1).
+	bool load(const std::vector<std::string>& faces, const std::string& cachePath = "", bool compress = false, bool prefilter = false);
+
+	unsigned int getTextureID() const;
+
+	int getMipLevels() const;
+
+	void bind() const;
+
+	void free();
+
+private:
+	bool LoadFromCache(const std::string& cachePath, uint64_t stamp, uint32_t flags);
+
+	bool DecodeFaces(const std::vector<std::string>& faces, FaceImages& images, int& components);
+
+	void Upload(const std::vector<FaceImages>& levels, int components, bool compress);
+
+	void WriteCache(const std::string& cachePath, uint64_t stamp, uint32_t flags, const std::vector<FaceImages>& levels, int components);
+
+	static void GenerateMips(std::vector<FaceImages>& levels, int faceSize, int components);
+
+	static void Prefilter(std::vector<FaceImages>& levels, int faceSize, int components);
+
+	static uint64_t SourceStamp(const std::vector<std::string>& faces);
+
+	static GLenum FormatFromComponents(int components);
+
+	static glm::vec3 FaceTexelToDirection(int face, float u, float v);
+
+	static void DirectionToFaceTexel(const glm::vec3& direction, int& face, float& u, float& v);
+};
+
+bool Cubemap::load(const std::vector<std::string>& faces, const std::string& cachePath, bool compress, bool prefilter)
+{
+	if (faces.size() != 6)
+	{
+		std::cout << "Cubemap needs exactly 6 faces, got " << faces.size() << std::endl;
+		return false;
+	}
+
+	uint32_t flags = (compress ? CACHE_COMPRESSED : 0) | (prefilter ? CACHE_PREFILTERED : 0);
+	uint64_t stamp = SourceStamp(faces);
+
+	glGenTextures(1, &m_TextureID);
+	TextureBindings::getInstance().bindTexture(GL_TEXTURE_CUBE_MAP, m_TextureID);
+
+	if (cachePath.empty() || !LoadFromCache(cachePath, stamp, flags))
+	{
+		std::vector<FaceImages> levels(1);
+		int components;
+
+		if (!DecodeFaces(faces, levels[0], components))
+		{
+			free();
+			return false;
+		}
+
+		GenerateMips(levels, m_FaceSize, components);
+
+		if (prefilter)
+			Prefilter(levels, m_FaceSize, components);
+
+		Upload(levels, components, compress);
+
+		if (!cachePath.empty())
+			WriteCache(cachePath, stamp, flags, levels, components);
+	}
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, m_MipLevels - 1);
+
+	// Filter across face edges, otherwise the seams show on the blurry prefiltered levels
+	GLState::getInstance().enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+	return true;
+}
+
+unsigned int Cubemap::getTextureID() const
+{
+	return m_TextureID;
+}
+
+int Cubemap::getMipLevels() const
+{
+	return m_MipLevels;
+}
+
+void Cubemap::bind() const
+{
+	TextureBindings::getInstance().bindTexture(GL_TEXTURE_CUBE_MAP, m_TextureID);
+}
+
+void Cubemap::free()
+{
+	glDeleteTextures(1, &m_TextureID);
+	TextureBindings::getInstance().forget(m_TextureID);
+	m_TextureID = 0;
+}
+
+// Uploads every image straight from the mapped file. Returns false if the cache is missing, stale
+// or was built with different options, in which case it gets rebuilt.
+bool Cubemap::LoadFromCache(const std::string& cachePath, uint64_t stamp, uint32_t flags)
+{
+	MappedFile file;
+	if (!file.open(cachePath) || file.size() < sizeof(CubemapCacheHeader))
+		return false;
+
+	CubemapCacheHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+
+	if (std::memcmp(header.magic, "CUBE", 4) != 0 || header.version != CACHE_VERSION ||
+		header.sourceStamp != stamp || header.flags != flags || header.mipLevels == 0)
+		return false;
+
+	size_t imageCount = static_cast<size_t>(header.mipLevels) * 6;
+	if (file.size() < sizeof(header) + imageCount * sizeof(CubemapCacheImage))
+		return false;
+
+	const CubemapCacheImage* images = reinterpret_cast<const CubemapCacheImage*>(file.data() + sizeof(header));
+	for (size_t i = 0; i < imageCount; i++)
+	{
+		if (images[i].offset + images[i].size > file.size())
+			return false;
+	}
+
+	GLenum format = FormatFromComponents(header.components);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (uint32_t level = 0; level < header.mipLevels; level++)
+	{
+		for (int face = 0; face < 6; face++)
+		{
+			const CubemapCacheImage& image = images[level * 6 + face];
+			const unsigned char* data = file.data() + image.offset;
+
+			if (header.compressedData)
+				glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, header.internalFormat, image.width, image.width, 0, image.size, data);
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, header.internalFormat, image.width, image.width, 0, format, GL_UNSIGNED_BYTE, data);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	m_FaceSize = header.faceSize;
+	m_MipLevels = header.mipLevels;
+
+	return true;
+}
+
+// Decodes all six faces at the same time, one thread per face
+bool Cubemap::DecodeFaces(const std::vector<std::string>& faces, FaceImages& images, int& components)
+{
+	struct DecodedFace
+	{
+		unsigned char* data = nullptr;
+		int width = 0, height = 0, components = 0;
+	};
+
+	std::array<DecodedFace, 6> decoded;
+	std::vector<std::thread> threads;
+
+	// Cubemap faces are not flipped, their origin is at the top left
+	bool flip = GetFlipVerticallyOnLoad();
+	SetFlipVerticallyOnLoad(false);
+
+	for (int i = 0; i < 6; i++)
+	{
+		threads.emplace_back([&faces, &decoded, i]()
+			{
+				DecodedFace& face = decoded[i];
+				face.data = stbi_load(faces[i].c_str(), &face.width, &face.height, &face.components, 0);
+			});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	SetFlipVerticallyOnLoad(flip);
+
+	bool success = true;
+	for (int i = 0; i < 6; i++)
+	{
+		if (!decoded[i].data)
+		{
+			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+			success = false;
+		}
+		else if (decoded[i].width != decoded[i].height || decoded[i].width != decoded[0].width || decoded[i].components != decoded[0].components)
+		{
+			std::cout << "Cubemap faces must be square and of the same size and format: " << faces[i] << std::endl;
+			success = false;
+		}
+	}
+
+	if (success)
+	{
+		m_FaceSize = decoded[0].width;
+		components = decoded[0].components;
+
+		size_t bytes = static_cast<size_t>(m_FaceSize) * m_FaceSize * components;
+		for (int i = 0; i < 6; i++)
+			images[i].assign(decoded[i].data, decoded[i].data + bytes);
+	}
+
+	for (auto& face : decoded)
+		stbi_image_free(face.data);
+
+	return success;
+}
+
+void Cubemap::Upload(const std::vector<FaceImages>& levels, int components, bool compress)
+{
+	GLenum format = FormatFromComponents(components);
+	GLint internalFormat = format;
+
+	if (compress)
+	{
+		switch (format)
+		{
+		case GL_RED: internalFormat = GL_COMPRESSED_RED; break;
+		case GL_RG:  internalFormat = GL_COMPRESSED_RG; break;
+		case GL_RGB: internalFormat = GL_COMPRESSED_RGB; break;
+		default:     internalFormat = GL_COMPRESSED_RGBA; break;
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t level = 0; level < levels.size(); level++)
+	{
+		int size = std::max(m_FaceSize >> level, 1);
+		for (int face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint)level, internalFormat, size, size, 0, format, GL_UNSIGNED_BYTE, levels[level][face].data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	m_MipLevels = static_cast<int>(levels.size());
+}
+
+// Compressed images are read back from the driver so the compression only ever happens once
+void Cubemap::WriteCache(const std::string& cachePath, uint64_t stamp, uint32_t flags, const std::vector<FaceImages>& levels, int components)
+{
+	GLint internalFormat = 0, compressed = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_COMPRESSED, &compressed);
+
+	std::vector<FaceImages> compressedLevels;
+	const std::vector<FaceImages>* source = &levels;
+
+	if (compressed)
+	{
+		compressedLevels.resize(levels.size());
+		for (size_t level = 0; level < levels.size(); level++)
+		{
+			for (int face = 0; face < 6; face++)
+			{
+				GLint size = 0;
+				glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint)level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+
+				compressedLevels[level][face].resize(size);
+				glGetCompressedTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, (GLint)level, compressedLevels[level][face].data());
+			}
+		}
+		source = &compressedLevels;
+	}
+	else
+	{
+		internalFormat = FormatFromComponents(components);
+	}
+
+	CubemapCacheHeader header;
+	std::memcpy(header.magic, "CUBE", 4);
+	header.version = CACHE_VERSION;
+	header.sourceStamp = stamp;
+	header.faceSize = m_FaceSize;
+	header.mipLevels = static_cast<uint32_t>(levels.size());
+	header.components = components;
+	header.flags = flags;
+	header.internalFormat = internalFormat;
+	header.compressedData = compressed ? 1 : 0;
+
+	std::vector<CubemapCacheImage> images(levels.size() * 6);
+	uint64_t offset = sizeof(header) + images.size() * sizeof(CubemapCacheImage);
+
+	for (size_t level = 0; level < levels.size(); level++)
+	{
+		for (int face = 0; face < 6; face++)
+		{
+			CubemapCacheImage& image = images[level * 6 + face];
+			image.offset = offset;
+			image.size = static_cast<uint32_t>((*source)[level][face].size());
+			image.width = std::max(m_FaceSize >> level, 1);
+
+			// Keep every image 4 byte aligned
+			offset += (image.size + 3) & ~3u;
+		}
+	}
+
+	std::ofstream stream(cachePath, std::ios::binary | std::ios::trunc);
+	if (!stream.is_open())
+	{
+		std::cout << "Failed to write cubemap cache: " << cachePath << std::endl;
+		return;
+	}
+
+	const char padding[4] = { 0 };
+
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(images.data()), images.size() * sizeof(CubemapCacheImage));
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		const std::vector<unsigned char>& data = (*source)[i / 6][i % 6];
+		stream.write(reinterpret_cast<const char*>(data.data()), data.size());
+		stream.write(padding, ((data.size() + 3) & ~size_t(3)) - data.size());
+	}
+}
+
+// Builds the rest of the mip chain with a 2x2 box filter
+void Cubemap::GenerateMips(std::vector<FaceImages>& levels, int faceSize, int components)
+{
+	int size = faceSize;
+
+	while (size > 1)
+	{
+		int newSize = size / 2;
+		const FaceImages& source = levels.back();
+		FaceImages destination;
+
+		for (int face = 0; face < 6; face++)
+		{
+			const unsigned char* src = source[face].data();
+			destination[face].resize(static_cast<size_t>(newSize) * newSize * components);
+			unsigned char* dst = destination[face].data();
+
+			for (int y = 0; y < newSize; y++)
+			{
+				const unsigned char* row0 = src + static_cast<size_t>(y * 2) * size * components;
+				const unsigned char* row1 = row0 + static_cast<size_t>(size) * components;
+
+				for (int x = 0; x < newSize; x++)
+				{
+					for (int c = 0; c < components; c++)
+					{
+						int i = x * 2 * components + c;
+						int sum = row0[i] + row0[i + components] + row1[i] + row1[i + components];
+						dst[(static_cast<size_t>(y) * newSize + x) * components + c] = static_cast<unsigned char>((sum + 2) / 4);
+					}
+				}
+			}
+		}
+
+		levels.push_back(std::move(destination));
+		size = newSize;
+	}
+}
+
+// Replaces every level below the base with GGX prefiltered radiance (split-sum approximation, N = V = R).
+// Samples are importance sampled and read from the box filtered chain at a level matching the sample's
+// solid angle, which keeps the sample count low without visible noise. Faces are filtered in parallel.
+void Cubemap::Prefilter(std::vector<FaceImages>& levels, int faceSize, int components)
+{
+	const std::vector<FaceImages> source = levels;
+	const int mipLevels = static_cast<int>(levels.size());
+
+	if (mipLevels < 2)
+		return;
+
+	auto radicalInverse = [](uint32_t bits)
+		{
+			bits = (bits << 16u) | (bits >> 16u);
+			bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+			bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+			bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+			bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+			return float(bits) * 2.3283064365386963e-10f;
+		};
+
+	const float pi = 3.14159265f;
+	const float texelSolidAngle = 4.0f * pi / (6.0f * faceSize * faceSize);
+
+	auto filterFace = [&](int level, int face)
+		{
+			float roughness = static_cast<float>(level) / (mipLevels - 1);
+			float a = roughness * roughness;
+			int size = std::max(faceSize >> level, 1);
+			unsigned char* dst = levels[level][face].data();
+
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					glm::vec3 N = glm::normalize(FaceTexelToDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f));
+
+					// Tangent space around N
+					glm::vec3 up = std::abs(N.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+					glm::vec3 tangent = glm::normalize(glm::cross(up, N));
+					glm::vec3 bitangent = glm::cross(N, tangent);
+
+					float color[4] = { 0.0f };
+					float totalWeight = 0.0f;
+
+					for (int s = 0; s < PREFILTER_SAMPLES; s++)
+					{
+						float xi1 = static_cast<float>(s) / PREFILTER_SAMPLES;
+						float xi2 = radicalInverse(s);
+
+						float phi = 2.0f * pi * xi1;
+						float cosTheta = std::sqrt((1.0f - xi2) / (1.0f + (a * a - 1.0f) * xi2));
+						float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+						glm::vec3 H = tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + N * cosTheta;
+						glm::vec3 L = H * (2.0f * glm::dot(N, H)) - N;
+
+						float NdotL = glm::dot(N, L);
+						if (NdotL <= 0.0f)
+							continue;
+
+						// Pick the source level whose texels cover about as much solid angle as this sample
+						float NdotH = cosTheta;
+						float d = (a * a - 1.0f) * NdotH * NdotH + 1.0f;
+						float D = (a * a) / (pi * d * d);
+						float pdf = D / 4.0f + 0.0001f;
+						float sampleSolidAngle = 1.0f / (PREFILTER_SAMPLES * pdf + 0.0001f);
+						float mip = roughness == 0.0f ? 0.0f : 0.5f * std::log2(sampleSolidAngle / texelSolidAngle);
+						int sourceLevel = std::min(std::max(static_cast<int>(mip + 0.5f), 0), mipLevels - 1);
+
+						int sourceFace;
+						float u, v;
+						DirectionToFaceTexel(L, sourceFace, u, v);
+
+						int sourceSize = std::max(faceSize >> sourceLevel, 1);
+						int sx = std::min(static_cast<int>((u * 0.5f + 0.5f) * sourceSize), sourceSize - 1);
+						int sy = std::min(static_cast<int>((v * 0.5f + 0.5f) * sourceSize), sourceSize - 1);
+						const unsigned char* texel = source[sourceLevel][sourceFace].data() + (static_cast<size_t>(sy) * sourceSize + sx) * components;
+
+						for (int c = 0; c < components; c++)
+							color[c] += texel[c] * NdotL;
+						totalWeight += NdotL;
+					}
+
+					for (int c = 0; c < components; c++)
+						dst[(static_cast<size_t>(y) * size + x) * components + c] = static_cast<unsigned char>(std::min(color[c] / std::max(totalWeight, 0.0001f) + 0.5f, 255.0f));
+				}
+			}
+		};
+
+	std::vector<std::thread> threads;
+	for (int face = 0; face < 6; face++)
+	{
+		threads.emplace_back([&filterFace, mipLevels, face]()
+			{
+				for (int level = 1; level < mipLevels; level++)
+					filterFace(level, face);
+			});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+// Hash of every face path, file size and modification time
+uint64_t Cubemap::SourceStamp(const std::vector<std::string>& faces)
+{
+	uint64_t hash = HashBytes(nullptr, 0);
+
+	for (const auto& face : faces)
+	{
+		std::error_code error;
+		uint64_t size = std::filesystem::file_size(face, error);
+		int64_t time = std::filesystem::last_write_time(face, error).time_since_epoch().count();
+
+		hash = HashBytes(face.data(), face.size(), hash);
+		hash = HashBytes(&size, sizeof(size), hash);
+		hash = HashBytes(&time, sizeof(time), hash);
+	}
+
+	return hash;
+}
+
+GLenum Cubemap::FormatFromComponents(int components)
+{
+	switch (components)
+	{
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 3: return GL_RGB;
+	default: return GL_RGBA;
+	}
+}
+
+// u and v are in [-1, 1], following the face layout of the GL specification
+glm::vec3 Cubemap::FaceTexelToDirection(int face, float u, float v)
+{
+	switch (face)
+	{
+	case 0:  return glm::vec3(1.0f, -v, -u);		// +X
+	case 1:  return glm::vec3(-1.0f, -v, u);		// -X
+	case 2:  return glm::vec3(u, 1.0f, v);			// +Y
+	case 3:  return glm::vec3(u, -1.0f, -v);		// -Y
+	case 4:  return glm::vec3(u, -v, 1.0f);			// +Z
+	default: return glm::vec3(-u, -v, -1.0f);		// -Z
+	}
+}
+
+void Cubemap::DirectionToFaceTexel(const glm::vec3& direction, int& face, float& u, float& v)
+{
+	glm::vec3 a = glm::abs(direction);
+
+	if (a.x >= a.y && a.x >= a.z)
+	{
+		face = direction.x > 0.0f ? 0 : 1;
+		u = (direction.x > 0.0f ? -direction.z : direction.z) / a.x;
+		v = -direction.y / a.x;
+	}
+	else if (a.y >= a.z)
+	{
+		face = direction.y > 0.0f ? 2 : 3;
+		u = direction.x / a.y;
+		v = (direction.y > 0.0f ? direction.z : -direction.z) / a.y;
+	}
+	else
+	{
+		face = direction.z > 0.0f ? 4 : 5;
+		u = (direction.z > 0.0f ? direction.x : -direction.x) / a.z;
+		v = -direction.y / a.z;
+	}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// GL 4.5 direct state access entry points. The glad loader in src/ only covers GL 3.3, so these are
+// loaded here on top of it. Call DSA::load() right after gladLoadGLLoader(); if the context does not
+// support DSA, isAvailable() stays false and every wrapper keeps binding objects to edit them.
+namespace DSA
+{
+	typedef void (APIENTRYP PFNCREATEBUFFERSPROC)(GLsizei n, GLuint* buffers);
+	typedef void (APIENTRYP PFNNAMEDBUFFERDATAPROC)(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+	typedef void (APIENTRYP PFNNAMEDBUFFERSTORAGEPROC)(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags);
+	typedef void (APIENTRYP PFNNAMEDBUFFERSUBDATAPROC)(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+	typedef void (APIENTRYP PFNCREATEVERTEXARRAYSPROC)(GLsizei n, GLuint* arrays);
+	typedef void (APIENTRYP PFNVERTEXARRAYVERTEXBUFFERPROC)(GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride);
+	typedef void (APIENTRYP PFNVERTEXARRAYELEMENTBUFFERPROC)(GLuint vaobj, GLuint buffer);
+	typedef void (APIENTRYP PFNENABLEVERTEXARRAYATTRIBPROC)(GLuint vaobj, GLuint index);
+	typedef void (APIENTRYP PFNVERTEXARRAYATTRIBFORMATPROC)(GLuint vaobj, GLuint attribindex, GLint size, GLenum type, GLboolean normalized, GLuint relativeoffset);
+	typedef void (APIENTRYP PFNVERTEXARRAYATTRIBIFORMATPROC)(GLuint vaobj, GLuint attribindex, GLint size, GLenum type, GLuint relativeoffset);
+	typedef void (APIENTRYP PFNVERTEXARRAYATTRIBBINDINGPROC)(GLuint vaobj, GLuint attribindex, GLuint bindingindex);
+	typedef void (APIENTRYP PFNVERTEXARRAYBINDINGDIVISORPROC)(GLuint vaobj, GLuint bindingindex, GLuint divisor);
+	typedef void (APIENTRYP PFNCREATETEXTURESPROC)(GLenum target, GLsizei n, GLuint* textures);
+	typedef void (APIENTRYP PFNTEXTURESTORAGE2DPROC)(GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+	typedef void (APIENTRYP PFNTEXTURESUBIMAGE2DPROC)(GLuint texture, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+	typedef void (APIENTRYP PFNTEXTUREPARAMETERIPROC)(GLuint texture, GLenum pname, GLint param);
+	typedef void (APIENTRYP PFNGENERATETEXTUREMIPMAPPROC)(GLuint texture);
+
+	inline PFNCREATEBUFFERSPROC CreateBuffers = nullptr;
+	inline PFNNAMEDBUFFERDATAPROC NamedBufferData = nullptr;
+	inline PFNNAMEDBUFFERSTORAGEPROC NamedBufferStorage = nullptr;
+	inline PFNNAMEDBUFFERSUBDATAPROC NamedBufferSubData = nullptr;
+	inline PFNCREATEVERTEXARRAYSPROC CreateVertexArrays = nullptr;
+	inline PFNVERTEXARRAYVERTEXBUFFERPROC VertexArrayVertexBuffer = nullptr;
+	inline PFNVERTEXARRAYELEMENTBUFFERPROC VertexArrayElementBuffer = nullptr;
+	inline PFNENABLEVERTEXARRAYATTRIBPROC EnableVertexArrayAttrib = nullptr;
+	inline PFNVERTEXARRAYATTRIBFORMATPROC VertexArrayAttribFormat = nullptr;
+	inline PFNVERTEXARRAYATTRIBIFORMATPROC VertexArrayAttribIFormat = nullptr;
+	inline PFNVERTEXARRAYATTRIBBINDINGPROC VertexArrayAttribBinding = nullptr;
+	inline PFNVERTEXARRAYBINDINGDIVISORPROC VertexArrayBindingDivisor = nullptr;
+	inline PFNCREATETEXTURESPROC CreateTextures = nullptr;
+	inline PFNTEXTURESTORAGE2DPROC TextureStorage2D = nullptr;
+	inline PFNTEXTURESUBIMAGE2DPROC TextureSubImage2D = nullptr;
+	inline PFNTEXTUREPARAMETERIPROC TextureParameteri = nullptr;
+	inline PFNGENERATETEXTUREMIPMAPPROC GenerateTextureMipmap = nullptr;
+
+	inline bool available = false;
+
+	inline bool isAvailable()
+	{
+		return available;
+	}
+
+	// Looks for GL 4.5 or ARB_direct_state_access and loads the entry points. Returns isAvailable().
+	inline bool load(GLADloadproc loader)
+	{
+		GLint major = 0, minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+		bool supported = major > 4 || (major == 4 && minor >= 5);
+
+		if (!supported)
+		{
+			GLint extensionCount = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+
+			for (GLint i = 0; i < extensionCount && !supported; i++)
+			{
+				const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+				supported = extension && std::strcmp(extension, "GL_ARB_direct_state_access") == 0;
+			}
+		}
+
+		if (!supported)
+			return available = false;
+
+		CreateBuffers = (PFNCREATEBUFFERSPROC)loader("glCreateBuffers");
+		NamedBufferData = (PFNNAMEDBUFFERDATAPROC)loader("glNamedBufferData");
+		NamedBufferStorage = (PFNNAMEDBUFFERSTORAGEPROC)loader("glNamedBufferStorage");
+		NamedBufferSubData = (PFNNAMEDBUFFERSUBDATAPROC)loader("glNamedBufferSubData");
+		CreateVertexArrays = (PFNCREATEVERTEXARRAYSPROC)loader("glCreateVertexArrays");
+		VertexArrayVertexBuffer = (PFNVERTEXARRAYVERTEXBUFFERPROC)loader("glVertexArrayVertexBuffer");
+		VertexArrayElementBuffer = (PFNVERTEXARRAYELEMENTBUFFERPROC)loader("glVertexArrayElementBuffer");
+		EnableVertexArrayAttrib = (PFNENABLEVERTEXARRAYATTRIBPROC)loader("glEnableVertexArrayAttrib");
+		VertexArrayAttribFormat = (PFNVERTEXARRAYATTRIBFORMATPROC)loader("glVertexArrayAttribFormat");
+		VertexArrayAttribIFormat = (PFNVERTEXARRAYATTRIBIFORMATPROC)loader("glVertexArrayAttribIFormat");
+		VertexArrayAttribBinding = (PFNVERTEXARRAYATTRIBBINDINGPROC)loader("glVertexArrayAttribBinding");
+		VertexArrayBindingDivisor = (PFNVERTEXARRAYBINDINGDIVISORPROC)loader("glVertexArrayBindingDivisor");
+		CreateTextures = (PFNCREATETEXTURESPROC)loader("glCreateTextures");
+		TextureStorage2D = (PFNTEXTURESTORAGE2DPROC)loader("glTextureStorage2D");
+		TextureSubImage2D = (PFNTEXTURESUBIMAGE2DPROC)loader("glTextureSubImage2D");
+		TextureParameteri = (PFNTEXTUREPARAMETERIPROC)loader("glTextureParameteri");
+		GenerateTextureMipmap = (PFNGENERATETEXTUREMIPMAPPROC)loader("glGenerateTextureMipmap");
+
+		available = CreateBuffers && NamedBufferData && NamedBufferStorage && NamedBufferSubData &&
+			CreateVertexArrays && VertexArrayVertexBuffer && VertexArrayElementBuffer && EnableVertexArrayAttrib &&
+			VertexArrayAttribFormat && VertexArrayAttribIFormat && VertexArrayAttribBinding && VertexArrayBindingDivisor &&
+			CreateTextures && TextureStorage2D && TextureSubImage2D && TextureParameteri && GenerateTextureMipmap;
+
+		return available;
+	}
+
+	// Immutable texture storage needs a sized internal format
+	inline GLenum sizedInternalFormat(GLint internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_RED:		return GL_R8;
+		case GL_RG:			return GL_RG8;
+		case GL_RGB:		return GL_RGB8;
+		case GL_RGBA:		return GL_RGBA8;
+		case GL_SRGB:		return GL_SRGB8;
+		case GL_SRGB_ALPHA:	return GL_SRGB8_ALPHA8;
+		default:			return internalFormat;
+		}
+	}
+}
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "TextureBindings.h"
+
+#include <cstdint>
+
+// Calls issued to GL and calls skipped because they would not have changed anything
+struct GLStateCounter
+{
+	uint64_t issued = 0;
+	uint64_t elided = 0;
+};
+
+struct GLStateStats
+{
+	GLStateCounter program;
+	GLStateCounter vertexArray;
+	GLStateCounter buffer;
+	GLStateCounter capability;		// glEnable / glDisable
+	GLStateCounter depth;			// Depth function and mask
+	GLStateCounter blend;
+	GLStateCounter cull;			// Cull face and front face
+	GLStateCounter stencil;
+	GLStateCounter viewport;
+	TextureBindingStats textures;	// Texture units and samplers, tracked by TextureBindings
+
+	uint64_t getIssued() const;
+	uint64_t getElided() const;
+};
+
+// Remembers the GL state the code base sets and skips calls that would not change it: the program, the vertex array,
+// the buffer bound to every target, the enabled capabilities, depth, blend, cull and stencil state and the viewport.
+// Textures and samplers go through TextureBindings, which this folds into its counters. Every wrapper has to go
+// through here, otherwise the cache goes stale; call invalidate() after foreign GL code.
+//
+// Everything starts out unknown, so the first call of each kind always reaches GL. The element array buffer binding
+// belongs to the vertex array and becomes unknown whenever another vertex array is bound.
+class GLState
+{
+private:
+	static constexpr unsigned int UNKNOWN = ~0u;
+
+	// Buffer targets that are cached, others are always passed through
+	enum BufferSlot { ARRAY, ELEMENT_ARRAY, COPY_READ, COPY_WRITE, UNIFORM, TEXTURE_BUFFER, PIXEL_PACK, PIXEL_UNPACK, BUFFER_SLOT_COUNT };
+
+	// Capabilities that are cached, others are always passed through
+	enum CapabilitySlot { DEPTH_TEST, BLEND, CULL_FACE, STENCIL_TEST, SCISSOR_TEST, POLYGON_OFFSET_FILL, SEAMLESS_CUBE_MAP, CAPABILITY_SLOT_COUNT };
+
+	unsigned int m_Program = UNKNOWN;
+	unsigned int m_VertexArray = UNKNOWN;
+	unsigned int m_Buffers[BUFFER_SLOT_COUNT];
+	uint8_t m_Capabilities[CAPABILITY_SLOT_COUNT];		// 0 disabled, 1 enabled, 2 unknown
+
+	GLenum m_DepthFunc = UNKNOWN;
+	unsigned int m_DepthMask = UNKNOWN;
+
+	GLenum m_BlendSource = UNKNOWN;
+	GLenum m_BlendDestination = UNKNOWN;
+
+	GLenum m_CullFace = UNKNOWN;
+	GLenum m_FrontFace = UNKNOWN;
+
+	GLenum m_StencilFunc = UNKNOWN;
+	GLint m_StencilReference = 0;
+	GLuint m_StencilValueMask = 0;
+	GLenum m_StencilFail = UNKNOWN;
+	GLenum m_StencilDepthFail = UNKNOWN;
+	GLenum m_StencilPass = UNKNOWN;
+	GLuint m_StencilWriteMask = 0;
+	bool m_StencilWriteMaskKnown = false;
+
+	GLint m_Viewport[4] = { 0, 0, 0, 0 };
+	bool m_ViewportKnown = false;
+
+	GLStateStats m_Stats;
+	GLStateStats m_LastFrame;
+
+	// This is a singleton class
+	GLState() { invalidate(); }
+
+public:
+	GLState(GLState const&) = delete;
+	void operator=(GLState const&) = delete;
+
+	static GLState& getInstance();
+
+	void useProgram(unsigned int program);
+
+	void bindVertexArray(unsigned int vertexArray);
+	unsigned int getVertexArray() const { return m_VertexArray; }
+
+	void bindBuffer(GLenum target, unsigned int buffer);
+
+	// Call before deleting, GL unbinds deleted objects on its own
+	void forgetProgram(unsigned int program);
+	void forgetVertexArray(unsigned int vertexArray);
+	void forgetBuffer(unsigned int buffer);
+
+	void setCapability(GLenum capability, bool enabled);
+	void enable(GLenum capability) { setCapability(capability, true); }
+	void disable(GLenum capability) { setCapability(capability, false); }
+
+	void setDepthFunc(GLenum func);
+	void setDepthMask(bool write);
+
+	void setBlendFunc(GLenum source, GLenum destination);
+
+	void setCullFace(GLenum face);
+	void setFrontFace(GLenum winding);
+
+	void setStencilFunc(GLenum func, GLint reference, GLuint mask);
+	void setStencilOp(GLenum stencilFail, GLenum depthFail, GLenum pass);
+	void setStencilMask(GLuint mask);
+
+	void setViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// Forgets everything, the next call of each kind reaches GL again. Use after GL calls that bypassed the cache.
+	void invalidate();
+
+	// Call once a frame, the counters of the frame that just ended move to getFrameStats()
+	void beginFrame();
+
+	// Counters of the last complete frame, for profiling
+	const GLStateStats& getFrameStats() const { return m_LastFrame; }
+
+	// Counters since the current frame began
+	GLStateStats getStats() const;
+
+private:
+	static int BufferSlotOf(GLenum target);
+	static int CapabilitySlotOf(GLenum capability);
+
+	static bool Changed(bool changed, GLStateCounter& counter)
+	{
+		if (changed)
+			counter.issued++;
+		else
+			counter.elided++;
+		return changed;
+	}
+};
+
+// State belongs to a GL context and every context lives on its own thread, so each thread gets its own cache
+inline GLState& GLState::getInstance()
+{
+	static thread_local GLState state;
+	return state;
+}
+
+uint64_t GLStateStats::getIssued() const
+{
+	return program.issued + vertexArray.issued + buffer.issued + capability.issued + depth.issued + blend.issued + cull.issued + stencil.issued +
+		viewport.issued + textures.activeTextureCalls + textures.bindTextureCalls + textures.bindSamplerCalls;
+}
+
+uint64_t GLStateStats::getElided() const
+{
+	return program.elided + vertexArray.elided + buffer.elided + capability.elided + depth.elided + blend.elided + cull.elided + stencil.elided +
+		viewport.elided + textures.activeTextureElided + textures.bindTextureElided + textures.bindSamplerElided;
+}
+
+void GLState::useProgram(unsigned int program)
+{
+	if (!Changed(m_Program != program, m_Stats.program))
+		return;
+
+	glUseProgram(program);
+	m_Program = program;
+}
+
+void GLState::bindVertexArray(unsigned int vertexArray)
+{
+	if (!Changed(m_VertexArray != vertexArray, m_Stats.vertexArray))
+		return;
+
+	glBindVertexArray(vertexArray);
+	m_VertexArray = vertexArray;
+	m_Buffers[ELEMENT_ARRAY] = UNKNOWN;
+}
+
+void GLState::bindBuffer(GLenum target, unsigned int buffer)
+{
+	int slot = BufferSlotOf(target);
+	if (slot < 0)
+	{
+		m_Stats.buffer.issued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (!Changed(m_Buffers[slot] != buffer, m_Stats.buffer))
+		return;
+
+	glBindBuffer(target, buffer);
+	m_Buffers[slot] = buffer;
+}
+
+void GLState::forgetProgram(unsigned int program)
+{
+	// A deleted program stays in use until another one is, only the name can be handed out again
+	if (m_Program == program)
+		m_Program = UNKNOWN;
+}
+
+void GLState::forgetVertexArray(unsigned int vertexArray)
+{
+	if (m_VertexArray == vertexArray)
+	{
+		m_VertexArray = 0;
+		m_Buffers[ELEMENT_ARRAY] = UNKNOWN;
+	}
+}
+
+void GLState::forgetBuffer(unsigned int buffer)
+{
+	for (unsigned int& bound : m_Buffers)
+	{
+		if (bound == buffer)
+			bound = 0;
+	}
+}
+
+void GLState::setCapability(GLenum capability, bool enabled)
+{
+	int slot = CapabilitySlotOf(capability);
+	if (slot >= 0 && !Changed(m_Capabilities[slot] != uint8_t(enabled), m_Stats.capability))
+		return;
+
+	if (slot < 0)
+		m_Stats.capability.issued++;
+	else
+		m_Capabilities[slot] = uint8_t(enabled);
+
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+}
+
+void GLState::setDepthFunc(GLenum func)
+{
+	if (!Changed(m_DepthFunc != func, m_Stats.depth))
+		return;
+
+	glDepthFunc(func);
+	m_DepthFunc = func;
+}
+
+void GLState::setDepthMask(bool write)
+{
+	if (!Changed(m_DepthMask != unsigned(write), m_Stats.depth))
+		return;
+
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+	m_DepthMask = unsigned(write);
+}
+
+void GLState::setBlendFunc(GLenum source, GLenum destination)
+{
+	if (!Changed(m_BlendSource != source || m_BlendDestination != destination, m_Stats.blend))
+		return;
+
+	glBlendFunc(source, destination);
+	m_BlendSource = source;
+	m_BlendDestination = destination;
+}
+
+void GLState::setCullFace(GLenum face)
+{
+	if (!Changed(m_CullFace != face, m_Stats.cull))
+		return;
+
+	glCullFace(face);
+	m_CullFace = face;
+}
+
+void GLState::setFrontFace(GLenum winding)
+{
+	if (!Changed(m_FrontFace != winding, m_Stats.cull))
+		return;
+
+	glFrontFace(winding);
+	m_FrontFace = winding;
+}
+
+void GLState::setStencilFunc(GLenum func, GLint reference, GLuint mask)
+{
+	if (!Changed(m_StencilFunc != func || m_StencilReference != reference || m_StencilValueMask != mask, m_Stats.stencil))
+		return;
+
+	glStencilFunc(func, reference, mask);
+	m_StencilFunc = func;
+	m_StencilReference = reference;
+	m_StencilValueMask = mask;
+}
+
+void GLState::setStencilOp(GLenum stencilFail, GLenum depthFail, GLenum pass)
+{
+	if (!Changed(m_StencilFail != stencilFail || m_StencilDepthFail != depthFail || m_StencilPass != pass, m_Stats.stencil))
+		return;
+
+	glStencilOp(stencilFail, depthFail, pass);
+	m_StencilFail = stencilFail;
+	m_StencilDepthFail = depthFail;
+	m_StencilPass = pass;
+}
+
+void GLState::setStencilMask(GLuint mask)
+{
+	if (!Changed(!m_StencilWriteMaskKnown || m_StencilWriteMask != mask, m_Stats.stencil))
+		return;
+
+	glStencilMask(mask);
+	m_StencilWriteMask = mask;
+	m_StencilWriteMaskKnown = true;
+}
+
+void GLState::setViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	bool changed = !m_ViewportKnown || m_Viewport[0] != x || m_Viewport[1] != y || m_Viewport[2] != width || m_Viewport[3] != height;
+	if (!Changed(changed, m_Stats.viewport))
+		return;
+
+	glViewport(x, y, width, height);
+	m_Viewport[0] = x;
+	m_Viewport[1] = y;
+	m_Viewport[2] = width;
+	m_Viewport[3] = height;
+	m_ViewportKnown = true;
+}
+
+void GLState::invalidate()
+{
+	m_Program = UNKNOWN;
+	m_VertexArray = UNKNOWN;
+	for (unsigned int& buffer : m_Buffers)
+		buffer = UNKNOWN;
+	for (uint8_t& capability : m_Capabilities)
+		capability = 2;
+
+	m_DepthFunc = UNKNOWN;
+	m_DepthMask = UNKNOWN;
+	m_BlendSource = m_BlendDestination = UNKNOWN;
+	m_CullFace = m_FrontFace = UNKNOWN;
+	m_StencilFunc = m_StencilFail = m_StencilDepthFail = m_StencilPass = UNKNOWN;
+	m_StencilWriteMaskKnown = false;
+	m_ViewportKnown = false;
+}
+
+void GLState::beginFrame()
+{
+	m_LastFrame = getStats();
+	m_Stats = GLStateStats();
+	TextureBindings::getInstance().resetStats();
+}
+
+GLStateStats GLState::getStats() const
+{
+	GLStateStats stats = m_Stats;
+	stats.textures = TextureBindings::getInstance().getStats();
+	return stats;
+}
+
+int GLState::BufferSlotOf(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER:			return ARRAY;
+	case GL_ELEMENT_ARRAY_BUFFER:	return ELEMENT_ARRAY;
+	case GL_COPY_READ_BUFFER:		return COPY_READ;
+	case GL_COPY_WRITE_BUFFER:		return COPY_WRITE;
+	case GL_UNIFORM_BUFFER:			return UNIFORM;
+	case GL_TEXTURE_BUFFER:			return TEXTURE_BUFFER;
+	case GL_PIXEL_PACK_BUFFER:		return PIXEL_PACK;
+	case GL_PIXEL_UNPACK_BUFFER:	return PIXEL_UNPACK;
+	default:						return -1;
+	}
+}
+
+int GLState::CapabilitySlotOf(GLenum capability)
+{
+	switch (capability)
+	{
+	case GL_DEPTH_TEST:					return DEPTH_TEST;
+	case GL_BLEND:						return BLEND;
+	case GL_CULL_FACE:					return CULL_FACE;
+	case GL_STENCIL_TEST:				return STENCIL_TEST;
+	case GL_SCISSOR_TEST:				return SCISSOR_TEST;
+	case GL_POLYGON_OFFSET_FILL:		return POLYGON_OFFSET_FILL;
+	case GL_TEXTURE_CUBE_MAP_SEAMLESS:	return SEAMLESS_CUBE_MAP;
+	default:							return -1;
+	}
+}
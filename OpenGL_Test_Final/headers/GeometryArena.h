@@ -0,0 +1,702 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "VertexFormat.h"
+#include "VertexArray.h"
+#include "DSA.h"
+#include "AsyncLoader.h"
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+// Free list sub-allocator over a range of [0, capacity) units. Free blocks are kept sorted by offset and merge
+// with their neighbours when freed, allocation takes the smallest block that fits.
+class RangeAllocator
+{
+public:
+	static constexpr uint64_t INVALID = ~uint64_t(0);
+
+private:
+	std::map<uint64_t, uint64_t> m_FreeBlocks;	// offset -> size
+	uint64_t m_Capacity = 0;
+	uint64_t m_Used = 0;
+
+public:
+	RangeAllocator() = default;
+	explicit RangeAllocator(uint64_t capacity);
+
+	// Returns the offset of the block or INVALID if nothing fits
+	uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+
+	void free(uint64_t offset, uint64_t size);
+
+	// Marks [0, used) as allocated and the rest as free, for after compaction packed everything to the front
+	void reset(uint64_t used);
+
+	uint64_t getCapacity() const { return m_Capacity; }
+	uint64_t getUsed() const { return m_Used; }
+	uint64_t getLargestFreeBlock() const;
+
+	// True if all free space is one block at the end
+	bool isPacked() const;
+};
+
+RangeAllocator::RangeAllocator(uint64_t capacity)
+	: m_Capacity(capacity)
+{
+	if (capacity > 0)
+		m_FreeBlocks[0] = capacity;
+}
+
+uint64_t RangeAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+	auto best = m_FreeBlocks.end();
+	uint64_t bestPadding = 0;
+
+	for (auto block = m_FreeBlocks.begin(); block != m_FreeBlocks.end(); ++block)
+	{
+		uint64_t padding = (alignment - block->first % alignment) % alignment;
+		if (block->second < size + padding)
+			continue;
+
+		if (best == m_FreeBlocks.end() || block->second < best->second)
+		{
+			best = block;
+			bestPadding = padding;
+		}
+	}
+
+	if (best == m_FreeBlocks.end())
+		return INVALID;
+
+	uint64_t blockOffset = best->first, blockSize = best->second;
+	uint64_t offset = blockOffset + bestPadding;
+	m_FreeBlocks.erase(best);
+
+	// The alignment padding in front and whatever is left behind stay free
+	if (bestPadding > 0)
+		m_FreeBlocks[blockOffset] = bestPadding;
+	if (blockSize > bestPadding + size)
+		m_FreeBlocks[offset + size] = blockSize - bestPadding - size;
+
+	m_Used += size;
+	return offset;
+}
+
+void RangeAllocator::free(uint64_t offset, uint64_t size)
+{
+	if (size == 0)
+		return;
+
+	m_Used -= size;
+
+	auto next = m_FreeBlocks.lower_bound(offset);
+
+	// Merge with the block in front
+	if (next != m_FreeBlocks.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			m_FreeBlocks.erase(previous);
+		}
+	}
+
+	// Merge with the block behind
+	if (next != m_FreeBlocks.end() && offset + size == next->first)
+	{
+		size += next->second;
+		m_FreeBlocks.erase(next);
+	}
+
+	m_FreeBlocks[offset] = size;
+}
+
+void RangeAllocator::reset(uint64_t used)
+{
+	m_FreeBlocks.clear();
+	m_Used = used;
+
+	if (used < m_Capacity)
+		m_FreeBlocks[used] = m_Capacity - used;
+}
+
+uint64_t RangeAllocator::getLargestFreeBlock() const
+{
+	uint64_t largest = 0;
+	for (const auto& [offset, size] : m_FreeBlocks)
+		largest = std::max(largest, size);
+
+	return largest;
+}
+
+bool RangeAllocator::isPacked() const
+{
+	return m_FreeBlocks.empty() || (m_FreeBlocks.size() == 1 && m_FreeBlocks.begin()->first == m_Used);
+}
+
+// Geometry with fewer than 65536 vertices draws with 16 bit indices
+inline GLenum IndexTypeFor(size_t vertexCount)
+{
+	return vertexCount < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+inline size_t IndexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+typedef uint32_t GeometryHandle;
+constexpr GeometryHandle INVALID_GEOMETRY = ~GeometryHandle(0);
+
+// Where an allocation's data is, for the draw call after GeometryArena::bind()
+struct GeometryRange
+{
+	GLint baseVertex = 0;			// Added to every index, also the first vertex for glDrawArrays
+	uintptr_t indexOffset = 0;		// Byte offset of the first index in the bound element buffer
+};
+
+struct GeometryArenaStats
+{
+	unsigned int layouts = 0;
+	unsigned int pages = 0;
+	unsigned int allocations = 0;
+	uint64_t vertexBytes = 0;
+	uint64_t vertexBytesUsed = 0;
+	uint64_t indexBytes = 0;
+	uint64_t indexBytesUsed = 0;
+	uint64_t largestFreeVertexBytes = 0;
+	uint64_t largestFreeIndexBytes = 0;
+	uint64_t vertexArrayBinds = 0;
+	uint64_t vertexArrayBindsElided = 0;
+	unsigned int compactions = 0;
+	uint64_t bytesMoved = 0;
+
+	// 0 when the free space is one block, close to 1 when it is scattered in small holes
+	float getFragmentation() const;
+};
+
+inline float GeometryArenaStats::getFragmentation() const
+{
+	uint64_t free = (vertexBytes - vertexBytesUsed) + (indexBytes - indexBytesUsed);
+	return free > 0 ? 1.0f - float(largestFreeVertexBytes + largestFreeIndexBytes) / float(free) : 0.0f;
+}
+
+// Shared vertex and index buffers for all static geometry. Every vertex layout gets its own pages, a page being a large
+// vertex buffer, a large index buffer and one vertex array over both, so every mesh of a layout draws from the same
+// vertex array with glDrawElementsBaseVertex and consecutive draws don't switch vertex arrays. Indices stay relative to
+// the mesh, 16 and 32 bit indices share the index buffers. Buffers are shared between contexts, so the loader thread
+// allocates too; vertex arrays are not, the render thread creates them on first bind.
+class GeometryArena
+{
+public:
+	static constexpr uint64_t PAGE_VERTEX_BYTES = 32ull << 20;
+	static constexpr uint64_t PAGE_INDEX_BYTES = 16ull << 20;
+
+private:
+	struct Page
+	{
+		unsigned int vertexBuffer = 0;
+		unsigned int indexBuffer = 0;
+		unsigned int vertexArray = 0;
+		RangeAllocator vertices;		// In vertices, so offsets are base vertices
+		RangeAllocator indices;			// In bytes
+		bool reattach = false;			// Written to from another context, the vertex array has to pick the buffers up again
+	};
+
+	struct Layout
+	{
+		std::vector<VertexAttribute> attributes;
+		unsigned int stride = 0;
+		std::vector<Page> pages;
+	};
+
+	struct Allocation
+	{
+		uint32_t layout = 0;
+		uint32_t page = 0;
+		uint64_t firstVertex = 0;
+		uint64_t vertexCount = 0;
+		uint64_t indexOffset = 0;
+		uint64_t indexBytes = 0;
+		bool live = false;
+	};
+
+	std::vector<Layout> m_Layouts;
+	std::unordered_map<uint64_t, uint32_t> m_LayoutLookup;
+	std::vector<Allocation> m_Allocations;
+	std::vector<GeometryHandle> m_FreeHandles;
+	GeometryArenaStats m_Stats;
+
+	mutable std::mutex m_Mutex;
+
+	// This is a singleton class
+	GeometryArena() {}
+
+public:
+	GeometryArena(GeometryArena const&) = delete;
+	void operator=(GeometryArena const&) = delete;
+
+	static GeometryArena& getInstance();
+
+	// Copies the vertices (in the given layout) and indices into the arena. indexBytes may be 0 for glDrawArrays geometry.
+	GeometryHandle allocate(const std::vector<VertexAttribute>& attributes, unsigned int stride, const void* vertexData, size_t vertexCount,
+		const void* indexData, size_t indexBytes);
+
+	void free(GeometryHandle handle);
+
+	// Binds the vertex array the allocation draws with, unless it already is, and returns where its data is.
+	// Invalid or freed handles bind nothing and get an empty range. Render thread only.
+	GeometryRange bind(GeometryHandle handle);
+
+	// Moves the live allocations of every page to its front and releases empty pages at the end.
+	// Render thread only, the loader must not be allocating at the same time.
+	void compact();
+
+	GeometryArenaStats getStats() const;
+
+	void resetStats();
+
+	// Deletes every GL object, all handles become invalid
+	void release();
+
+private:
+	static uint64_t LayoutKey(const std::vector<VertexAttribute>& attributes, unsigned int stride);
+
+	uint32_t FindLayout(const std::vector<VertexAttribute>& attributes, unsigned int stride);
+
+	Page CreatePage(const Layout& layout, uint64_t minVertices, uint64_t minIndexBytes);
+
+	void SetupVertexArray(const Layout& layout, Page& page);
+
+	void CompactPage(uint32_t layoutIndex, uint32_t pageIndex);
+
+	static unsigned int CreateBuffer(uint64_t size);
+
+	static void Upload(unsigned int buffer, uint64_t offset, uint64_t size, const void* data);
+};
+
+inline GeometryArena& GeometryArena::getInstance()
+{
+	static GeometryArena arena;
+	return arena;
+}
+
+GeometryHandle GeometryArena::allocate(const std::vector<VertexAttribute>& attributes, unsigned int stride, const void* vertexData, size_t vertexCount,
+	const void* indexData, size_t indexBytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	uint32_t layoutIndex = FindLayout(attributes, stride);
+	Layout& layout = m_Layouts[layoutIndex];
+
+	// Index blocks are rounded up to 4 bytes, so 32 bit indices stay aligned however 16 bit ones come and go
+	Allocation allocation;
+	allocation.layout = layoutIndex;
+	allocation.vertexCount = vertexCount;
+	allocation.indexBytes = (indexBytes + 3) & ~uint64_t(3);
+	allocation.live = true;
+
+	// First page with room for both the vertices and the indices, or a new one
+	bool placed = false;
+	for (uint32_t p = 0; p < layout.pages.size() && !placed; p++)
+	{
+		Page& page = layout.pages[p];
+
+		uint64_t firstVertex = page.vertices.allocate(vertexCount);
+		if (firstVertex == RangeAllocator::INVALID)
+			continue;
+
+		uint64_t indexOffset = indexBytes > 0 ? page.indices.allocate(allocation.indexBytes) : 0;
+		if (indexOffset == RangeAllocator::INVALID)
+		{
+			page.vertices.free(firstVertex, vertexCount);
+			continue;
+		}
+
+		allocation.page = p;
+		allocation.firstVertex = firstVertex;
+		allocation.indexOffset = indexOffset;
+		placed = true;
+	}
+
+	if (!placed)
+	{
+		layout.pages.push_back(CreatePage(layout, vertexCount, allocation.indexBytes));
+		Page& page = layout.pages.back();
+
+		allocation.page = static_cast<uint32_t>(layout.pages.size() - 1);
+		allocation.firstVertex = page.vertices.allocate(vertexCount);
+		allocation.indexOffset = indexBytes > 0 ? page.indices.allocate(allocation.indexBytes) : 0;
+	}
+
+	Page& page = layout.pages[allocation.page];
+	Upload(page.vertexBuffer, allocation.firstVertex * stride, vertexCount * stride, vertexData);
+	if (indexBytes > 0)
+		Upload(page.indexBuffer, allocation.indexOffset, indexBytes, indexData);
+
+	if (AsyncLoader::isLoaderThread())
+		page.reattach = true;
+
+	GeometryHandle handle;
+	if (!m_FreeHandles.empty())
+	{
+		handle = m_FreeHandles.back();
+		m_FreeHandles.pop_back();
+		m_Allocations[handle] = allocation;
+	}
+	else
+	{
+		handle = static_cast<GeometryHandle>(m_Allocations.size());
+		m_Allocations.push_back(allocation);
+	}
+
+	return handle;
+}
+
+void GeometryArena::free(GeometryHandle handle)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	if (handle >= m_Allocations.size() || !m_Allocations[handle].live)
+		return;
+
+	Allocation& allocation = m_Allocations[handle];
+	Page& page = m_Layouts[allocation.layout].pages[allocation.page];
+
+	page.vertices.free(allocation.firstVertex, allocation.vertexCount);
+	if (allocation.indexBytes > 0)
+		page.indices.free(allocation.indexOffset, allocation.indexBytes);
+
+	allocation.live = false;
+	m_FreeHandles.push_back(handle);
+}
+
+GeometryRange GeometryArena::bind(GeometryHandle handle)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	if (handle >= m_Allocations.size() || !m_Allocations[handle].live)
+		return GeometryRange();
+
+	const Allocation& allocation = m_Allocations[handle];
+	Layout& layout = m_Layouts[allocation.layout];
+	Page& page = layout.pages[allocation.page];
+
+	if (page.vertexArray == 0 || page.reattach)
+		SetupVertexArray(layout, page);
+
+	if (GLState::getInstance().getVertexArray() == page.vertexArray)
+		m_Stats.vertexArrayBindsElided++;
+	else
+		m_Stats.vertexArrayBinds++;
+
+	GLState::getInstance().bindVertexArray(page.vertexArray);
+
+	GeometryRange range;
+	range.baseVertex = static_cast<GLint>(allocation.firstVertex);
+	range.indexOffset = static_cast<uintptr_t>(allocation.indexOffset);
+	return range;
+}
+
+void GeometryArena::compact()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (uint32_t l = 0; l < m_Layouts.size(); l++)
+	{
+		Layout& layout = m_Layouts[l];
+
+		for (uint32_t p = 0; p < layout.pages.size(); p++)
+		{
+			if (!layout.pages[p].vertices.isPacked() || !layout.pages[p].indices.isPacked())
+				CompactPage(l, p);
+		}
+
+		// Nothing refers to empty pages at the end, so they can go
+		while (!layout.pages.empty() && layout.pages.back().vertices.getUsed() == 0 && layout.pages.back().indices.getUsed() == 0)
+		{
+			Page& page = layout.pages.back();
+
+			GLState::getInstance().forgetVertexArray(page.vertexArray);
+			if (page.vertexArray != 0)
+				glDeleteVertexArrays(1, &page.vertexArray);
+			GLState::getInstance().forgetBuffer(page.vertexBuffer);
+			glDeleteBuffers(1, &page.vertexBuffer);
+			GLState::getInstance().forgetBuffer(page.indexBuffer);
+			glDeleteBuffers(1, &page.indexBuffer);
+
+			layout.pages.pop_back();
+		}
+	}
+}
+
+GeometryArenaStats GeometryArena::getStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	GeometryArenaStats stats = m_Stats;
+	stats.layouts = static_cast<unsigned int>(m_Layouts.size());
+	stats.allocations = static_cast<unsigned int>(m_Allocations.size() - m_FreeHandles.size());
+
+	for (const Layout& layout : m_Layouts)
+	{
+		for (const Page& page : layout.pages)
+		{
+			stats.pages++;
+			stats.vertexBytes += page.vertices.getCapacity() * layout.stride;
+			stats.vertexBytesUsed += page.vertices.getUsed() * layout.stride;
+			stats.indexBytes += page.indices.getCapacity();
+			stats.indexBytesUsed += page.indices.getUsed();
+			stats.largestFreeVertexBytes = std::max(stats.largestFreeVertexBytes, page.vertices.getLargestFreeBlock() * layout.stride);
+			stats.largestFreeIndexBytes = std::max(stats.largestFreeIndexBytes, page.indices.getLargestFreeBlock());
+		}
+	}
+
+	return stats;
+}
+
+void GeometryArena::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	m_Stats.vertexArrayBinds = m_Stats.vertexArrayBindsElided = 0;
+	m_Stats.compactions = 0;
+	m_Stats.bytesMoved = 0;
+}
+
+void GeometryArena::release()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (Layout& layout : m_Layouts)
+	{
+		for (Page& page : layout.pages)
+		{
+			GLState::getInstance().forgetVertexArray(page.vertexArray);
+			if (page.vertexArray != 0)
+				glDeleteVertexArrays(1, &page.vertexArray);
+			GLState::getInstance().forgetBuffer(page.vertexBuffer);
+			glDeleteBuffers(1, &page.vertexBuffer);
+			GLState::getInstance().forgetBuffer(page.indexBuffer);
+			glDeleteBuffers(1, &page.indexBuffer);
+		}
+	}
+
+	m_Layouts.clear();
+	m_LayoutLookup.clear();
+	m_Allocations.clear();
+	m_FreeHandles.clear();
+}
+
+uint64_t GeometryArena::LayoutKey(const std::vector<VertexAttribute>& attributes, unsigned int stride)
+{
+	// Field by field, VertexAttribute has padding
+	uint64_t key = 14695981039346656037ull;
+	auto mix = [&key](uint64_t value) { key = (key ^ value) * 1099511628211ull; };
+
+	mix(stride);
+	for (const VertexAttribute& attribute : attributes)
+	{
+		mix(attribute.location);
+		mix(static_cast<uint64_t>(attribute.count));
+		mix(attribute.type);
+		mix(attribute.normalized);
+		mix(attribute.integer);
+		mix(attribute.offset);
+	}
+
+	return key;
+}
+
+uint32_t GeometryArena::FindLayout(const std::vector<VertexAttribute>& attributes, unsigned int stride)
+{
+	uint64_t key = LayoutKey(attributes, stride);
+
+	auto found = m_LayoutLookup.find(key);
+	if (found != m_LayoutLookup.end())
+		return found->second;
+
+	Layout layout;
+	layout.attributes = attributes;
+	layout.stride = stride;
+	m_Layouts.push_back(std::move(layout));
+
+	uint32_t index = static_cast<uint32_t>(m_Layouts.size() - 1);
+	m_LayoutLookup[key] = index;
+	return index;
+}
+
+GeometryArena::Page GeometryArena::CreatePage(const Layout& layout, uint64_t minVertices, uint64_t minIndexBytes)
+{
+	// Meshes bigger than a page get a page of their own size
+	uint64_t vertexCapacity = std::max<uint64_t>(PAGE_VERTEX_BYTES / layout.stride, minVertices);
+	uint64_t indexCapacity = std::max<uint64_t>(PAGE_INDEX_BYTES, minIndexBytes);
+
+	Page page;
+	page.vertices = RangeAllocator(vertexCapacity);
+	page.indices = RangeAllocator(indexCapacity);
+	page.vertexBuffer = CreateBuffer(vertexCapacity * layout.stride);
+	page.indexBuffer = CreateBuffer(indexCapacity);
+	return page;
+}
+
+void GeometryArena::SetupVertexArray(const Layout& layout, Page& page)
+{
+	const GLsizei stride = layout.stride;
+
+	if (page.vertexArray != 0)
+	{
+		// Attaching the buffers again makes writes from the loader's context visible to this one
+		GLState::getInstance().forgetVertexArray(page.vertexArray);
+		glDeleteVertexArrays(1, &page.vertexArray);
+		page.vertexArray = 0;
+	}
+
+	if (DSA::isAvailable())
+	{
+		DSA::CreateVertexArrays(1, &page.vertexArray);
+
+		DSA::VertexArrayVertexBuffer(page.vertexArray, 0, page.vertexBuffer, 0, stride);
+		DSA::VertexArrayElementBuffer(page.vertexArray, page.indexBuffer);
+
+		for (const VertexAttribute& attribute : layout.attributes)
+		{
+			DSA::EnableVertexArrayAttrib(page.vertexArray, attribute.location);
+
+			if (attribute.integer)
+				DSA::VertexArrayAttribIFormat(page.vertexArray, attribute.location, attribute.count, attribute.type, attribute.offset);
+			else
+				DSA::VertexArrayAttribFormat(page.vertexArray, attribute.location, attribute.count, attribute.type, attribute.normalized, attribute.offset);
+
+			DSA::VertexArrayAttribBinding(page.vertexArray, attribute.location, 0);
+		}
+	}
+	else
+	{
+		glGenVertexArrays(1, &page.vertexArray);
+
+		GLState::getInstance().bindVertexArray(page.vertexArray);
+		GLState::getInstance().bindBuffer(GL_ARRAY_BUFFER, page.vertexBuffer);
+		GLState::getInstance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.indexBuffer);
+
+		for (const VertexAttribute& attribute : layout.attributes)
+		{
+			glEnableVertexAttribArray(attribute.location);
+
+			if (attribute.integer)
+				glVertexAttribIPointer(attribute.location, attribute.count, attribute.type, stride, (void*)(size_t)attribute.offset);
+			else
+				glVertexAttribPointer(attribute.location, attribute.count, attribute.type, attribute.normalized, stride, (void*)(size_t)attribute.offset);
+		}
+	}
+
+	page.reattach = false;
+}
+
+void GeometryArena::CompactPage(uint32_t layoutIndex, uint32_t pageIndex)
+{
+	Layout& layout = m_Layouts[layoutIndex];
+	Page& page = layout.pages[pageIndex];
+
+	std::vector<Allocation*> live;
+	for (Allocation& allocation : m_Allocations)
+	{
+		if (allocation.live && allocation.layout == layoutIndex && allocation.page == pageIndex)
+			live.push_back(&allocation);
+	}
+
+	// Copy everything packed into fresh buffers, copying inside one buffer is not allowed to overlap
+	unsigned int vertexBuffer = CreateBuffer(page.vertices.getCapacity() * layout.stride);
+	unsigned int indexBuffer = CreateBuffer(page.indices.getCapacity());
+
+	uint64_t nextVertex = 0, nextIndexOffset = 0;
+
+	std::sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) { return a->firstVertex < b->firstVertex; });
+	GLState::getInstance().bindBuffer(GL_COPY_READ_BUFFER, page.vertexBuffer);
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+	for (Allocation* allocation : live)
+	{
+		if (allocation->vertexCount > 0)
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->firstVertex * layout.stride, nextVertex * layout.stride, allocation->vertexCount * layout.stride);
+
+		allocation->firstVertex = nextVertex;
+		nextVertex += allocation->vertexCount;
+	}
+
+	std::sort(live.begin(), live.end(), [](const Allocation* a, const Allocation* b) { return a->indexOffset < b->indexOffset; });
+	GLState::getInstance().bindBuffer(GL_COPY_READ_BUFFER, page.indexBuffer);
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+	for (Allocation* allocation : live)
+	{
+		if (allocation->indexBytes == 0)
+			continue;
+
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation->indexOffset, nextIndexOffset, allocation->indexBytes);
+
+		allocation->indexOffset = nextIndexOffset;
+		nextIndexOffset += allocation->indexBytes;
+	}
+
+	GLState::getInstance().bindBuffer(GL_COPY_READ_BUFFER, 0);
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	m_Stats.compactions++;
+	m_Stats.bytesMoved += nextVertex * layout.stride + nextIndexOffset;
+
+	GLState::getInstance().forgetBuffer(page.vertexBuffer);
+	glDeleteBuffers(1, &page.vertexBuffer);
+	GLState::getInstance().forgetBuffer(page.indexBuffer);
+	glDeleteBuffers(1, &page.indexBuffer);
+	page.vertexBuffer = vertexBuffer;
+	page.indexBuffer = indexBuffer;
+
+	page.vertices.reset(nextVertex);
+	page.indices.reset(nextIndexOffset);
+
+	// The vertex array still points at the old buffers
+	page.reattach = true;
+}
+
+unsigned int GeometryArena::CreateBuffer(uint64_t size)
+{
+	unsigned int buffer = 0;
+
+	if (DSA::isAvailable())
+	{
+		DSA::CreateBuffers(1, &buffer);
+		DSA::NamedBufferData(buffer, size, nullptr, GL_STATIC_DRAW);
+		return buffer;
+	}
+
+	// Through the copy target, it is not part of any vertex array's state
+	glGenBuffers(1, &buffer);
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return buffer;
+}
+
+void GeometryArena::Upload(unsigned int buffer, uint64_t offset, uint64_t size, const void* data)
+{
+	if (size == 0)
+		return;
+
+	if (DSA::isAvailable())
+	{
+		DSA::NamedBufferSubData(buffer, offset, size, data);
+		return;
+	}
+
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+	GLState::getInstance().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
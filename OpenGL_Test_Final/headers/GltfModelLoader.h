@@ -0,0 +1,1105 @@
+#pragma once
+
+#include "AssimpModelLoader.h"
+#include "Json.h"
+#include "MappedFile.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+
+// Reads glTF 2.0 files, .gltf with its buffers or a single .glb, into a Model without going through Assimp. The binary
+// buffers are memory mapped and the geometry arena is filled from the mapping: index accessors are uploaded as they are,
+// and so is vertex data that is already interleaved in the mesh's vertex format. Other vertex data is gathered into the
+// format attribute by attribute, converting only the attributes whose encoding differs.
+//
+// Every primitive becomes a Mesh with its material's textures, glTF meshes used by several nodes are uploaded once and
+// the nodes share them. Meshes use VertexFormat::gltf() when the model asks for the full format, otherwise the model's
+// format. The model's meshOptimization and lodGeneration apply like for Assimp formats; they need the vertices on the
+// CPU, so only with both turned off does the geometry go up straight from the mapping. Primitives without normals get
+// flat ones, as the specification asks. Not read: skins, animations, morph targets, sparse accessors, accessors without
+// a buffer view and primitives other than triangle lists.
+class GltfLoader
+{
+public:
+	// Adds the file's meshes, textures and nodes to model. Model::load() calls this for .gltf and .glb paths.
+	static bool load(const std::string& path, Model& model);
+
+	// True for .gltf and .glb paths
+	static bool isGltfFile(const std::string& path);
+
+private:
+	// Component types, the same numbers as the GL enums
+	enum ComponentType : int
+	{
+		BYTE = 5120,
+		UNSIGNED_BYTE = 5121,
+		SHORT = 5122,
+		UNSIGNED_SHORT = 5123,
+		UNSIGNED_INT = 5125,
+		FLOAT = 5126
+	};
+
+	// Elements of an accessor, stride bytes apart in a mapped buffer
+	struct Accessor
+	{
+		const unsigned char* data = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		int componentType = 0;
+		int components = 0;
+		bool normalized = false;
+		int bufferView = -1;
+		size_t viewOffset = 0;		// Of the first element, inside the buffer view
+
+		size_t getComponentSize() const;
+		size_t getElementSize() const { return getComponentSize() * components; }
+		GLenum getGLType() const;
+
+		// Up to four components of element i as floats, normalized integers mapped to [0, 1] or [-1, 1]
+		glm::vec4 readFloat4(size_t i) const;
+		uint32_t readIndex(size_t i) const;
+	};
+
+	struct Document
+	{
+		JsonValue json;
+		std::string path;
+		std::string directory;
+		MappedFile file;
+		std::vector<std::unique_ptr<MappedFile>> bufferFiles;
+		std::vector<std::vector<unsigned char>> decodedBuffers;			// From data: URIs
+		std::vector<std::pair<const unsigned char*, size_t>> buffers;
+	};
+
+	// A primitive ready for upload, built on the thread pool without touching GL
+	struct Primitive
+	{
+		const JsonValue* source = nullptr;
+		VertexFormat format;
+		int material = -1;
+
+		const void* vertexData = nullptr;		// Into the mapping, or vertices
+		std::vector<unsigned char> vertices;
+		size_t vertexCount = 0;
+
+		const void* indexData = nullptr;		// Into the mapping, or indices
+		std::vector<unsigned char> indices;
+		size_t indexCount = 0;
+		GLenum indexType = GL_UNSIGNED_INT;
+
+		// Set when the model's optimization or LOD generation ran, the mesh is built from these instead
+		bool processed = false;
+		std::vector<Vertex> processedVertices;
+		std::vector<unsigned int> processedIndices;
+		std::vector<MeshLod> lods;
+		MeshOptimizeStats stats;
+
+		AABB bounds;
+		BoundingSphere sphere;
+		bool valid = false;
+	};
+
+	static bool OpenDocument(const std::string& path, Document& document);
+	static bool LoadBuffers(Document& document);
+	static bool ReadAccessor(const Document& document, int index, Accessor& accessor);
+
+	static void BuildPrimitive(const Document& document, const Model& model, Primitive& primitive);
+
+	// Vertex i of the primitive is read from source vertex corners[i], or from vertex i if corners is empty
+	static bool GatherVertices(const Accessor* sources, const std::vector<uint32_t>& corners, const std::vector<glm::vec3>& generatedNormals, Primitive& primitive);
+
+	// Gives every triangle its own three vertices with the face normal, for primitives without normals. corners gets
+	// the source vertex of every new vertex, the indices become a plain list.
+	static std::vector<glm::vec3> GenerateFlatNormals(const Accessor& positions, Primitive& primitive, std::vector<uint32_t>& corners);
+
+	// Indices 0, 1, 2, ... for count vertices
+	static void SetListIndices(Primitive& primitive, size_t count);
+
+	// Runs the model's optimization and LOD generation on the gathered vertices
+	static void ProcessPrimitive(const Model& model, Primitive& primitive);
+
+	static std::vector<std::vector<Texture>> LoadMaterials(const Document& document, Model& model);
+
+	static void AddNode(const Document& document, int node, int parent, const std::vector<unsigned int>& meshFirst,
+		const std::vector<unsigned int>& meshCount, std::vector<bool>& visited, Model& model);
+	static glm::mat4 NodeTransform(const JsonValue& node);
+
+	static bool DecodeBase64(std::string_view text, std::vector<unsigned char>& out);
+	static std::string DecodeUri(const std::string& uri);
+};
+
+bool GltfLoader::isGltfFile(const std::string& path)
+{
+	size_t dot = path.find_last_of("./\\");
+	if (dot == std::string::npos || path[dot] != '.')
+		return false;
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == "gltf" || extension == "glb";
+}
+
+bool GltfLoader::load(const std::string& path, Model& model)
+{
+	Document document;
+	if (!OpenDocument(path, document) || !LoadBuffers(document))
+	{
+		std::cout << "ERROR::GLTF:: Could not read " << path << std::endl;
+		return false;
+	}
+
+	model.directory = document.directory;
+
+	// CPU phase: every primitive is checked and gathered on the thread pool
+	const JsonValue& meshes = document.json["meshes"];
+	std::vector<Primitive> primitives;
+	std::vector<size_t> meshPrimitives(meshes.size() + 1, 0);
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		for (const JsonValue& source : meshes[m]["primitives"].getElements())
+		{
+			primitives.emplace_back();
+			primitives.back().source = &source;
+			primitives.back().format = model.vertexFormat.isFull() ? VertexFormat::gltf() : model.vertexFormat;
+			primitives.back().format.skinned = false;
+		}
+		meshPrimitives[m + 1] = primitives.size();
+	}
+
+	ThreadPool::getInstance().parallelFor(primitives.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			BuildPrimitive(document, model, primitives[i]);
+	});
+
+	model.optimizationStats = MeshOptimizeStats();
+	for (const Primitive& primitive : primitives)
+	{
+		if (primitive.processed)
+			model.optimizationStats.accumulate(primitive.stats);
+	}
+
+	std::vector<std::vector<Texture>> materials = LoadMaterials(document, model);
+
+	// GL phase: the primitives of a glTF mesh become consecutive meshes, which every node using the glTF mesh refers to
+	std::vector<unsigned int> meshFirst(meshes.size(), 0), meshCount(meshes.size(), 0);
+	model.meshes.reserve(model.meshes.size() + primitives.size());
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		meshFirst[m] = static_cast<unsigned int>(model.meshes.size());
+		for (size_t p = meshPrimitives[m]; p < meshPrimitives[m + 1]; p++)
+		{
+			Primitive& primitive = primitives[p];
+			if (!primitive.valid)
+				continue;
+
+			std::vector<Texture> textures;
+			if (primitive.material >= 0 && primitive.material < static_cast<int>(materials.size()))
+				textures = materials[primitive.material];
+
+			if (primitive.processed)
+			{
+				model.meshes.push_back(Mesh(std::move(primitive.processedVertices), std::move(primitive.processedIndices), std::move(textures), primitive.format));
+
+				Mesh& mesh = model.meshes.back();
+				mesh.bounds = primitive.bounds;
+				mesh.sphere = primitive.sphere;
+				mesh.lods = std::move(primitive.lods);
+
+				if (model.geometryRetention == GeometryRetention::Release)
+					mesh.releaseGeometry();
+				continue;
+			}
+
+			model.meshes.push_back(Mesh(primitive.vertexData, primitive.vertexCount, primitive.indexData, primitive.indexCount, primitive.indexType,
+				std::move(textures), primitive.format));
+
+			Mesh& mesh = model.meshes.back();
+			mesh.bounds = primitive.bounds;
+			mesh.sphere = primitive.sphere;
+
+			if (model.geometryRetention == GeometryRetention::Keep)
+			{
+				mesh.vertices = UnpackVertices(primitive.vertexData, primitive.vertexCount, primitive.format);
+				if (primitive.indexType == GL_UNSIGNED_SHORT)
+				{
+					const uint16_t* indices = static_cast<const uint16_t*>(primitive.indexData);
+					mesh.indices.assign(indices, indices + primitive.indexCount);
+				}
+				else
+				{
+					const uint32_t* indices = static_cast<const uint32_t*>(primitive.indexData);
+					mesh.indices.assign(indices, indices + primitive.indexCount);
+				}
+			}
+		}
+		meshCount[m] = static_cast<unsigned int>(model.meshes.size()) - meshFirst[m];
+	}
+
+	// One root above the scene's nodes, the model's bounds are the first node's
+	const JsonValue& scenes = document.json["scenes"];
+	const JsonValue& scene = scenes[static_cast<size_t>(document.json["scene"].getInt(0))];
+	const JsonValue& nodes = document.json["nodes"];
+
+	model.nodes.clear();
+	model.nodes.emplace_back();
+	model.nodes[0].name = scene["name"].getString();
+
+	std::vector<bool> visited(nodes.size(), false);
+	if (scene.isObject())
+	{
+		for (const JsonValue& root : scene["nodes"].getElements())
+			AddNode(document, root.getInt(), 0, meshFirst, meshCount, visited, model);
+	}
+	else
+	{
+		// Without scenes every node that is nobody's child is a root
+		std::vector<bool> isChild(nodes.size(), false);
+		for (const JsonValue& node : nodes.getElements())
+		{
+			for (const JsonValue& child : node["children"].getElements())
+			{
+				if (child.getSize(nodes.size()) < nodes.size())
+					isChild[child.getSize()] = true;
+			}
+		}
+
+		for (size_t n = 0; n < nodes.size(); n++)
+		{
+			if (!isChild[n])
+				AddNode(document, static_cast<int>(n), 0, meshFirst, meshCount, visited, model);
+		}
+	}
+
+	model.ComputeNodeBounds();
+	model.BuildHierarchy();
+
+	return true;
+}
+
+bool GltfLoader::OpenDocument(const std::string& path, Document& document)
+{
+	document.path = path;
+	document.directory = path.substr(0, path.find_last_of("/\\"));
+	if (path.find_last_of("/\\") == std::string::npos)
+		document.directory = ".";
+
+	if (!document.file.open(path))
+	{
+		std::cout << "ERROR::GLTF:: Could not open " << path << std::endl;
+		return false;
+	}
+
+	const unsigned char* data = document.file.data();
+	const size_t size = document.file.size();
+
+	// .gltf files are the JSON alone
+	if (size < 12 || std::memcmp(data, "glTF", 4) != 0)
+		return JsonValue::parse(reinterpret_cast<const char*>(data), size, document.json);
+
+	// .glb: a 12 byte header, then a JSON chunk and an optional binary chunk, each with its length and type
+	uint32_t header[3];
+	std::memcpy(header, data, sizeof(header));
+	if (header[1] != 2 || header[2] > size)
+	{
+		std::cout << "ERROR::GLTF:: " << path << " is not a version 2 binary glTF file" << std::endl;
+		return false;
+	}
+
+	const char* json = nullptr;
+	size_t jsonSize = 0;
+	for (size_t offset = 12; offset + 8 <= header[2];)
+	{
+		uint32_t chunk[2];
+		std::memcpy(chunk, data + offset, sizeof(chunk));
+		offset += 8;
+		if (chunk[0] > header[2] - offset)
+			break;
+
+		if (chunk[1] == 0x4E4F534A && !json)			// "JSON"
+		{
+			json = reinterpret_cast<const char*>(data + offset);
+			jsonSize = chunk[0];
+		}
+		else if (chunk[1] == 0x004E4942 && document.buffers.empty())	// "BIN\0", buffer 0 when it has no URI
+		{
+			document.buffers.emplace_back(data + offset, chunk[0]);
+		}
+
+		offset += (chunk[0] + 3) & ~size_t(3);
+	}
+
+	if (!json)
+	{
+		std::cout << "ERROR::GLTF:: " << path << " has no JSON chunk" << std::endl;
+		return false;
+	}
+
+	return JsonValue::parse(json, jsonSize, document.json);
+}
+
+bool GltfLoader::LoadBuffers(Document& document)
+{
+	std::pair<const unsigned char*, size_t> binaryChunk(nullptr, 0);
+	if (!document.buffers.empty())
+		binaryChunk = document.buffers[0];
+	document.buffers.clear();
+
+	for (const JsonValue& buffer : document.json["buffers"].getElements())
+	{
+		const std::string& uri = buffer["uri"].getString();
+		size_t byteLength = buffer["byteLength"].getSize();
+
+		if (uri.empty())
+		{
+			document.buffers.push_back(binaryChunk);
+		}
+		else if (uri.compare(0, 5, "data:") == 0)
+		{
+			size_t comma = uri.find(',');
+			document.decodedBuffers.emplace_back();
+			if (comma == std::string::npos || !DecodeBase64(std::string_view(uri).substr(comma + 1), document.decodedBuffers.back()))
+			{
+				std::cout << "ERROR::GLTF:: Could not decode an embedded buffer" << std::endl;
+				return false;
+			}
+			document.buffers.emplace_back(document.decodedBuffers.back().data(), document.decodedBuffers.back().size());
+		}
+		else
+		{
+			document.bufferFiles.push_back(std::make_unique<MappedFile>());
+			MappedFile& file = *document.bufferFiles.back();
+			if (!file.open(document.directory + '/' + DecodeUri(uri)))
+			{
+				std::cout << "ERROR::GLTF:: Could not open buffer " << uri << std::endl;
+				return false;
+			}
+			document.buffers.emplace_back(file.data(), file.size());
+		}
+
+		if (document.buffers.back().second < byteLength)
+		{
+			std::cout << "ERROR::GLTF:: Buffer " << document.buffers.size() - 1 << " is shorter than its byteLength" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool GltfLoader::ReadAccessor(const Document& document, int index, Accessor& accessor)
+{
+	const JsonValue& source = document.json["accessors"][static_cast<size_t>(index)];
+	if (!source.isObject())
+		return false;
+
+	static const std::pair<const char*, int> types[] = { { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 } };
+	accessor.components = 0;
+	for (const auto& [name, components] : types)
+	{
+		if (source["type"].getString() == name)
+			accessor.components = components;
+	}
+
+	accessor.componentType = source["componentType"].getInt(0);
+	accessor.count = source["count"].getSize();
+	accessor.normalized = source["normalized"].getBool();
+	accessor.bufferView = source["bufferView"].getInt(-1);
+
+	if (accessor.components == 0 || accessor.getComponentSize() == 0)
+	{
+		std::cout << "ERROR::GLTF:: Accessor " << index << " has an unsupported type" << std::endl;
+		return false;
+	}
+
+	if (source["sparse"].isObject())
+	{
+		std::cout << "ERROR::GLTF:: Sparse accessor " << index << " is not supported" << std::endl;
+		return false;
+	}
+
+	// Accessors without a buffer view are all zeros
+	if (accessor.bufferView < 0)
+	{
+		std::cout << "ERROR::GLTF:: Accessor " << index << " has no buffer view, which is not supported" << std::endl;
+		return false;
+	}
+
+	const JsonValue& view = document.json["bufferViews"][static_cast<size_t>(accessor.bufferView)];
+	size_t buffer = view["buffer"].getSize(document.buffers.size());
+	if (buffer >= document.buffers.size() || !document.buffers[buffer].first)
+		return false;
+
+	size_t viewOffset = view["byteOffset"].getSize();
+	size_t viewLength = view["byteLength"].getSize();
+	accessor.viewOffset = source["byteOffset"].getSize();
+	accessor.stride = view["byteStride"].getSize(accessor.getElementSize());
+
+	// The last element has to end inside the view, and the view inside the buffer. Checked with subtractions and a
+	// division instead of adding up the extent, so huge counts and offsets from the file can't wrap around.
+	const size_t bufferSize = document.buffers[buffer].second;
+	const size_t elementSize = accessor.getElementSize();
+	bool fits = viewOffset <= bufferSize && viewLength <= bufferSize - viewOffset && accessor.stride >= elementSize;
+	if (fits && accessor.count > 0)
+	{
+		fits = accessor.viewOffset <= viewLength && elementSize <= viewLength - accessor.viewOffset &&
+			accessor.count - 1 <= (viewLength - accessor.viewOffset - elementSize) / accessor.stride;
+	}
+
+	if (!fits)
+	{
+		std::cout << "ERROR::GLTF:: Accessor " << index << " reaches past its buffer" << std::endl;
+		return false;
+	}
+
+	accessor.data = document.buffers[buffer].first + viewOffset + accessor.viewOffset;
+	return true;
+}
+
+size_t GltfLoader::Accessor::getComponentSize() const
+{
+	switch (componentType)
+	{
+	case BYTE:
+	case UNSIGNED_BYTE:		return 1;
+	case SHORT:
+	case UNSIGNED_SHORT:	return 2;
+	case UNSIGNED_INT:
+	case FLOAT:				return 4;
+	default:				return 0;
+	}
+}
+
+GLenum GltfLoader::Accessor::getGLType() const
+{
+	switch (componentType)
+	{
+	case BYTE:				return GL_BYTE;
+	case UNSIGNED_BYTE:		return GL_UNSIGNED_BYTE;
+	case SHORT:				return GL_SHORT;
+	case UNSIGNED_SHORT:	return GL_UNSIGNED_SHORT;
+	case UNSIGNED_INT:		return GL_UNSIGNED_INT;
+	default:				return GL_FLOAT;
+	}
+}
+
+glm::vec4 GltfLoader::Accessor::readFloat4(size_t i) const
+{
+	const unsigned char* element = data + i * stride;
+	float values[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (int c = 0; c < components; c++)
+	{
+		switch (componentType)
+		{
+		case FLOAT:
+			std::memcpy(&values[c], element + c * 4, 4);
+			break;
+		case UNSIGNED_BYTE:
+			values[c] = element[c] / (normalized ? 255.0f : 1.0f);
+			break;
+		case BYTE:
+			values[c] = normalized ? std::max(static_cast<int8_t>(element[c]) / 127.0f, -1.0f) : static_cast<int8_t>(element[c]);
+			break;
+		case UNSIGNED_SHORT:
+		{
+			uint16_t value;
+			std::memcpy(&value, element + c * 2, 2);
+			values[c] = value / (normalized ? 65535.0f : 1.0f);
+			break;
+		}
+		case SHORT:
+		{
+			int16_t value;
+			std::memcpy(&value, element + c * 2, 2);
+			values[c] = normalized ? std::max(value / 32767.0f, -1.0f) : value;
+			break;
+		}
+		case UNSIGNED_INT:
+		{
+			uint32_t value;
+			std::memcpy(&value, element + c * 4, 4);
+			values[c] = static_cast<float>(value);
+			break;
+		}
+		}
+	}
+
+	return glm::vec4(values[0], values[1], values[2], values[3]);
+}
+
+uint32_t GltfLoader::Accessor::readIndex(size_t i) const
+{
+	const unsigned char* element = data + i * stride;
+	if (componentType == UNSIGNED_BYTE)
+		return element[0];
+
+	if (componentType == UNSIGNED_SHORT)
+	{
+		uint16_t value;
+		std::memcpy(&value, element, 2);
+		return value;
+	}
+
+	uint32_t value;
+	std::memcpy(&value, element, 4);
+	return value;
+}
+
+void GltfLoader::BuildPrimitive(const Document& document, const Model& model, Primitive& primitive)
+{
+	const JsonValue& source = *primitive.source;
+	const JsonValue& attributes = source["attributes"];
+	primitive.material = source["material"].getInt(-1);
+
+	if (source["mode"].getInt(4) != 4)
+	{
+		std::cout << "WARNING::GLTF:: Skipped a primitive that is not a triangle list" << std::endl;
+		return;
+	}
+
+	// Sources for the attribute locations of VertexFormat, bitangents (4) come from the normal and tangent
+	static const char* names[] = { "POSITION", "NORMAL", "TEXCOORD_0", "TANGENT" };
+	Accessor sources[4];
+	for (int location = 0; location < 4; location++)
+	{
+		int index = attributes[names[location]].getInt(-1);
+		if (index >= 0 && !ReadAccessor(document, index, sources[location]))
+			return;
+	}
+
+	const Accessor& positions = sources[0];
+	if (!positions.data || positions.components != 3)
+	{
+		std::cout << "ERROR::GLTF:: Primitive without vec3 positions" << std::endl;
+		return;
+	}
+	primitive.vertexCount = positions.count;
+
+	for (int location = 1; location < 4; location++)
+	{
+		if (sources[location].data && sources[location].count != primitive.vertexCount)
+		{
+			std::cout << "ERROR::GLTF:: " << names[location] << " has a different vertex count than POSITION" << std::endl;
+			return;
+		}
+	}
+
+	// 16 and 32 bit indices go up as they are, 8 bit ones are widened and unindexed triangles get a list
+	int indexAccessor = source["indices"].getInt(-1);
+	if (indexAccessor >= 0)
+	{
+		Accessor indices;
+		if (!ReadAccessor(document, indexAccessor, indices) || indices.components != 1)
+			return;
+
+		primitive.indexCount = indices.count;
+		if (indices.componentType == UNSIGNED_SHORT || indices.componentType == UNSIGNED_INT)
+		{
+			primitive.indexType = indices.componentType == UNSIGNED_SHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			primitive.indexData = indices.data;
+		}
+		else
+		{
+			primitive.indexType = GL_UNSIGNED_SHORT;
+			primitive.indices.resize(indices.count * sizeof(uint16_t));
+			uint16_t* out = reinterpret_cast<uint16_t*>(primitive.indices.data());
+			for (size_t i = 0; i < indices.count; i++)
+				out[i] = static_cast<uint16_t>(indices.readIndex(i));
+			primitive.indexData = out;
+		}
+
+		for (size_t i = 0; i < indices.count; i++)
+		{
+			if (indices.readIndex(i) >= primitive.vertexCount)
+			{
+				std::cout << "ERROR::GLTF:: Index " << indices.readIndex(i) << " is past the primitive's " << primitive.vertexCount << " vertices" << std::endl;
+				return;
+			}
+		}
+	}
+	else
+	{
+		SetListIndices(primitive, primitive.vertexCount);
+	}
+
+	std::vector<uint32_t> corners;
+	std::vector<glm::vec3> generatedNormals;
+	if (!sources[1].data)
+		generatedNormals = GenerateFlatNormals(positions, primitive, corners);
+
+	if (!GatherVertices(sources, corners, generatedNormals, primitive))
+		return;
+
+	if (model.meshOptimization.getKey() != 0 || model.lodGeneration.maxLods > 1)
+	{
+		ProcessPrimitive(model, primitive);
+	}
+	else
+	{
+		// Positions are the first attribute of every format
+		const unsigned int stride = primitive.format.getStride();
+		const glm::vec3* vertexPositions = static_cast<const glm::vec3*>(primitive.vertexData);
+		primitive.bounds = ComputeBounds(vertexPositions, primitive.vertexCount, stride);
+		primitive.sphere = ComputeBoundingSphere(vertexPositions, primitive.vertexCount, stride, primitive.bounds);
+	}
+
+	primitive.valid = true;
+}
+
+void GltfLoader::SetListIndices(Primitive& primitive, size_t count)
+{
+	primitive.indexCount = count;
+	primitive.indexType = IndexTypeFor(count);
+	primitive.indices.resize(count * IndexSize(primitive.indexType));
+	for (size_t i = 0; i < count; i++)
+	{
+		if (primitive.indexType == GL_UNSIGNED_SHORT)
+			reinterpret_cast<uint16_t*>(primitive.indices.data())[i] = static_cast<uint16_t>(i);
+		else
+			reinterpret_cast<uint32_t*>(primitive.indices.data())[i] = static_cast<uint32_t>(i);
+	}
+	primitive.indexData = primitive.indices.data();
+}
+
+void GltfLoader::ProcessPrimitive(const Model& model, Primitive& primitive)
+{
+	std::vector<Vertex>& vertices = primitive.processedVertices;
+	std::vector<unsigned int>& indices = primitive.processedIndices;
+
+	vertices = UnpackVertices(primitive.vertexData, primitive.vertexCount, primitive.format);
+	indices.resize(primitive.indexCount);
+	for (size_t i = 0; i < primitive.indexCount; i++)
+	{
+		if (primitive.indexType == GL_UNSIGNED_SHORT)
+			indices[i] = static_cast<const uint16_t*>(primitive.indexData)[i];
+		else
+			std::memcpy(&indices[i], static_cast<const unsigned char*>(primitive.indexData) + i * 4, 4);
+	}
+
+	// The same steps as Model::ProcessMesh
+	primitive.stats = MeshOptimizer::optimize(vertices, indices, model.meshOptimization);
+	primitive.lods = MeshSimplifier::generateLods(vertices, indices, model.lodGeneration);
+	primitive.bounds = ComputeBounds(&vertices.data()->vPosition, vertices.size(), sizeof(Vertex));
+	primitive.sphere = ComputeBoundingSphere(&vertices.data()->vPosition, vertices.size(), sizeof(Vertex), primitive.bounds);
+
+	// The packed copies are not needed anymore
+	primitive.vertices = std::vector<unsigned char>();
+	primitive.indices = std::vector<unsigned char>();
+	primitive.vertexData = nullptr;
+	primitive.indexData = nullptr;
+	primitive.processed = true;
+}
+
+bool GltfLoader::GatherVertices(const Accessor* sources, const std::vector<uint32_t>& corners, const std::vector<glm::vec3>& generatedNormals, Primitive& primitive)
+{
+	const VertexFormat& format = primitive.format;
+	const std::vector<VertexAttribute> attributes = format.getAttributes();
+	const unsigned int stride = format.getStride();
+	const size_t count = primitive.vertexCount;
+
+	auto matches = [](const Accessor& source, const VertexAttribute& attribute)
+	{
+		return source.data && source.getGLType() == attribute.type && source.components == attribute.count &&
+			source.normalized == (attribute.normalized != GL_FALSE);
+	};
+
+	auto sourceVertex = [&corners](size_t i) -> size_t { return corners.empty() ? i : corners[i]; };
+
+	// Interleaved exactly like the format (same buffer view, stride and offsets): the mapping is the vertex buffer
+	bool interleaved = generatedNormals.empty() && corners.empty();
+	for (const VertexAttribute& attribute : attributes)
+	{
+		const Accessor& source = sources[std::min<GLuint>(attribute.location, 3)];
+		interleaved = interleaved && attribute.location < 4 && matches(source, attribute) && source.bufferView == sources[0].bufferView &&
+			source.stride == stride && source.viewOffset == sources[0].viewOffset + attribute.offset;
+	}
+
+	if (interleaved)
+	{
+		primitive.vertexData = sources[0].data;
+		return true;
+	}
+
+	primitive.vertices.assign(count * stride, 0);
+	unsigned char* out = primitive.vertices.data();
+
+	for (const VertexAttribute& attribute : attributes)
+	{
+		unsigned char* dst = out + attribute.offset;
+
+		// Same encoding: a strided copy without looking at the values
+		if (attribute.location < 4 && matches(sources[attribute.location], attribute))
+		{
+			const Accessor& source = sources[attribute.location];
+			const size_t size = source.getElementSize();
+			for (size_t i = 0; i < count; i++)
+				std::memcpy(dst + i * stride, source.data + sourceVertex(i) * source.stride, size);
+			continue;
+		}
+
+		const Accessor& normals = sources[1];
+		const Accessor& tangents = sources[3];
+		auto normal = [&](size_t i) { return normals.data ? glm::vec3(normals.readFloat4(sourceVertex(i))) : generatedNormals[i]; };
+
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned char* element = dst + i * stride;
+			const size_t s = sourceVertex(i);
+			uint32_t word = 0;
+
+			switch (attribute.location)
+			{
+			case 0:
+			{
+				glm::vec3 position(sources[0].readFloat4(s));
+				std::memcpy(element, &position, 12);
+				break;
+			}
+			case 1:
+			{
+				glm::vec3 n = normal(i);
+				if (format.normals == VertexFormat::Normals::Float)
+					std::memcpy(element, &n, 12);
+				else
+				{
+					word = glm::packSnorm2x16(OctahedralEncode(n));
+					std::memcpy(element, &word, 4);
+				}
+				break;
+			}
+			case 2:
+			{
+				// Missing texture coordinates stay zero
+				if (!sources[2].data)
+					break;
+
+				glm::vec4 value = sources[2].readFloat4(s);
+				glm::vec2 texCoord(value.x, value.y);
+				if (format.texCoords == VertexFormat::TexCoords::Float)
+					std::memcpy(element, &texCoord, 8);
+				else
+				{
+					word = format.texCoords == VertexFormat::TexCoords::Half ? glm::packHalf2x16(texCoord) : glm::packUnorm2x16(texCoord);
+					std::memcpy(element, &word, 4);
+				}
+				break;
+			}
+			case 3:
+			{
+				glm::vec4 tangent = tangents.data ? tangents.readFloat4(s) : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+				if (format.tangents == VertexFormat::Tangents::Float)
+					std::memcpy(element, &tangent, 12);
+				else if (format.tangents == VertexFormat::Tangents::Float4)
+					std::memcpy(element, &tangent, 16);
+				else
+				{
+					float length = glm::length(glm::vec3(tangent));
+					glm::vec3 direction = length > 0.0f ? glm::vec3(tangent) / length : glm::vec3(0.0f);
+					word = glm::packSnorm3x10_1x2(glm::vec4(direction, tangent.w < 0.0f ? -1.0f : 1.0f));
+					std::memcpy(element, &word, 4);
+				}
+				break;
+			}
+			case 4:
+			{
+				// glTF keeps the handedness in the tangent's w instead of storing bitangents
+				glm::vec4 tangent = tangents.data ? tangents.readFloat4(s) : glm::vec4(0.0f);
+				glm::vec3 bitangent = glm::cross(normal(i), glm::vec3(tangent)) * (tangent.w < 0.0f ? -1.0f : 1.0f);
+				std::memcpy(element, &bitangent, 12);
+				break;
+			}
+			}
+		}
+	}
+
+	primitive.vertexData = primitive.vertices.data();
+	return true;
+}
+
+std::vector<glm::vec3> GltfLoader::GenerateFlatNormals(const Accessor& positions, Primitive& primitive, std::vector<uint32_t>& corners)
+{
+	const size_t count = primitive.indexCount / 3 * 3;
+	std::vector<glm::vec3> normals(count);
+	corners.resize(count);
+
+	auto index = [&primitive](size_t i) -> uint32_t
+	{
+		if (primitive.indexType == GL_UNSIGNED_SHORT)
+			return static_cast<const uint16_t*>(primitive.indexData)[i];
+
+		uint32_t value;
+		std::memcpy(&value, static_cast<const unsigned char*>(primitive.indexData) + i * 4, 4);
+		return value;
+	};
+
+	for (size_t i = 0; i < count; i += 3)
+	{
+		uint32_t a = index(i), b = index(i + 1), c = index(i + 2);
+		glm::vec3 pa(positions.readFloat4(a)), pb(positions.readFloat4(b)), pc(positions.readFloat4(c));
+		glm::vec3 face = glm::cross(pb - pa, pc - pa);
+		float length = glm::length(face);
+		face = length > 0.0f ? face / length : glm::vec3(0.0f, 1.0f, 0.0f);
+
+		corners[i] = a;
+		corners[i + 1] = b;
+		corners[i + 2] = c;
+		normals[i] = normals[i + 1] = normals[i + 2] = face;
+	}
+
+	primitive.vertexCount = count;
+	SetListIndices(primitive, count);
+	return normals;
+}
+
+std::vector<std::vector<Texture>> GltfLoader::LoadMaterials(const Document& document, Model& model)
+{
+	const JsonValue& materials = document.json["materials"];
+	const JsonValue& textures = document.json["textures"];
+	const JsonValue& images = document.json["images"];
+
+	// The shaders' sampler names: base color is the diffuse texture, metallic-roughness takes the specular slot
+	static const std::pair<const char*, const char*> slots[] = {
+		{ "baseColorTexture", "texture_diffuse" },
+		{ "metallicRoughnessTexture", "texture_specular" },
+		{ "normalTexture", "texture_normal" }
+	};
+
+	auto imageOf = [&](const JsonValue& material, const char* slot)
+	{
+		const JsonValue& reference = std::strcmp(slot, "normalTexture") == 0 ? material[slot] : material["pbrMetallicRoughness"][slot];
+		const JsonValue& texture = textures[static_cast<size_t>(reference["index"].getInt(-1))];
+		return texture["source"].getInt(-1);
+	};
+
+	// Images that are inside a buffer are named after the file, so loading the file twice finds them again
+	auto imagePath = [&](int image)
+	{
+		const std::string& uri = images[static_cast<size_t>(image)]["uri"].getString();
+		if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+			return DecodeUri(uri);
+		return document.path + "#image" + std::to_string(image);
+	};
+
+	std::vector<int> used;
+	for (const JsonValue& material : materials.getElements())
+	{
+		for (const auto& [slot, typeName] : slots)
+		{
+			int image = imageOf(material, slot);
+			if (image >= 0 && image < static_cast<int>(images.size()))
+				used.push_back(image);
+		}
+	}
+	std::sort(used.begin(), used.end());
+	used.erase(std::unique(used.begin(), used.end()), used.end());
+
+	used.erase(std::remove_if(used.begin(), used.end(), [&](int image)
+	{
+		std::string path = imagePath(image);
+		return std::any_of(model.textures_loaded.begin(), model.textures_loaded.end(), [&path](const Texture& texture) { return texture.path == path; });
+	}), used.end());
+
+	// Decoding happens on the thread pool, straight from the mapped buffer for embedded images
+	std::vector<TextureImage> decoded(used.size());
+	ThreadPool::getInstance().parallelFor(used.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const JsonValue& image = images[static_cast<size_t>(used[i])];
+			const std::string& uri = image["uri"].getString();
+
+			if (!uri.empty() && uri.compare(0, 5, "data:") != 0)
+			{
+				decoded[i] = DecodeTextureFile(DecodeUri(uri).c_str(), document.directory);
+				continue;
+			}
+
+			std::vector<unsigned char> embedded;
+			const unsigned char* bytes = nullptr;
+			size_t size = 0;
+			if (!uri.empty())
+			{
+				size_t comma = uri.find(',');
+				if (comma != std::string::npos && DecodeBase64(std::string_view(uri).substr(comma + 1), embedded))
+				{
+					bytes = embedded.data();
+					size = embedded.size();
+				}
+			}
+			else
+			{
+				const JsonValue& view = document.json["bufferViews"][static_cast<size_t>(image["bufferView"].getInt(-1))];
+				size_t buffer = view["buffer"].getSize(document.buffers.size());
+				size_t offset = view["byteOffset"].getSize(), length = view["byteLength"].getSize();
+				if (buffer < document.buffers.size() && offset + length <= document.buffers[buffer].second)
+				{
+					bytes = document.buffers[buffer].first + offset;
+					size = length;
+				}
+			}
+
+			// The name is not a file, so the residency manager has nothing to reload these from and keeps them resident
+			decoded[i].filename = imagePath(used[i]);
+			decoded[i].flipped = GetFlipVerticallyOnLoad();
+			decoded[i].reloadable = false;
+			if (bytes)
+				decoded[i].data = stbi_load_from_memory(bytes, static_cast<int>(size), &decoded[i].width, &decoded[i].height, &decoded[i].components, 0);
+		}
+	});
+
+	for (size_t i = 0; i < used.size(); i++)
+	{
+		std::string path = imagePath(used[i]);
+
+		Texture texture;
+		texture.id = TextureFromImage(decoded[i], path.c_str(), model.gammaCorrection);
+		texture.path = path;
+		model.textures_loaded.push_back(texture);
+	}
+
+	std::vector<std::vector<Texture>> result(materials.size());
+	for (size_t m = 0; m < materials.size(); m++)
+	{
+		for (const auto& [slot, typeName] : slots)
+		{
+			int image = imageOf(materials[m], slot);
+			if (image >= 0 && image < static_cast<int>(images.size()))
+				result[m].push_back(model.FindTexture(imagePath(image), typeName));
+		}
+	}
+
+	return result;
+}
+
+void GltfLoader::AddNode(const Document& document, int node, int parent, const std::vector<unsigned int>& meshFirst,
+	const std::vector<unsigned int>& meshCount, std::vector<bool>& visited, Model& model)
+{
+	// A node can only be in the tree once, which also stops cycles in broken files
+	if (node < 0 || node >= static_cast<int>(visited.size()) || visited[node])
+		return;
+	visited[node] = true;
+
+	const JsonValue& source = document.json["nodes"][static_cast<size_t>(node)];
+
+	int index = static_cast<int>(model.nodes.size());
+	model.nodes.emplace_back();
+	model.nodes[index].name = source["name"].getString();
+	model.nodes[index].parent = parent;
+	model.nodes[index].transform = NodeTransform(source);
+
+	int mesh = source["mesh"].getInt(-1);
+	if (mesh >= 0 && mesh < static_cast<int>(meshFirst.size()))
+	{
+		model.nodes[index].firstMesh = meshFirst[mesh];
+		model.nodes[index].meshCount = meshCount[mesh];
+	}
+
+	for (const JsonValue& child : source["children"].getElements())
+		AddNode(document, child.getInt(), index, meshFirst, meshCount, visited, model);
+}
+
+glm::mat4 GltfLoader::NodeTransform(const JsonValue& node)
+{
+	const JsonValue& matrix = node["matrix"];
+	if (matrix.size() == 16)
+	{
+		// Column major like glm
+		float values[16];
+		for (size_t i = 0; i < 16; i++)
+			values[i] = static_cast<float>(matrix[i].getNumber());
+
+		return glm::mat4(values[0], values[1], values[2], values[3], values[4], values[5], values[6], values[7],
+			values[8], values[9], values[10], values[11], values[12], values[13], values[14], values[15]);
+	}
+
+	const JsonValue& t = node["translation"];
+	const JsonValue& r = node["rotation"];
+	const JsonValue& s = node["scale"];
+
+	glm::vec3 translation(float(t[0].getNumber(0.0)), float(t[1].getNumber(0.0)), float(t[2].getNumber(0.0)));
+	glm::quat rotation(float(r[3].getNumber(1.0)), float(r[0].getNumber(0.0)), float(r[1].getNumber(0.0)), float(r[2].getNumber(0.0)));
+	glm::vec3 scale(float(s[0].getNumber(1.0)), float(s[1].getNumber(1.0)), float(s[2].getNumber(1.0)));
+
+	return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+}
+
+bool GltfLoader::DecodeBase64(std::string_view text, std::vector<unsigned char>& out)
+{
+	auto value = [](char c) -> int
+	{
+		if (c >= 'A' && c <= 'Z') return c - 'A';
+		if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+		if (c >= '0' && c <= '9') return c - '0' + 52;
+		if (c == '+') return 62;
+		if (c == '/') return 63;
+		return -1;
+	};
+
+	out.clear();
+	out.reserve(text.size() / 4 * 3);
+
+	uint32_t bits = 0;
+	int bitCount = 0;
+	for (char c : text)
+	{
+		if (c == '=')
+			break;
+
+		int v = value(c);
+		if (v < 0)
+			return false;
+
+		bits = (bits << 6) | uint32_t(v);
+		bitCount += 6;
+		if (bitCount >= 8)
+		{
+			bitCount -= 8;
+			out.push_back(static_cast<unsigned char>(bits >> bitCount));
+		}
+	}
+
+	return true;
+}
+
+std::string GltfLoader::DecodeUri(const std::string& uri)
+{
+	// Relative URIs escape spaces and the like as %XX
+	std::string path;
+	path.reserve(uri.size());
+	for (size_t i = 0; i < uri.size(); i++)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size() && std::isxdigit(static_cast<unsigned char>(uri[i + 1])) && std::isxdigit(static_cast<unsigned char>(uri[i + 2])))
+		{
+			path += static_cast<char>(std::stoi(uri.substr(i + 1, 2), nullptr, 16));
+			i += 2;
+		}
+		else
+		{
+			path += uri[i];
+		}
+	}
+	return path;
+}
+
+void Model::load(const std::string& path, bool gamma)
+{
+	gammaCorrection = gamma;
+
+	if (GltfLoader::isGltfFile(path))
+		GltfLoader::load(path, *this);
+	else
+		LoadModel(path);
+}
@@ -2,6 +2,11 @@
 
 #include <glad/glad.h>
 
+#include "DSA.h"
+#include "GLState.h"
+
+#include <utility>
+
 class IndexBuffer
 {
 private:
@@ -10,6 +15,15 @@ private:
 public:
 	IndexBuffer() = default;
 
+	// Owns the GL object, so it can be moved but not copied
+	IndexBuffer(const IndexBuffer&) = delete;
+	IndexBuffer& operator=(const IndexBuffer&) = delete;
+
+	IndexBuffer(IndexBuffer&& other) noexcept;
+	IndexBuffer& operator=(IndexBuffer&& other) noexcept;
+
+	~IndexBuffer();
+
 	void generate();
 
 	void bind() const;
@@ -18,35 +32,73 @@ public:
 
 	void setBuffer(size_t bytes, const void* data) const;
 
-	void free() const;
+	void free();
 
 	const unsigned int getID() const;
 };
 
+IndexBuffer::IndexBuffer(IndexBuffer&& other) noexcept
+	: m_IndexBufferID(other.m_IndexBufferID)
+{
+	other.m_IndexBufferID = 0;
+}
+
+IndexBuffer& IndexBuffer::operator=(IndexBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		free();
+		std::swap(m_IndexBufferID, other.m_IndexBufferID);
+	}
+	return *this;
+}
+
+IndexBuffer::~IndexBuffer()
+{
+	free();
+}
+
 void IndexBuffer::generate()
 {
+	// With DSA the buffer is created without attaching it to the bound vertex array
+	if (DSA::isAvailable())
+	{
+		DSA::CreateBuffers(1, &m_IndexBufferID);
+		return;
+	}
+
 	glGenBuffers(1, &m_IndexBufferID);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferID);
+	GLState::getInstance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferID);
 }
 
 void IndexBuffer::bind() const
 {
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferID);
+	GLState::getInstance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBufferID);
 }
 
 void IndexBuffer::unbind() const
 {
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	GLState::getInstance().bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 void IndexBuffer::setBuffer(size_t bytes, const void* data) const
 {
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+	if (DSA::isAvailable())
+		DSA::NamedBufferData(m_IndexBufferID, bytes, data, GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
 }
 
-void IndexBuffer::free() const
+// Deleting is safe to repeat, the destructor calls this as well
+void IndexBuffer::free()
 {
-	glDeleteBuffers(1, &m_IndexBufferID);
+	if (m_IndexBufferID != 0)
+	{
+		GLState::getInstance().forgetBuffer(m_IndexBufferID);
+		glDeleteBuffers(1, &m_IndexBufferID);
+	}
+
+	m_IndexBufferID = 0;
 }
 
 const unsigned int IndexBuffer::getID() const
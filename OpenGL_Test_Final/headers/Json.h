@@ -0,0 +1,334 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <cctype>
+
+// Read-only JSON document tree, enough for the files the loaders read (glTF). Looking up a key or index that isn't
+// there gives a null value instead of failing, so optional properties read as value["a"]["b"].getNumber(fallback).
+class JsonValue
+{
+public:
+	enum class Type : uint8_t { Null, Bool, Number, String, Array, Object };
+
+private:
+	Type m_Type = Type::Null;
+	bool m_Bool = false;
+	double m_Number = 0.0;
+	std::string m_String;
+	std::vector<JsonValue> m_Elements;
+	std::vector<std::pair<std::string, JsonValue>> m_Members;		// In file order, lookups are linear
+
+	// Deeper documents are rejected instead of running out of stack
+	static constexpr int MAX_DEPTH = 256;
+
+public:
+	Type getType() const { return m_Type; }
+
+	bool isNull() const { return m_Type == Type::Null; }
+	bool isNumber() const { return m_Type == Type::Number; }
+	bool isString() const { return m_Type == Type::String; }
+	bool isArray() const { return m_Type == Type::Array; }
+	bool isObject() const { return m_Type == Type::Object; }
+
+	bool getBool(bool fallback = false) const { return m_Type == Type::Bool ? m_Bool : fallback; }
+	double getNumber(double fallback = 0.0) const { return m_Type == Type::Number ? m_Number : fallback; }
+	int getInt(int fallback = -1) const { return m_Type == Type::Number ? static_cast<int>(m_Number) : fallback; }
+	size_t getSize(size_t fallback = 0) const { return m_Type == Type::Number && m_Number >= 0.0 ? static_cast<size_t>(m_Number) : fallback; }
+	const std::string& getString() const { return m_String; }
+
+	// Elements of an array or members of an object, 0 for anything else
+	size_t size() const { return m_Type == Type::Array ? m_Elements.size() : m_Members.size(); }
+
+	const JsonValue& operator[](size_t index) const;
+	const JsonValue& operator[](std::string_view key) const;
+
+	const std::vector<JsonValue>& getElements() const { return m_Elements; }
+	const std::vector<std::pair<std::string, JsonValue>>& getMembers() const { return m_Members; }
+
+	static bool parse(const char* text, size_t size, JsonValue& value);
+
+private:
+	static const JsonValue& Null()
+	{
+		static const JsonValue null;
+		return null;
+	}
+
+	static bool ParseValue(const char*& p, const char* end, JsonValue& value, int depth);
+	static bool ParseString(const char*& p, const char* end, std::string& string);
+
+	static void SkipWhitespace(const char*& p, const char* end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+			p++;
+	}
+
+	static bool Match(const char*& p, const char* end, std::string_view word)
+	{
+		if (size_t(end - p) < word.size() || std::string_view(p, word.size()) != word)
+			return false;
+		p += word.size();
+		return true;
+	}
+
+	static void AppendUtf8(std::string& string, uint32_t codePoint);
+};
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	return m_Type == Type::Array && index < m_Elements.size() ? m_Elements[index] : Null();
+}
+
+const JsonValue& JsonValue::operator[](std::string_view key) const
+{
+	for (const auto& [name, member] : m_Members)
+	{
+		if (name == key)
+			return member;
+	}
+	return Null();
+}
+
+bool JsonValue::parse(const char* text, size_t size, JsonValue& value)
+{
+	const char* p = text;
+	const char* end = text + size;
+
+	value = JsonValue();
+	if (!ParseValue(p, end, value, 0))
+	{
+		std::cerr << "JSON parse error at byte " << (p - text) << std::endl;
+		return false;
+	}
+
+	SkipWhitespace(p, end);
+	if (p != end)
+	{
+		std::cerr << "JSON has trailing characters at byte " << (p - text) << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool JsonValue::ParseValue(const char*& p, const char* end, JsonValue& value, int depth)
+{
+	SkipWhitespace(p, end);
+	if (p >= end || depth > MAX_DEPTH)
+		return false;
+
+	switch (*p)
+	{
+	case '{':
+	{
+		value.m_Type = Type::Object;
+		p++;
+		SkipWhitespace(p, end);
+		if (p < end && *p == '}')
+		{
+			p++;
+			return true;
+		}
+
+		for (;;)
+		{
+			SkipWhitespace(p, end);
+			std::string key;
+			if (!ParseString(p, end, key))
+				return false;
+
+			SkipWhitespace(p, end);
+			if (p >= end || *p != ':')
+				return false;
+			p++;
+
+			value.m_Members.emplace_back(std::move(key), JsonValue());
+			if (!ParseValue(p, end, value.m_Members.back().second, depth + 1))
+				return false;
+
+			SkipWhitespace(p, end);
+			if (p < end && *p == ',')
+			{
+				p++;
+				continue;
+			}
+			if (p < end && *p == '}')
+			{
+				p++;
+				return true;
+			}
+			return false;
+		}
+	}
+	case '[':
+	{
+		value.m_Type = Type::Array;
+		p++;
+		SkipWhitespace(p, end);
+		if (p < end && *p == ']')
+		{
+			p++;
+			return true;
+		}
+
+		for (;;)
+		{
+			value.m_Elements.emplace_back();
+			if (!ParseValue(p, end, value.m_Elements.back(), depth + 1))
+				return false;
+
+			SkipWhitespace(p, end);
+			if (p < end && *p == ',')
+			{
+				p++;
+				continue;
+			}
+			if (p < end && *p == ']')
+			{
+				p++;
+				return true;
+			}
+			return false;
+		}
+	}
+	case '"':
+		value.m_Type = Type::String;
+		return ParseString(p, end, value.m_String);
+	case 't':
+		value.m_Type = Type::Bool;
+		value.m_Bool = true;
+		return Match(p, end, "true");
+	case 'f':
+		value.m_Type = Type::Bool;
+		value.m_Bool = false;
+		return Match(p, end, "false");
+	case 'n':
+		value.m_Type = Type::Null;
+		return Match(p, end, "null");
+	default:
+	{
+		// strtod needs a terminated string, numbers are short so they are copied out
+		const char* start = p;
+		while (p < end && (std::isdigit(static_cast<unsigned char>(*p)) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+			p++;
+
+		std::string number(start, p);
+		char* numberEnd = nullptr;
+		value.m_Type = Type::Number;
+		value.m_Number = std::strtod(number.c_str(), &numberEnd);
+		if (number.empty() || numberEnd != number.c_str() + number.size())
+		{
+			p = start;
+			return false;
+		}
+		return true;
+	}
+	}
+}
+
+bool JsonValue::ParseString(const char*& p, const char* end, std::string& string)
+{
+	if (p >= end || *p != '"')
+		return false;
+	p++;
+
+	auto readHex = [&p, end](uint32_t& codeUnit)
+	{
+		if (end - p < 4)
+			return false;
+
+		codeUnit = 0;
+		for (int i = 0; i < 4; i++, p++)
+		{
+			char c = *p;
+			uint32_t digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 16;
+			if (digit > 15)
+				return false;
+			codeUnit = codeUnit * 16 + digit;
+		}
+		return true;
+	};
+
+	while (p < end && *p != '"')
+	{
+		if (*p != '\\')
+		{
+			string += *p++;
+			continue;
+		}
+
+		if (++p >= end)
+			return false;
+
+		switch (*p++)
+		{
+		case '"':	string += '"'; break;
+		case '\\':	string += '\\'; break;
+		case '/':	string += '/'; break;
+		case 'b':	string += '\b'; break;
+		case 'f':	string += '\f'; break;
+		case 'n':	string += '\n'; break;
+		case 'r':	string += '\r'; break;
+		case 't':	string += '\t'; break;
+		case 'u':
+		{
+			uint32_t codePoint;
+			if (!readHex(codePoint))
+				return false;
+
+			// Characters outside the basic plane come as a surrogate pair
+			if (codePoint >= 0xD800 && codePoint < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+			{
+				p += 2;
+				uint32_t low;
+				if (!readHex(low) || low < 0xDC00 || low >= 0xE000)
+					return false;
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+			}
+
+			AppendUtf8(string, codePoint);
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+
+	if (p >= end)
+		return false;
+	p++;
+	return true;
+}
+
+void JsonValue::AppendUtf8(std::string& string, uint32_t codePoint)
+{
+	if (codePoint < 0x80)
+	{
+		string += static_cast<char>(codePoint);
+	}
+	else if (codePoint < 0x800)
+	{
+		string += static_cast<char>(0xC0 | (codePoint >> 6));
+		string += static_cast<char>(0x80 | (codePoint & 0x3F));
+	}
+	else if (codePoint < 0x10000)
+	{
+		string += static_cast<char>(0xE0 | (codePoint >> 12));
+		string += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		string += static_cast<char>(0x80 | (codePoint & 0x3F));
+	}
+	else
+	{
+		string += static_cast<char>(0xF0 | (codePoint >> 18));
+		string += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+		string += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+		string += static_cast<char>(0x80 | (codePoint & 0x3F));
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// Instance matrices sorted by LOD, LOD i owns matrices [offsets[i], offsets[i + 1])
+struct LodInstanceGroups
+{
+	std::vector<glm::mat4> matrices;
+	std::vector<unsigned int> offsets;
+
+	unsigned int getLodCount() const { return offsets.empty() ? 0 : static_cast<unsigned int>(offsets.size() - 1); }
+	unsigned int getCount(unsigned int lod) const { return offsets[lod + 1] - offsets[lod]; }
+};
+
+// Picks LODs from how many pixels their error covers on screen: the coarsest LOD whose error stays under pixelError wins.
+// Switching to a coarser LOD needs the error to be a bit further under the limit (hysteresis), so objects sitting right
+// at a switching distance don't flicker between two LODs while the camera moves.
+//
+// Instanced use, e.g. an asteroid field with Asteroid.glsl (instanceMatrix at INSTANCE_MATRIX_LOCATION, 12 to 15):
+//   selector.setView(camera.position, glm::radians(fov), screenHeight);
+//   selector.groupInstances(rock.meshes[0], rockMatrices, rockLods, groups);
+//   upload groups.matrices to the instance buffer, then for every LOD with instances call rock.meshes[0].BindGeometry(),
+//   point attributes 12 to 15 (divisor 1) at offsets[lod] * sizeof(glm::mat4) and call
+//   rock.meshes[0].DrawInstanced(shader, groups.getCount(lod), lod)
+//   afterwards disable attributes 12 to 15 again. BindGeometry() binds the geometry arena's vertex array, which every
+//   mesh with the same vertex layout shares, so instance attributes left enabled would apply to their draws too.
+class LodSelector
+{
+public:
+	float pixelError = 1.0f;		// Largest error a LOD may show on screen, in pixels
+	float hysteresis = 0.25f;		// A coarser LOD than last frame's has to stay under pixelError * (1 - hysteresis)
+	float minPixelSize = 2.0f;		// Objects smaller than this on screen get the coarsest LOD
+
+	// Call once a frame before selecting. fovY is the vertical field of view in radians, viewportHeight in pixels.
+	void setView(const glm::vec3& cameraPosition, float fovY, float viewportHeight);
+
+	// LOD to draw mesh with at this model matrix. previousLod is the LOD it was drawn with last frame.
+	unsigned int select(const Mesh& mesh, const glm::mat4& model, unsigned int previousLod = 0) const;
+
+	// Selects the LOD of every instance and sorts the matrices into one run per LOD. lodState keeps the LOD of every
+	// instance between frames for the hysteresis, it is resized to match instances.
+	void groupInstances(const Mesh& mesh, const std::vector<glm::mat4>& instances, std::vector<uint8_t>& lodState, LodInstanceGroups& groups) const;
+
+private:
+	glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+
+	// Pixels covered by one unit at a distance of one unit
+	float m_PixelsPerUnit = 1.0f;
+};
+
+void LodSelector::setView(const glm::vec3& cameraPosition, float fovY, float viewportHeight)
+{
+	m_CameraPosition = cameraPosition;
+	m_PixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+}
+
+unsigned int LodSelector::select(const Mesh& mesh, const glm::mat4& model, unsigned int previousLod) const
+{
+	const unsigned int lodCount = mesh.getLodCount();
+	if (lodCount == 1)
+		return 0;
+
+	// Bounding sphere of the mesh in world space, scaled by the largest axis scale of the model matrix
+	BoundingSphere sphere = mesh.getWorldSphere(model);
+	glm::vec3 center = sphere.center;
+	float radius = sphere.radius;
+	float scale = mesh.sphere.radius > 0.0f ? radius / mesh.sphere.radius : 1.0f;
+
+	// Inside the sphere everything is as close as it gets
+	float distance = std::max(glm::length(center - m_CameraPosition) - radius, 1e-4f);
+	float pixelsPerModelUnit = m_PixelsPerUnit * scale / distance;
+
+	if (2.0f * radius * m_PixelsPerUnit / distance < minPixelSize)
+		return lodCount - 1;
+
+	for (unsigned int lod = lodCount - 1; lod > 0; lod--)
+	{
+		float limit = lod > previousLod ? pixelError * (1.0f - hysteresis) : pixelError;
+
+		if (mesh.getLod(lod).error * pixelsPerModelUnit <= limit)
+			return lod;
+	}
+
+	return 0;
+}
+
+void LodSelector::groupInstances(const Mesh& mesh, const std::vector<glm::mat4>& instances, std::vector<uint8_t>& lodState, LodInstanceGroups& groups) const
+{
+	const unsigned int lodCount = mesh.getLodCount();
+	lodState.resize(instances.size(), 0);
+
+	ThreadPool::getInstance().parallelFor(instances.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			lodState[i] = static_cast<uint8_t>(select(mesh, instances[i], lodState[i]));
+	}, 4096);
+
+	// Counting sort, instances keep their relative order inside each LOD
+	groups.offsets.assign(lodCount + 1, 0);
+	for (uint8_t lod : lodState)
+		groups.offsets[lod + 1]++;
+
+	for (unsigned int lod = 0; lod < lodCount; lod++)
+		groups.offsets[lod + 1] += groups.offsets[lod];
+
+	groups.matrices.resize(instances.size());
+	std::vector<unsigned int> fill(groups.offsets.begin(), groups.offsets.end() - 1);
+	for (size_t i = 0; i < instances.size(); i++)
+		groups.matrices[fill[lodState[i]]++] = instances[i];
+}
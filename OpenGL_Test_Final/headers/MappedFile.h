@@ -0,0 +1,169 @@
+#pragma once
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+// Read-only memory mapping of a whole file. The mapping lives until close() or destruction.
+class MappedFile
+{
+private:
+	const unsigned char* m_Data = nullptr;
+	size_t m_Size = 0;
+
+#ifdef _WIN32
+	HANDLE m_File = INVALID_HANDLE_VALUE;
+	HANDLE m_Mapping = nullptr;
+#else
+	int m_File = -1;
+#endif
+
+public:
+	MappedFile() = default;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const std::string& path);
+
+	void close();
+
+	const unsigned char* data() const { return m_Data; }
+
+	size_t size() const { return m_Size; }
+
+	bool isOpen() const { return m_Data != nullptr; }
+
+	~MappedFile();
+};
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_Mapping)
+	{
+		close();
+		return false;
+	}
+
+	m_Data = static_cast<const unsigned char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	m_Size = static_cast<size_t>(size.QuadPart);
+#else
+	m_File = ::open(path.c_str(), O_RDONLY);
+	if (m_File < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(m_File, &info) != 0 || info.st_size == 0)
+	{
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (mapping == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+
+	m_Data = static_cast<const unsigned char*>(mapping);
+	m_Size = static_cast<size_t>(info.st_size);
+#endif
+
+	if (!m_Data)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+
+	m_Mapping = nullptr;
+	m_File = INVALID_HANDLE_VALUE;
+#else
+	if (m_Data)
+		munmap(const_cast<unsigned char*>(m_Data), m_Size);
+	if (m_File >= 0)
+		::close(m_File);
+
+	m_File = -1;
+#endif
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+// 64-bit FNV-1a style hash, mixing 8 bytes at a time. Used to key caches by the content of their source files.
+inline uint64_t HashBytes(const void* data, size_t bytes, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	const uint64_t prime = 1099511628211ull;
+
+	for (; bytes >= 8; bytes -= 8, p += 8)
+	{
+		uint64_t word;
+		std::memcpy(&word, p, 8);
+		hash = (hash ^ word) * prime;
+	}
+
+	for (; bytes > 0; bytes--, p++)
+		hash = (hash ^ *p) * prime;
+
+	return hash;
+}
+
+// Hashes the whole content of a file, returns 0 if it can not be read
+inline uint64_t HashFile(const std::string& path)
+{
+	MappedFile file;
+	if (!file.open(path))
+		return 0;
+
+	return HashBytes(file.data(), file.size());
+}
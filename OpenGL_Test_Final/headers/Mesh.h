@@ -4,13 +4,27 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "Shader.h"
+#include "TextureResidency.h"
+#include "TextureBindings.h"
+#include "DSA.h"
+#include "AsyncLoader.h"
+#include "VertexFormat.h"
+#include "ThreadPool.h"
+#include "GeometryArena.h"
+#include "Bounds.h"
 
 #include <iostream>
 #include <vector>
 #include <string>
 #include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <utility>
 
 #define MAX_BONE_INFLUENCE 4
 
@@ -31,33 +45,479 @@ struct Vertex {
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// VertexFormat::full() describes this struct by hand
+static_assert(sizeof(Vertex) == 88 && offsetof(Vertex, vTexCoords) == 24 && offsetof(Vertex, m_BoneIDs) == 56 && offsetof(Vertex, m_Weights) == 72,
+    "Vertex no longer matches VertexFormat::full()");
+
+// Octahedral mapping of a unit vector onto [-1, 1]^2, the inverse of decodeOctahedral() in the shaders
+inline glm::vec2 OctahedralEncode(const glm::vec3& n)
+{
+    float length = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (length == 0.0f)
+        return glm::vec2(0.0f, 0.0f);
+
+    float x = n.x / length, y = n.y / length;
+    if (n.z < 0.0f)
+    {
+        float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = foldedX;
+        y = foldedY;
+    }
+
+    return glm::vec2(x, y);
+}
+
+inline glm::vec3 OctahedralDecode(const glm::vec2& e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+    if (n.z < 0.0f)
+    {
+        float x = (1.0f - std::fabs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+        float y = (1.0f - std::fabs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+        n.x = x;
+        n.y = y;
+    }
+
+    return glm::normalize(n);
+}
+
+// The packed skinned formats store every joint ID in a byte
+constexpr int MAX_PACKED_JOINT = 255;
+
+// True if the format can address every joint that moves the vertices. Influences without weight are ignored.
+bool CanPackJoints(const Vertex* vertices, size_t count, const VertexFormat& format)
+{
+    if (format.isFull() || !format.skinned)
+        return true;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        {
+            if (vertices[i].m_Weights[j] > 0.0f && vertices[i].m_BoneIDs[j] > MAX_PACKED_JOINT)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Converts vertices into the layout of a format, in parallel for big meshes.
+// Not needed for the full format, which is the Vertex struct itself.
+// Returns nothing if the format can not address the joints, see CanPackJoints().
+std::vector<unsigned char> PackVertices(const Vertex* vertices, size_t count, const VertexFormat& format)
+{
+    if (!CanPackJoints(vertices, count, format))
+    {
+        std::cout << "ERROR::MESH:: Joint IDs above " << MAX_PACKED_JOINT << " do not fit the packed vertex format" << std::endl;
+        return std::vector<unsigned char>();
+    }
+
+    const unsigned int stride = format.getStride();
+    const std::vector<VertexAttribute> attributes = format.getAttributes();
+    std::vector<unsigned char> packed(count * stride);
+
+    ThreadPool::getInstance().parallelFor(count, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const Vertex& vertex = vertices[i];
+            unsigned char* out = packed.data() + i * stride;
+
+            for (const VertexAttribute& attribute : attributes)
+            {
+                unsigned char* dst = out + attribute.offset;
+                uint32_t word = 0;
+
+                switch (attribute.location)
+                {
+                case 0:
+                    std::memcpy(dst, &vertex.vPosition, 12);
+                    break;
+                case 1:
+                    if (format.normals == VertexFormat::Normals::Float)
+                        std::memcpy(dst, &vertex.vNormal, 12);
+                    else
+                    {
+                        word = glm::packSnorm2x16(OctahedralEncode(vertex.vNormal));
+                        std::memcpy(dst, &word, 4);
+                    }
+                    break;
+                case 2:
+                    if (format.texCoords == VertexFormat::TexCoords::Float)
+                        std::memcpy(dst, &vertex.vTexCoords, 8);
+                    else
+                    {
+                        word = format.texCoords == VertexFormat::TexCoords::Half ? glm::packHalf2x16(vertex.vTexCoords) : glm::packUnorm2x16(vertex.vTexCoords);
+                        std::memcpy(dst, &word, 4);
+                    }
+                    break;
+                case 3:
+                    if (format.tangents == VertexFormat::Tangents::Float)
+                        std::memcpy(dst, &vertex.vTangent, 12);
+                    else if (format.tangents == VertexFormat::Tangents::Float4)
+                    {
+                        float sign = glm::dot(glm::cross(vertex.vNormal, vertex.vTangent), vertex.vBitangent) < 0.0f ? -1.0f : 1.0f;
+                        glm::vec4 tangent(vertex.vTangent, sign);
+                        std::memcpy(dst, &tangent, 16);
+                    }
+                    else
+                    {
+                        // The bitangent is rebuilt in the shader as cross(normal, tangent) * sign
+                        float length = glm::length(vertex.vTangent);
+                        glm::vec3 tangent = length > 0.0f ? vertex.vTangent / length : glm::vec3(0.0f);
+                        float sign = glm::dot(glm::cross(vertex.vNormal, vertex.vTangent), vertex.vBitangent) < 0.0f ? -1.0f : 1.0f;
+                        word = glm::packSnorm3x10_1x2(glm::vec4(tangent, sign));
+                        std::memcpy(dst, &word, 4);
+                    }
+                    break;
+                case 4:
+                    std::memcpy(dst, &vertex.vBitangent, 12);
+                    break;
+                case 5:
+                    // Only influences without weight can be out of range here
+                    for (int j = 0; j < 4; j++)
+                        dst[j] = static_cast<unsigned char>(std::clamp(vertex.m_BoneIDs[j], 0, MAX_PACKED_JOINT));
+                    break;
+                case 6:
+                    word = glm::packUnorm4x8(glm::vec4(vertex.m_Weights[0], vertex.m_Weights[1], vertex.m_Weights[2], vertex.m_Weights[3]));
+                    std::memcpy(dst, &word, 4);
+                    break;
+                }
+            }
+        }
+    }, 4096);
+
+    return packed;
+}
+
+// Turns packed vertices back into Vertex structs, for meshes that keep their geometry after loading a packed cache
+std::vector<Vertex> UnpackVertices(const void* data, size_t count, const VertexFormat& format)
+{
+    std::vector<Vertex> vertices(count);
+
+    if (format.isFull())
+    {
+        std::memcpy(vertices.data(), data, count * sizeof(Vertex));
+        return vertices;
+    }
+
+    const unsigned int stride = format.getStride();
+    const std::vector<VertexAttribute> attributes = format.getAttributes();
+    const unsigned char* packed = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Vertex& vertex = vertices[i];
+        const unsigned char* in = packed + i * stride;
+        float sign = 1.0f;
+
+        for (const VertexAttribute& attribute : attributes)
+        {
+            const unsigned char* src = in + attribute.offset;
+            uint32_t word = 0;
+
+            switch (attribute.location)
+            {
+            case 0:
+                std::memcpy(&vertex.vPosition, src, 12);
+                break;
+            case 1:
+                if (format.normals == VertexFormat::Normals::Float)
+                    std::memcpy(&vertex.vNormal, src, 12);
+                else
+                {
+                    std::memcpy(&word, src, 4);
+                    vertex.vNormal = OctahedralDecode(glm::unpackSnorm2x16(word));
+                }
+                break;
+            case 2:
+                if (format.texCoords == VertexFormat::TexCoords::Float)
+                    std::memcpy(&vertex.vTexCoords, src, 8);
+                else
+                {
+                    std::memcpy(&word, src, 4);
+                    vertex.vTexCoords = format.texCoords == VertexFormat::TexCoords::Half ? glm::unpackHalf2x16(word) : glm::unpackUnorm2x16(word);
+                }
+                break;
+            case 3:
+                if (format.tangents == VertexFormat::Tangents::Float)
+                    std::memcpy(&vertex.vTangent, src, 12);
+                else if (format.tangents == VertexFormat::Tangents::Float4)
+                {
+                    glm::vec4 tangent;
+                    std::memcpy(&tangent, src, 16);
+                    vertex.vTangent = glm::vec3(tangent.x, tangent.y, tangent.z);
+                    sign = tangent.w < 0.0f ? -1.0f : 1.0f;
+                }
+                else
+                {
+                    std::memcpy(&word, src, 4);
+                    glm::vec4 tangent = glm::unpackSnorm3x10_1x2(word);
+                    vertex.vTangent = glm::vec3(tangent.x, tangent.y, tangent.z);
+                    sign = tangent.w < 0.0f ? -1.0f : 1.0f;
+                }
+                break;
+            case 4:
+                std::memcpy(&vertex.vBitangent, src, 12);
+                break;
+            case 5:
+                for (int j = 0; j < 4; j++)
+                    vertex.m_BoneIDs[j] = src[j];
+                break;
+            case 6:
+            {
+                std::memcpy(&word, src, 4);
+                glm::vec4 weights = glm::unpackUnorm4x8(word);
+                for (int j = 0; j < 4; j++)
+                    vertex.m_Weights[j] = weights[j];
+                break;
+            }
+            }
+        }
+
+        if (format.tangents != VertexFormat::Tangents::Float)
+            vertex.vBitangent = glm::cross(vertex.vNormal, vertex.vTangent) * sign;
+    }
+
+    return vertices;
+}
+
+// Range of the index buffer that draws one level of detail. error is how far (in model units) the
+// simplified surface may be from the full mesh, 0 for LOD 0.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float error;
+};
+
+// A node of the imported scene, parents come before their children. Its meshes are meshes[firstMesh, firstMesh + meshCount)
+// of the model. The bounds are in the node's own space and hold its meshes and everything below it.
+struct ModelNode {
+    std::string name;
+    int parent = -1;
+    glm::mat4 transform = glm::mat4(1.0f);     // Relative to the parent
+    unsigned int firstMesh = 0;
+    unsigned int meshCount = 0;
+    AABB bounds;
+    BoundingSphere sphere;
+};
+
 struct Texture {
     unsigned int id;
     std::string type;
     std::string path;
 };
 
+// What happens to a mesh's CPU copy of its vertices and indices once they are on the GPU.
+// Only keep it when something still reads it, like picking or physics.
+enum class GeometryRetention {
+    Release,
+    Keep
+};
+
 class Mesh {
 public:
     // Mesh data
     std::vector<Vertex>       vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture>      textures;
-    unsigned int VAO;
+    AABB bounds;
+    BoundingSphere sphere;
+    // LODs from fine to coarse, their indices follow each other in indices. Empty means one LOD that is the whole index buffer.
+    std::vector<MeshLod> lods;
 
     // Constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, const VertexFormat& format = VertexFormat::full())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        m_Format = format;
+        m_IndexType = IndexTypeFor(this->vertices.size());
+
+        // Skinning with the wrong joints is worse than the bigger vertices
+        if (!CanPackJoints(this->vertices.data(), this->vertices.size(), format))
+        {
+            std::cout << "WARNING::MESH:: Joint IDs above " << MAX_PACKED_JOINT << " do not fit the packed vertex format, using the full format" << std::endl;
+            m_Format = VertexFormat::full();
+        }
+
+        // Pack vertices and indices into the layout they are drawn with
+        std::vector<unsigned char> packed;
+        const void* vertexData = this->vertices.data();
+        if (!m_Format.isFull())
+        {
+            packed = PackVertices(this->vertices.data(), this->vertices.size(), m_Format);
+            vertexData = packed.data();
+        }
+
+        std::vector<uint16_t> shortIndices;
+        const void* indexData = this->indices.data();
+        if (m_IndexType == GL_UNSIGNED_SHORT)
+        {
+            shortIndices.assign(this->indices.begin(), this->indices.end());
+            indexData = shortIndices.data();
+        }
 
         // Set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(vertexData, this->vertices.size(), indexData, this->indices.size());
+    }
+
+    // Uploads vertices and indices that are already in the given format and index type straight from memory
+    // that is not kept, e.g. a mapped mesh cache. vertices and indices stay empty.
+    Mesh(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount, GLenum indexType, std::vector<Texture> textures, const VertexFormat& format = VertexFormat::full())
+    {
+        this->textures = std::move(textures);
+        m_Format = format;
+        m_IndexType = indexType;
+
+        setupMesh(vertexData, vertexCount, indexData, indexCount);
+    }
+
+    // The mesh owns its block of the geometry arena, so it can be moved but not copied.
+    // The textures belong to the model that loaded them.
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    Mesh(Mesh&& other) noexcept
+        : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+          bounds(other.bounds), sphere(other.sphere), lods(std::move(other.lods)), m_Geometry(other.m_Geometry), m_Sampler(other.m_Sampler), m_IndexCount(other.m_IndexCount),
+          m_IndexType(other.m_IndexType), m_Format(other.m_Format)
+    {
+        other.m_Geometry = INVALID_GEOMETRY;
+        other.m_IndexCount = 0;
+    }
+
+    Mesh& operator=(Mesh&& other) noexcept
+    {
+        if (this != &other)
+        {
+            free();
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            bounds = other.bounds;
+            sphere = other.sphere;
+            lods = std::move(other.lods);
+            m_Sampler = other.m_Sampler;
+            m_Format = other.m_Format;
+            m_IndexType = other.m_IndexType;
+            std::swap(m_Geometry, other.m_Geometry);
+            std::swap(m_IndexCount, other.m_IndexCount);
+        }
+        return *this;
+    }
+
+    ~Mesh()
+    {
+        free();
+    }
+
+    // Gives the geometry back to the arena, safe to call more than once
+    void free()
+    {
+        if (m_Geometry != INVALID_GEOMETRY)
+            GeometryArena::getInstance().free(m_Geometry);
+
+        m_Geometry = INVALID_GEOMETRY;
+        m_IndexCount = 0;
+    }
+
+    // Drops the CPU copy of the geometry, the GPU buffers are all drawing needs
+    void releaseGeometry()
+    {
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+    }
+
+    bool hasGeometry() const { return !vertices.empty(); }
+
+    const VertexFormat& getFormat() const { return m_Format; }
+
+    unsigned int getIndexCount() const { return m_IndexCount; }
+
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLenum getIndexType() const { return m_IndexType; }
+
+    // Bounds in world space when drawn with this model matrix
+    AABB getWorldBounds(const glm::mat4& model) const { return bounds.transform(model); }
+    BoundingSphere getWorldSphere(const glm::mat4& model) const { return sphere.transform(model); }
+
+    unsigned int getLodCount() const { return lods.empty() ? 1 : static_cast<unsigned int>(lods.size()); }
+
+    // LODs past the last one give the coarsest
+    MeshLod getLod(unsigned int lod) const
+    {
+        if (lods.empty())
+            return { 0, m_IndexCount, 0.0f };
+
+        return lods[std::min<size_t>(lod, lods.size() - 1)];
     }
 
     // Render the mesh
-    void Draw(Shader& shader)
+    void Draw(Shader& shader, unsigned int lod = 0)
+    {
+        bindTextures(shader);
+        DrawGeometry(lod);
+    }
+
+    // The two halves of Draw(), for callers that sort their draws and only bind a material when it changes (see Renderer.h)
+    void BindMaterial(Shader& shader)
+    {
+        bindTextures(shader);
+    }
+
+    void DrawGeometry(unsigned int lod = 0)
+    {
+        // Draw mesh. The arena's vertex array stays bound, the next mesh with this vertex format draws from it as well.
+        // The active texture unit is left alone too, the binding cache keeps track of it.
+        MeshLod range = getLod(lod);
+        GeometryRange geometry = GeometryArena::getInstance().bind(m_Geometry);
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, m_IndexType, (void*)(geometry.indexOffset + range.firstIndex * IndexSize(m_IndexType)), geometry.baseVertex);
+    }
+
+    // Render instanceCount copies of the mesh, the per instance attributes come from whatever the caller
+    // attached to the vertex array (see LodSelector.h)
+    void DrawInstanced(Shader& shader, unsigned int instanceCount, unsigned int lod = 0)
+    {
+        if (instanceCount == 0)
+            return;
+
+        bindTextures(shader);
+        DrawGeometryInstanced(instanceCount, lod);
+    }
+
+    // Binds the vertex array the mesh draws from, so per instance attributes can be attached to it
+    void BindGeometry()
+    {
+        GeometryArena::getInstance().bind(m_Geometry);
+    }
+
+    void DrawGeometryInstanced(unsigned int instanceCount, unsigned int lod = 0)
+    {
+        MeshLod range = getLod(lod);
+        GeometryRange geometry = GeometryArena::getInstance().bind(m_Geometry);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, m_IndexType, (void*)(geometry.indexOffset + range.firstIndex * IndexSize(m_IndexType)),
+            instanceCount, geometry.baseVertex);
+    }
+
+private:
+    // Vertices and indices in the shared geometry buffers
+    GeometryHandle m_Geometry = INVALID_GEOMETRY;
+
+    // Shared sampler object, same parameters TextureFromFile sets on the textures
+    unsigned int m_Sampler = 0;
+
+    unsigned int m_IndexCount = 0;
+    GLenum m_IndexType = GL_UNSIGNED_INT;
+
+    // Layout of the vertex buffer
+    VertexFormat m_Format;
+
+    // Binds the textures to consecutive units and points the shader's samplers at them
+    void bindTextures(Shader& shader)
     {
         // Bind appropriate textures
         unsigned int diffuseNr = 1;
@@ -71,7 +531,6 @@ public:
 
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // Active proper texture unit before binding
             // Retrieve texture number (the N in diffuse_textureN)
 
             name = textures[i].type;
@@ -88,8 +547,10 @@ public:
             // Now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.id, (name + number).c_str()), i);
 
-            // And finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // And finally bind the texture, reloading it first if it was evicted.
+            // The binding cache skips the unit switch and bind if it is already there.
+            TextureResidency::getInstance().touch(textures[i].id);
+            TextureBindings::getInstance().bind(i, GL_TEXTURE_2D, textures[i].id, m_Sampler);
         }
 #endif
         
@@ -100,7 +561,6 @@ public:
 
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // Active proper texture unit before binding
             // Retrieve texture number (the N in diffuse_textureN)
 
             strcpy_s(name, static_cast<rsize_t>(MAX_SIZE)-1, textures[i].type.c_str());
@@ -123,64 +583,21 @@ public:
             strncat_s(name, MAX_SIZE, number, 3);
             glUniform1i(glGetUniformLocation(shader.getID(), name), i);
 
-            // And finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // And finally bind the texture, reloading it first if it was evicted.
+            // The binding cache skips the unit switch and bind if it is already there.
+            TextureResidency::getInstance().touch(textures[i].id);
+            TextureBindings::getInstance().bind(i, GL_TEXTURE_2D, textures[i].id, m_Sampler);
         }
 #endif
-        // Bind vertex array
-        glBindVertexArray(VAO);
-
-        // Draw mesh
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        
-        // Always good practice to set everything back to defaults once configured.
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
     }
 
-private:
-    // Render data 
-    unsigned int VBO, EBO;
-
-    // Initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // Create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // Load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // Set the vertex attribute pointers
-        // Vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // Vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, vNormal));
-        // Vertex texture coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, vTexCoords));
-        // Vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, vTangent));
-        // Vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, vBitangent));
-        // IDs
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        // Weights
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    // Copies the vertices and indices into the geometry arena
+    void setupMesh(const void* vertexData, size_t vertexCount, const void* indexData, size_t indexCount)
+    {
+        m_Sampler = SamplerCache::getInstance().get(SamplerDesc());
+        m_IndexCount = static_cast<unsigned int>(indexCount);
+
+        m_Geometry = GeometryArena::getInstance().allocate(m_Format.getAttributes(), m_Format.getStride(), vertexData, vertexCount,
+            indexData, indexCount * IndexSize(m_IndexType));
     }
 };
\ No newline at end of file
@@ -0,0 +1,457 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MappedFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+// Layout of a mesh cache file:
+//   MeshCacheHeader
+//   MeshCacheEntry   x meshCount
+//   MeshCacheTexture x textureCount
+//   MeshCacheLod     x lodCount
+//   MeshCacheNode    x nodeCount
+//   string data (texture paths and types and node names, not null terminated)
+//   vertex and index data of every mesh, each blob 16 byte aligned
+// Everything is stored in the layout the GPU gets it in (vertices already packed into their VertexFormat),
+// so loading is a straight copy out of the mapping. Indices of all LODs of a mesh are one blob.
+
+// Everything the cached meshes depend on besides the code itself
+struct MeshCacheKey
+{
+	uint64_t sourceHash = 0;	// Hash of the model file content
+	uint32_t importFlags = 0;	// Assimp post processing flags the meshes were built with
+	uint32_t optimizeFlags = 0;	// MeshOptimizeOptions key
+	uint32_t vertexFormat = 0;	// VertexFormat key the model asked for, the meshes may drop the bone streams
+	uint32_t lodOptions = 0;	// MeshLodOptions key
+};
+
+struct MeshCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t importFlags;
+	uint32_t vertexSize;		// sizeof(Vertex), catches layout changes that forgot to bump the version
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t vertexFormat;
+	uint32_t optimizeFlags;
+	uint32_t lodOptions;
+	uint32_t lodCount;
+	uint32_t nodeCount;
+	uint32_t reserved;
+	uint64_t stringsOffset;
+	uint64_t stringsSize;
+};
+
+struct MeshCacheEntry
+{
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t firstTexture;
+	uint32_t textureCount;
+	uint32_t vertexFormat;		// VertexFormat key of this mesh's vertices
+	uint32_t vertexStride;
+	uint32_t indexSize;			// 2 or 4 bytes, whichever the mesh draws with
+	uint32_t firstLod;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t lodCount;
+	float sphere[4];			// Center and radius
+	uint32_t reserved;
+};
+
+struct MeshCacheTexture
+{
+	uint32_t pathOffset;
+	uint32_t pathLength;
+	uint32_t typeOffset;
+	uint32_t typeLength;
+};
+
+struct MeshCacheLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;
+	uint32_t reserved;
+};
+
+struct MeshCacheNode
+{
+	int32_t parent;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	uint32_t firstMesh;
+	uint32_t meshCount;
+	float transform[16];		// Column major
+	float boundsMin[3];
+	float boundsMax[3];
+	float sphere[4];
+};
+
+// Binary copy of a model's processed meshes. A hit skips Assimp and all per-vertex work; the cache is rebuilt
+// whenever the model file or anything else in the MeshCacheKey changes. Only the model file itself is hashed, edits to material
+// libraries next to it need the cache file deleted.
+class MeshCache
+{
+public:
+	static constexpr uint32_t VERSION = 7;
+
+private:
+	MappedFile m_File;
+	const MeshCacheHeader* m_Header = nullptr;
+	const MeshCacheEntry* m_Entries = nullptr;
+	const MeshCacheTexture* m_Textures = nullptr;
+	const MeshCacheLod* m_Lods = nullptr;
+	const MeshCacheNode* m_Nodes = nullptr;
+	const char* m_Strings = nullptr;
+
+public:
+	MeshCache() = default;
+
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	// Maps the cache and checks it was built with this key. Returns false if it is missing or stale.
+	bool open(const std::string& cachePath, const MeshCacheKey& key);
+
+	void close();
+
+	uint32_t getMeshCount() const { return m_Header ? m_Header->meshCount : 0; }
+
+	const MeshCacheEntry& getMesh(uint32_t index) const { return m_Entries[index]; }
+
+	const void* getVertices(const MeshCacheEntry& entry) const { return m_File.data() + entry.vertexOffset; }
+
+	VertexFormat getVertexFormat(const MeshCacheEntry& entry) const { return VertexFormat::fromKey(entry.vertexFormat); }
+
+	const void* getIndices(const MeshCacheEntry& entry) const { return m_File.data() + entry.indexOffset; }
+
+	GLenum getIndexType(const MeshCacheEntry& entry) const { return entry.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
+	std::string_view getTexturePath(uint32_t texture) const { return { m_Strings + m_Textures[texture].pathOffset, m_Textures[texture].pathLength }; }
+
+	std::string_view getTextureType(uint32_t texture) const { return { m_Strings + m_Textures[texture].typeOffset, m_Textures[texture].typeLength }; }
+
+	std::vector<MeshLod> getLods(const MeshCacheEntry& entry) const;
+
+	// Node tree of the model, mesh ranges relative to the first cached mesh
+	std::vector<ModelNode> getNodes() const;
+
+	// Writes the meshes, their textures, LODs and bounds and the nodes. The meshes still need their CPU side vertices and indices.
+	static bool write(const std::string& cachePath, const MeshCacheKey& key, const std::vector<Mesh>& meshes, const std::vector<ModelNode>& nodes);
+
+private:
+	bool Validate(const MeshCacheKey& key) const;
+};
+
+bool MeshCache::open(const std::string& cachePath, const MeshCacheKey& key)
+{
+	close();
+
+	if (!m_File.open(cachePath))
+		return false;
+
+	if (m_File.size() < sizeof(MeshCacheHeader))
+	{
+		close();
+		return false;
+	}
+
+	m_Header = reinterpret_cast<const MeshCacheHeader*>(m_File.data());
+
+	if (!Validate(key))
+	{
+		close();
+		return false;
+	}
+
+	m_Entries = reinterpret_cast<const MeshCacheEntry*>(m_File.data() + sizeof(MeshCacheHeader));
+	m_Textures = reinterpret_cast<const MeshCacheTexture*>(m_Entries + m_Header->meshCount);
+	m_Lods = reinterpret_cast<const MeshCacheLod*>(m_Textures + m_Header->textureCount);
+	m_Nodes = reinterpret_cast<const MeshCacheNode*>(m_Lods + m_Header->lodCount);
+	m_Strings = reinterpret_cast<const char*>(m_File.data() + m_Header->stringsOffset);
+	return true;
+}
+
+void MeshCache::close()
+{
+	m_File.close();
+	m_Header = nullptr;
+	m_Entries = nullptr;
+	m_Textures = nullptr;
+	m_Lods = nullptr;
+	m_Nodes = nullptr;
+	m_Strings = nullptr;
+}
+
+std::vector<MeshLod> MeshCache::getLods(const MeshCacheEntry& entry) const
+{
+	std::vector<MeshLod> lods;
+	lods.reserve(entry.lodCount);
+
+	for (uint32_t i = entry.firstLod; i < entry.firstLod + entry.lodCount; i++)
+		lods.push_back({ m_Lods[i].firstIndex, m_Lods[i].indexCount, m_Lods[i].error });
+
+	return lods;
+}
+
+std::vector<ModelNode> MeshCache::getNodes() const
+{
+	std::vector<ModelNode> nodes(m_Header ? m_Header->nodeCount : 0);
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const MeshCacheNode& record = m_Nodes[i];
+		ModelNode& node = nodes[i];
+
+		node.name.assign(m_Strings + record.nameOffset, record.nameLength);
+		node.parent = record.parent;
+		node.firstMesh = record.firstMesh;
+		node.meshCount = record.meshCount;
+		std::memcpy(glm::value_ptr(node.transform), record.transform, sizeof(record.transform));
+		node.bounds.min = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+		node.bounds.max = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+		node.sphere.center = glm::vec3(record.sphere[0], record.sphere[1], record.sphere[2]);
+		node.sphere.radius = record.sphere[3];
+	}
+
+	return nodes;
+}
+
+bool MeshCache::Validate(const MeshCacheKey& key) const
+{
+	const MeshCacheHeader& header = *m_Header;
+
+	if (std::memcmp(header.magic, "MESH", 4) != 0 || header.version != VERSION || header.vertexSize != sizeof(Vertex))
+		return false;
+
+	if (header.sourceHash != key.sourceHash || header.importFlags != key.importFlags ||
+		header.optimizeFlags != key.optimizeFlags || header.vertexFormat != key.vertexFormat || header.lodOptions != key.lodOptions)
+		return false;
+
+	// Make sure a truncated file can not send anything outside the mapping
+	uint64_t tables = sizeof(MeshCacheHeader) + uint64_t(header.meshCount) * sizeof(MeshCacheEntry) + uint64_t(header.textureCount) * sizeof(MeshCacheTexture) +
+		uint64_t(header.lodCount) * sizeof(MeshCacheLod) + uint64_t(header.nodeCount) * sizeof(MeshCacheNode);
+	if (tables > m_File.size() || header.stringsOffset + header.stringsSize > m_File.size())
+		return false;
+
+	const MeshCacheEntry* entries = reinterpret_cast<const MeshCacheEntry*>(m_File.data() + sizeof(MeshCacheHeader));
+	const MeshCacheTexture* textures = reinterpret_cast<const MeshCacheTexture*>(entries + header.meshCount);
+	const MeshCacheLod* lods = reinterpret_cast<const MeshCacheLod*>(textures + header.textureCount);
+	const MeshCacheNode* nodes = reinterpret_cast<const MeshCacheNode*>(lods + header.lodCount);
+
+	for (uint32_t i = 0; i < header.meshCount; i++)
+	{
+		const MeshCacheEntry& entry = entries[i];
+
+		if (entry.vertexStride != VertexFormat::fromKey(entry.vertexFormat).getStride() ||
+			entry.vertexOffset + uint64_t(entry.vertexCount) * entry.vertexStride > m_File.size() ||
+			(entry.indexSize != 2 && entry.indexSize != 4) ||
+			entry.indexOffset + uint64_t(entry.indexCount) * entry.indexSize > m_File.size() ||
+			uint64_t(entry.firstTexture) + entry.textureCount > header.textureCount ||
+			uint64_t(entry.firstLod) + entry.lodCount > header.lodCount)
+			return false;
+
+		for (uint32_t l = entry.firstLod; l < entry.firstLod + entry.lodCount; l++)
+		{
+			if (uint64_t(lods[l].firstIndex) + lods[l].indexCount > entry.indexCount)
+				return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < header.textureCount; i++)
+	{
+		if (uint64_t(textures[i].pathOffset) + textures[i].pathLength > header.stringsSize ||
+			uint64_t(textures[i].typeOffset) + textures[i].typeLength > header.stringsSize)
+			return false;
+	}
+
+	// Parents have to come first, that is what lets the node tree be walked front to back
+	for (uint32_t i = 0; i < header.nodeCount; i++)
+	{
+		if (nodes[i].parent >= static_cast<int32_t>(i) || nodes[i].parent < -1 ||
+			uint64_t(nodes[i].firstMesh) + nodes[i].meshCount > header.meshCount ||
+			uint64_t(nodes[i].nameOffset) + nodes[i].nameLength > header.stringsSize)
+			return false;
+	}
+
+	return true;
+}
+
+bool MeshCache::write(const std::string& cachePath, const MeshCacheKey& key, const std::vector<Mesh>& meshes, const std::vector<ModelNode>& nodes)
+{
+	auto align = [](uint64_t offset) { return (offset + 15) & ~uint64_t(15); };
+
+	std::vector<MeshCacheEntry> entries(meshes.size());
+	std::vector<MeshCacheTexture> textures;
+	std::vector<MeshCacheLod> lods;
+	std::vector<MeshCacheNode> nodeRecords(nodes.size());
+	std::string strings;
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const Mesh& mesh = meshes[i];
+		MeshCacheEntry& entry = entries[i];
+
+		entry.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		entry.indexCount = static_cast<uint32_t>(mesh.indices.size());
+		entry.firstTexture = static_cast<uint32_t>(textures.size());
+		entry.textureCount = static_cast<uint32_t>(mesh.textures.size());
+		entry.vertexFormat = mesh.getFormat().getKey();
+		entry.vertexStride = mesh.getFormat().getStride();
+		entry.indexSize = mesh.getIndexType() == GL_UNSIGNED_SHORT ? 2 : 4;
+		entry.firstLod = static_cast<uint32_t>(lods.size());
+		entry.lodCount = static_cast<uint32_t>(mesh.lods.size());
+		entry.reserved = 0;
+
+		for (const MeshLod& lod : mesh.lods)
+			lods.push_back({ lod.firstIndex, lod.indexCount, lod.error, 0 });
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			entry.boundsMin[axis] = mesh.bounds.min[axis];
+			entry.boundsMax[axis] = mesh.bounds.max[axis];
+			entry.sphere[axis] = mesh.sphere.center[axis];
+		}
+		entry.sphere[3] = mesh.sphere.radius;
+
+		for (const Texture& texture : mesh.textures)
+		{
+			MeshCacheTexture record;
+			record.pathOffset = static_cast<uint32_t>(strings.size());
+			record.pathLength = static_cast<uint32_t>(texture.path.size());
+			strings += texture.path;
+			record.typeOffset = static_cast<uint32_t>(strings.size());
+			record.typeLength = static_cast<uint32_t>(texture.type.size());
+			strings += texture.type;
+			textures.push_back(record);
+		}
+	}
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		const ModelNode& node = nodes[i];
+		MeshCacheNode& record = nodeRecords[i];
+
+		record.parent = node.parent;
+		record.nameOffset = static_cast<uint32_t>(strings.size());
+		record.nameLength = static_cast<uint32_t>(node.name.size());
+		strings += node.name;
+		record.firstMesh = node.firstMesh;
+		record.meshCount = node.meshCount;
+		std::memcpy(record.transform, glm::value_ptr(node.transform), sizeof(record.transform));
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			record.boundsMin[axis] = node.bounds.min[axis];
+			record.boundsMax[axis] = node.bounds.max[axis];
+			record.sphere[axis] = node.sphere.center[axis];
+		}
+		record.sphere[3] = node.sphere.radius;
+	}
+
+	MeshCacheHeader header = {};
+	std::memcpy(header.magic, "MESH", 4);
+	header.version = VERSION;
+	header.sourceHash = key.sourceHash;
+	header.importFlags = key.importFlags;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = static_cast<uint32_t>(entries.size());
+	header.textureCount = static_cast<uint32_t>(textures.size());
+	header.vertexFormat = key.vertexFormat;
+	header.optimizeFlags = key.optimizeFlags;
+	header.lodOptions = key.lodOptions;
+	header.lodCount = static_cast<uint32_t>(lods.size());
+	header.nodeCount = static_cast<uint32_t>(nodeRecords.size());
+	header.stringsOffset = sizeof(MeshCacheHeader) + entries.size() * sizeof(MeshCacheEntry) + textures.size() * sizeof(MeshCacheTexture) +
+		lods.size() * sizeof(MeshCacheLod) + nodeRecords.size() * sizeof(MeshCacheNode);
+	header.stringsSize = strings.size();
+
+	// Lay out the geometry blobs after the string data
+	uint64_t offset = align(header.stringsOffset + header.stringsSize);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		entries[i].vertexOffset = offset;
+		offset = align(offset + uint64_t(entries[i].vertexCount) * entries[i].vertexStride);
+		entries[i].indexOffset = offset;
+		offset = align(offset + uint64_t(entries[i].indexCount) * entries[i].indexSize);
+	}
+
+	// Written to a temporary file first so a crash never leaves a half written cache behind
+	std::string tempPath = cachePath + ".tmp";
+	std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+		return false;
+	}
+
+	auto pad = [&file, &align]()
+	{
+		static const char zeros[16] = {};
+		uint64_t position = static_cast<uint64_t>(file.tellp());
+		file.write(zeros, static_cast<std::streamsize>(align(position) - position));
+	};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+	file.write(reinterpret_cast<const char*>(textures.data()), textures.size() * sizeof(MeshCacheTexture));
+	file.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshCacheLod));
+	file.write(reinterpret_cast<const char*>(nodeRecords.data()), nodeRecords.size() * sizeof(MeshCacheNode));
+	file.write(strings.data(), strings.size());
+	pad();
+
+	for (const Mesh& mesh : meshes)
+	{
+		if (mesh.getFormat().isFull())
+		{
+			file.write(reinterpret_cast<const char*>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+		}
+		else
+		{
+			std::vector<unsigned char> packed = PackVertices(mesh.vertices.data(), mesh.vertices.size(), mesh.getFormat());
+			file.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+		}
+		pad();
+		if (mesh.getIndexType() == GL_UNSIGNED_SHORT)
+		{
+			std::vector<uint16_t> shortIndices(mesh.indices.begin(), mesh.indices.end());
+			file.write(reinterpret_cast<const char*>(shortIndices.data()), shortIndices.size() * sizeof(uint16_t));
+		}
+		else
+		{
+			file.write(reinterpret_cast<const char*>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+		}
+		pad();
+	}
+
+	file.close();
+	if (!file)
+	{
+		std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	std::remove(cachePath.c_str());
+	if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		std::cerr << "Could not write mesh cache " << cachePath << std::endl;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,570 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MappedFile.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+// Which steps MeshOptimizer::optimize() runs, in this order
+struct MeshOptimizeOptions
+{
+	bool weld = true;				// Merge bit identical vertices
+	bool vertexCache = true;		// Reorder triangles for the post-transform cache (Forsyth)
+	bool overdraw = true;			// Reorder clusters of triangles so outward facing ones come first
+	bool vertexFetch = true;		// Renumber vertices in the order they are first used
+	bool measureOverdraw = false;	// Rasterize the mesh before and after for the overdraw statistics, slow
+
+	// Packs the steps that change the mesh into an integer for cache files
+	uint32_t getKey() const { return uint32_t(weld) | uint32_t(vertexCache) << 1 | uint32_t(overdraw) << 2 | uint32_t(vertexFetch) << 3; }
+};
+
+// Before/after numbers of an optimization. ACMR is the average number of post-transform cache misses per triangle
+// (0.5 is ideal for big regular meshes, 3 is the worst), ATVR the same per vertex (1 is ideal). Overdraw is how often
+// every covered pixel gets shaded on average, over the six axis views (1 is ideal), and is 0 if it was not measured.
+struct MeshOptimizeStats
+{
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	size_t triangles = 0;
+	float acmrBefore = 0.0f;
+	float acmrAfter = 0.0f;
+	float atvrBefore = 0.0f;
+	float atvrAfter = 0.0f;
+	float overdrawBefore = 0.0f;
+	float overdrawAfter = 0.0f;
+
+	// Adds another mesh, weighting its ratios by its size
+	void accumulate(const MeshOptimizeStats& other);
+};
+
+// Import time optimizations for indexed triangle meshes. Everything works on the CPU copy and is safe to run
+// on several meshes at once from the thread pool.
+class MeshOptimizer
+{
+public:
+	// Size of the FIFO cache the statistics simulate, a typical post-transform cache size
+	static constexpr unsigned int STATS_CACHE_SIZE = 16;
+
+	static MeshOptimizeStats optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const MeshOptimizeOptions& options = MeshOptimizeOptions());
+
+	// Removes duplicate vertices and points the indices at the remaining copy
+	static void weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation", greedy triangle order for an LRU cache
+	static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount);
+
+	// Sander, Nehab and Barczak's "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw": cuts the
+	// cache optimized order into clusters where the cache would restart anyway and sorts the clusters so the
+	// ones facing away from the mesh center are drawn first, which then hide the ones behind them
+	static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+
+	// Renumbers vertices in the order the indices first use them, dropping unused ones
+	static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+	// Simulates a FIFO post-transform cache, returns the misses
+	static size_t countCacheMisses(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = STATS_CACHE_SIZE);
+
+	// Rasterizes the mesh from the six axis directions with a depth buffer, returns shaded / covered pixels
+	static float measureOverdraw(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int resolution = 256);
+
+private:
+	static void GenerateClusters(const std::vector<unsigned int>& indices, size_t vertexCount, float threshold, std::vector<size_t>& clusterStarts);
+};
+
+void MeshOptimizeStats::accumulate(const MeshOptimizeStats& other)
+{
+	size_t triangleTotal = triangles + other.triangles;
+	size_t vertexTotal = verticesAfter + other.verticesAfter;
+
+	auto weight = [](float a, size_t wa, float b, size_t wb) { return wa + wb ? (a * wa + b * wb) / float(wa + wb) : 0.0f; };
+
+	acmrBefore = weight(acmrBefore, triangles, other.acmrBefore, other.triangles);
+	acmrAfter = weight(acmrAfter, triangles, other.acmrAfter, other.triangles);
+	atvrBefore = weight(atvrBefore, verticesBefore, other.atvrBefore, other.verticesBefore);
+	atvrAfter = weight(atvrAfter, verticesAfter, other.atvrAfter, other.verticesAfter);
+	overdrawBefore = weight(overdrawBefore, triangles, other.overdrawBefore, other.triangles);
+	overdrawAfter = weight(overdrawAfter, triangles, other.overdrawAfter, other.triangles);
+
+	verticesBefore += other.verticesBefore;
+	verticesAfter = vertexTotal;
+	triangles = triangleTotal;
+}
+
+MeshOptimizeStats MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const MeshOptimizeOptions& options)
+{
+	MeshOptimizeStats stats;
+	stats.verticesBefore = vertices.size();
+	stats.triangles = indices.size() / 3;
+
+	if (stats.triangles == 0 || vertices.empty())
+	{
+		stats.verticesAfter = vertices.size();
+		return stats;
+	}
+
+	size_t misses = countCacheMisses(indices, vertices.size());
+	stats.acmrBefore = float(misses) / stats.triangles;
+	stats.atvrBefore = float(misses) / vertices.size();
+
+	if (options.measureOverdraw)
+		stats.overdrawBefore = measureOverdraw(vertices, indices);
+
+	if (options.weld)
+		weldVertices(vertices, indices);
+
+	if (options.vertexCache)
+		optimizeVertexCache(indices, vertices.size());
+
+	if (options.overdraw)
+		optimizeOverdraw(indices, vertices);
+
+	if (options.vertexFetch)
+		optimizeVertexFetch(vertices, indices);
+
+	stats.verticesAfter = vertices.size();
+
+	misses = countCacheMisses(indices, vertices.size());
+	stats.acmrAfter = float(misses) / stats.triangles;
+	stats.atvrAfter = float(misses) / vertices.size();
+
+	if (options.measureOverdraw)
+		stats.overdrawAfter = measureOverdraw(vertices, indices);
+
+	return stats;
+}
+
+void MeshOptimizer::weldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	// Open addressing table of vertex indices, at most half full
+	size_t tableSize = 1;
+	while (tableSize < vertices.size() * 2)
+		tableSize <<= 1;
+
+	const unsigned int EMPTY = ~0u;
+	std::vector<unsigned int> table(tableSize, EMPTY);
+	std::vector<unsigned int> remap(vertices.size());
+	size_t unique = 0;
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		size_t slot = HashBytes(&vertices[i], sizeof(Vertex)) & (tableSize - 1);
+
+		while (table[slot] != EMPTY && std::memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+
+		if (table[slot] == EMPTY)
+		{
+			// First copy of this vertex, compact it to the front
+			vertices[unique] = vertices[i];
+			table[slot] = static_cast<unsigned int>(unique);
+			unique++;
+		}
+
+		remap[i] = table[slot];
+	}
+
+	vertices.resize(unique);
+
+	for (unsigned int& index : indices)
+		index = remap[index];
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+	constexpr int CACHE_SIZE = 32;
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+	const size_t triangleCount = indices.size() / 3;
+
+	auto vertexScore = [](int cachePosition, unsigned int activeTriangles)
+	{
+		if (activeTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition < 0)
+			score = 0.0f;
+		else if (cachePosition < 3)
+			score = LAST_TRIANGLE_SCORE;		// The last triangle's vertices get a fixed score so it is not picked again right away
+		else
+			score = std::pow(1.0f - float(cachePosition - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+
+		// Vertices with few triangles left get a boost, to finish them off and not leave lone triangles behind
+		return score + VALENCE_BOOST_SCALE * std::pow(float(activeTriangles), -VALENCE_BOOST_POWER);
+	};
+
+	// Triangles of every vertex, as offsets into one array
+	std::vector<unsigned int> activeTriangles(vertexCount, 0);
+	for (unsigned int index : indices)
+		activeTriangles[index]++;
+
+	std::vector<unsigned int> triangleOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		triangleOffsets[v + 1] = triangleOffsets[v] + activeTriangles[v];
+
+	std::vector<unsigned int> vertexTriangles(indices.size());
+	{
+		std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++)
+				vertexTriangles[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScores[v] = vertexScore(-1, activeTriangles[v]);
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<char> emitted(triangleCount, 0);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	// LRU cache of vertices, with room for the three that the newest triangle pushes out
+	std::vector<unsigned int> cache, newCache;
+	cache.reserve(CACHE_SIZE + 3);
+	newCache.reserve(CACHE_SIZE + 3);
+
+	size_t scanPosition = 0;
+	long long bestTriangle = -1;
+
+	while (result.size() < indices.size())
+	{
+		// No candidate around the cache, fall back to the best of the remaining triangles in input order
+		if (bestTriangle < 0)
+		{
+			while (scanPosition < triangleCount && emitted[scanPosition])
+				scanPosition++;
+			if (scanPosition == triangleCount)
+				break;
+
+			bestTriangle = static_cast<long long>(scanPosition);
+		}
+
+		const size_t t = static_cast<size_t>(bestTriangle);
+		emitted[t] = 1;
+
+		// Emit it and move its vertices to the front of the LRU cache
+		newCache.clear();
+
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = indices[t * 3 + k];
+			result.push_back(v);
+			newCache.push_back(v);
+
+			// Drop the triangle from the vertex' active list
+			unsigned int* begin = vertexTriangles.data() + triangleOffsets[v];
+			unsigned int* end = begin + activeTriangles[v];
+			unsigned int* found = std::find(begin, end, static_cast<unsigned int>(t));
+			std::swap(*found, *(end - 1));
+			activeTriangles[v]--;
+		}
+
+		for (unsigned int v : cache)
+		{
+			if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+				newCache.push_back(v);
+		}
+
+		// Update the scores of everything that was or is in the cache, and look for the next triangle among them
+		for (size_t i = 0; i < newCache.size(); i++)
+			cachePosition[newCache[i]] = i < CACHE_SIZE ? static_cast<int>(i) : -1;
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+
+		for (unsigned int v : newCache)
+		{
+			float newScore = vertexScore(cachePosition[v], activeTriangles[v]);
+			float delta = newScore - vertexScores[v];
+			vertexScores[v] = newScore;
+
+			for (unsigned int i = 0; i < activeTriangles[v]; i++)
+			{
+				unsigned int triangle = vertexTriangles[triangleOffsets[v] + i];
+				triangleScores[triangle] += delta;
+
+				if (triangleScores[triangle] > bestScore)
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		if (newCache.size() > CACHE_SIZE)
+			newCache.resize(CACHE_SIZE);
+		cache.swap(newCache);
+	}
+
+	indices.swap(result);
+}
+
+size_t MeshOptimizer::countCacheMisses(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	// A vertex is in the FIFO if it was added less than cacheSize misses ago
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+
+	for (unsigned int index : indices)
+	{
+		if (insertedAt[index] == 0 || misses + 1 - insertedAt[index] > cacheSize)
+		{
+			misses++;
+			insertedAt[index] = misses;
+		}
+	}
+
+	return misses;
+}
+
+void MeshOptimizer::GenerateClusters(const std::vector<unsigned int>& indices, size_t vertexCount, float threshold, std::vector<size_t>& clusterStarts)
+{
+	const size_t triangleCount = indices.size() / 3;
+	const float meshAcmr = float(countCacheMisses(indices, vertexCount)) / triangleCount;
+
+	// Every cluster is simulated with a cold cache, vertices inserted before clusterBase count as evicted
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+	size_t clusterBase = 0;
+	size_t clusterMisses = 0;
+	size_t clusterTriangles = 0;
+
+	auto inCache = [&](unsigned int index)
+	{
+		return insertedAt[index] > clusterBase && misses - insertedAt[index] < STATS_CACHE_SIZE;
+	};
+
+	auto startCluster = [&](size_t triangle)
+	{
+		clusterStarts.push_back(triangle);
+		clusterBase = misses;
+		clusterMisses = 0;
+		clusterTriangles = 0;
+	};
+
+	clusterStarts.clear();
+	clusterStarts.push_back(0);
+
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const unsigned int* triangle = &indices[t * 3];
+
+		// Hard boundary: a triangle that misses on all three vertices restarts the cache anyway, cutting there is free
+		if (clusterTriangles > 0 && !inCache(triangle[0]) && !inCache(triangle[1]) && !inCache(triangle[2]))
+			startCluster(t);
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (!inCache(triangle[k]))
+			{
+				misses++;
+				insertedAt[triangle[k]] = misses;
+				clusterMisses++;
+			}
+		}
+		clusterTriangles++;
+
+		// Soft boundary: the cluster is long enough that its own cold cache start keeps ACMR within the threshold
+		if (t + 1 < triangleCount && float(clusterMisses) / clusterTriangles <= threshold * meshAcmr)
+			startCluster(t + 1);
+	}
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+
+	std::vector<size_t> clusterStarts;
+	GenerateClusters(indices, vertices.size(), threshold, clusterStarts);
+	clusterStarts.push_back(triangleCount);
+
+	const size_t clusterCount = clusterStarts.size() - 1;
+
+	// Area weighted centroid of the whole mesh and of every cluster, plus the clusters' average normals
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> clusterAreas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const glm::vec3& a = vertices[indices[t * 3]].vPosition;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].vPosition;
+			const glm::vec3& p = vertices[indices[t * 3 + 2]].vPosition;
+
+			glm::vec3 normal = glm::cross(b - a, p - a);		// Length is twice the area
+			float area = glm::length(normal);
+			glm::vec3 centroid = (a + b + p) / 3.0f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += normal;
+			clusterAreas[c] += area;
+		}
+
+		meshCentroid += clusterCentroids[c];
+		meshArea += clusterAreas[c];
+	}
+
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	// Clusters facing away from the center are more likely to be in front of others, so they go first
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::vec3 centroid = clusterAreas[c] > 0.0f ? clusterCentroids[c] / clusterAreas[c] : glm::vec3(0.0f);
+		float normalLength = glm::length(clusterNormals[c]);
+		glm::vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+
+		sortKeys[c] = glm::dot(centroid - meshCentroid, normal);
+	}
+
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+
+	for (size_t c : order)
+		result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	const unsigned int UNUSED = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == UNUSED)
+		{
+			remap[index] = static_cast<unsigned int>(result.size());
+			result.push_back(vertices[index]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices.swap(result);
+}
+
+float MeshOptimizer::measureOverdraw(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, unsigned int resolution)
+{
+	struct View
+	{
+		glm::vec3 right, up, forward;
+	};
+
+	// Right handed bases looking down each axis, counter clockwise triangles face the viewer
+	static const View views[6] = {
+		{ glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, -1) },
+		{ glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, 0, 1) },
+		{ glm::vec3(0, 0, -1), glm::vec3(0, 1, 0), glm::vec3(-1, 0, 0) },
+		{ glm::vec3(0, 0, 1), glm::vec3(0, 1, 0), glm::vec3(1, 0, 0) },
+		{ glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0) },
+		{ glm::vec3(1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, 1, 0) }
+	};
+
+	if (vertices.empty() || indices.size() < 3)
+		return 0.0f;
+
+	glm::vec3 boundsMin = vertices[0].vPosition, boundsMax = vertices[0].vPosition;
+	for (const Vertex& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.vPosition);
+		boundsMax = glm::max(boundsMax, vertex.vPosition);
+	}
+
+	glm::vec3 extent = boundsMax - boundsMin;
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float scale = std::max(extent.x, std::max(extent.y, extent.z)) * 0.5f;
+	if (scale <= 0.0f)
+		return 0.0f;
+
+	std::vector<float> depth(resolution * resolution);
+	size_t shaded = 0, covered = 0;
+
+	for (const View& view : views)
+	{
+		std::fill(depth.begin(), depth.end(), INFINITY);
+
+		auto project = [&](const glm::vec3& position)
+		{
+			glm::vec3 p = (position - center) / scale;		// Into [-1, 1]
+			return glm::vec3(glm::dot(p, view.right), glm::dot(p, view.up), glm::dot(p, view.forward));
+		};
+
+		for (size_t t = 0; t + 2 < indices.size(); t += 3)
+		{
+			glm::vec3 a = project(vertices[indices[t]].vPosition);
+			glm::vec3 b = project(vertices[indices[t + 1]].vPosition);
+			glm::vec3 c = project(vertices[indices[t + 2]].vPosition);
+
+			float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+			if (area <= 0.0f)
+				continue;		// Back facing or degenerate
+
+			// Pixel bounds of the triangle
+			auto toPixel = [resolution](float v) { return (v + 1.0f) * 0.5f * resolution; };
+			float minX = toPixel(std::min(a.x, std::min(b.x, c.x))), maxX = toPixel(std::max(a.x, std::max(b.x, c.x)));
+			float minY = toPixel(std::min(a.y, std::min(b.y, c.y))), maxY = toPixel(std::max(a.y, std::max(b.y, c.y)));
+
+			int x0 = std::max(0, int(minX)), x1 = std::min(int(resolution) - 1, int(maxX));
+			int y0 = std::max(0, int(minY)), y1 = std::min(int(resolution) - 1, int(maxY));
+
+			for (int y = y0; y <= y1; y++)
+			{
+				for (int x = x0; x <= x1; x++)
+				{
+					// Pixel center back in projected space
+					float px = (x + 0.5f) / resolution * 2.0f - 1.0f;
+					float py = (y + 0.5f) / resolution * 2.0f - 1.0f;
+
+					float w0 = ((b.x - px) * (c.y - py) - (c.x - px) * (b.y - py)) / area;
+					float w1 = ((c.x - px) * (a.y - py) - (a.x - px) * (c.y - py)) / area;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+
+					float z = w0 * a.z + w1 * b.z + w2 * c.z;
+					float& stored = depth[y * resolution + x];
+
+					if (z < stored)
+					{
+						if (stored == INFINITY)
+							covered++;
+						stored = z;
+						shaded++;
+					}
+				}
+			}
+		}
+	}
+
+	return covered ? float(shaded) / covered : 0.0f;
+}
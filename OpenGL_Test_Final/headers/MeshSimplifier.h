@@ -0,0 +1,398 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "MappedFile.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+
+// How MeshSimplifier::generateLods() builds the LOD chain of a mesh
+struct MeshLodOptions
+{
+	unsigned int maxLods = 4;		// Including the full mesh, 1 turns LOD generation off
+	float reduction = 0.5f;			// Triangle count of each LOD relative to the one before it
+	float maxError = 0.05f;			// Largest error a LOD may have, relative to the size of the mesh
+	unsigned int minTriangles = 32;	// No LOD gets fewer triangles than this
+
+	// Packs the options into an integer for cache files
+	uint32_t getKey() const { return static_cast<uint32_t>(HashBytes(this, sizeof(MeshLodOptions))); }
+};
+
+// Quadric error metric edge collapse (Garland & Heckbert). The simplified meshes index the original vertices,
+// vertices only ever collapse onto one of their neighbours, so every LOD can share one vertex buffer.
+// Vertices on open borders and on attribute seams (several vertices at one position) stay where they are,
+// so LODs never tear holes or smear texture coordinates across a seam.
+class MeshSimplifier
+{
+public:
+	// Collapses edges until at most targetIndexCount indices are left or the next collapse would move the surface more
+	// than targetError, relative to the size of the mesh. resultError gets the error that was reached, also relative.
+	static std::vector<unsigned int> simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t targetIndexCount,
+		float targetError, float* resultError = nullptr);
+
+	// Appends the LODs of the mesh to indices and returns where each one is, LOD 0 being the indices passed in.
+	// The errors of the returned LODs are in model units.
+	static std::vector<MeshLod> generateLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const MeshLodOptions& options = MeshLodOptions());
+
+	// Largest side of the bounding box of the vertices, what relative errors are relative to
+	static float getExtent(const std::vector<Vertex>& vertices);
+
+private:
+	// Sum of squared distances to a set of planes, weighted by the area of the triangles they came from
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		void addPlane(const glm::vec3& normal, float distance, float area);
+		void add(const Quadric& other);
+
+		// Mean squared distance of the point to the planes
+		double evaluate(const glm::vec3& point) const;
+	};
+
+	// Collapse of vertex from onto vertex to
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+	};
+
+	static void FindLockedVertices(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, std::vector<char>& locked);
+};
+
+void MeshSimplifier::Quadric::addPlane(const glm::vec3& normal, float distance, float area)
+{
+	double x = normal.x, y = normal.y, z = normal.z, d = distance, w = area;
+
+	a00 += w * x * x; a01 += w * x * y; a02 += w * x * z;
+	a11 += w * y * y; a12 += w * y * z;
+	a22 += w * z * z;
+	b0 += w * x * d; b1 += w * y * d; b2 += w * z * d;
+	c += w * d * d;
+	weight += w;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& other)
+{
+	a00 += other.a00; a01 += other.a01; a02 += other.a02;
+	a11 += other.a11; a12 += other.a12;
+	a22 += other.a22;
+	b0 += other.b0; b1 += other.b1; b2 += other.b2;
+	c += other.c;
+	weight += other.weight;
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::vec3& point) const
+{
+	double x = point.x, y = point.y, z = point.z;
+
+	double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z
+		+ a11 * y * y + 2 * a12 * y * z
+		+ a22 * z * z
+		+ 2 * (b0 * x + b1 * y + b2 * z)
+		+ c;
+
+	// Rounding can push the error of a point on all planes slightly below zero
+	return weight > 0 ? std::max(error, 0.0) / weight : 0.0;
+}
+
+float MeshSimplifier::getExtent(const std::vector<Vertex>& vertices)
+{
+	if (vertices.empty())
+		return 0.0f;
+
+	glm::vec3 min = vertices[0].vPosition, max = vertices[0].vPosition;
+	for (const Vertex& vertex : vertices)
+	{
+		min = glm::min(min, vertex.vPosition);
+		max = glm::max(max, vertex.vPosition);
+	}
+
+	glm::vec3 size = max - min;
+	return std::max(size.x, std::max(size.y, size.z));
+}
+
+void MeshSimplifier::FindLockedVertices(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, std::vector<char>& locked)
+{
+	// Vertices sharing a position (seams) get the same position ID, the first vertex at that position
+	size_t tableSize = 1;
+	while (tableSize < vertices.size() * 2)
+		tableSize <<= 1;
+
+	const unsigned int EMPTY = ~0u;
+	std::vector<unsigned int> table(tableSize, EMPTY);
+	std::vector<unsigned int> position(vertices.size());
+	std::vector<unsigned int> positionUsers(vertices.size(), 0);
+
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		size_t slot = HashBytes(&vertices[i].vPosition, sizeof(glm::vec3)) & (tableSize - 1);
+
+		while (table[slot] != EMPTY && std::memcmp(&vertices[table[slot]].vPosition, &vertices[i].vPosition, sizeof(glm::vec3)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+
+		if (table[slot] == EMPTY)
+			table[slot] = static_cast<unsigned int>(i);
+
+		position[i] = table[slot];
+		positionUsers[position[i]]++;
+	}
+
+	locked.assign(vertices.size(), 0);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		if (positionUsers[position[i]] > 1)
+			locked[i] = 1;
+	}
+
+	// An edge is on a border if no triangle walks it the other way round. Edges are compared by position,
+	// so the two sides of a seam still count as connected.
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			uint64_t a = position[indices[t + k]], b = position[indices[t + (k + 1) % 3]];
+			edges.push_back(a << 32 | b);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+			uint64_t reverse = uint64_t(position[b]) << 32 | position[a];
+
+			if (!std::binary_search(edges.begin(), edges.end(), reverse))
+				locked[a] = locked[b] = 1;
+		}
+	}
+}
+
+std::vector<unsigned int> MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, size_t targetIndexCount,
+	float targetError, float* resultError)
+{
+	std::vector<unsigned int> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+	const size_t vertexCount = vertices.size();
+
+	if (resultError)
+		*resultError = 0.0f;
+
+	float extent = getExtent(vertices);
+	if (extent <= 0.0f || result.size() <= targetIndexCount)
+		return result;
+
+	std::vector<char> locked;
+	FindLockedVertices(vertices, result, locked);
+
+	// Every vertex starts with the planes of the triangles around it
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t t = 0; t < result.size(); t += 3)
+	{
+		const glm::vec3& p0 = vertices[result[t]].vPosition;
+		const glm::vec3& p1 = vertices[result[t + 1]].vPosition;
+		const glm::vec3& p2 = vertices[result[t + 2]].vPosition;
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+
+		normal /= length;
+		Quadric plane;
+		plane.addPlane(normal, -glm::dot(normal, p0), length * 0.5f);
+
+		for (int k = 0; k < 3; k++)
+			quadrics[result[t + k]].add(plane);
+	}
+
+	const double errorLimit = double(targetError) * extent * double(targetError) * extent;
+	double reachedError = 0.0;
+
+	std::vector<unsigned int> triangleCounts(vertexCount);
+	std::vector<unsigned int> triangleOffsets(vertexCount + 1);
+	std::vector<unsigned int> vertexTriangles;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<Collapse> collapses;
+
+	// Each pass collapses the cheapest edges that don't share a triangle, then rebuilds the adjacency
+	while (result.size() > targetIndexCount)
+	{
+		const size_t triangleCount = result.size() / 3;
+
+		std::fill(triangleCounts.begin(), triangleCounts.end(), 0);
+		for (unsigned int index : result)
+			triangleCounts[index]++;
+
+		triangleOffsets[0] = 0;
+		for (size_t v = 0; v < vertexCount; v++)
+			triangleOffsets[v + 1] = triangleOffsets[v] + triangleCounts[v];
+
+		vertexTriangles.resize(result.size());
+		{
+			std::vector<unsigned int> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t t = 0; t < triangleCount; t++)
+				for (int k = 0; k < 3; k++)
+					vertexTriangles[fill[result[t * 3 + k]]++] = static_cast<unsigned int>(t);
+		}
+
+		// Cheapest direction of every edge, each interior edge shows up twice so only the a < b half is used.
+		// Border edges only show up once, but their vertices are locked anyway.
+		collapses.clear();
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+				if (a > b || (locked[a] && locked[b]))
+					continue;
+
+				Quadric quadric = quadrics[a];
+				quadric.add(quadrics[b]);
+
+				double costAB = locked[a] ? -1.0 : quadric.evaluate(vertices[b].vPosition);
+				double costBA = locked[b] ? -1.0 : quadric.evaluate(vertices[a].vPosition);
+
+				if (costBA < 0.0 || (costAB >= 0.0 && costAB <= costBA))
+					collapses.push_back({ a, b, costAB });
+				else
+					collapses.push_back({ b, a, costBA });
+			}
+		}
+
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+
+		// Every collapse removes about two triangles. Passes are capped so the costs get refreshed regularly.
+		size_t needed = (result.size() - targetIndexCount) / 6 + 1;
+		size_t budget = std::min(needed, collapses.size() / 4 + 1);
+
+		std::fill(touched.begin(), touched.end(), 0);
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = static_cast<unsigned int>(v);
+
+		size_t applied = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.cost > errorLimit || applied >= budget)
+				break;
+
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Reject the collapse if a triangle around the removed vertex would flip or become degenerate
+			const glm::vec3& target = vertices[collapse.to].vPosition;
+			bool flips = false;
+
+			for (unsigned int i = triangleOffsets[collapse.from]; i < triangleOffsets[collapse.from + 1] && !flips; i++)
+			{
+				const unsigned int* triangle = &result[vertexTriangles[i] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+					continue;
+
+				glm::vec3 p[3], q[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = vertices[triangle[k]].vPosition;
+					q[k] = triangle[k] == collapse.from ? target : p[k];
+				}
+
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+				if (glm::dot(before, after) <= 0.0f)
+					flips = true;
+			}
+
+			if (flips)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			reachedError = std::max(reachedError, collapse.cost);
+			applied++;
+
+			// Nothing around the collapse may move again this pass, the flip test above assumed it stays put
+			for (unsigned int i = triangleOffsets[collapse.from]; i < triangleOffsets[collapse.from + 1]; i++)
+			{
+				const unsigned int* triangle = &result[vertexTriangles[i] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+			}
+			touched[collapse.to] = 1;
+		}
+
+		if (applied == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that lost a corner
+		size_t write = 0;
+		for (size_t t = 0; t < result.size(); t += 3)
+		{
+			unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError)
+		*resultError = static_cast<float>(std::sqrt(reachedError) / extent);
+
+	return result;
+}
+
+std::vector<MeshLod> MeshSimplifier::generateLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, const MeshLodOptions& options)
+{
+	std::vector<MeshLod> lods;
+	lods.push_back({ 0, static_cast<unsigned int>(indices.size()), 0.0f });
+
+	float extent = getExtent(vertices);
+	if (options.maxLods <= 1 || extent <= 0.0f)
+		return lods;
+
+	// Every LOD is simplified from the full mesh, so errors don't add up along the chain
+	const std::vector<unsigned int> full(indices);
+	size_t previous = full.size();
+
+	for (unsigned int level = 1; level < options.maxLods; level++)
+	{
+		size_t target = static_cast<size_t>(previous / 3 * options.reduction) * 3;
+		if (target / 3 < options.minTriangles)
+			break;
+
+		float error = 0.0f;
+		std::vector<unsigned int> lod = simplify(vertices, full, target, options.maxError, &error);
+
+		// The error limit or the locked vertices stopped it, further LODs would only be copies
+		if (lod.size() * 10 > previous * 9)
+			break;
+
+		MeshOptimizer::optimizeVertexCache(lod, vertices.size());
+
+		lods.push_back({ static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(lod.size()), error * extent });
+		indices.insert(indices.end(), lod.begin(), lod.end());
+		previous = lod.size();
+	}
+
+	return lods;
+}
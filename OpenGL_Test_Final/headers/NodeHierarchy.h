@@ -0,0 +1,270 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "ThreadPool.h"
+
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Transform hierarchy stored as flat arrays, one entry per node in depth first order. Every subtree is a contiguous
+// range [node, getSubtreeEnd(node)), so updating the world matrices is one front to back pass in which a parent is
+// always done before its children, and subtrees that don't share a parent can be handed to different threads.
+//
+// Changing a local transform only marks the node dirty, update() then recomputes the world matrices of the dirty
+// nodes and everything below them.
+class NodeHierarchy
+{
+public:
+	// Below this many nodes the whole pass runs on the calling thread
+	static constexpr size_t PARALLEL_MIN_NODES = 4096;
+
+	// Subtrees up to this size are updated as one piece of work
+	static constexpr size_t SUBTREE_GRAIN = 1024;
+
+private:
+	std::vector<int> m_Parents;
+	std::vector<unsigned int> m_SubtreeEnds;
+	std::vector<glm::vec3> m_Translations;
+	std::vector<glm::quat> m_Rotations;
+	std::vector<glm::vec3> m_Scales;
+	std::vector<glm::mat4> m_Worlds;
+	std::vector<uint8_t> m_Dirty;
+
+	// Path from a root to the last added node, depth first order means a new node hangs off somewhere on it
+	std::vector<unsigned int> m_OpenPath;
+	bool m_DepthFirst = true;
+
+	// Roots of subtrees too large for one piece, updated in order before the pieces (m_Ranges) run in parallel
+	std::vector<unsigned int> m_SerialNodes;
+	std::vector<std::pair<unsigned int, unsigned int>> m_Ranges;
+	bool m_ScheduleValid = false;
+
+public:
+	// Appends a node below parent (-1 for a root). The parent has to be on the path from the root to the last added
+	// node, adding the nodes depth first does that. Returns the node's index.
+	unsigned int addNode(int parent, const glm::mat4& local);
+
+	void clear();
+
+	size_t size() const { return m_Parents.size(); }
+
+	int getParent(unsigned int node) const { return m_Parents[node]; }
+
+	// One past the last node of node's subtree
+	unsigned int getSubtreeEnd(unsigned int node) const { return m_SubtreeEnds[node]; }
+
+	const glm::vec3& getTranslation(unsigned int node) const { return m_Translations[node]; }
+	const glm::quat& getRotation(unsigned int node) const { return m_Rotations[node]; }
+	const glm::vec3& getScale(unsigned int node) const { return m_Scales[node]; }
+
+	void setTranslation(unsigned int node, const glm::vec3& translation) { m_Translations[node] = translation; m_Dirty[node] = 1; }
+	void setRotation(unsigned int node, const glm::quat& rotation) { m_Rotations[node] = rotation; m_Dirty[node] = 1; }
+	void setScale(unsigned int node, const glm::vec3& scale) { m_Scales[node] = scale; m_Dirty[node] = 1; }
+
+	// Sets translation, rotation and scale from a matrix without shear
+	void setLocal(unsigned int node, const glm::mat4& local);
+
+	glm::mat4 getLocal(unsigned int node) const;
+
+	// Node to hierarchy space as of the last update()
+	const glm::mat4& getWorld(unsigned int node) const { return m_Worlds[node]; }
+	const std::vector<glm::mat4>& getWorlds() const { return m_Worlds; }
+
+	bool isDirty(unsigned int node) const { return m_Dirty[node] != 0; }
+
+	// Recomputes the world matrices of dirty nodes and their subtrees. Returns how many were recomputed.
+	size_t update();
+
+private:
+	void BuildSchedule();
+	void PartitionSubtree(unsigned int node);
+
+	// Updates nodes [begin, end), returns how many were dirty
+	size_t UpdateRange(unsigned int begin, unsigned int end);
+};
+
+unsigned int NodeHierarchy::addNode(int parent, const glm::mat4& local)
+{
+	unsigned int node = static_cast<unsigned int>(m_Parents.size());
+
+	if (parent >= static_cast<int>(node))
+	{
+		std::cerr << "Node " << node << " has to come after its parent " << parent << std::endl;
+		parent = -1;
+	}
+
+	while (!m_OpenPath.empty() && static_cast<int>(m_OpenPath.back()) != parent)
+		m_OpenPath.pop_back();
+
+	// Still topologically sorted, but the subtrees are not contiguous any more
+	if (parent >= 0 && m_OpenPath.empty())
+		m_DepthFirst = false;
+
+	m_Parents.push_back(parent);
+	m_SubtreeEnds.push_back(node + 1);
+	m_Translations.emplace_back(0.0f);
+	m_Rotations.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+	m_Scales.emplace_back(1.0f);
+	m_Worlds.emplace_back(1.0f);
+	m_Dirty.push_back(1);
+
+	m_OpenPath.push_back(node);
+	for (unsigned int ancestor : m_OpenPath)
+		m_SubtreeEnds[ancestor] = node + 1;
+
+	setLocal(node, local);
+	m_ScheduleValid = false;
+	return node;
+}
+
+void NodeHierarchy::clear()
+{
+	m_Parents.clear();
+	m_SubtreeEnds.clear();
+	m_Translations.clear();
+	m_Rotations.clear();
+	m_Scales.clear();
+	m_Worlds.clear();
+	m_Dirty.clear();
+	m_OpenPath.clear();
+	m_DepthFirst = true;
+	m_ScheduleValid = false;
+}
+
+void NodeHierarchy::setLocal(unsigned int node, const glm::mat4& local)
+{
+	glm::vec3 scale(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])), glm::length(glm::vec3(local[2])));
+
+	// A mirrored basis keeps its rotation by flipping one axis' scale
+	if (glm::dot(glm::cross(glm::vec3(local[0]), glm::vec3(local[1])), glm::vec3(local[2])) < 0.0f)
+		scale.x = -scale.x;
+
+	glm::mat3 rotation(glm::vec3(local[0]) / (scale.x != 0.0f ? scale.x : 1.0f),
+		glm::vec3(local[1]) / (scale.y != 0.0f ? scale.y : 1.0f),
+		glm::vec3(local[2]) / (scale.z != 0.0f ? scale.z : 1.0f));
+
+	m_Translations[node] = glm::vec3(local[3]);
+	m_Rotations[node] = glm::quat_cast(rotation);
+	m_Scales[node] = scale;
+	m_Dirty[node] = 1;
+}
+
+glm::mat4 NodeHierarchy::getLocal(unsigned int node) const
+{
+	glm::mat4 local = glm::mat4_cast(m_Rotations[node]);
+	local[0] *= m_Scales[node].x;
+	local[1] *= m_Scales[node].y;
+	local[2] *= m_Scales[node].z;
+	local[3] = glm::vec4(m_Translations[node], 1.0f);
+	return local;
+}
+
+size_t NodeHierarchy::update()
+{
+	const unsigned int count = static_cast<unsigned int>(size());
+
+	size_t updated = 0;
+	if (count < PARALLEL_MIN_NODES || !m_DepthFirst)
+	{
+		updated = UpdateRange(0, count);
+	}
+	else
+	{
+		if (!m_ScheduleValid)
+			BuildSchedule();
+
+		for (unsigned int node : m_SerialNodes)
+			updated += UpdateRange(node, node + 1);
+
+		// The parents of every range are serial nodes (done above) or inside the range itself
+		std::vector<size_t> rangeUpdated(m_Ranges.size(), 0);
+		ThreadPool::getInstance().parallelFor(m_Ranges.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+				rangeUpdated[i] = UpdateRange(m_Ranges[i].first, m_Ranges[i].second);
+		});
+
+		for (size_t rangeCount : rangeUpdated)
+			updated += rangeCount;
+	}
+
+	// Only cleared now, children read their parent's flag during the pass
+	if (!m_Dirty.empty())
+		std::memset(m_Dirty.data(), 0, m_Dirty.size());
+
+	return updated;
+}
+
+size_t NodeHierarchy::UpdateRange(unsigned int begin, unsigned int end)
+{
+	size_t updated = 0;
+
+	for (unsigned int node = begin; node < end; node++)
+	{
+		int parent = m_Parents[node];
+		if (parent >= 0 && m_Dirty[parent])
+			m_Dirty[node] = 1;
+
+		if (!m_Dirty[node])
+			continue;
+
+		m_Worlds[node] = parent >= 0 ? m_Worlds[parent] * getLocal(node) : getLocal(node);
+		updated++;
+	}
+
+	return updated;
+}
+
+void NodeHierarchy::BuildSchedule()
+{
+	m_SerialNodes.clear();
+	m_Ranges.clear();
+
+	for (unsigned int root = 0; root < size(); root = m_SubtreeEnds[root])
+		PartitionSubtree(root);
+
+	m_ScheduleValid = true;
+}
+
+void NodeHierarchy::PartitionSubtree(unsigned int node)
+{
+	unsigned int end = m_SubtreeEnds[node];
+
+	if (end - node <= SUBTREE_GRAIN)
+	{
+		m_Ranges.emplace_back(node, end);
+		return;
+	}
+
+	m_SerialNodes.push_back(node);
+
+	// Neighbouring small subtrees are next to each other in memory, they are gathered into pieces of up to the grain
+	unsigned int pieceBegin = node + 1;
+	for (unsigned int child = node + 1; child < end; child = m_SubtreeEnds[child])
+	{
+		unsigned int childEnd = m_SubtreeEnds[child];
+
+		if (childEnd - child > SUBTREE_GRAIN)
+		{
+			if (pieceBegin < child)
+				m_Ranges.emplace_back(pieceBegin, child);
+			PartitionSubtree(child);
+			pieceBegin = childEnd;
+		}
+		else if (childEnd - pieceBegin > SUBTREE_GRAIN)
+		{
+			m_Ranges.emplace_back(pieceBegin, child);
+			pieceBegin = child;
+		}
+	}
+
+	if (pieceBegin < end)
+		m_Ranges.emplace_back(pieceBegin, end);
+}
@@ -0,0 +1,711 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+// One corner of a triangle, zero based indices into the position, texture coordinate and normal arrays, -1 if the
+// face left that component out
+struct ObjCorner
+{
+	int position;
+	int texCoord;
+	int normal;
+};
+
+// Corners from firstCorner up to the next run's use material (an index into ObjData::materials)
+struct ObjMaterialRun
+{
+	size_t firstCorner;
+	int material;
+};
+
+// A material of an MTL file, colors and texture paths as written (relative to the MTL file)
+struct ObjMaterial
+{
+	std::string name;
+	glm::vec3 ambient = glm::vec3(0.0f);		// Ka
+	glm::vec3 diffuse = glm::vec3(0.8f);		// Kd
+	glm::vec3 specular = glm::vec3(0.0f);		// Ks
+	float shininess = 0.0f;						// Ns
+	float opacity = 1.0f;						// d
+	std::string diffuseMap;						// map_Kd
+	std::string specularMap;					// map_Ks
+	std::string normalMap;						// map_Bump, bump or norm
+};
+
+// Everything SimpleModel reads from an OBJ file. Faces with more than three corners are split into triangle fans,
+// so corners holds three entries per triangle.
+struct ObjData
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texCoords;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners;
+	std::string materialLibrary;		// First mtllib, empty if there is none
+
+	std::vector<std::string> materials;			// usemtl names in the order they first appear
+	std::vector<ObjMaterialRun> materialRuns;	// Sorted by firstCorner, corners before the first run have no material
+};
+
+// How many positions, texture coordinates and normals came before the text being parsed, for parsing a file piece by
+// piece. Corner indices then count from the start of the file, the vertex arrays only hold the piece's own.
+struct ObjParseBase
+{
+	size_t positions = 0;
+	size_t texCoords = 0;
+	size_t normals = 0;
+};
+
+// Open addressing hash map from (position, texture coordinate, normal) corners to the index of the unique vertex
+// made from them. The slots only hold vertex indices, the corners themselves are kept in insertion order, which is
+// also the order of the vertex buffer built from them.
+class ObjVertexMap
+{
+private:
+	std::vector<uint32_t> m_Slots;		// Vertex index + 1, 0 is an empty slot
+	std::vector<ObjCorner> m_Vertices;
+	uint32_t m_Mask = 0;
+
+public:
+	// expectedVertices sizes the table up front, it grows past that on its own
+	explicit ObjVertexMap(size_t expectedVertices = 1024);
+
+	// Index of the vertex for corner, adding it if it is new
+	uint32_t insert(const ObjCorner& corner);
+
+	const std::vector<ObjCorner>& getVertices() const { return m_Vertices; }
+
+	size_t size() const { return m_Vertices.size(); }
+
+	void clear();
+
+private:
+	static uint32_t Hash(const ObjCorner& corner)
+	{
+		uint32_t h = uint32_t(corner.position) * 0x9E3779B1u ^ uint32_t(corner.texCoord) * 0x85EBCA77u ^ uint32_t(corner.normal) * 0xC2B2AE3Du;
+		return h ^ (h >> 15);
+	}
+
+	void Grow();
+};
+
+ObjVertexMap::ObjVertexMap(size_t expectedVertices)
+{
+	size_t capacity = 16;
+	while (capacity < expectedVertices * 2)
+		capacity *= 2;
+
+	m_Slots.assign(capacity, 0);
+	m_Mask = static_cast<uint32_t>(capacity - 1);
+	m_Vertices.reserve(expectedVertices);
+}
+
+uint32_t ObjVertexMap::insert(const ObjCorner& corner)
+{
+	// Kept at most half full so probe runs stay short
+	if ((m_Vertices.size() + 1) * 2 > m_Slots.size())
+		Grow();
+
+	for (uint32_t slot = Hash(corner) & m_Mask;; slot = (slot + 1) & m_Mask)
+	{
+		uint32_t entry = m_Slots[slot];
+		if (entry == 0)
+		{
+			m_Vertices.push_back(corner);
+			m_Slots[slot] = static_cast<uint32_t>(m_Vertices.size());
+			return static_cast<uint32_t>(m_Vertices.size() - 1);
+		}
+
+		const ObjCorner& existing = m_Vertices[entry - 1];
+		if (existing.position == corner.position && existing.texCoord == corner.texCoord && existing.normal == corner.normal)
+			return entry - 1;
+	}
+}
+
+void ObjVertexMap::clear()
+{
+	std::fill(m_Slots.begin(), m_Slots.end(), 0);
+	m_Vertices.clear();
+}
+
+void ObjVertexMap::Grow()
+{
+	m_Slots.assign(m_Slots.size() * 2, 0);
+	m_Mask = static_cast<uint32_t>(m_Slots.size() - 1);
+
+	for (uint32_t i = 0; i < m_Vertices.size(); i++)
+	{
+		uint32_t slot = Hash(m_Vertices[i]) & m_Mask;
+		while (m_Slots[slot] != 0)
+			slot = (slot + 1) & m_Mask;
+		m_Slots[slot] = i + 1;
+	}
+}
+
+// Reads OBJ files through a memory mapping. The file is cut into chunks at line ends that are parsed in parallel,
+// then stitched together: every chunk's counts become offsets through prefix sums, which also resolve the
+// negative (relative) indices a chunk could not know the absolute value of.
+class ObjParser
+{
+public:
+	// Chunks are at least this large, smaller files are parsed on the calling thread in one go
+	static constexpr size_t CHUNK_SIZE = size_t(4) << 20;
+
+	static bool parse(const std::string& path, ObjData& data);
+
+	// Parses text that is already in memory
+	static bool parse(const char* text, size_t size, ObjData& data);
+
+	// Parses text that continues a file after base's elements, text has to start at the beginning of a line
+	static bool parse(const char* text, size_t size, ObjData& data, const ObjParseBase& base);
+
+	// Reads the materials of an MTL file
+	static bool parseMaterials(const std::string& path, std::vector<ObjMaterial>& materials);
+
+	// Number parsing used by the OBJ and MTL readers. Both skip leading blanks, stop at the first character that doesn't
+	// belong to the number and return false (leaving p alone) when there is no number.
+	static bool ParseFloat(const char*& p, const char* end, float& value);
+	static bool ParseInt(const char*& p, const char* end, int& value);
+
+private:
+	// A corner as the chunk saw it: absolute indices, or for negative ones the position relative to the chunk's own
+	// first element, marked in relativeMask (bit 0 position, 1 texture coordinate, 2 normal)
+	struct ChunkCorner
+	{
+		int index[3];
+		uint32_t relativeMask;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> texCoords;
+		std::vector<glm::vec3> normals;
+		std::vector<ChunkCorner> corners;
+		std::string materialLibrary;
+		std::vector<std::pair<size_t, std::string>> materialSwitches;	// usemtl lines, by the corner they start at
+
+		bool failed = false;
+		size_t errorLine = 0;		// Line inside the chunk
+	};
+
+	static constexpr int MISSING = INT_MIN;
+
+	static void ParseChunk(Chunk& chunk);
+	static bool ParseCorner(const char*& p, const char* end, const Chunk& chunk, ChunkCorner& corner);
+
+	static bool IsBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	static void SkipBlanks(const char*& p, const char* end)
+	{
+		while (p < end && IsBlank(*p))
+			p++;
+	}
+
+	// The rest of the line without surrounding blanks, for names and paths
+	static std::string ReadName(const char* p, const char* lineEnd)
+	{
+		SkipBlanks(p, lineEnd);
+		while (lineEnd > p && IsBlank(lineEnd[-1]))
+			lineEnd--;
+		return std::string(p, lineEnd);
+	}
+
+	// Path of a texture map statement: the options in front of it (-o 1 1 1, -bm 0.5, ...) are skipped and the rest of
+	// the line is the path, spaces included
+	static std::string ReadMapPath(const char* p, const char* lineEnd)
+	{
+		while (true)
+		{
+			SkipBlanks(p, lineEnd);
+			if (p >= lineEnd || *p != '-')
+				break;
+
+			const char* option = p;
+			while (p < lineEnd && !IsBlank(*p))
+				p++;
+			std::string name(option, p);
+
+			if (name == "-o" || name == "-s" || name == "-t")
+			{
+				// One to three numbers
+				for (int i = 0; i < 3; i++)
+				{
+					const char* q = p;
+					float value;
+					if (!ParseFloat(q, lineEnd, value) || (q < lineEnd && !IsBlank(*q)))
+						break;
+					p = q;
+				}
+			}
+			else
+			{
+				int arguments = name == "-mm" ? 2 : 1;
+				for (int i = 0; i < arguments; i++)
+				{
+					SkipBlanks(p, lineEnd);
+					while (p < lineEnd && !IsBlank(*p))
+						p++;
+				}
+			}
+		}
+
+		return ReadName(p, lineEnd);
+	}
+
+	static bool StartsWithKeyword(const char* p, const char* lineEnd, const char* keyword)
+	{
+		size_t length = std::strlen(keyword);
+		return size_t(lineEnd - p) > length && std::memcmp(p, keyword, length) == 0 && IsBlank(p[length]);
+	}
+};
+
+bool ObjParser::parse(const std::string& path, ObjData& data)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cerr << "Failed to open object file: " << path << std::endl;
+		return false;
+	}
+
+	if (!parse(reinterpret_cast<const char*>(file.data()), file.size(), data))
+	{
+		std::cerr << "Failed to parse object file: " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool ObjParser::parse(const char* text, size_t size, ObjData& data)
+{
+	return parse(text, size, data, ObjParseBase());
+}
+
+bool ObjParser::parse(const char* text, size_t size, ObjData& data, const ObjParseBase& base)
+{
+	data = ObjData();
+
+	// Chunk boundaries move forward to just past the next line end
+	std::vector<Chunk> chunks;
+	const char* end = text + size;
+	for (const char* begin = text; begin < end;)
+	{
+		const char* split = begin + std::min(CHUNK_SIZE, size_t(end - begin));
+		while (split < end && split[-1] != '\n')
+			split++;
+
+		chunks.emplace_back();
+		chunks.back().begin = begin;
+		chunks.back().end = split;
+		begin = split;
+	}
+
+	ThreadPool::getInstance().parallelFor(chunks.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			ParseChunk(chunks[i]);
+	});
+
+	// Prefix sums give every chunk its place in the merged arrays
+	struct Offsets { size_t positions, texCoords, normals, corners; };
+	std::vector<Offsets> offsets(chunks.size() + 1, { 0, 0, 0, 0 });
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		const Chunk& chunk = chunks[i];
+		if (chunk.failed)
+		{
+			size_t line = chunk.errorLine;
+			for (const char* p = text; p < chunk.begin; p++)
+				line += *p == '\n';
+
+			std::cerr << "OBJ parse error on line " << line + 1 << std::endl;
+			return false;
+		}
+
+		if (data.materialLibrary.empty())
+			data.materialLibrary = chunk.materialLibrary;
+
+		// A chunk without usemtl lines carries on with the material the one before it ended with
+		for (const auto& [corner, name] : chunk.materialSwitches)
+		{
+			auto found = std::find(data.materials.begin(), data.materials.end(), name);
+			int material = static_cast<int>(found - data.materials.begin());
+			if (found == data.materials.end())
+				data.materials.push_back(name);
+
+			data.materialRuns.push_back({ offsets[i].corners + corner, material });
+		}
+
+		offsets[i + 1].positions = offsets[i].positions + chunk.positions.size();
+		offsets[i + 1].texCoords = offsets[i].texCoords + chunk.texCoords.size();
+		offsets[i + 1].normals = offsets[i].normals + chunk.normals.size();
+		offsets[i + 1].corners = offsets[i].corners + chunk.corners.size();
+	}
+
+	const Offsets& total = offsets.back();
+	data.positions.resize(total.positions);
+	data.texCoords.resize(total.texCoords);
+	data.normals.resize(total.normals);
+	data.corners.resize(total.corners);
+
+	std::vector<uint8_t> outOfRange(chunks.size(), 0);
+
+	ThreadPool::getInstance().parallelFor(chunks.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const Chunk& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + offsets[i].positions);
+			std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), data.texCoords.begin() + offsets[i].texCoords);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + offsets[i].normals);
+
+			const int64_t first[3] = { int64_t(base.positions + offsets[i].positions), int64_t(base.texCoords + offsets[i].texCoords), int64_t(base.normals + offsets[i].normals) };
+			const int64_t count[3] = { int64_t(base.positions + total.positions), int64_t(base.texCoords + total.texCoords), int64_t(base.normals + total.normals) };
+
+			ObjCorner* out = data.corners.data() + offsets[i].corners;
+			for (const ChunkCorner& corner : chunk.corners)
+			{
+				int resolved[3];
+				for (int c = 0; c < 3; c++)
+				{
+					if (corner.index[c] == MISSING)
+					{
+						resolved[c] = -1;
+						continue;
+					}
+
+					int64_t index = corner.index[c] + ((corner.relativeMask >> c) & 1 ? first[c] : 0);
+					if (index < 0 || index >= count[c])
+					{
+						outOfRange[i] = 1;
+						index = -1;
+					}
+					resolved[c] = static_cast<int>(index);
+				}
+
+				*out++ = { resolved[0], resolved[1], resolved[2] };
+			}
+		}
+	});
+
+	for (uint8_t failed : outOfRange)
+	{
+		if (failed)
+		{
+			std::cerr << "OBJ face refers to a vertex that doesn't exist" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void ObjParser::ParseChunk(Chunk& chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	size_t line = 0;
+
+	// Corners of the current face, reused between faces
+	std::vector<ChunkCorner> face;
+
+	for (; p < end; line++)
+	{
+		SkipBlanks(p, end);
+
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if (!lineEnd)
+			lineEnd = end;
+
+		bool ok = true;
+		if (p + 1 < lineEnd && p[0] == 'v' && IsBlank(p[1]))
+		{
+			p += 2;
+			glm::vec3 position;
+			ok = ParseFloat(p, lineEnd, position.x) && ParseFloat(p, lineEnd, position.y) && ParseFloat(p, lineEnd, position.z);
+			chunk.positions.push_back(position);
+		}
+		else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && IsBlank(p[2]))
+		{
+			p += 3;
+			glm::vec2 texCoord(0.0f);
+			ok = ParseFloat(p, lineEnd, texCoord.x);
+			ParseFloat(p, lineEnd, texCoord.y);		// v is optional
+			chunk.texCoords.push_back(texCoord);
+		}
+		else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2]))
+		{
+			p += 3;
+			glm::vec3 normal;
+			ok = ParseFloat(p, lineEnd, normal.x) && ParseFloat(p, lineEnd, normal.y) && ParseFloat(p, lineEnd, normal.z);
+			chunk.normals.push_back(normal);
+		}
+		else if (p + 1 < lineEnd && p[0] == 'f' && IsBlank(p[1]))
+		{
+			p += 2;
+			face.clear();
+
+			ChunkCorner corner;
+			while (ParseCorner(p, lineEnd, chunk, corner))
+				face.push_back(corner);
+
+			SkipBlanks(p, lineEnd);
+			ok = face.size() >= 3 && p == lineEnd;
+
+			// Fan around the first corner, fine for the convex polygons OBJ exporters write
+			for (size_t i = 2; ok && i < face.size(); i++)
+			{
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[i - 1]);
+				chunk.corners.push_back(face[i]);
+			}
+		}
+		else if (StartsWithKeyword(p, lineEnd, "usemtl"))
+		{
+			chunk.materialSwitches.emplace_back(chunk.corners.size(), ReadName(p + 7, lineEnd));
+		}
+		else if (chunk.materialLibrary.empty() && StartsWithKeyword(p, lineEnd, "mtllib"))
+		{
+			chunk.materialLibrary = ReadName(p + 7, lineEnd);
+		}
+		// Comments, groups, objects, smoothing groups and anything else are skipped
+
+		if (!ok)
+		{
+			chunk.failed = true;
+			chunk.errorLine = line;
+			return;
+		}
+
+		p = lineEnd + 1;
+	}
+}
+
+bool ObjParser::parseMaterials(const std::string& path, std::vector<ObjMaterial>& materials)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cerr << "Failed to open material file: " << path << std::endl;
+		return false;
+	}
+
+	const char* p = reinterpret_cast<const char*>(file.data());
+	const char* end = p + file.size();
+
+	auto readColor = [](const char* p, const char* lineEnd, glm::vec3& color)
+	{
+		// A single value is a grey
+		if (ParseFloat(p, lineEnd, color.x) && !(ParseFloat(p, lineEnd, color.y) && ParseFloat(p, lineEnd, color.z)))
+			color.y = color.z = color.x;
+	};
+
+	// Texture statements may start with options (-bm 1.0 and the like), the path is the last word
+	ObjMaterial* material = nullptr;
+	for (; p < end; p++)
+	{
+		SkipBlanks(p, end);
+
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if (!lineEnd)
+			lineEnd = end;
+
+		if (StartsWithKeyword(p, lineEnd, "newmtl"))
+		{
+			materials.emplace_back();
+			material = &materials.back();
+			material->name = ReadName(p + 7, lineEnd);
+		}
+		else if (material)
+		{
+			float value;
+			const char* q = p + 2;
+			if (StartsWithKeyword(p, lineEnd, "Ka"))
+				readColor(q, lineEnd, material->ambient);
+			else if (StartsWithKeyword(p, lineEnd, "Kd"))
+				readColor(q, lineEnd, material->diffuse);
+			else if (StartsWithKeyword(p, lineEnd, "Ks"))
+				readColor(q, lineEnd, material->specular);
+			else if (StartsWithKeyword(p, lineEnd, "Ns") && ParseFloat(q, lineEnd, value))
+				material->shininess = value;
+			else if (StartsWithKeyword(p, lineEnd, "d"))
+			{
+				q = p + 1;
+				if (ParseFloat(q, lineEnd, value))
+					material->opacity = value;
+			}
+			else if (StartsWithKeyword(p, lineEnd, "map_Kd"))
+				material->diffuseMap = ReadMapPath(p + 6, lineEnd);
+			else if (StartsWithKeyword(p, lineEnd, "map_Ks"))
+				material->specularMap = ReadMapPath(p + 6, lineEnd);
+			else if (StartsWithKeyword(p, lineEnd, "map_Bump") || StartsWithKeyword(p, lineEnd, "map_bump"))
+				material->normalMap = ReadMapPath(p + 8, lineEnd);
+			else if (StartsWithKeyword(p, lineEnd, "bump") || StartsWithKeyword(p, lineEnd, "norm"))
+				material->normalMap = ReadMapPath(p + 4, lineEnd);
+		}
+
+		p = lineEnd;
+	}
+
+	return true;
+}
+
+bool ObjParser::ParseCorner(const char*& p, const char* end, const Chunk& chunk, ChunkCorner& corner)
+{
+	const size_t counts[3] = { chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size() };
+	const char* start = p;
+
+	corner.index[0] = corner.index[1] = corner.index[2] = MISSING;
+	corner.relativeMask = 0;
+
+	// v, v/t, v//n or v/t/n
+	for (int c = 0; c < 3; c++)
+	{
+		if (c > 0)
+		{
+			if (p >= end || *p != '/')
+				break;
+			p++;
+			if (p < end && *p == '/')
+				continue;
+		}
+
+		int index;
+		if (c > 0 && (p >= end || IsBlank(*p) || *p == '\n'))
+			break;
+		if (!ParseInt(p, end, index) || index == 0)
+		{
+			p = start;
+			return false;
+		}
+
+		if (index > 0)
+		{
+			corner.index[c] = index - 1;
+		}
+		else
+		{
+			corner.index[c] = static_cast<int>(counts[c]) + index;
+			corner.relativeMask |= 1u << c;
+		}
+	}
+
+	return true;
+}
+
+bool ObjParser::ParseInt(const char*& p, const char* end, int& value)
+{
+	const char* s = p;
+	SkipBlanks(s, end);
+
+	bool negative = s < end && *s == '-';
+	if (s < end && (*s == '-' || *s == '+'))
+		s++;
+
+	if (s >= end || unsigned(*s - '0') > 9)
+		return false;
+
+	int64_t result = 0;
+	while (s < end && unsigned(*s - '0') <= 9 && result <= INT_MAX)
+		result = result * 10 + (*s++ - '0');
+
+	value = static_cast<int>(std::min<int64_t>(result, INT_MAX)) * (negative ? -1 : 1);
+	p = s;
+	return true;
+}
+
+bool ObjParser::ParseFloat(const char*& p, const char* end, float& value)
+{
+	// Exact powers of ten up to 1e22 are doubles, larger exponents are rare enough for a loop
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	const char* s = p;
+	SkipBlanks(s, end);
+
+	bool negative = s < end && *s == '-';
+	if (s < end && (*s == '-' || *s == '+'))
+		s++;
+
+	// Up to 19 significant digits fit in the mantissa, the rest only move the exponent
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	const char* digitsStart = s;
+
+	for (; s < end && unsigned(*s - '0') <= 9; s++)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + unsigned(*s - '0');
+			digits += mantissa != 0;
+		}
+		else
+		{
+			exponent++;
+		}
+	}
+
+	if (s < end && *s == '.')
+	{
+		s++;
+		for (; s < end && unsigned(*s - '0') <= 9; s++)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + unsigned(*s - '0');
+				digits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+
+	// Needs at least one digit on either side of the point
+	if (s == digitsStart || (s == digitsStart + 1 && *digitsStart == '.'))
+		return false;
+
+	if (s < end && (*s == 'e' || *s == 'E'))
+	{
+		const char* e = s + 1;
+		int exponentValue;
+		if (e < end && (*e == '-' || *e == '+' || unsigned(*e - '0') <= 9) && ParseInt(e, end, exponentValue))
+		{
+			exponent += exponentValue;
+			s = e;
+		}
+	}
+
+	double result = static_cast<double>(mantissa);
+	if (exponent < 0)
+	{
+		for (; exponent < -22; exponent += 22)
+			result /= powers[22];
+		result /= powers[-exponent];
+	}
+	else
+	{
+		for (; exponent > 22; exponent -= 22)
+			result *= powers[22];
+		result *= powers[exponent];
+	}
+
+	value = static_cast<float>(negative ? -result : result);
+	p = s;
+	return true;
+}
@@ -0,0 +1,415 @@
+#pragma once
+
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+struct ObjStreamOptions
+{
+	// Bytes of the file read and parsed at a time, shrunk to fit the memory budget
+	size_t windowBytes = size_t(64) << 20;
+
+	// Upper limit for the memory the import allocates. The spill files are read through memory mappings, their pages
+	// belong to the OS file cache and are not counted.
+	size_t memoryBudget = size_t(1) << 30;
+
+	// Largest buffer range that is mapped at once while uploading
+	size_t uploadBytes = size_t(32) << 20;
+
+	// Where the spill files go, the system's temporary directory if empty
+	std::string tempDirectory;
+};
+
+// Indices [firstIndex, firstIndex + indexCount) of the index spill, relative to baseVertex and all below vertexCount
+struct ObjStreamPiece
+{
+	size_t firstIndex;
+	size_t indexCount;
+	size_t baseVertex;
+	size_t vertexCount;
+};
+
+// Imports OBJ files of any size in bounded memory. The file is read in windows that are parsed like a whole file would
+// be, their vertex data and triangle corners go to spill files on disk. The corners are then deduplicated piece by piece
+// into final vertex and index spill files, which are uploaded from disk in bounded ranges afterwards. Every piece has
+// its own vertices, so a vertex shared across a piece boundary is stored once per piece.
+//
+// Vertices are 3 floats position, 3 floats normal and, if the file has texture coordinates, 2 floats texture
+// coordinates, the layout SimpleModel uses. Indices are 32 bit and restart at 0 in every piece.
+//
+// The spill files are deleted when the stream is destroyed or closed.
+class ObjStream
+{
+public:
+	// Parsing a window allocates up to this many times its size: the text, every chunk's arrays and the merged arrays.
+	// Most of that is for files made of short face lines like "f 1 2 3".
+	static constexpr size_t WINDOW_SHARE = 12;
+
+	// Bytes the deduplication of one corner can take: the corner and its index, the map's entry and slots, and the
+	// vertex it may turn into
+	static constexpr size_t CORNER_BYTES = sizeof(ObjCorner) + 4 + sizeof(ObjCorner) + 16 + 32;
+
+private:
+	// File on disk written front to back, removed again with the stream
+	struct SpillFile
+	{
+		std::string path;
+		std::ofstream stream;
+		size_t bytes = 0;
+
+		bool create(const std::string& filePath);
+		void write(const void* data, size_t size);
+		bool finish();
+		void remove();
+	};
+
+	SpillFile m_Positions, m_TexCoords, m_Normals, m_Corners;
+	SpillFile m_Vertices, m_Indices;
+
+	size_t m_PositionCount = 0, m_TexCoordCount = 0, m_NormalCount = 0, m_CornerCount = 0;
+	size_t m_VertexCount = 0;
+	std::vector<ObjStreamPiece> m_Pieces;
+
+	std::string m_MaterialLibrary;
+	std::vector<std::string> m_Materials;
+	std::vector<ObjMaterialRun> m_MaterialRuns;		// Indices equal corners, no reordering happens
+
+	static inline std::atomic<unsigned int> s_StreamCount = 0;
+
+public:
+	ObjStream() = default;
+
+	// Owns its spill files, so it can't be copied
+	ObjStream(const ObjStream&) = delete;
+	ObjStream& operator=(const ObjStream&) = delete;
+
+	~ObjStream();
+
+	bool import(const std::string& path, const ObjStreamOptions& options = ObjStreamOptions());
+
+	// Deletes the spill files
+	void close();
+
+	bool hasTexCoords() const { return m_TexCoordCount != 0; }
+
+	unsigned int getVertexStride() const { return hasTexCoords() ? 32 : 24; }
+
+	size_t getVertexCount() const { return m_VertexCount; }
+	size_t getIndexCount() const { return m_CornerCount; }
+
+	const std::vector<ObjStreamPiece>& getPieces() const { return m_Pieces; }
+
+	const std::string& getMaterialLibrary() const { return m_MaterialLibrary; }
+	const std::vector<std::string>& getMaterials() const { return m_Materials; }
+	const std::vector<ObjMaterialRun>& getMaterialRuns() const { return m_MaterialRuns; }
+
+	// Copies vertices or indices from the spill files to out, which can be a mapped buffer
+	bool readVertices(size_t first, size_t count, void* out) const;
+	bool readIndices(size_t first, size_t count, void* out) const;
+
+private:
+	bool ReadWindows(const std::string& path, size_t windowBytes);
+	bool BuildPieces(size_t pieceCorners);
+
+	static bool ReadSpill(const std::string& path, size_t offset, size_t size, void* out);
+};
+
+bool ObjStream::SpillFile::create(const std::string& filePath)
+{
+	path = filePath;
+	bytes = 0;
+	stream.open(path, std::ios::binary | std::ios::trunc);
+	return stream.is_open();
+}
+
+void ObjStream::SpillFile::write(const void* data, size_t size)
+{
+	stream.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+	bytes += size;
+}
+
+bool ObjStream::SpillFile::finish()
+{
+	stream.close();
+	return !stream.fail();
+}
+
+void ObjStream::SpillFile::remove()
+{
+	if (stream.is_open())
+		stream.close();
+
+	if (!path.empty())
+		std::remove(path.c_str());
+
+	path.clear();
+	bytes = 0;
+}
+
+ObjStream::~ObjStream()
+{
+	close();
+}
+
+void ObjStream::close()
+{
+	for (SpillFile* file : { &m_Positions, &m_TexCoords, &m_Normals, &m_Corners, &m_Vertices, &m_Indices })
+		file->remove();
+
+	m_PositionCount = m_TexCoordCount = m_NormalCount = m_CornerCount = m_VertexCount = 0;
+	m_Pieces.clear();
+	m_MaterialLibrary.clear();
+	m_Materials.clear();
+	m_MaterialRuns.clear();
+}
+
+bool ObjStream::import(const std::string& path, const ObjStreamOptions& options)
+{
+	close();
+
+	std::error_code error;
+	std::filesystem::path directory = options.tempDirectory.empty() ? std::filesystem::temp_directory_path(error) : std::filesystem::path(options.tempDirectory);
+	if (error)
+	{
+		std::cerr << "No temporary directory for streaming " << path << ": " << error.message() << std::endl;
+		return false;
+	}
+
+	// Unique per process and stream, several imports can run at once
+	std::string prefix = "obj_stream_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "_" + std::to_string(s_StreamCount++);
+	auto spillPath = [&](const char* name) { return (directory / (prefix + name)).string(); };
+
+	if (!m_Positions.create(spillPath(".v")) || !m_TexCoords.create(spillPath(".vt")) || !m_Normals.create(spillPath(".vn")) ||
+		!m_Corners.create(spillPath(".f")) || !m_Vertices.create(spillPath(".vertices")) || !m_Indices.create(spillPath(".indices")))
+	{
+		std::cerr << "Could not create spill files in " << directory.string() << std::endl;
+		close();
+		return false;
+	}
+
+	size_t windowBytes = std::min(options.windowBytes, options.memoryBudget / WINDOW_SHARE);
+	size_t pieceCorners = options.memoryBudget / CORNER_BYTES / 3 * 3;
+	if (windowBytes < 4096 || pieceCorners < 3)
+	{
+		std::cerr << "Memory budget of " << options.memoryBudget << " bytes is too small to stream " << path << std::endl;
+		close();
+		return false;
+	}
+
+	bool ok = ReadWindows(path, windowBytes) && BuildPieces(pieceCorners);
+
+	// Only the deduplicated vertices and indices are needed from here on
+	for (SpillFile* file : { &m_Positions, &m_TexCoords, &m_Normals, &m_Corners })
+		file->remove();
+
+	ok = m_Vertices.finish() && m_Indices.finish() && ok;
+	if (!ok)
+	{
+		std::cerr << "Failed to stream object file: " << path << std::endl;
+		close();
+	}
+
+	return ok;
+}
+
+bool ObjStream::ReadWindows(const std::string& path, size_t windowBytes)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cerr << "Failed to open object file: " << path << std::endl;
+		return false;
+	}
+
+	std::vector<char> window(windowBytes);
+	size_t carried = 0;			// Start of a line the last window cut off, moved to the front
+	size_t windowOffset = 0;	// Where the window starts in the file
+	ObjParseBase base;
+
+	for (;;)
+	{
+		file.read(window.data() + carried, static_cast<std::streamsize>(window.size() - carried));
+		size_t filled = carried + static_cast<size_t>(file.gcount());
+		bool last = filled < window.size();
+		if (filled == 0)
+			break;
+
+		// Everything up to the last line end is parsed, the rest goes with the next window
+		size_t parsed = filled;
+		if (!last)
+		{
+			while (parsed > 0 && window[parsed - 1] != '\n')
+				parsed--;
+
+			if (parsed == 0)
+			{
+				std::cerr << "Line at byte " << windowOffset << " is longer than the " << windowBytes << " byte window" << std::endl;
+				return false;
+			}
+		}
+
+		ObjData data;
+		if (!ObjParser::parse(window.data(), parsed, data, base))
+		{
+			std::cerr << "The line is counted from byte " << windowOffset << std::endl;
+			return false;
+		}
+
+		m_Positions.write(data.positions.data(), data.positions.size() * sizeof(glm::vec3));
+		m_TexCoords.write(data.texCoords.data(), data.texCoords.size() * sizeof(glm::vec2));
+		m_Normals.write(data.normals.data(), data.normals.size() * sizeof(glm::vec3));
+		m_Corners.write(data.corners.data(), data.corners.size() * sizeof(ObjCorner));
+
+		if (m_MaterialLibrary.empty())
+			m_MaterialLibrary = data.materialLibrary;
+
+		// Material names and runs of the window, moved to the whole file's
+		for (const ObjMaterialRun& run : data.materialRuns)
+		{
+			const std::string& name = data.materials[run.material];
+			auto found = std::find(m_Materials.begin(), m_Materials.end(), name);
+			int material = static_cast<int>(found - m_Materials.begin());
+			if (found == m_Materials.end())
+				m_Materials.push_back(name);
+
+			m_MaterialRuns.push_back({ m_CornerCount + run.firstCorner, material });
+		}
+
+		base.positions += data.positions.size();
+		base.texCoords += data.texCoords.size();
+		base.normals += data.normals.size();
+		m_CornerCount += data.corners.size();
+
+		carried = filled - parsed;
+		std::memmove(window.data(), window.data() + parsed, carried);
+		windowOffset += parsed;
+
+		if (last)
+			break;
+	}
+
+	m_PositionCount = base.positions;
+	m_TexCoordCount = base.texCoords;
+	m_NormalCount = base.normals;
+
+	return m_Positions.finish() && m_TexCoords.finish() && m_Normals.finish() && m_Corners.finish();
+}
+
+bool ObjStream::BuildPieces(size_t pieceCorners)
+{
+	if (m_CornerCount == 0)
+		return true;
+
+	// Corners refer to vertex data anywhere in the file, so it is read through mappings instead of into memory
+	MappedFile positionFile, texCoordFile, normalFile;
+	if (!positionFile.open(m_Positions.path) || (m_TexCoordCount != 0 && !texCoordFile.open(m_TexCoords.path)) ||
+		(m_NormalCount != 0 && !normalFile.open(m_Normals.path)))
+	{
+		std::cerr << "Could not map the spilled vertex data" << std::endl;
+		return false;
+	}
+
+	const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(positionFile.data());
+	const glm::vec2* texCoords = reinterpret_cast<const glm::vec2*>(texCoordFile.data());
+	const glm::vec3* normals = reinterpret_cast<const glm::vec3*>(normalFile.data());
+
+	std::ifstream cornerFile(m_Corners.path, std::ios::binary);
+	if (!cornerFile)
+	{
+		std::cerr << "Could not read the spilled faces" << std::endl;
+		return false;
+	}
+
+	pieceCorners = std::min(pieceCorners, m_CornerCount);
+	const size_t floatsPerVertex = getVertexStride() / sizeof(float);
+
+	// Sized for the worst case up front, so nothing grows past the budget
+	ObjVertexMap vertexMap(pieceCorners);
+	std::vector<ObjCorner> corners(pieceCorners);
+	std::vector<uint32_t> indices(pieceCorners);
+	std::vector<float> vertices;
+	vertices.reserve(pieceCorners * floatsPerVertex);
+
+	for (size_t first = 0; first < m_CornerCount; first += pieceCorners)
+	{
+		size_t count = std::min(pieceCorners, m_CornerCount - first);
+		cornerFile.read(reinterpret_cast<char*>(corners.data()), static_cast<std::streamsize>(count * sizeof(ObjCorner)));
+		if (static_cast<size_t>(cornerFile.gcount()) != count * sizeof(ObjCorner))
+		{
+			std::cerr << "The spilled faces are shorter than expected" << std::endl;
+			return false;
+		}
+
+		vertexMap.clear();
+		for (size_t i = 0; i < count; i++)
+			indices[i] = vertexMap.insert(corners[i]);
+
+		// Corners that leave out a texture coordinate or normal get zeros
+		const std::vector<ObjCorner>& unique = vertexMap.getVertices();
+		vertices.resize(unique.size() * floatsPerVertex);
+		ThreadPool::getInstance().parallelFor(unique.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const ObjCorner& corner = unique[i];
+				glm::vec3 normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f);
+
+				float* vertex = vertices.data() + i * floatsPerVertex;
+				std::memcpy(vertex, &positions[corner.position], sizeof(glm::vec3));
+				std::memcpy(vertex + 3, &normal, sizeof(glm::vec3));
+				if (floatsPerVertex == 8)
+				{
+					glm::vec2 texCoord = corner.texCoord >= 0 ? texCoords[corner.texCoord] : glm::vec2(0.0f);
+					std::memcpy(vertex + 6, &texCoord, sizeof(glm::vec2));
+				}
+			}
+		}, 4096);
+
+		m_Vertices.write(vertices.data(), vertices.size() * sizeof(float));
+		m_Indices.write(indices.data(), count * sizeof(uint32_t));
+
+		m_Pieces.push_back({ first, count, m_VertexCount, unique.size() });
+		m_VertexCount += unique.size();
+	}
+
+	return true;
+}
+
+bool ObjStream::readVertices(size_t first, size_t count, void* out) const
+{
+	return ReadSpill(m_Vertices.path, first * getVertexStride(), count * getVertexStride(), out);
+}
+
+bool ObjStream::readIndices(size_t first, size_t count, void* out) const
+{
+	return ReadSpill(m_Indices.path, first * sizeof(uint32_t), count * sizeof(uint32_t), out);
+}
+
+bool ObjStream::ReadSpill(const std::string& path, size_t offset, size_t size, void* out)
+{
+	std::ifstream file(path, std::ios::binary);
+	file.seekg(static_cast<std::streamoff>(offset));
+	file.read(static_cast<char*>(out), static_cast<std::streamsize>(size));
+
+	if (!file || static_cast<size_t>(file.gcount()) != size)
+	{
+		std::cerr << "Could not read " << size << " bytes at " << offset << " from " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
@@ -10,6 +10,10 @@
 #include <mutex>	
 
 #include "Camera.h"
+#include "TextureResidency.h"
+#include "DSA.h"
+#include "GLState.h"
+#include "AsyncLoader.h"
 
 // Constants
 #define MAX_KEYS GLFW_KEY_LAST
@@ -44,6 +48,12 @@ private:
 protected:
 	GLFWwindow* window;
 
+	// Hidden window whose context shares objects with the main one, owned by the loader thread
+	GLFWwindow* loaderWindow = nullptr;
+
+	// Uploads resources on the loader context, see AsyncLoader.h
+	AsyncLoader loader;
+
 	enum class Mouse
 	{
 		LEFT = 0,
@@ -90,6 +100,12 @@ private:
 			float fElapsedTime = elapsedTime.count();
 			fTimeSinceStart += fElapsedTime;
 
+			// Stamp a new frame for texture LRU tracking and free textures if over the memory budget
+			TextureResidency::getInstance().beginFrame();
+
+			// Last frame's GL call counters become readable through GLState::getFrameStats()
+			GLState::getInstance().beginFrame();
+
 			// Update key and mouse states on each frame, they may be used later by the programmer
 			// 1. Update key states
 			for (int i = 0; i < MAX_KEYS; i++)
@@ -140,6 +156,9 @@ private:
 				}
 			}
 
+			// Publish resources the loader thread finished uploading
+			loader.poll();
+
 			HandleInputs(fElapsedTime);
 
 			if (!Update(fElapsedTime))
@@ -175,6 +194,9 @@ private:
 			glfwSwapBuffers(window);
 		}
 
+		// The loader has to stop while the shared objects still exist
+		loader.stop();
+
 		// Give the window context back to the main thread
 		glfwMakeContextCurrent(nullptr);
 	}
@@ -223,17 +245,17 @@ private:
 		camera.ProcessMouse(GetMousePosX(), GetMousePosY(), ScreenWidth(), ScreenHeight(), bFirstMouse);
 
 		// Update view matrix
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+		GLState::getInstance().bindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 		glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(camera.getLookAt()));
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		GLState::getInstance().bindBuffer(GL_UNIFORM_BUFFER, 0);
 	}
 
 	void UpdateProjectionMatrix()
 	{
 		matProjection = glm::perspective(fFov * pi / 180.0f, (float)ScreenWidth() / (float)ScreenHeight(), 0.1f, 1000.0f);
-		glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
+		GLState::getInstance().bindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
 		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(matProjection));
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		GLState::getInstance().bindBuffer(GL_UNIFORM_BUFFER, 0);
 	}
 
 public:
@@ -249,6 +271,7 @@ public:
 
 	~OpenGL_Graphics()
 	{
+		GLState::getInstance().forgetBuffer(uboMatrices);
 		glDeleteBuffers(1, &uboMatrices);
 	}
 
@@ -278,6 +301,14 @@ public:
 		if (window == NULL)
 			Error("Failed to create window.");
 
+		// Create an invisible window for the loader thread, its context shares objects with the main window
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		loaderWindow = glfwCreateWindow(1, 1, "Loader", NULL, window);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+		if (loaderWindow == NULL)
+			std::cerr << "Failed to create loader context, resources will load on the renderer thread\n";
+
 		// Set window position on screen
 		glfwSetWindowPos(window, 360, 75);
 
@@ -296,16 +327,19 @@ public:
 		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 			Error("Failed to initalize GLAD");
 
+		// Load the GL 4.5 direct state access functions on top of GLAD, if the driver has them
+		DSA::load((GLADloadproc)glfwGetProcAddress);
+
 		// Set viewport and callback function when window gets resized 
-		glViewport(0, 0, m_width, m_height);
+		GLState::getInstance().setViewport(0, 0, m_width, m_height);
 
 		// Enable z-buffer and enable face-culling
-		glEnable(GL_DEPTH_TEST);		  // Enable depth testing
-		glDepthFunc(GL_LESS);
+		GLState::getInstance().enable(GL_DEPTH_TEST);		  // Enable depth testing
+		GLState::getInstance().setDepthFunc(GL_LESS);
 
-		//glEnable(GL_CULL_FACE);         // Enable face culling
-		//glCullFace(GL_BACK);            // Cull back faces
-		//glFrontFace(GL_CCW);            // Define front faces as counter-clockwise
+		//GLState::getInstance().enable(GL_CULL_FACE);         // Enable face culling
+		//GLState::getInstance().setCullFace(GL_BACK);         // Cull back faces
+		//GLState::getInstance().setFrontFace(GL_CCW);         // Define front faces as counter-clockwise
 		
 		// Display GPU info
 		DisplayGPU();
@@ -324,6 +358,9 @@ public:
 		// Make the window context null before calling the renderer thread
 		glfwMakeContextCurrent(nullptr);
 
+		// Start the loader, its jobs start once Setup() submits them
+		loader.start(loaderWindow);
+
 		// Start the renderer
 		std::thread rendererThread = std::thread(&OpenGL_Graphics::RendererThread, this);
 
@@ -345,6 +382,8 @@ public:
 
 		// Cleanup functions
 		Destroy();
+		if (loaderWindow)
+			glfwDestroyWindow(loaderWindow);
 		glfwDestroyWindow(window);
 		glfwTerminate();
 	}
@@ -414,6 +453,7 @@ private:
 		std::cout << "Vendor: " << vendor << '\n';
 		std::cout << "OpenGL Version: " << version << '\n';
 		std::cout << "GLSL Version: " << glslVersion << '\n';
+		std::cout << "Direct state access: " << (DSA::isAvailable() ? "yes" : "no") << '\n';
 		std::cout << std::endl;
 		std::cout << "-------------------------------------\n\n";
 	}
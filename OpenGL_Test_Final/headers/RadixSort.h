@@ -0,0 +1,113 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+// A sort key with its payload, usually the index of what the key was made from
+struct SortEntry
+{
+	uint64_t key;
+	uint32_t value;
+};
+
+// Below this many entries a comparison sort is faster than the radix passes
+constexpr size_t RADIX_SORT_MIN_ENTRIES = 1024;
+
+// Entries per block, blocks are what the thread pool works on
+constexpr size_t RADIX_SORT_BLOCK = 16384;
+
+// Stable LSD radix sort by key, 8 bits per pass. Every pass counts the digits of each block of the array in parallel,
+// a prefix sum over (digit, block) then gives every block its own output range per digit, so the blocks scatter in
+// parallel without synchronizing and equal digits keep their order. Bits that are the same in every key (unused
+// fields, the high bits of small values) don't get a pass. scratch is resized to match and can be kept between calls.
+void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	const size_t count = entries.size();
+	if (count < RADIX_SORT_MIN_ENTRIES)
+	{
+		std::stable_sort(entries.begin(), entries.end(), [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+		return;
+	}
+
+	scratch.resize(count);
+	ThreadPool& pool = ThreadPool::getInstance();
+	const size_t blockCount = (count + RADIX_SORT_BLOCK - 1) / RADIX_SORT_BLOCK;
+
+	// Only bits that differ between two keys need sorting
+	std::vector<uint64_t> blockOr(blockCount, 0), blockAnd(blockCount, ~uint64_t(0));
+	pool.parallelFor(blockCount, [&](size_t begin, size_t end)
+	{
+		for (size_t block = begin; block < end; block++)
+		{
+			uint64_t any = 0, all = ~uint64_t(0);
+			for (size_t i = block * RADIX_SORT_BLOCK; i < std::min(count, (block + 1) * RADIX_SORT_BLOCK); i++)
+			{
+				any |= entries[i].key;
+				all &= entries[i].key;
+			}
+			blockOr[block] = any;
+			blockAnd[block] = all;
+		}
+	});
+
+	uint64_t varying = 0, all = ~uint64_t(0);
+	for (size_t block = 0; block < blockCount; block++)
+	{
+		varying |= blockOr[block];
+		all &= blockAnd[block];
+	}
+	varying ^= all;
+
+	std::vector<uint32_t> offsets(blockCount * 256);
+	SortEntry* source = entries.data();
+	SortEntry* target = scratch.data();
+
+	for (unsigned int shift = 0; shift < 64; shift += 8)
+	{
+		if (((varying >> shift) & 0xFF) == 0)
+			continue;
+
+		pool.parallelFor(blockCount, [&](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				uint32_t* histogram = offsets.data() + block * 256;
+				std::fill(histogram, histogram + 256, 0);
+				for (size_t i = block * RADIX_SORT_BLOCK; i < std::min(count, (block + 1) * RADIX_SORT_BLOCK); i++)
+					histogram[(source[i].key >> shift) & 0xFF]++;
+			}
+		});
+
+		// Digit major, so block 1's entries with a digit land after block 0's with the same digit
+		uint32_t offset = 0;
+		for (unsigned int digit = 0; digit < 256; digit++)
+		{
+			for (size_t block = 0; block < blockCount; block++)
+			{
+				uint32_t digitCount = offsets[block * 256 + digit];
+				offsets[block * 256 + digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		pool.parallelFor(blockCount, [&](size_t begin, size_t end)
+		{
+			for (size_t block = begin; block < end; block++)
+			{
+				uint32_t* next = offsets.data() + block * 256;
+				for (size_t i = block * RADIX_SORT_BLOCK; i < std::min(count, (block + 1) * RADIX_SORT_BLOCK); i++)
+					target[next[(source[i].key >> shift) & 0xFF]++] = source[i];
+			}
+		});
+
+		std::swap(source, target);
+	}
+
+	// An odd number of passes leaves the result in scratch
+	if (source != entries.data())
+		entries.swap(scratch);
+}
@@ -1,17 +1,141 @@
 #pragma once
 
 #include "Shader.h"
-#include "Model.h"
+#include "AssimpModelLoader.h"
+#include "SimpleModel.h"
+#include "RadixSort.h"
+#include "SlotMap.h"
+#include "ThreadPool.h"
+#include "GLState.h"
+#include "SceneBvh.h"
 
+#include <glm/glm.hpp>
+
+#include <vector>
 #include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+// State changes the last render() made, to see how well the sort groups the draws
+struct RenderStats
+{
+	unsigned int draws = 0;				// Draw calls, an instanced batch is one
+	unsigned int instancedDraws = 0;
+	unsigned int instances = 0;			// Submitted draws that went into instanced batches
+	unsigned int shaderChanges = 0;
+	unsigned int materialChanges = 0;
+	unsigned int culled = 0;			// Renderables outside the frustum
+};
 
+// Something the renderer draws every frame until it is removed
+typedef SlotHandle RenderableHandle;
+
+enum class RenderableType : uint8_t { Mesh, Model, SimpleModel };
+
+struct RenderableGeometry
+{
+	RenderableType type;
+	void* object;			// The Mesh, Model or SimpleModel
+};
+
+struct RenderableFlags
+{
+	bool visible = true;
+	bool translucent = false;
+	uint8_t pass = 0;
+	uint8_t lod = 0;		// Ignored for SimpleModels
+};
+
+// Render queue. Every draw submitted during a frame gets a 64 bit sort key, render() sorts the keys and draws in that
+// order, only switching the program, the material and the blend state when they differ from the draw before.
+//
+// Key layout, from the highest bit:
+//   2 bits   pass, passes draw in increasing order
+//   1 bit    translucent, after the opaque draws of the pass
+//   opaque:      11 bits shader | 14 bits material | 14 bits mesh | 22 bits depth, front to back for early-z
+//   translucent: 22 bits depth, back to front for blending | 11 bits shader | 14 bits material | 14 bits mesh
+// Shader, material and mesh (a mesh at one LOD) are small numbers handed out per frame in submission order. More of
+// them than fit in their bits only makes the sort group them less well, the state changes compare the full numbers.
+//
+// Opaque draws of the same mesh with the same material and shader end up next to each other. When there are at
+// least MIN_INSTANCES of them in a row and the shader is instanceable (see Shader::isInstanceable()), their matrices
+// go into the instance buffer and the run becomes one instanced draw.
+//
+// Meshes and Models added with add() are kept in a SceneBvh by their world bounds. With a frustum set, render() only
+// submits the ones the BVH finds in it. SimpleModels have no bounds and are always submitted.
 class Renderer
 {
+public:
+	static constexpr unsigned int PASS_COUNT = 4;
+	static constexpr unsigned int SHADER_BITS = 11;
+	static constexpr unsigned int MATERIAL_BITS = 14;
+	static constexpr unsigned int MESH_BITS = 14;
+	static constexpr unsigned int DEPTH_BITS = 22;
+	static constexpr unsigned int MIN_INSTANCES = 2;
+
 private:
-	// Stores references to each model and its corresponding shader
+	// A draw of a mesh or of a whole SimpleModel (which binds its own materials)
+	struct Item
+	{
+		Shader* shader;
+		Mesh* mesh;
+		SimpleModel* simpleModel;
+		glm::mat4 matrix;
+		glm::vec3 center;				// Of the bounds in world space, for the depth
+		unsigned int lod;
+		uint32_t shaderId;
+		uint32_t materialId;
+		uint32_t meshId;
+		uint8_t pass;
+		bool translucent;
+	};
+
+	// Sorted draws [begin, end), instanced when firstInstance is set
+	struct Run
+	{
+		size_t begin;
+		size_t end;
+		size_t firstInstance;
+	};
+
+	static constexpr size_t NOT_INSTANCED = SIZE_MAX;
+
+	// Columns of m_Renderables, the transform of a renderable is at its position in the transform column
+	enum { RENDERABLE_GEOMETRY, RENDERABLE_SHADER, RENDERABLE_TRANSFORM, RENDERABLE_FLAGS };
+
+	// Drawn every frame, added with add()
+	SlotMap<RenderableGeometry, Shader*, glm::mat4, RenderableFlags> m_Renderables;
+
+	// World bounds of the renderables by slot index, except for SimpleModels which are listed in m_Unbounded.
+	// m_UnboundedPosition holds where a slot is in m_Unbounded, NOT_UNBOUNDED if it is not there.
+	static constexpr uint32_t NOT_UNBOUNDED = UINT32_MAX;
+	SceneBvh m_SceneIndex;
+	std::vector<uint32_t> m_Unbounded;
+	std::vector<uint32_t> m_UnboundedPosition;
+	std::vector<uint32_t> m_Visible;
+
+	Frustum m_Frustum;
+	bool m_bCulling = false;
+
+	std::vector<Item> m_Items;
+	std::vector<SortEntry> m_Keys;
+	std::vector<SortEntry> m_Scratch;
+	std::vector<Run> m_Runs;
+
+	// Matrices of the instanced runs, streamed into m_InstanceBuffer every frame
+	std::vector<glm::mat4> m_Instances;
+	unsigned int m_InstanceBuffer = 0;
+
+	std::unordered_map<const void*, uint32_t> m_ShaderIds;
+	std::unordered_map<uint64_t, uint32_t> m_MaterialIds;
+	std::unordered_map<uint64_t, uint32_t> m_MeshIds;
+
+	glm::vec3 m_ViewPosition = glm::vec3(0.0f);
+	glm::vec3 m_ViewDirection = glm::vec3(0.0f, 0.0f, -1.0f);
+	float m_Near = 0.1f;
+	float m_Far = 1000.0f;
 
-	std::unordered_map<Model*, Shader*> models;
-	Shader* currentShader = nullptr;
+	RenderStats m_Stats;
 
 	// This is a singleton class
 	Renderer() {}
@@ -22,9 +146,76 @@ public:
 
 	static Renderer& getInstance();
 
-	void addModel(Model* model, Shader* shader);
+	// Camera the depths are measured from, draws beyond far all sort as far
+	void setView(const glm::vec3& position, const glm::vec3& direction, float nearPlane, float farPlane);
 
+	// Draws the object with shader every frame until the handle is removed. The same object can be added any number
+	// of times, with different shaders or transforms. Models draw each mesh where its node puts it.
+	RenderableHandle add(Mesh& mesh, Shader& shader, const glm::mat4& matrix = glm::mat4(1.0f), RenderableFlags flags = RenderableFlags());
+	RenderableHandle add(Model& model, Shader& shader, const glm::mat4& matrix = glm::mat4(1.0f), RenderableFlags flags = RenderableFlags());
+	RenderableHandle add(SimpleModel& model, Shader& shader, const glm::mat4& matrix = glm::mat4(1.0f), RenderableFlags flags = RenderableFlags());
+
+	RenderableHandle addModel(Model* model, Shader* shader, const glm::mat4& matrix = glm::mat4(1.0f)) { return add(*model, *shader, matrix); }
+
+	// These return false and do nothing for handles that were already removed
+	bool remove(RenderableHandle handle);
+	bool setTransform(RenderableHandle handle, const glm::mat4& matrix);
+	bool setShader(RenderableHandle handle, Shader& shader);
+	bool setFlags(RenderableHandle handle, RenderableFlags flags);
+
+	bool contains(RenderableHandle handle) const { return m_Renderables.contains(handle); }
+	size_t getRenderableCount() const { return m_Renderables.size(); }
+
+	// From now on render() skips the renderables outside the frustum of this matrix (projection * view)
+	void setFrustum(const glm::mat4& viewProjection);
+	void disableCulling() { m_bCulling = false; }
+
+	// Nearest renderable whose world bounds the ray hits, for picking. SimpleModels are never hit.
+	bool pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RenderableHandle& handle, float& distance) const;
+
+	// The bounds of the renderables by the index of their handles, for finding what a light reaches
+	const SceneBvh& getSceneIndex() const { return m_SceneIndex; }
+
+	// Queues draws for the next render()
+	void submit(Shader& shader, Mesh& mesh, const glm::mat4& matrix, unsigned int lod = 0, bool translucent = false, uint8_t pass = 0);
+	void submit(Shader& shader, Model& model, const glm::mat4& matrix, unsigned int lod = 0, bool translucent = false, uint8_t pass = 0);
+	void submit(Shader& shader, SimpleModel& model, const glm::mat4& matrix, bool translucent = false, uint8_t pass = 0);
+
+	// Sorts and draws everything queued since the last call, then empties the queue
 	void render();
+
+	const RenderStats& getStats() const { return m_Stats; }
+
+	void free();
+
+	static uint64_t MakeKey(uint8_t pass, bool translucent, uint32_t shader, uint32_t material, uint32_t mesh, uint32_t depth);
+
+private:
+	// Adds the renderable to the scene index, or to m_Unbounded
+	void IndexRenderable(RenderableHandle handle);
+
+	void SubmitRenderable(size_t dense);
+
+	uint32_t QuantizeDepth(const glm::vec3& position) const;
+
+	// Splits the sorted draws into runs and gathers the matrices of the instanced ones
+	void BuildRuns();
+
+	static bool CanInstance(const Item& first, const Item& item);
+
+	// Points the per instance matrix of the bound vertex array at the instance buffer, from instance firstInstance on
+	void AttachInstances(size_t firstInstance);
+
+	// Turns the per instance matrix off again on the bound vertex array, other meshes of its page draw without it
+	void DetachInstances();
+
+	static uint32_t Intern(std::unordered_map<const void*, uint32_t>& ids, const void* object);
+	static uint32_t Intern(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t key);
+
+	// Draws with the same texture IDs share a material
+	static uint64_t MaterialKey(const Mesh& mesh);
+
+	static void SetBlending(bool translucent);
 };
 
 inline Renderer& Renderer::getInstance()
@@ -33,22 +224,463 @@ inline Renderer& Renderer::getInstance()
 	return renderer;
 }
 
-void Renderer::addModel(Model* model, Shader* shader)
+void Renderer::setView(const glm::vec3& position, const glm::vec3& direction, float nearPlane, float farPlane)
+{
+	m_ViewPosition = position;
+	m_ViewDirection = glm::normalize(direction);
+	m_Near = nearPlane;
+	m_Far = std::max(farPlane, nearPlane + 1e-3f);
+}
+
+RenderableHandle Renderer::add(Mesh& mesh, Shader& shader, const glm::mat4& matrix, RenderableFlags flags)
 {
-	models.insert(std::make_pair(model, shader));
+	RenderableHandle handle = m_Renderables.insert({ RenderableType::Mesh, &mesh }, &shader, matrix, flags);
+	IndexRenderable(handle);
+	return handle;
+}
+
+RenderableHandle Renderer::add(Model& model, Shader& shader, const glm::mat4& matrix, RenderableFlags flags)
+{
+	RenderableHandle handle = m_Renderables.insert({ RenderableType::Model, &model }, &shader, matrix, flags);
+	IndexRenderable(handle);
+	return handle;
+}
+
+RenderableHandle Renderer::add(SimpleModel& model, Shader& shader, const glm::mat4& matrix, RenderableFlags flags)
+{
+	RenderableHandle handle = m_Renderables.insert({ RenderableType::SimpleModel, &model }, &shader, matrix, flags);
+	IndexRenderable(handle);
+	return handle;
+}
+
+bool Renderer::remove(RenderableHandle handle)
+{
+	if (!m_Renderables.erase(handle))
+		return false;
+
+	m_SceneIndex.remove(handle.index);
+
+	if (handle.index < m_UnboundedPosition.size() && m_UnboundedPosition[handle.index] != NOT_UNBOUNDED)
+	{
+		// Swap with the last entry
+		uint32_t position = m_UnboundedPosition[handle.index];
+		m_Unbounded[position] = m_Unbounded.back();
+		m_UnboundedPosition[m_Unbounded[position]] = position;
+		m_Unbounded.pop_back();
+		m_UnboundedPosition[handle.index] = NOT_UNBOUNDED;
+	}
+	return true;
+}
+
+bool Renderer::setTransform(RenderableHandle handle, const glm::mat4& matrix)
+{
+	glm::mat4* transform = m_Renderables.get<RENDERABLE_TRANSFORM>(handle);
+	if (!transform)
+		return false;
+
+	*transform = matrix;
+	IndexRenderable(handle);
+	return true;
+}
+
+bool Renderer::setShader(RenderableHandle handle, Shader& shader)
+{
+	Shader** slot = m_Renderables.get<RENDERABLE_SHADER>(handle);
+	if (slot)
+		*slot = &shader;
+	return slot != nullptr;
+}
+
+bool Renderer::setFlags(RenderableHandle handle, RenderableFlags flags)
+{
+	RenderableFlags* slot = m_Renderables.get<RENDERABLE_FLAGS>(handle);
+	if (slot)
+		*slot = flags;
+	return slot != nullptr;
+}
+
+void Renderer::setFrustum(const glm::mat4& viewProjection)
+{
+	m_Frustum = Frustum::fromMatrix(viewProjection);
+	m_bCulling = true;
+}
+
+bool Renderer::pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RenderableHandle& handle, float& distance) const
+{
+	uint32_t object;
+	if (!m_SceneIndex.raycast(origin, direction, maxDistance, object, distance))
+		return false;
+
+	handle = m_Renderables.getHandle(m_Renderables.getDense(object));
+	return true;
+}
+
+void Renderer::submit(Shader& shader, Mesh& mesh, const glm::mat4& matrix, unsigned int lod, bool translucent, uint8_t pass)
+{
+	Item item;
+	item.shader = &shader;
+	item.mesh = &mesh;
+	item.simpleModel = nullptr;
+	item.matrix = matrix;
+	item.center = mesh.getWorldSphere(matrix).center;
+	item.lod = std::min(lod, mesh.getLodCount() - 1);
+	item.shaderId = Intern(m_ShaderIds, &shader);
+	item.materialId = Intern(m_MaterialIds, MaterialKey(mesh));
+	item.meshId = Intern(m_MeshIds, reinterpret_cast<uintptr_t>(&mesh) ^ uint64_t(item.lod) << 56);		// Pointers stay below bit 56
+	item.pass = static_cast<uint8_t>(std::min<unsigned int>(pass, PASS_COUNT - 1));
+	item.translucent = translucent;
+	m_Items.push_back(item);
+}
+
+void Renderer::submit(Shader& shader, Model& model, const glm::mat4& matrix, unsigned int lod, bool translucent, uint8_t pass)
+{
+	// Same placement as Model::Draw(shader, model, lod)
+	model.hierarchy.update();
+
+	for (unsigned int n = 0; n < model.nodes.size(); n++)
+	{
+		const ModelNode& node = model.nodes[n];
+		glm::mat4 nodeMatrix = matrix * model.hierarchy.getWorld(n);
+
+		for (unsigned int i = node.firstMesh; i < node.firstMesh + node.meshCount; i++)
+		{
+			bool skinned = model.meshes[i].getFormat().skinned && !model.skeleton.empty();
+			submit(shader, model.meshes[i], skinned ? matrix : nodeMatrix, lod, translucent, pass);
+		}
+	}
+}
+
+void Renderer::submit(Shader& shader, SimpleModel& model, const glm::mat4& matrix, bool translucent, uint8_t pass)
+{
+	Item item;
+	item.shader = &shader;
+	item.mesh = nullptr;
+	item.simpleModel = &model;
+	item.matrix = matrix;
+	item.center = glm::vec3(matrix[3]);
+	item.lod = 0;
+	item.shaderId = Intern(m_ShaderIds, &shader);
+	item.materialId = Intern(m_MaterialIds, reinterpret_cast<uintptr_t>(&model));
+	item.meshId = Intern(m_MeshIds, reinterpret_cast<uintptr_t>(&model));
+	item.pass = static_cast<uint8_t>(std::min<unsigned int>(pass, PASS_COUNT - 1));
+	item.translucent = translucent;
+	m_Items.push_back(item);
 }
 
 void Renderer::render()
 {
-	for (const auto& [model, shader] : models)
+	// Refits what moved, swaps in a finished rebuild
+	m_SceneIndex.update();
+
+	unsigned int culled = 0;
+	if (m_bCulling)
+	{
+		m_SceneIndex.cull(m_Frustum, m_Visible);
+		for (uint32_t object : m_Visible)
+			SubmitRenderable(m_Renderables.getDense(object));
+
+		for (uint32_t object : m_Unbounded)
+			SubmitRenderable(m_Renderables.getDense(object));
+
+		culled = static_cast<unsigned int>(m_Renderables.size() - m_Visible.size() - m_Unbounded.size());
+	}
+	else
+	{
+		for (size_t i = 0; i < m_Renderables.size(); i++)
+			SubmitRenderable(i);
+	}
+
+	m_Keys.resize(m_Items.size());
+	ThreadPool::getInstance().parallelFor(m_Items.size(), [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const Item& item = m_Items[i];
+			m_Keys[i].key = MakeKey(item.pass, item.translucent, item.shaderId, item.materialId, item.meshId, QuantizeDepth(item.center));
+			m_Keys[i].value = static_cast<uint32_t>(i);
+		}
+	}, 4096);
+
+	RadixSort(m_Keys, m_Scratch);
+	BuildRuns();
+
+	// Orphaned every frame so the driver never waits for last frame's draws to finish reading
+	if (!m_Instances.empty())
+	{
+		if (m_InstanceBuffer == 0)
+			glGenBuffers(1, &m_InstanceBuffer);
+
+		size_t size = m_Instances.size() * sizeof(glm::mat4);
+		GLState::getInstance().bindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+		glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, m_Instances.data());
+	}
+
+	// Walk in key order and only touch the state that changed since the previous draw
+	m_Stats = RenderStats();
+	m_Stats.culled = culled;
+	Shader* shader = nullptr;
+	uint32_t material = UINT32_MAX;
+	bool blending = false;
+
+	for (const Run& run : m_Runs)
+	{
+		const Item& first = m_Items[m_Keys[run.begin].value];
+
+		if (first.translucent != blending)
+		{
+			SetBlending(first.translucent);
+			blending = first.translucent;
+		}
+
+		if (first.shader != shader)
+		{
+			first.shader->use();
+			shader = first.shader;
+			material = UINT32_MAX;		// The sampler uniforms belong to the program
+			m_Stats.shaderChanges++;
+		}
+
+		if (run.firstInstance != NOT_INSTANCED)
+		{
+			if (first.materialId != material)
+			{
+				first.mesh->BindMaterial(*shader);
+				material = first.materialId;
+				m_Stats.materialChanges++;
+			}
+
+			unsigned int instanceCount = static_cast<unsigned int>(run.end - run.begin);
+			first.mesh->BindGeometry();
+			AttachInstances(run.firstInstance);
+
+			shader->setInstancedDraw(true);
+			first.mesh->DrawGeometryInstanced(instanceCount, first.lod);
+			shader->setInstancedDraw(false);
+			DetachInstances();
+
+			m_Stats.draws++;
+			m_Stats.instancedDraws++;
+			m_Stats.instances += instanceCount;
+			continue;
+		}
+
+		for (size_t i = run.begin; i < run.end; i++)
+		{
+			const Item& item = m_Items[m_Keys[i].value];
+			shader->setMat4("matModel", item.matrix);
+
+			if (item.mesh)
+			{
+				if (item.materialId != material)
+				{
+					item.mesh->BindMaterial(*shader);
+					material = item.materialId;
+					m_Stats.materialChanges++;
+				}
+				item.mesh->DrawGeometry(item.lod);
+			}
+			else
+			{
+				// Binds its own materials, whatever was bound before is gone
+				item.simpleModel->draw(*shader);
+				material = UINT32_MAX;
+				m_Stats.materialChanges++;
+			}
+
+			m_Stats.draws++;
+		}
+	}
+
+	if (blending)
+		SetBlending(false);
+
+	m_Items.clear();
+	m_Instances.clear();
+	m_ShaderIds.clear();
+	m_MaterialIds.clear();
+	m_MeshIds.clear();
+}
+
+void Renderer::free()
+{
+	if (m_InstanceBuffer != 0)
+	{
+		GLState::getInstance().forgetBuffer(m_InstanceBuffer);
+		glDeleteBuffers(1, &m_InstanceBuffer);
+	}
+
+	m_InstanceBuffer = 0;
+	m_Renderables.clear();
+
+	m_SceneIndex.clear();
+	m_Unbounded.clear();
+	m_UnboundedPosition.clear();
+	m_bCulling = false;
+}
+
+void Renderer::IndexRenderable(RenderableHandle handle)
+{
+	size_t dense = m_Renderables.getDense(handle.index);
+	const RenderableGeometry& geometry = m_Renderables.column<RENDERABLE_GEOMETRY>()[dense];
+	const glm::mat4& matrix = m_Renderables.column<RENDERABLE_TRANSFORM>()[dense];
+
+	// Models are bounded by their bind pose
+	switch (geometry.type)
+	{
+	case RenderableType::Mesh:
+		m_SceneIndex.setBounds(handle.index, static_cast<const Mesh*>(geometry.object)->getWorldBounds(matrix));
+		break;
+	case RenderableType::Model:
+		m_SceneIndex.setBounds(handle.index, static_cast<const Model*>(geometry.object)->getWorldBounds(matrix));
+		break;
+	case RenderableType::SimpleModel:
+		if (handle.index >= m_UnboundedPosition.size())
+			m_UnboundedPosition.resize(handle.index + 1, NOT_UNBOUNDED);
+
+		if (m_UnboundedPosition[handle.index] == NOT_UNBOUNDED)
+		{
+			m_UnboundedPosition[handle.index] = static_cast<uint32_t>(m_Unbounded.size());
+			m_Unbounded.push_back(handle.index);
+		}
+		break;
+	}
+}
+
+void Renderer::SubmitRenderable(size_t dense)
+{
+	const RenderableGeometry& geometry = m_Renderables.column<RENDERABLE_GEOMETRY>()[dense];
+	Shader& shader = *m_Renderables.column<RENDERABLE_SHADER>()[dense];
+	const glm::mat4& matrix = m_Renderables.column<RENDERABLE_TRANSFORM>()[dense];
+	const RenderableFlags& flags = m_Renderables.column<RENDERABLE_FLAGS>()[dense];
+
+	if (!flags.visible)
+		return;
+
+	switch (geometry.type)
+	{
+	case RenderableType::Mesh:
+		submit(shader, *static_cast<Mesh*>(geometry.object), matrix, flags.lod, flags.translucent, flags.pass);
+		break;
+	case RenderableType::Model:
+		submit(shader, *static_cast<Model*>(geometry.object), matrix, flags.lod, flags.translucent, flags.pass);
+		break;
+	case RenderableType::SimpleModel:
+		submit(shader, *static_cast<SimpleModel*>(geometry.object), matrix, flags.translucent, flags.pass);
+		break;
+	}
+}
+
+uint64_t Renderer::MakeKey(uint8_t pass, bool translucent, uint32_t shader, uint32_t material, uint32_t mesh, uint32_t depth)
+{
+	const uint64_t shaderBits = shader & ((1u << SHADER_BITS) - 1);
+	const uint64_t materialBits = material & ((1u << MATERIAL_BITS) - 1);
+	const uint64_t meshBits = mesh & ((1u << MESH_BITS) - 1);
+	const uint64_t depthBits = depth & ((1u << DEPTH_BITS) - 1);
+
+	uint64_t key = uint64_t(pass & (PASS_COUNT - 1)) << 62 | uint64_t(translucent) << 61;
+	if (!translucent)
+		return key | shaderBits << 50 | materialBits << 36 | meshBits << 22 | depthBits;
+
+	// Far first, so the larger depth has to give the smaller key
+	const uint64_t inverseDepth = ((1u << DEPTH_BITS) - 1) - depthBits;
+	return key | inverseDepth << 39 | shaderBits << 28 | materialBits << 14 | meshBits;
+}
+
+uint32_t Renderer::QuantizeDepth(const glm::vec3& position) const
+{
+	float depth = glm::dot(position - m_ViewPosition, m_ViewDirection);
+	float t = std::clamp((depth - m_Near) / (m_Far - m_Near), 0.0f, 1.0f);
+	return static_cast<uint32_t>(t * float((1u << DEPTH_BITS) - 1));
+}
+
+void Renderer::BuildRuns()
+{
+	m_Runs.clear();
+
+	for (size_t begin = 0; begin < m_Keys.size();)
 	{
-		if (!currentShader || (currentShader->id != shader->id))
+		const Item& first = m_Items[m_Keys[begin].value];
+
+		size_t end = begin + 1;
+		if (first.mesh && !first.translucent && first.shader->isInstanceable())
 		{
-			shader->use();
-			currentShader = shader;
+			while (end < m_Keys.size() && CanInstance(first, m_Items[m_Keys[end].value]))
+				end++;
 		}
 
-		currentShader->setMat4("matModel", model->matModel);
-		model->draw();
+		// Shorter runs are drawn one by one
+		if (end - begin >= MIN_INSTANCES)
+		{
+			m_Runs.push_back({ begin, end, m_Instances.size() });
+			for (size_t i = begin; i < end; i++)
+				m_Instances.push_back(m_Items[m_Keys[i].value].matrix);
+		}
+		else
+		{
+			m_Runs.push_back({ begin, end, NOT_INSTANCED });
+		}
+
+		begin = end;
 	}
-}
\ No newline at end of file
+}
+
+bool Renderer::CanInstance(const Item& first, const Item& item)
+{
+	// The key fields are cut to their bits, so neighbours in the sorted order can still differ
+	return item.mesh && !item.translucent && item.pass == first.pass && item.shader == first.shader && item.materialId == first.materialId &&
+		item.meshId == first.meshId;
+}
+
+void Renderer::AttachInstances(size_t firstInstance)
+{
+	// Vertex arrays are shared between meshes, so the pointers are set again for every batch
+	GLState::getInstance().bindBuffer(GL_ARRAY_BUFFER, m_InstanceBuffer);
+
+	for (GLuint column = 0; column < 4; column++)
+	{
+		GLuint location = INSTANCE_MATRIX_LOCATION + column;
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(firstInstance * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(location, 1);
+	}
+}
+
+void Renderer::DetachInstances()
+{
+	for (GLuint column = 0; column < 4; column++)
+	{
+		GLuint location = INSTANCE_MATRIX_LOCATION + column;
+		glVertexAttribDivisor(location, 0);
+		glDisableVertexAttribArray(location);
+	}
+}
+
+uint32_t Renderer::Intern(std::unordered_map<const void*, uint32_t>& ids, const void* object)
+{
+	return ids.emplace(object, static_cast<uint32_t>(ids.size())).first->second;
+}
+
+uint32_t Renderer::Intern(std::unordered_map<uint64_t, uint32_t>& ids, uint64_t key)
+{
+	return ids.emplace(key, static_cast<uint32_t>(ids.size())).first->second;
+}
+
+uint64_t Renderer::MaterialKey(const Mesh& mesh)
+{
+	// FNV-1a over the texture IDs in binding order
+	uint64_t hash = 14695981039346656037ull;
+	for (const Texture& texture : mesh.textures)
+		hash = (hash ^ texture.id) * 1099511628211ull;
+	return hash;
+}
+
+void Renderer::SetBlending(bool translucent)
+{
+	GLState& state = GLState::getInstance();
+
+	state.setCapability(GL_BLEND, translucent);
+	state.setDepthMask(!translucent);
+	if (translucent)
+		state.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <mutex>
+#include <utility>
+
+// Sampling parameters of a GL sampler object
+struct SamplerDesc
+{
+	GLint wrapS = GL_REPEAT;
+	GLint wrapT = GL_REPEAT;
+	GLint wrapR = GL_REPEAT;
+	GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLint magFilter = GL_LINEAR;
+
+	bool operator==(const SamplerDesc& other) const
+	{
+		return wrapS == other.wrapS && wrapT == other.wrapT && wrapR == other.wrapR &&
+			minFilter == other.minFilter && magFilter == other.magFilter;
+	}
+};
+
+// Hands out one shared sampler object per distinct parameter set, so sampling state is set once
+// at creation instead of with glTexParameteri calls every time a texture is bound
+class SamplerCache
+{
+private:
+	// There are only ever a handful of distinct samplers, a linear search beats hashing here
+	std::vector<std::pair<SamplerDesc, unsigned int>> m_Samplers;
+
+	// Sampler objects are shared between contexts, so the loader thread uses the same cache
+	std::mutex m_Mutex;
+
+	// This is a singleton class
+	SamplerCache() {}
+
+public:
+	SamplerCache(SamplerCache const&) = delete;
+	void operator=(SamplerCache const&) = delete;
+
+	static SamplerCache& getInstance();
+
+	// Returns the sampler for these parameters, creating it on first use
+	unsigned int get(const SamplerDesc& desc);
+
+	size_t getSamplerCount() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Samplers.size(); }
+
+	void free();
+};
+
+inline SamplerCache& SamplerCache::getInstance()
+{
+	static SamplerCache cache;
+	return cache;
+}
+
+unsigned int SamplerCache::get(const SamplerDesc& desc)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (const auto& [samplerDesc, sampler] : m_Samplers)
+	{
+		if (samplerDesc == desc)
+			return sampler;
+	}
+
+	unsigned int sampler;
+	glGenSamplers(1, &sampler);
+
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, desc.wrapS);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, desc.wrapT);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, desc.wrapR);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+
+	m_Samplers.push_back(std::make_pair(desc, sampler));
+	return sampler;
+}
+
+void SamplerCache::free()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (const auto& [samplerDesc, sampler] : m_Samplers)
+		glDeleteSamplers(1, &sampler);
+
+	m_Samplers.clear();
+}
@@ -0,0 +1,1164 @@
+#pragma once
+
+#include "Bounds.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cstdint>
+#include <cmath>
+
+// Set on BvhNode::count for children that are leaves
+constexpr uint32_t BVH_LEAF = 0x80000000u;
+
+// Four children of a BVH node. The boxes are stored per axis so one SIMD test covers all four, the node fills two
+// cache lines exactly. Unused children have count 0 and an inverted box that no test passes.
+struct alignas(64) BvhNode
+{
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+	uint32_t child[4];		// Node index, or for leaves the first entry of their objects in the object order
+	uint32_t count[4];		// Objects below the child, BVH_LEAF set for leaves
+};
+
+static_assert(sizeof(BvhNode) == 128, "BvhNode should fill two cache lines");
+
+// Bounding volume hierarchy over the world bounds of a scene's objects, for culling, picking and gathering objects
+// near lights. Objects are small integer IDs (the Renderer uses slot indices), their bounds set with setBounds().
+//
+// The tree is built with binned SAH into four-wide nodes; the top levels are split on the calling thread and the
+// subtrees below them are built on the thread pool. Moving objects only refits the nodes above them, which lets the
+// tree get worse over time: update() watches the SAH cost and rebuilds on a background thread once it grew by
+// rebuildCost, then swaps the new tree in. Objects added after the last build are kept in a list and tested one by
+// one until the next one.
+//
+// Every node's objects are one range of the object order, so a node entirely inside the frustum hands out its
+// objects without testing anything below it and culling costs about as much as the number of visible objects.
+class SceneBvh
+{
+public:
+	static constexpr unsigned int LEAF_SIZE = 4;
+	static constexpr unsigned int BIN_COUNT = 16;
+
+	// update() starts a rebuild once the SAH cost grew by this factor since the build...
+	float rebuildCost = 1.5f;
+
+	// ...or once this share of the objects is not in the tree
+	float rebuildPending = 0.05f;
+
+private:
+	static constexpr uint32_t NONE = ~0u;
+
+	// Below this many node levels ranges are split at the median instead of by SAH, which bounds the depth and with it
+	// the traversal stack
+	static constexpr unsigned int MAX_SAH_DEPTH = 24;
+	static constexpr unsigned int STACK_SIZE = 3 * (MAX_SAH_DEPTH + 32) + 4;
+
+	// Ranges at least this large are binned on the thread pool
+	static constexpr size_t PARALLEL_BINNING = 65536;
+
+	enum ObjectFlags : uint8_t { LIVE = 1, MOVED = 2, MOVED_DURING_REBUILD = 4, PENDING = 8 };
+
+	struct Tree
+	{
+		std::vector<BvhNode> nodes;				// Root first, every node comes before its children
+		std::vector<uint32_t> nodeFirst;		// First entry in order of everything below a node
+		std::vector<uint32_t> parents;
+		std::vector<uint32_t> order;			// Object IDs, the objects below any node are one range
+		std::vector<uint32_t> objectLeaf;		// node * 4 + child of the leaf holding an object, NONE if it is not in the tree
+		double cost = 0.0;						// SAH cost, not yet divided by the root's area
+		float builtCost = 0.0f;					// getCost() right after the build
+	};
+
+	// A subtree the top levels left for the thread pool
+	struct BuildTask
+	{
+		uint32_t begin;
+		uint32_t end;
+		uint32_t parent;
+		uint32_t child;
+		unsigned int depth;
+		Tree tree;
+	};
+
+	struct BuildContext
+	{
+		const std::vector<AABB>& bounds;
+		const std::vector<glm::vec3>& centroids;	// By object ID
+		uint32_t* order;
+		size_t taskSize;							// Ranges up to this size become tasks, while tasks is set
+		std::vector<BuildTask>* tasks;
+	};
+
+	struct Bins
+	{
+		AABB boxes[3][BIN_COUNT];
+		uint32_t counts[3][BIN_COUNT];
+	};
+
+	Tree m_Tree;
+
+	std::vector<AABB> m_Bounds;				// By object ID
+	std::vector<uint8_t> m_Flags;
+	std::vector<uint32_t> m_Moved;			// Moved since the last refit
+	std::vector<uint32_t> m_Pending;		// Not in the tree, may hold IDs that were removed since
+	size_t m_LiveCount = 0;
+
+	std::vector<uint32_t> m_DirtyNodes;
+	std::vector<uint8_t> m_NodeDirty;
+
+	std::thread m_RebuildThread;
+	std::atomic<bool> m_bRebuildDone = false;
+	bool m_bRebuilding = false;
+	Tree m_Rebuilt;
+	std::vector<uint32_t> m_MovedDuringRebuild;
+
+public:
+	SceneBvh() = default;
+	~SceneBvh();
+
+	SceneBvh(const SceneBvh&) = delete;
+	SceneBvh& operator=(const SceneBvh&) = delete;
+
+	// Adds the object or moves it
+	void setBounds(uint32_t object, const AABB& bounds);
+
+	void remove(uint32_t object);
+
+	bool contains(uint32_t object) const { return object < m_Flags.size() && (m_Flags[object] & LIVE); }
+	const AABB& getBounds(uint32_t object) const { return m_Bounds[object]; }
+
+	// Builds the tree over every object now, waiting for a background rebuild that is still running
+	void build();
+
+	// Removes every object and drops the tree, waiting for a background rebuild that is still running
+	void clear();
+
+	// Refits the nodes above the objects that moved since the last refit
+	void refit();
+
+	// Call once a frame: swaps in a finished background rebuild, refits and starts a rebuild if the tree got too bad.
+	// Returns true if a new tree was swapped in.
+	bool update();
+
+	bool isRebuilding() const { return m_bRebuilding; }
+
+	// SAH cost of the tree relative to its root box, lower is better
+	float getCost() const;
+
+	size_t getNodeCount() const { return m_Tree.nodes.size(); }
+	size_t getObjectCount() const { return m_LiveCount; }
+
+	// Objects whose bounds intersect the frustum, replacing the contents of objects
+	void cull(const Frustum& frustum, std::vector<uint32_t>& objects) const;
+
+	// Objects whose bounds overlap box, for gathering what a light or shadow reaches
+	void query(const AABB& box, std::vector<uint32_t>& objects) const;
+
+	// Nearest object whose bounds the ray hits within maxDistance, for picking. direction does not need to be normalized,
+	// distance is in multiples of it.
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& object, float& distance) const;
+
+private:
+	void MarkMoved(uint32_t object);
+	bool InTree(uint32_t object) const { return object < m_Tree.objectLeaf.size() && m_Tree.objectLeaf[object] != NONE; }
+
+	// Starts building a tree from a copy of the bounds, update() swaps it in when done
+	void StartRebuild();
+	void FinishRebuild();
+
+	// Makes the tree current: objects that moved during its build get refitted, the pending list is rebuilt
+	void Adopt(Tree&& tree);
+
+	std::vector<uint32_t> LiveObjects() const;
+
+	void RefitNode(uint32_t node);
+
+	// Appends the live objects in [begin, end) of the order
+	void EmitRange(uint32_t begin, uint32_t end, std::vector<uint32_t>& objects) const;
+
+	// Range of the order below child c of node
+	void ChildRange(const BvhNode& node, unsigned int c, uint32_t& begin, uint32_t& end) const;
+
+	static Tree BuildTree(const std::vector<AABB>& bounds, std::vector<uint32_t> objects);
+	static uint32_t BuildNode(Tree& tree, BuildContext& context, uint32_t begin, uint32_t end, const AABB& box, uint32_t parent, unsigned int depth);
+	static uint32_t Split(BuildContext& context, uint32_t begin, uint32_t end, unsigned int depth, AABB& leftBox, AABB& rightBox);
+	static uint32_t SplitMedian(BuildContext& context, uint32_t begin, uint32_t end, const AABB& centroidBox, AABB& leftBox, AABB& rightBox);
+	static void BinRange(const BuildContext& context, uint32_t begin, uint32_t end, const AABB& centroidBox, Bins& bins);
+
+	static double ComputeCost(const Tree& tree);
+
+	static AABB EmptyBox();
+	static float Area(const AABB& box);
+	static AABB ChildBox(const BvhNode& node, unsigned int c);
+	static AABB NodeBox(const BvhNode& node);
+	static void SetChildBox(BvhNode& node, unsigned int c, const AABB& box);
+
+	// Bit c is set for children that reach outside the frustum, and for children that touch it at all
+	static void TestFrustum(const BvhNode& node, const Frustum& frustum, int& touching, int& inside);
+	static void TestBox(const BvhNode& node, const AABB& box, int& overlapping, int& contained);
+	static int TestRay(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float entry[4]);
+};
+
+SceneBvh::~SceneBvh()
+{
+	if (m_RebuildThread.joinable())
+		m_RebuildThread.join();
+}
+
+void SceneBvh::setBounds(uint32_t object, const AABB& bounds)
+{
+	if (object >= m_Bounds.size())
+	{
+		m_Bounds.resize(object + 1, EmptyBox());
+		m_Flags.resize(object + 1, 0);
+	}
+
+	if (!(m_Flags[object] & LIVE))
+		m_LiveCount++;
+
+	m_Bounds[object] = bounds;
+	m_Flags[object] |= LIVE;
+
+	if (InTree(object))
+	{
+		MarkMoved(object);
+	}
+	else if (!(m_Flags[object] & PENDING))
+	{
+		m_Flags[object] |= PENDING;
+		m_Pending.push_back(object);
+	}
+
+	if (m_bRebuilding && !(m_Flags[object] & MOVED_DURING_REBUILD))
+	{
+		m_Flags[object] |= MOVED_DURING_REBUILD;
+		m_MovedDuringRebuild.push_back(object);
+	}
+}
+
+void SceneBvh::remove(uint32_t object)
+{
+	if (!contains(object))
+		return;
+
+	// The object stays in the tree as an empty box until the next build, its leaf skips it
+	m_Flags[object] &= ~LIVE;
+	m_Bounds[object] = EmptyBox();
+	m_LiveCount--;
+
+	if (InTree(object))
+		MarkMoved(object);
+
+	if (m_bRebuilding && !(m_Flags[object] & MOVED_DURING_REBUILD))
+	{
+		m_Flags[object] |= MOVED_DURING_REBUILD;
+		m_MovedDuringRebuild.push_back(object);
+	}
+}
+
+void SceneBvh::build()
+{
+	if (m_bRebuilding)
+		FinishRebuild();
+
+	Adopt(BuildTree(m_Bounds, LiveObjects()));
+}
+
+void SceneBvh::clear()
+{
+	if (m_bRebuilding)
+	{
+		m_RebuildThread.join();
+		m_bRebuilding = false;
+		m_Rebuilt = Tree();
+	}
+
+	m_Tree = Tree();
+	m_Bounds.clear();
+	m_Flags.clear();
+	m_Moved.clear();
+	m_Pending.clear();
+	m_LiveCount = 0;
+	m_DirtyNodes.clear();
+	m_NodeDirty.clear();
+	m_MovedDuringRebuild.clear();
+}
+
+void SceneBvh::refit()
+{
+	for (uint32_t object : m_Moved)
+	{
+		m_Flags[object] &= ~MOVED;
+		if (!InTree(object))
+			continue;
+
+		// Everything above the leaf, up to the first node that is already on the list
+		uint32_t node = m_Tree.objectLeaf[object] >> 2;
+		while (node != NONE && !m_NodeDirty[node])
+		{
+			m_NodeDirty[node] = 1;
+			m_DirtyNodes.push_back(node);
+			node = m_Tree.parents[node];
+		}
+	}
+	m_Moved.clear();
+
+	// Children come after their parents, so going backwards refits every node after its children
+	std::sort(m_DirtyNodes.begin(), m_DirtyNodes.end(), std::greater<uint32_t>());
+	for (uint32_t node : m_DirtyNodes)
+	{
+		RefitNode(node);
+		m_NodeDirty[node] = 0;
+	}
+	m_DirtyNodes.clear();
+}
+
+bool SceneBvh::update()
+{
+	bool swapped = false;
+	if (m_bRebuilding && m_bRebuildDone)
+	{
+		FinishRebuild();
+		swapped = true;
+	}
+
+	refit();
+
+	if (!m_bRebuilding)
+	{
+		size_t inTree = m_LiveCount - std::min(m_LiveCount, m_Pending.size());
+		bool tooManyPending = m_Pending.size() > std::max<size_t>(64, size_t(rebuildPending * float(inTree)));
+		bool tooExpensive = !m_Tree.nodes.empty() && getCost() > m_Tree.builtCost * rebuildCost;
+
+		if (tooManyPending || tooExpensive)
+			StartRebuild();
+	}
+
+	return swapped;
+}
+
+float SceneBvh::getCost() const
+{
+	if (m_Tree.nodes.empty())
+		return 0.0f;
+
+	float rootArea = Area(NodeBox(m_Tree.nodes[0]));
+	return rootArea > 0.0f ? float(m_Tree.cost / rootArea) : 0.0f;
+}
+
+void SceneBvh::cull(const Frustum& frustum, std::vector<uint32_t>& objects) const
+{
+	objects.clear();
+
+	if (!m_Tree.nodes.empty())
+	{
+		uint32_t stack[STACK_SIZE];
+		unsigned int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const BvhNode& node = m_Tree.nodes[stack[--top]];
+
+			int touching, inside;
+			TestFrustum(node, frustum, touching, inside);
+
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				if (!(touching & (1 << c)))
+					continue;
+
+				uint32_t begin, end;
+				ChildRange(node, c, begin, end);
+
+				if (inside & (1 << c))
+				{
+					EmitRange(begin, end, objects);
+				}
+				else if (node.count[c] & BVH_LEAF)
+				{
+					for (uint32_t i = begin; i < end; i++)
+					{
+						uint32_t object = m_Tree.order[i];
+						if ((m_Flags[object] & LIVE) && frustum.intersects(m_Bounds[object]))
+							objects.push_back(object);
+					}
+				}
+				else
+				{
+					stack[top++] = node.child[c];
+				}
+			}
+		}
+	}
+
+	for (uint32_t object : m_Pending)
+	{
+		if ((m_Flags[object] & LIVE) && frustum.intersects(m_Bounds[object]))
+			objects.push_back(object);
+	}
+}
+
+void SceneBvh::query(const AABB& box, std::vector<uint32_t>& objects) const
+{
+	objects.clear();
+
+	auto overlaps = [&box](const AABB& other)
+	{
+		return other.min.x <= box.max.x && other.max.x >= box.min.x && other.min.y <= box.max.y && other.max.y >= box.min.y &&
+			other.min.z <= box.max.z && other.max.z >= box.min.z;
+	};
+
+	if (!m_Tree.nodes.empty())
+	{
+		uint32_t stack[STACK_SIZE];
+		unsigned int top = 0;
+		stack[top++] = 0;
+
+		while (top > 0)
+		{
+			const BvhNode& node = m_Tree.nodes[stack[--top]];
+
+			int overlapping, contained;
+			TestBox(node, box, overlapping, contained);
+
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				if (!(overlapping & (1 << c)))
+					continue;
+
+				uint32_t begin, end;
+				ChildRange(node, c, begin, end);
+
+				if (contained & (1 << c))
+				{
+					EmitRange(begin, end, objects);
+				}
+				else if (node.count[c] & BVH_LEAF)
+				{
+					for (uint32_t i = begin; i < end; i++)
+					{
+						uint32_t object = m_Tree.order[i];
+						if ((m_Flags[object] & LIVE) && overlaps(m_Bounds[object]))
+							objects.push_back(object);
+					}
+				}
+				else
+				{
+					stack[top++] = node.child[c];
+				}
+			}
+		}
+	}
+
+	for (uint32_t object : m_Pending)
+	{
+		if ((m_Flags[object] & LIVE) && overlaps(m_Bounds[object]))
+			objects.push_back(object);
+	}
+}
+
+bool SceneBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& object, float& distance) const
+{
+	// Zero components give infinities, which the slab test handles
+	glm::vec3 inverseDirection = 1.0f / direction;
+	float nearest = maxDistance;
+	uint32_t hit = NONE;
+
+	auto testObject = [&](uint32_t candidate)
+	{
+		if (!(m_Flags[candidate] & LIVE))
+			return;
+
+		const AABB& box = m_Bounds[candidate];
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+		float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+
+		if (entry <= exit && entry < nearest)
+		{
+			nearest = entry;
+			hit = candidate;
+		}
+	};
+
+	if (!m_Tree.nodes.empty())
+	{
+		uint32_t stack[STACK_SIZE];
+		float stackEntry[STACK_SIZE];
+		unsigned int top = 0;
+		stack[top] = 0;
+		stackEntry[top++] = 0.0f;
+
+		while (top > 0)
+		{
+			top--;
+			if (stackEntry[top] >= nearest)
+				continue;
+
+			const BvhNode& node = m_Tree.nodes[stack[top]];
+
+			float entry[4];
+			int hits = TestRay(node, origin, inverseDirection, nearest, entry);
+
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				if (!(hits & (1 << c)))
+					continue;
+
+				if (node.count[c] & BVH_LEAF)
+				{
+					uint32_t begin, end;
+					ChildRange(node, c, begin, end);
+					for (uint32_t i = begin; i < end; i++)
+						testObject(m_Tree.order[i]);
+				}
+				else
+				{
+					stack[top] = node.child[c];
+					stackEntry[top++] = entry[c];
+				}
+			}
+		}
+	}
+
+	for (uint32_t candidate : m_Pending)
+		testObject(candidate);
+
+	if (hit == NONE)
+		return false;
+
+	object = hit;
+	distance = nearest;
+	return true;
+}
+
+void SceneBvh::MarkMoved(uint32_t object)
+{
+	if (m_Flags[object] & MOVED)
+		return;
+
+	m_Flags[object] |= MOVED;
+	m_Moved.push_back(object);
+}
+
+void SceneBvh::StartRebuild()
+{
+	m_bRebuilding = true;
+	m_bRebuildDone = false;
+
+	// The thread works on copies, so objects can keep moving while it builds
+	m_RebuildThread = std::thread([this, bounds = m_Bounds, objects = LiveObjects()]() mutable
+	{
+		m_Rebuilt = BuildTree(bounds, std::move(objects));
+		m_bRebuildDone = true;
+	});
+}
+
+void SceneBvh::FinishRebuild()
+{
+	m_RebuildThread.join();
+	m_bRebuilding = false;
+
+	Adopt(std::move(m_Rebuilt));
+	m_Rebuilt = Tree();
+}
+
+void SceneBvh::Adopt(Tree&& tree)
+{
+	m_Tree = std::move(tree);
+	m_NodeDirty.assign(m_Tree.nodes.size(), 0);
+
+	// The new tree has the bounds these had when its build started
+	for (uint32_t object : m_MovedDuringRebuild)
+	{
+		m_Flags[object] &= ~MOVED_DURING_REBUILD;
+		if (InTree(object))
+			MarkMoved(object);
+	}
+	m_MovedDuringRebuild.clear();
+
+	m_Pending.clear();
+	for (uint32_t object = 0; object < m_Flags.size(); object++)
+	{
+		m_Flags[object] &= ~PENDING;
+		if ((m_Flags[object] & LIVE) && !InTree(object))
+		{
+			m_Flags[object] |= PENDING;
+			m_Pending.push_back(object);
+		}
+	}
+
+	refit();
+}
+
+std::vector<uint32_t> SceneBvh::LiveObjects() const
+{
+	std::vector<uint32_t> objects;
+	objects.reserve(m_LiveCount);
+	for (uint32_t object = 0; object < m_Flags.size(); object++)
+	{
+		if (m_Flags[object] & LIVE)
+			objects.push_back(object);
+	}
+	return objects;
+}
+
+void SceneBvh::RefitNode(uint32_t index)
+{
+	BvhNode& node = m_Tree.nodes[index];
+
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		uint32_t count = node.count[c] & ~BVH_LEAF;
+		if (count == 0)
+			continue;
+
+		AABB box = EmptyBox();
+		if (node.count[c] & BVH_LEAF)
+		{
+			for (uint32_t i = node.child[c]; i < node.child[c] + count; i++)
+				box.expand(m_Bounds[m_Tree.order[i]]);
+		}
+		else
+		{
+			box = NodeBox(m_Tree.nodes[node.child[c]]);
+		}
+
+		// Leaves cost their objects, inner children one traversal step
+		double weight = (node.count[c] & BVH_LEAF) ? double(count) : 1.0;
+		m_Tree.cost += weight * (double(Area(box)) - double(Area(ChildBox(node, c))));
+		SetChildBox(node, c, box);
+	}
+}
+
+void SceneBvh::EmitRange(uint32_t begin, uint32_t end, std::vector<uint32_t>& objects) const
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t object = m_Tree.order[i];
+		if (m_Flags[object] & LIVE)
+			objects.push_back(object);
+	}
+}
+
+void SceneBvh::ChildRange(const BvhNode& node, unsigned int c, uint32_t& begin, uint32_t& end) const
+{
+	begin = (node.count[c] & BVH_LEAF) ? node.child[c] : m_Tree.nodeFirst[node.child[c]];
+	end = begin + (node.count[c] & ~BVH_LEAF);
+}
+
+SceneBvh::Tree SceneBvh::BuildTree(const std::vector<AABB>& bounds, std::vector<uint32_t> objects)
+{
+	Tree tree;
+	tree.order = std::move(objects);
+	tree.objectLeaf.assign(bounds.size(), NONE);
+
+	const uint32_t count = static_cast<uint32_t>(tree.order.size());
+	if (count == 0)
+		return tree;
+
+	ThreadPool& pool = ThreadPool::getInstance();
+
+	std::vector<glm::vec3> centroids(bounds.size());
+	pool.parallelFor(count, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			centroids[tree.order[i]] = bounds[tree.order[i]].getCenter();
+	}, 16384);
+
+	AABB box = EmptyBox();
+	for (uint32_t object : tree.order)
+		box.expand(bounds[object]);
+
+	// The top levels are split here, everything below them becomes a task for the pool
+	std::vector<BuildTask> tasks;
+	size_t taskSize = std::max<size_t>(4096, count / (std::max<size_t>(pool.getWorkerCount(), 1) * 8));
+	BuildContext context = { bounds, centroids, tree.order.data(), taskSize, &tasks };
+	BuildNode(tree, context, 0, count, box, NONE, 0);
+
+	pool.parallelFor(tasks.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			BuildTask& task = tasks[t];
+			BuildContext taskContext = { bounds, centroids, tree.order.data(), 0, nullptr };
+
+			const BvhNode& parent = tree.nodes[task.parent];
+			BuildNode(task.tree, taskContext, task.begin, task.end, ChildBox(parent, task.child), NONE, task.depth);
+		}
+	});
+
+	// Append the subtrees behind the top levels, after their parents
+	for (BuildTask& task : tasks)
+	{
+		uint32_t offset = static_cast<uint32_t>(tree.nodes.size());
+
+		for (size_t n = 0; n < task.tree.nodes.size(); n++)
+		{
+			BvhNode node = task.tree.nodes[n];
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				if (node.count[c] != 0 && !(node.count[c] & BVH_LEAF))
+					node.child[c] += offset;
+			}
+
+			tree.nodes.push_back(node);
+			tree.nodeFirst.push_back(task.tree.nodeFirst[n]);
+			tree.parents.push_back(n == 0 ? task.parent : task.tree.parents[n] + offset);
+		}
+
+		tree.nodes[task.parent].child[task.child] = offset;
+	}
+
+	// Where every object ended up, for refitting
+	pool.parallelFor(tree.nodes.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t n = begin; n < end; n++)
+		{
+			const BvhNode& node = tree.nodes[n];
+			for (unsigned int c = 0; c < 4; c++)
+			{
+				if (!(node.count[c] & BVH_LEAF))
+					continue;
+
+				for (uint32_t i = node.child[c]; i < node.child[c] + (node.count[c] & ~BVH_LEAF); i++)
+					tree.objectLeaf[tree.order[i]] = static_cast<uint32_t>(n * 4 + c);
+			}
+		}
+	}, 1024);
+
+	tree.cost = ComputeCost(tree);
+	float rootArea = Area(NodeBox(tree.nodes[0]));
+	tree.builtCost = rootArea > 0.0f ? float(tree.cost / rootArea) : 0.0f;
+	return tree;
+}
+
+uint32_t SceneBvh::BuildNode(Tree& tree, BuildContext& context, uint32_t begin, uint32_t end, const AABB& box, uint32_t parent, unsigned int depth)
+{
+	uint32_t index = static_cast<uint32_t>(tree.nodes.size());
+	tree.nodes.emplace_back();
+	tree.nodeFirst.push_back(begin);
+	tree.parents.push_back(parent);
+
+	struct Range
+	{
+		uint32_t begin;
+		uint32_t end;
+		AABB box;
+	};
+
+	// Keep splitting the largest range that is too big for a leaf until there are four
+	Range ranges[4];
+	unsigned int rangeCount = 1;
+	ranges[0] = { begin, end, box };
+
+	while (rangeCount < 4)
+	{
+		int largest = -1;
+		for (unsigned int r = 0; r < rangeCount; r++)
+		{
+			if (ranges[r].end - ranges[r].begin > LEAF_SIZE && (largest < 0 || Area(ranges[r].box) > Area(ranges[largest].box)))
+				largest = static_cast<int>(r);
+		}
+
+		if (largest < 0)
+			break;
+
+		Range& range = ranges[largest];
+		AABB leftBox, rightBox;
+		uint32_t middle = Split(context, range.begin, range.end, depth, leftBox, rightBox);
+
+		ranges[rangeCount++] = { middle, range.end, rightBox };
+		range = { range.begin, middle, leftBox };
+	}
+
+	BvhNode node;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		node.child[c] = NONE;
+		node.count[c] = 0;
+		SetChildBox(node, c, EmptyBox());
+	}
+
+	for (unsigned int c = 0; c < rangeCount; c++)
+	{
+		const Range& range = ranges[c];
+		uint32_t count = range.end - range.begin;
+		SetChildBox(node, c, range.box);
+
+		if (count <= LEAF_SIZE)
+		{
+			node.child[c] = range.begin;
+			node.count[c] = count | BVH_LEAF;
+		}
+		else if (context.tasks && count <= context.taskSize)
+		{
+			// Filled in once the task's subtree is appended
+			node.count[c] = count;
+			context.tasks->push_back({ range.begin, range.end, index, c, depth + 1, Tree() });
+		}
+		else
+		{
+			// Not holding on to tree.nodes[index], the recursion grows the array
+			tree.nodes[index] = node;
+			node.child[c] = BuildNode(tree, context, range.begin, range.end, range.box, index, depth + 1);
+			node.count[c] = count;
+		}
+	}
+
+	tree.nodes[index] = node;
+	return index;
+}
+
+uint32_t SceneBvh::Split(BuildContext& context, uint32_t begin, uint32_t end, unsigned int depth, AABB& leftBox, AABB& rightBox)
+{
+	uint32_t* order = context.order;
+
+	AABB centroidBox = EmptyBox();
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const glm::vec3& centroid = context.centroids[order[i]];
+		centroidBox.min = glm::min(centroidBox.min, centroid);
+		centroidBox.max = glm::max(centroidBox.max, centroid);
+	}
+
+	glm::vec3 extent = centroidBox.max - centroidBox.min;
+	if (depth >= MAX_SAH_DEPTH || (extent.x <= 0.0f && extent.y <= 0.0f && extent.z <= 0.0f))
+		return SplitMedian(context, begin, end, centroidBox, leftBox, rightBox);
+
+	Bins bins;
+	if (end - begin >= PARALLEL_BINNING)
+	{
+		// Every block bins on its own, then the bins are added up
+		const size_t block = PARALLEL_BINNING / 4;
+		const size_t blockCount = (end - begin + block - 1) / block;
+		std::vector<Bins> blockBins(blockCount);
+
+		ThreadPool::getInstance().parallelFor(blockCount, [&](size_t first, size_t last)
+		{
+			for (size_t b = first; b < last; b++)
+				BinRange(context, uint32_t(begin + b * block), uint32_t(std::min<size_t>(end, begin + (b + 1) * block)), centroidBox, blockBins[b]);
+		});
+
+		bins = blockBins[0];
+		for (size_t b = 1; b < blockCount; b++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				for (unsigned int i = 0; i < BIN_COUNT; i++)
+				{
+					bins.boxes[axis][i].expand(blockBins[b].boxes[axis][i]);
+					bins.counts[axis][i] += blockBins[b].counts[axis][i];
+				}
+			}
+		}
+	}
+	else
+	{
+		BinRange(context, begin, end, centroidBox, bins);
+	}
+
+	// Sweep every axis for the plane between two bins with the lowest SAH cost
+	float bestCost = std::numeric_limits<float>::max();
+	int bestAxis = -1;
+	unsigned int bestBin = 0;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (extent[axis] <= 0.0f)
+			continue;
+
+		float rightCosts[BIN_COUNT];
+		AABB right = EmptyBox();
+		uint32_t rightCount = 0;
+		for (unsigned int i = BIN_COUNT - 1; i > 0; i--)
+		{
+			right.expand(bins.boxes[axis][i]);
+			rightCount += bins.counts[axis][i];
+			rightCosts[i] = Area(right) * float(rightCount);
+		}
+
+		AABB left = EmptyBox();
+		uint32_t leftCount = 0;
+		for (unsigned int i = 1; i < BIN_COUNT; i++)
+		{
+			left.expand(bins.boxes[axis][i - 1]);
+			leftCount += bins.counts[axis][i - 1];
+
+			float cost = Area(left) * float(leftCount) + rightCosts[i];
+			if (leftCount > 0 && leftCount < end - begin && cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = i;
+			}
+		}
+	}
+
+	if (bestAxis < 0)
+		return SplitMedian(context, begin, end, centroidBox, leftBox, rightBox);
+
+	const float scale = float(BIN_COUNT) / extent[bestAxis];
+	const float minimum = centroidBox.min[bestAxis];
+	uint32_t* middle = std::partition(order + begin, order + end, [&](uint32_t object)
+	{
+		unsigned int bin = std::min(BIN_COUNT - 1, unsigned((context.centroids[object][bestAxis] - minimum) * scale));
+		return bin < bestBin;
+	});
+
+	leftBox = EmptyBox();
+	rightBox = EmptyBox();
+	for (unsigned int i = 0; i < BIN_COUNT; i++)
+		(i < bestBin ? leftBox : rightBox).expand(bins.boxes[bestAxis][i]);
+
+	return static_cast<uint32_t>(middle - order);
+}
+
+uint32_t SceneBvh::SplitMedian(BuildContext& context, uint32_t begin, uint32_t end, const AABB& centroidBox, AABB& leftBox, AABB& rightBox)
+{
+	glm::vec3 extent = centroidBox.max - centroidBox.min;
+	int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+	uint32_t* order = context.order;
+	uint32_t middle = begin + (end - begin) / 2;
+	std::nth_element(order + begin, order + middle, order + end, [&](uint32_t a, uint32_t b) { return context.centroids[a][axis] < context.centroids[b][axis]; });
+
+	leftBox = EmptyBox();
+	rightBox = EmptyBox();
+	for (uint32_t i = begin; i < end; i++)
+		(i < middle ? leftBox : rightBox).expand(context.bounds[order[i]]);
+
+	return middle;
+}
+
+void SceneBvh::BinRange(const BuildContext& context, uint32_t begin, uint32_t end, const AABB& centroidBox, Bins& bins)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (unsigned int i = 0; i < BIN_COUNT; i++)
+		{
+			bins.boxes[axis][i] = EmptyBox();
+			bins.counts[axis][i] = 0;
+		}
+	}
+
+	glm::vec3 extent = centroidBox.max - centroidBox.min;
+	glm::vec3 scale;
+	for (int axis = 0; axis < 3; axis++)
+		scale[axis] = extent[axis] > 0.0f ? float(BIN_COUNT) / extent[axis] : 0.0f;
+
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t object = context.order[i];
+		const glm::vec3& centroid = context.centroids[object];
+		const AABB& box = context.bounds[object];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			unsigned int bin = std::min(BIN_COUNT - 1, unsigned((centroid[axis] - centroidBox.min[axis]) * scale[axis]));
+			bins.boxes[axis][bin].expand(box);
+			bins.counts[axis][bin]++;
+		}
+	}
+}
+
+double SceneBvh::ComputeCost(const Tree& tree)
+{
+	double cost = 0.0;
+	for (const BvhNode& node : tree.nodes)
+	{
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			if (node.count[c] == 0)
+				continue;
+
+			double weight = (node.count[c] & BVH_LEAF) ? double(node.count[c] & ~BVH_LEAF) : 1.0;
+			cost += weight * Area(ChildBox(node, c));
+		}
+	}
+	return cost;
+}
+
+AABB SceneBvh::EmptyBox()
+{
+	AABB box;
+	box.min = glm::vec3(std::numeric_limits<float>::max());
+	box.max = glm::vec3(-std::numeric_limits<float>::max());
+	return box;
+}
+
+float SceneBvh::Area(const AABB& box)
+{
+	glm::vec3 size = box.max - box.min;
+	if (size.x < 0.0f || size.y < 0.0f || size.z < 0.0f)
+		return 0.0f;
+
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+AABB SceneBvh::ChildBox(const BvhNode& node, unsigned int c)
+{
+	AABB box;
+	box.min = glm::vec3(node.minX[c], node.minY[c], node.minZ[c]);
+	box.max = glm::vec3(node.maxX[c], node.maxY[c], node.maxZ[c]);
+	return box;
+}
+
+AABB SceneBvh::NodeBox(const BvhNode& node)
+{
+	AABB box = EmptyBox();
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		if (node.count[c] != 0)
+			box.expand(ChildBox(node, c));
+	}
+	return box;
+}
+
+void SceneBvh::SetChildBox(BvhNode& node, unsigned int c, const AABB& box)
+{
+	node.minX[c] = box.min.x;
+	node.minY[c] = box.min.y;
+	node.minZ[c] = box.min.z;
+	node.maxX[c] = box.max.x;
+	node.maxY[c] = box.max.y;
+	node.maxZ[c] = box.max.z;
+}
+
+void SceneBvh::TestFrustum(const BvhNode& node, const Frustum& frustum, int& touching, int& inside)
+{
+	int outside = 0, crossing = 0;
+
+#ifdef BOUNDS_SSE2
+	const __m128 minX = _mm_load_ps(node.minX), minY = _mm_load_ps(node.minY), minZ = _mm_load_ps(node.minZ);
+	const __m128 maxX = _mm_load_ps(node.maxX), maxY = _mm_load_ps(node.maxY), maxZ = _mm_load_ps(node.maxZ);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		// The plane's normal is the same for all four boxes, so it picks the same corners for all of them: the one
+		// furthest along the normal is outside last, the nearest one inside last
+		const __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z), w = _mm_set1_ps(plane.w);
+		__m128 farX = plane.x >= 0.0f ? maxX : minX, nearX = plane.x >= 0.0f ? minX : maxX;
+		__m128 farY = plane.y >= 0.0f ? maxY : minY, nearY = plane.y >= 0.0f ? minY : maxY;
+		__m128 farZ = plane.z >= 0.0f ? maxZ : minZ, nearZ = plane.z >= 0.0f ? minZ : maxZ;
+
+		__m128 farDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, farX), _mm_mul_ps(ny, farY)), _mm_add_ps(_mm_mul_ps(nz, farZ), w));
+		__m128 nearDistance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nearX), _mm_mul_ps(ny, nearY)), _mm_add_ps(_mm_mul_ps(nz, nearZ), w));
+
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(farDistance, zero));
+		crossing |= _mm_movemask_ps(_mm_cmplt_ps(nearDistance, zero));
+	}
+#else
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		for (unsigned int c = 0; c < 4; c++)
+		{
+			float farDistance = plane.x * (plane.x >= 0.0f ? node.maxX[c] : node.minX[c]) + plane.y * (plane.y >= 0.0f ? node.maxY[c] : node.minY[c]) +
+				plane.z * (plane.z >= 0.0f ? node.maxZ[c] : node.minZ[c]) + plane.w;
+			float nearDistance = plane.x * (plane.x >= 0.0f ? node.minX[c] : node.maxX[c]) + plane.y * (plane.y >= 0.0f ? node.minY[c] : node.maxY[c]) +
+				plane.z * (plane.z >= 0.0f ? node.minZ[c] : node.maxZ[c]) + plane.w;
+
+			if (farDistance < 0.0f)
+				outside |= 1 << c;
+			if (nearDistance < 0.0f)
+				crossing |= 1 << c;
+		}
+	}
+#endif
+
+	int used = 0;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		if (node.count[c] != 0)
+			used |= 1 << c;
+	}
+
+	touching = used & ~outside;
+	inside = touching & ~crossing;
+}
+
+void SceneBvh::TestBox(const BvhNode& node, const AABB& box, int& overlapping, int& contained)
+{
+#ifdef BOUNDS_SSE2
+	const __m128 minX = _mm_load_ps(node.minX), minY = _mm_load_ps(node.minY), minZ = _mm_load_ps(node.minZ);
+	const __m128 maxX = _mm_load_ps(node.maxX), maxY = _mm_load_ps(node.maxY), maxZ = _mm_load_ps(node.maxZ);
+	const __m128 boxMinX = _mm_set1_ps(box.min.x), boxMinY = _mm_set1_ps(box.min.y), boxMinZ = _mm_set1_ps(box.min.z);
+	const __m128 boxMaxX = _mm_set1_ps(box.max.x), boxMaxY = _mm_set1_ps(box.max.y), boxMaxZ = _mm_set1_ps(box.max.z);
+
+	__m128 overlap = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(minX, boxMaxX), _mm_cmpge_ps(maxX, boxMinX)),
+		_mm_and_ps(_mm_and_ps(_mm_cmple_ps(minY, boxMaxY), _mm_cmpge_ps(maxY, boxMinY)), _mm_and_ps(_mm_cmple_ps(minZ, boxMaxZ), _mm_cmpge_ps(maxZ, boxMinZ))));
+	__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(minX, boxMinX), _mm_cmple_ps(maxX, boxMaxX)),
+		_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(minY, boxMinY), _mm_cmple_ps(maxY, boxMaxY)), _mm_and_ps(_mm_cmpge_ps(minZ, boxMinZ), _mm_cmple_ps(maxZ, boxMaxZ))));
+
+	// Unused children have inverted boxes, they never overlap anything
+	overlapping = _mm_movemask_ps(overlap);
+	contained = overlapping & _mm_movemask_ps(inside);
+#else
+	overlapping = contained = 0;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		if (node.minX[c] <= box.max.x && node.maxX[c] >= box.min.x && node.minY[c] <= box.max.y && node.maxY[c] >= box.min.y &&
+			node.minZ[c] <= box.max.z && node.maxZ[c] >= box.min.z)
+			overlapping |= 1 << c;
+
+		if (node.minX[c] >= box.min.x && node.maxX[c] <= box.max.x && node.minY[c] >= box.min.y && node.maxY[c] <= box.max.y &&
+			node.minZ[c] >= box.min.z && node.maxZ[c] <= box.max.z)
+			contained |= 1 << c;
+	}
+	contained &= overlapping;
+#endif
+}
+
+int SceneBvh::TestRay(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float entry[4])
+{
+	int hits = 0;
+
+#ifdef BOUNDS_SSE2
+	const __m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+	const __m128 inverseX = _mm_set1_ps(inverseDirection.x), inverseY = _mm_set1_ps(inverseDirection.y), inverseZ = _mm_set1_ps(inverseDirection.z);
+
+	__m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), inverseX), x1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), inverseX);
+	__m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), inverseY), y1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), inverseY);
+	__m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), inverseZ), z1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), inverseZ);
+
+	__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+	__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(maxDistance)));
+
+	_mm_storeu_ps(entry, tNear);
+	hits = _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		float x0 = (node.minX[c] - origin.x) * inverseDirection.x, x1 = (node.maxX[c] - origin.x) * inverseDirection.x;
+		float y0 = (node.minY[c] - origin.y) * inverseDirection.y, y1 = (node.maxY[c] - origin.y) * inverseDirection.y;
+		float z0 = (node.minZ[c] - origin.z) * inverseDirection.z, z1 = (node.maxZ[c] - origin.z) * inverseDirection.z;
+
+		float tNear = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+		float tFar = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), maxDistance));
+
+		entry[c] = tNear;
+		if (tNear <= tFar)
+			hits |= 1 << c;
+	}
+#endif
+
+	// Unused children have inverted boxes and never pass, but are masked out anyway
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		if (node.count[c] == 0)
+			hits &= ~(1 << c);
+	}
+
+	return hits;
+}
@@ -4,6 +4,9 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "VertexFormat.h"
+#include "GLState.h"
+
 #include <iostream>
 #include <string>
 #include <fstream>
@@ -22,6 +25,11 @@ public:
 	void use();
 	unsigned int getID() { return id; }
 
+	// True if the vertex shader takes its model matrix from "uniform mat4 matModel", those also get a per instance
+	// matrix at INSTANCE_MATRIX_LOCATION that setInstancedDraw(true) switches matModel to
+	bool isInstanceable() const { return instancedDrawLocation != -1; }
+	void setInstancedDraw(bool instanced);
+
 	void setBool(const std::string& name, bool value);
 	void setInt(const std::string& name, int value);
 	void setFloat(const std::string& name, float value);
@@ -33,6 +41,7 @@ public:
 
 private:
 	unsigned int id;
+	int instancedDrawLocation = -1;
 	unsigned int CompileShader(unsigned int type, const std::string& source, const std::string& shaderPath);
 };
 
@@ -74,7 +83,17 @@ void Shader::load(const std::string& shaderPath)
 		}
 	}
 
-	std::string vertexShader = "#version 330 core\n #define SHADER_VERTEX\n #ifdef SHADER_VERTEX\n" + ss[(int)ShaderType::VERTEX].str();
+	// A model matrix uniform can be fed per instance as well
+	std::string vertexSource = ss[(int)ShaderType::VERTEX].str();
+	size_t modelMatrix = vertexSource.find("uniform mat4 matModel;");
+	if (modelMatrix != std::string::npos)
+	{
+		size_t lineEnd = vertexSource.find('\n', modelMatrix);
+		vertexSource.insert(lineEnd == std::string::npos ? vertexSource.size() : lineEnd + 1, std::string("\n") + INSTANCING_GLSL);
+	}
+
+	// Vertex shaders also get the decode functions for packed vertex formats
+	std::string vertexShader = "#version 330 core\n #define SHADER_VERTEX\n" + std::string(VERTEX_FORMAT_GLSL) + SKINNING_GLSL + " #ifdef SHADER_VERTEX\n" + vertexSource;
 	std::string fragmentShader = "#version 330 core\n #define SHADER_FRAGMENT\n #ifdef SHADER_FRAGMENT\n" + ss[(int)ShaderType::FRAGMENT].str();
 	std::string geometryShader;
 
@@ -129,11 +148,21 @@ void Shader::load(const std::string& shaderPath)
 
 	if (isGeometryShaderPresent)
 		glDeleteShader(gs);
+
+	// -1 when there was no matModel uniform or the compiler dropped it
+	instancedDrawLocation = glGetUniformLocation(id, "instancedDraw");
 }
 
 void Shader::use()
 {
-	glUseProgram(id);
+	GLState::getInstance().useProgram(id);
+}
+
+// The program has to be in use, like for the other setters
+void Shader::setInstancedDraw(bool instanced)
+{
+	if (instancedDrawLocation != -1)
+		glUniform1i(instancedDrawLocation, (int)instanced);
 }
 
 void Shader::setBool(const std::string& name, bool value)
@@ -1,10 +1,14 @@
 #pragma once
 
-#include "VertexArray.h"
-#include "VertexBuffer.h"
+#include "GeometryArena.h"
 #include "Shader.h"
-#include "BufferLayout.h"
 #include "Texture2D.h"
+#include "Sampler.h"
+#include "ObjParser.h"
+#include "ObjStream.h"
+#include "VertexArray.h"
+#include "VertexBuffer.h"
+#include "IndexBuffer.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,17 +16,43 @@
 
 #include <vector>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <iomanip>
+#include <iostream>
+
+// A material of the model's MTL file with its textures loaded. Textures that the file doesn't name have ID 0.
+struct SimpleMaterial
+{
+	ObjMaterial desc;
+	Texture2D diffuseMap;		// Texture unit 0
+	Texture2D specularMap;		// Texture unit 1
+	Texture2D normalMap;		// Texture unit 2
+};
+
+// Indices [firstIndex, firstIndex + indexCount) all use one material, -1 for faces without one. Streamed models also
+// give every batch the base vertex of the piece it belongs to.
+struct SimpleModelBatch
+{
+	size_t firstIndex;
+	unsigned int indexCount;
+	int material;
+	GLint baseVertex = 0;
+};
 
 class SimpleModel
 {
 private:
-	VertexArray vao;
-	VertexBuffer<float> vbo;
+	GeometryHandle geometry = INVALID_GEOMETRY;
 	std::vector<Texture2D> textures;
 	int nr_indices = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+
+	// Faces are sorted by material at import, so every material is bound once per draw
+	std::vector<SimpleMaterial> materials;
+	std::vector<SimpleModelBatch> batches;
+
+	// Streamed models are too large for the geometry arena and keep their own buffers
+	VertexArray streamArray;
+	VertexBuffer<float> streamVertices;
+	IndexBuffer streamIndices;
 
 public:
 	//glm::mat4 matModel = glm::mat4(1.0f);
@@ -33,8 +63,11 @@ public:
 	// Load the object file
 	bool load(const std::string& objfilePath);
 
-	// Set textures to the model, if any
-	// For now, this function is just a placeholder and does nothing
+	// Loads object files larger than memory through ObjStream, within options.memoryBudget. Faces keep the file's
+	// order instead of being sorted by material, so a material can take several batches.
+	bool loadStreaming(const std::string& objfilePath, const ObjStreamOptions& options = ObjStreamOptions());
+
+	// Set textures to the model, if any. They are bound to units 0, 1, ... instead of the textures of the MTL materials.
 	void setTextures(const std::vector<std::string>& texturePaths);
 	void setTextures(const std::vector<std::string>&& texturePaths);
 
@@ -42,25 +75,147 @@ public:
 	void bindTextures();
 
 	// Function which draws the model onto the screen. Make sure to bind shaders before calling this function.
+	// Unless setTextures() was called, models with an MTL file bind the textures of each batch's material to units 0
+	// (diffuse), 1 (specular) and 2 (normal), and texture 0 to the units of maps the material doesn't have.
 	void draw();
 
-	// Destructor
+	// Same, also sets vMaterialColor to the diffuse color of every material
+	void draw(Shader& shader);
+
+	const std::vector<SimpleMaterial>& getMaterials() const { return materials; }
+	const std::vector<SimpleModelBatch>& getBatches() const { return batches; }
+
+	// The model owns its block of the geometry arena and its textures, so it can be moved but not copied
+	SimpleModel(const SimpleModel&) = delete;
+	SimpleModel& operator=(const SimpleModel&) = delete;
+
+	SimpleModel(SimpleModel&& other) noexcept;
+	SimpleModel& operator=(SimpleModel&& other) noexcept;
+
 	~SimpleModel();
 
 private:
+	// Model textures are sampled clamped to the edge through a shared sampler object, filtered the way the texture
+	// was loaded
+	static unsigned int GetSampler(const Texture2D& texture);
+
 	// Utility function to load model
-	bool LoadModel(VertexArray& vao, VertexBuffer<float>& vbo, int& vertexCount, const std::string& modelFile);
+	bool LoadModel(GeometryHandle& geometry, int& indexCount, GLenum& indexType, std::vector<SimpleModelBatch>& batches, const std::string& modelFile);
+
+	// Loads the materials of the model's MTL file, textures included
+	void LoadMaterials(const std::string& directory, const std::string& materialLibrary);
+
+	// Index of the material called name, -1 if the MTL file doesn't have it
+	int FindMaterial(const std::string& name) const;
+
+	// Copies the stream's spill files to the GPU, at most uploadBytes mapped at a time
+	bool UploadStream(const ObjStream& stream, size_t uploadBytes);
+
+	void DrawBatches(Shader* shader);
 };
 
 SimpleModel::SimpleModel(const std::string& objfilepath, const std::vector<std::string>&& texturePaths)
 {
-	LoadModel(vao, vbo, nr_indices, objfilepath);
+	LoadModel(geometry, nr_indices, indexType, batches, objfilepath);
 	setTextures(texturePaths);
 }
 
+SimpleModel::SimpleModel(SimpleModel&& other) noexcept
+	: geometry(other.geometry), textures(std::move(other.textures)), nr_indices(other.nr_indices), indexType(other.indexType),
+	  materials(std::move(other.materials)), batches(std::move(other.batches)),
+	  streamArray(std::move(other.streamArray)), streamVertices(std::move(other.streamVertices)), streamIndices(std::move(other.streamIndices))
+{
+	other.geometry = INVALID_GEOMETRY;
+	other.nr_indices = 0;
+}
+
+SimpleModel& SimpleModel::operator=(SimpleModel&& other) noexcept
+{
+	if (this != &other)
+	{
+		std::swap(geometry, other.geometry);
+		std::swap(nr_indices, other.nr_indices);
+		std::swap(indexType, other.indexType);
+		textures = std::move(other.textures);
+		materials = std::move(other.materials);
+		batches = std::move(other.batches);
+		streamArray = std::move(other.streamArray);
+		streamVertices = std::move(other.streamVertices);
+		streamIndices = std::move(other.streamIndices);
+	}
+	return *this;
+}
+
+SimpleModel::~SimpleModel()
+{
+	if (geometry != INVALID_GEOMETRY)
+		GeometryArena::getInstance().free(geometry);
+}
+
 bool SimpleModel::load(const std::string& objfilePath)
 {
-	return LoadModel(vao, vbo, nr_indices, objfilePath);
+	if (geometry != INVALID_GEOMETRY)
+		GeometryArena::getInstance().free(geometry);
+	geometry = INVALID_GEOMETRY;
+	materials.clear();
+	batches.clear();
+	streamArray.free();
+	streamVertices.free();
+	streamIndices.free();
+
+	return LoadModel(geometry, nr_indices, indexType, batches, objfilePath);
+}
+
+bool SimpleModel::loadStreaming(const std::string& objfilePath, const ObjStreamOptions& options)
+{
+	if (geometry != INVALID_GEOMETRY)
+		GeometryArena::getInstance().free(geometry);
+	geometry = INVALID_GEOMETRY;
+	materials.clear();
+	batches.clear();
+	nr_indices = 0;
+
+	ObjStream stream;
+	if (!stream.import(objfilePath, options))
+		return false;
+
+	std::string directory = objfilePath.substr(0, objfilePath.find_last_of("/\\") + 1);
+	if (!stream.getMaterialLibrary().empty())
+		LoadMaterials(directory, stream.getMaterialLibrary());
+
+	std::vector<int> materialOfName(stream.getMaterials().size());
+	for (size_t name = 0; name < materialOfName.size(); name++)
+		materialOfName[name] = FindMaterial(stream.getMaterials()[name]);
+
+	// Every piece is cut where the material changes, runs are in index order like the pieces
+	const std::vector<ObjMaterialRun>& runs = stream.getMaterialRuns();
+	size_t run = 0;
+	for (const ObjStreamPiece& piece : stream.getPieces())
+	{
+		size_t pieceEnd = piece.firstIndex + piece.indexCount;
+		for (size_t first = piece.firstIndex; first < pieceEnd;)
+		{
+			while (run < runs.size() && runs[run].firstCorner <= first)
+				run++;
+
+			// run is now the first run starting after first, the one before it is the current material
+			int material = run > 0 ? materialOfName[runs[run - 1].material] : -1;
+			size_t end = run < runs.size() ? std::min(pieceEnd, runs[run].firstCorner) : pieceEnd;
+
+			if (!batches.empty() && batches.back().material == material && batches.back().baseVertex == GLint(piece.baseVertex) &&
+				batches.back().firstIndex + batches.back().indexCount == first)
+				batches.back().indexCount += static_cast<unsigned int>(end - first);
+			else
+				batches.push_back({ first, static_cast<unsigned int>(end - first), material, GLint(piece.baseVertex) });
+
+			first = end;
+		}
+	}
+
+	indexType = GL_UNSIGNED_INT;
+	nr_indices = static_cast<int>(std::min<size_t>(stream.getIndexCount(), INT_MAX));
+
+	return UploadStream(stream, options.uploadBytes);
 }
 
 void SimpleModel::setTextures(const std::vector<std::string>& texturePaths)
@@ -69,15 +224,12 @@ void SimpleModel::setTextures(const std::vector<std::string>& texturePaths)
 	{
 		Texture2D texture;
 		texture.loadTexture(texturePath.c_str());
-		textures.push_back(texture);
+		textures.push_back(std::move(texture));
 	}
 
 	// Bind textures
 	for (unsigned int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		textures[i].bindTexture();
-	}
+		textures[i].bindTexture(i, GetSampler(textures[i]));
 }
 
 void SimpleModel::setTextures(const std::vector<std::string>&& texturePaths)
@@ -86,225 +238,311 @@ void SimpleModel::setTextures(const std::vector<std::string>&& texturePaths)
 	{
 		Texture2D texture;
 		texture.loadTexture(texturePath.c_str());
-		textures.push_back(texture);
+		textures.push_back(std::move(texture));
 	}
 
 	// Bind textures
 	for (unsigned int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		textures[i].bindTexture();
-	}
+		textures[i].bindTexture(i, GetSampler(textures[i]));
 }
 
 void SimpleModel::bindTextures()
 {
 	// Draw the model
-	vao.bind();
+	if (streamArray.getID() != 0)
+		streamArray.bind();
+	else if (geometry != INVALID_GEOMETRY)
+		GeometryArena::getInstance().bind(geometry);
 
 	// Bind textures
 	for (unsigned int i = 0; i < textures.size(); i++)
-	{
-		glActiveTexture(GL_TEXTURE0 + i);
-		textures[i].bindTexture();
-	}
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		textures[i].bindTexture(i, GetSampler(textures[i]));
 }
 
 void SimpleModel::draw()
 {
-	vao.bind();
-	glDrawArrays(GL_TRIANGLES, 0, nr_indices);
+	DrawBatches(nullptr);
 }
 
-SimpleModel::~SimpleModel()
+void SimpleModel::draw(Shader& shader)
 {
-	vbo.free();
-	vao.free();
+	DrawBatches(&shader);
 }
 
-// Utility function to load models (written earlier so I'm lazy to properly integrate it in load() function :/
-// TODO: Add texture functonality
-bool SimpleModel::LoadModel(VertexArray& vao, VertexBuffer<float>& vbo, int& vertexCount, const std::string& modelFile)
+void SimpleModel::DrawBatches(Shader* shader)
 {
-	std::vector<glm::vec3> temp_positions;
-	std::vector<glm::vec3> temp_normals;
-	std::vector<glm::vec2> temp_textures;
-
-	std::ifstream inputFileStream(modelFile);
-	std::string line;
-	std::stringstream ss;
+	GeometryRange range = { 0, 0 };
+	if (streamArray.getID() != 0)
+		streamArray.bind();
+	else if (geometry != INVALID_GEOMETRY)
+		range = GeometryArena::getInstance().bind(geometry);
+	else
+		return;		// Not loaded, or the load failed
 
-	if (!inputFileStream.is_open())
+	// Missing maps and faces without a material unbind their units, so nothing carries over from the batch before
+	auto bindMap = [](unsigned int unit, const Texture2D* map)
 	{
-		std::cerr << "Failed to open object file: " << modelFile << std::endl;
-		return false;
-	}
-
-	/** If the object file has "mtllib" on the third line, then the object file is
-	  * associated with some MTL file which we need to parse along with OBJ file */
-
-	// Go to the third line
-	std::string lineParser;
-	
-	// Read 3 lines
-	for (int i = 0; i < 3; i++)
-		std::getline(inputFileStream, lineParser);
+		if (map && map->getTextureID() != 0)
+			map->bindTexture(unit, GetSampler(*map));
+		else
+			TextureBindings::getInstance().bind(unit, GL_TEXTURE_2D, 0, 0);
+	};
 
-	// Read the third line and see if it has mtllib
-	//std::getline(inputFileStream, lineParser);
-	
-	if (lineParser.find("mtllib") != std::string::npos)
+	for (const SimpleModelBatch& batch : batches)
 	{
-		struct VertexTexture
+		if (!materials.empty())
 		{
-			glm::vec3 position;
-			glm::vec3 normal;
-			glm::vec2 textures;
-		};
-		std::vector<VertexTexture> verticesTexture;
+			const SimpleMaterial* material = batch.material >= 0 ? &materials[batch.material] : nullptr;
 
-		while (std::getline(inputFileStream, line))
-		{
-			// Vertex normals
-			if (line.starts_with("vn"))
+			// Textures given to setTextures() win over the material's
+			if (textures.empty())
 			{
-				float f1, f2, f3;
-				sscanf_s(line.c_str(), "%*s %f %f %f", &f1, &f2, &f3);
-				temp_normals.push_back({f1, f2, f3});
+				bindMap(0, material ? &material->diffuseMap : nullptr);
+				bindMap(1, material ? &material->specularMap : nullptr);
+				bindMap(2, material ? &material->normalMap : nullptr);
 			}
 
-			// Texture coordinates
-			else if (line.starts_with("vt"))
-			{
-				float f1, f2;
-				sscanf_s(line.c_str(), "%*s %f %f", &f1, &f2);
-				temp_textures.push_back({ f1, f2 });
-			}
+			if (shader)
+				shader->setVec3("vMaterialColor", material ? material->desc.diffuse : ObjMaterial().diffuse);
+		}
 
-			// Vertex coordinates
-			else if (line.starts_with('v'))
-			{
-				float f1, f2, f3;
-				sscanf_s(line.c_str(), "%*s %f %f %f", &f1, &f2, &f3);
-				temp_positions.push_back({ f1, f2, f3 });
-			}
+		glDrawElementsBaseVertex(GL_TRIANGLES, batch.indexCount, indexType, (void*)(range.indexOffset + batch.firstIndex * IndexSize(indexType)), range.baseVertex + batch.baseVertex);
+	}
+}
 
-			// Indices
-			else if (line.starts_with('f'))
-			{
-				int v[3];
-				int n[3];
-				int t[3];
+void SimpleModel::LoadMaterials(const std::string& directory, const std::string& materialLibrary)
+{
+	std::vector<ObjMaterial> descs;
+	if (!ObjParser::parseMaterials(directory + materialLibrary, descs))
+		return;
+
+	materials.resize(descs.size());
+	for (size_t i = 0; i < descs.size(); i++)
+	{
+		SimpleMaterial& material = materials[i];
+		material.desc = std::move(descs[i]);
+
+		if (!material.desc.diffuseMap.empty())
+			material.diffuseMap.loadTexture((directory + material.desc.diffuseMap).c_str());
+		if (!material.desc.specularMap.empty())
+			material.specularMap.loadTexture((directory + material.desc.specularMap).c_str());
+		if (!material.desc.normalMap.empty())
+			material.normalMap.loadTexture((directory + material.desc.normalMap).c_str());
+	}
+}
+
+int SimpleModel::FindMaterial(const std::string& name) const
+{
+	for (size_t m = 0; m < materials.size(); m++)
+	{
+		if (materials[m].desc.name == name)
+			return static_cast<int>(m);
+	}
 
-				sscanf_s(line.c_str(), "%*s %d/%d/%d %d/%d/%d %d/%d/%d", &v[0], &t[0], &n[0], &v[1], &t[1], &n[1], &v[2], &t[2], &n[2]);
+	return -1;
+}
+
+bool SimpleModel::UploadStream(const ObjStream& stream, size_t uploadBytes)
+{
+	streamArray.free();
+	streamVertices.free();
+	streamIndices.free();
 
-				int posIndex;
-				int normIndex;
-				int textIndex;
+	const size_t stride = stream.getVertexStride();
+	streamArray.generate();
+	streamArray.bind();
 
-				for (int i = 0; i < 3; i++)
-				{
-					posIndex = v[i] - 1;
-					normIndex = n[i] - 1;
-					textIndex = t[i] - 1;
+	// The buffers get their full size without data, then are filled one mapped range at a time so only the range
+	// being written needs memory
+	streamVertices.generate(stream.getVertexCount());
+	streamVertices.bind();
+	streamVertices.setBuffer(stream.getVertexCount() * stride, nullptr);
 
-					VertexTexture vertex;
-					vertex.position = temp_positions[posIndex];
-					vertex.normal = temp_normals[normIndex];
-					vertex.textures = temp_textures[textIndex];
+	streamIndices.generate();
+	streamIndices.bind();
+	streamIndices.setBuffer(stream.getIndexCount() * sizeof(uint32_t), nullptr);
 
-					verticesTexture.push_back(vertex);
-				}
+	auto upload = [uploadBytes](GLenum target, size_t count, size_t elementSize, auto read)
+	{
+		const size_t step = std::max<size_t>(1, uploadBytes / elementSize);
+		for (size_t first = 0; first < count; first += step)
+		{
+			size_t n = std::min(step, count - first);
+			void* mapped = glMapBufferRange(target, first * elementSize, n * elementSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			if (!mapped)
+			{
+				std::cerr << "Could not map " << n * elementSize << " bytes of a streamed model's buffer" << std::endl;
+				return false;
 			}
+
+			bool ok = read(first, n, mapped);
+			if (glUnmapBuffer(target) == GL_FALSE || !ok)
+				return false;
 		}
+		return true;
+	};
+
+	bool ok = upload(GL_ARRAY_BUFFER, stream.getVertexCount(), stride, [&stream](size_t first, size_t n, void* out) { return stream.readVertices(first, n, out); }) &&
+		upload(GL_ELEMENT_ARRAY_BUFFER, stream.getIndexCount(), sizeof(uint32_t), [&stream](size_t first, size_t n, void* out) { return stream.readIndices(first, n, out); });
+
+	// Same layout as the arena's: positions, normals and texture coordinates if the file has them
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, GLsizei(stride), (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, GLsizei(stride), (void*)12);
+	glEnableVertexAttribArray(1);
+	if (stream.hasTexCoords())
+	{
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, GLsizei(stride), (void*)24);
+		glEnableVertexAttribArray(2);
+	}
 
-		BufferLayout layout;
+	if (!ok)
+	{
+		std::cerr << "Failed to upload streamed model" << std::endl;
+		streamArray.free();
+		streamVertices.free();
+		streamIndices.free();
+		batches.clear();
+		nr_indices = 0;
+	}
 
-		vao.generate();
-		vbo.generate(8);		// 8 floats per vertex: 3 for vertex positions, 3 for vertex normals and 2 for texture coordinates
+	return ok;
+}
 
-		const void* vertexBuffer = verticesTexture.data();
-		vbo.setBuffer(verticesTexture.size() * 8 * sizeof(float), vertexBuffer);
+unsigned int SimpleModel::GetSampler(const Texture2D& texture)
+{
+	SamplerDesc desc;
+	desc.wrapS = GL_CLAMP_TO_EDGE;
+	desc.wrapT = GL_CLAMP_TO_EDGE;
+	desc.minFilter = texture.getMinFilter();
+	desc.magFilter = texture.getMagFilter();
+	return SamplerCache::getInstance().get(desc);
+}
 
-		layout.setBufferLayout(vao, vbo, 3, BufferType::FLOAT);		// Vertices
-		layout.setBufferLayout(vao, vbo, 3, BufferType::FLOAT);		// Normals
-		layout.setBufferLayout(vao, vbo, 2, BufferType::FLOAT);		// Texture coordinates
+// Utility function to load models (written earlier so I'm lazy to properly integrate it in load() function :/
+// TODO: Add texture functonality
+bool SimpleModel::LoadModel(GeometryHandle& geometry, int& indexCount, GLenum& indexType, std::vector<SimpleModelBatch>& batches, const std::string& modelFile)
+{
+	ObjData obj;
+	if (!ObjParser::parse(modelFile, obj))
+		return false;
 
-		vertexCount = verticesTexture.size();
-	}
+	std::string directory = modelFile.substr(0, modelFile.find_last_of("/\\") + 1);
+	if (!obj.materialLibrary.empty())
+		LoadMaterials(directory, obj.materialLibrary);
 
-	// Else, it is just a regular object file without any textures
-	else
+	// usemtl names to materials, faces without a known material go in the group after the last material
+	const int groupCount = static_cast<int>(materials.size()) + 1;
+	std::vector<int> groupOfName(obj.materials.size(), groupCount - 1);
+	for (size_t name = 0; name < obj.materials.size(); name++)
 	{
-		struct Vertex
+		for (size_t m = 0; m < materials.size(); m++)
 		{
-			glm::vec3 position;
-			glm::vec3 normal;
-		};
-
-		std::vector<Vertex> vertices;
+			if (materials[m].desc.name == obj.materials[name])
+				groupOfName[name] = static_cast<int>(m);
+		}
+	}
 
-		while (std::getline(inputFileStream, line))
-		{
-			if (line.starts_with("vn"))
-			{
-				float f1, f2, f3;
-				sscanf_s(line.c_str(), "%*s %f %f %f", &f1, &f2, &f3);
-				temp_normals.push_back({ f1, f2, f3 });
-			}
+	const size_t triangleCount = obj.corners.size() / 3;
+	std::vector<int> groups(triangleCount, groupCount - 1);
+	for (size_t run = 0; run < obj.materialRuns.size(); run++)
+	{
+		size_t begin = obj.materialRuns[run].firstCorner / 3;
+		size_t end = run + 1 < obj.materialRuns.size() ? obj.materialRuns[run + 1].firstCorner / 3 : triangleCount;
+		std::fill(groups.begin() + begin, groups.begin() + end, groupOfName[obj.materialRuns[run].material]);
+	}
 
-			if (line.starts_with('v'))
-			{
-				float f1, f2, f3;
-				sscanf_s(line.c_str(), "%*s %f %f %f", &f1, &f2, &f3);
-				temp_positions.push_back({ f1, f2, f3 });
-			}
+	// Counting sort of the triangles by group, each group becomes one contiguous range of indices
+	std::vector<size_t> groupStart(groupCount + 1, 0);
+	for (int group : groups)
+		groupStart[group + 1]++;
+	for (int group = 0; group < groupCount; group++)
+		groupStart[group + 1] += groupStart[group];
 
-			else if (line.starts_with('f'))
-			{
-				int v[3];
-				int n[3];
+	batches.clear();
+	for (int group = 0; group < groupCount; group++)
+	{
+		if (groupStart[group + 1] > groupStart[group])
+			batches.push_back({ static_cast<unsigned int>(groupStart[group] * 3), static_cast<unsigned int>((groupStart[group + 1] - groupStart[group]) * 3), group < groupCount - 1 ? group : -1 });
+	}
 
-				sscanf_s(line.c_str(), "%*s %d//%d %d//%d %d//%d", &v[0], &n[0], &v[1], &n[1], &v[2], &n[2]);
+	std::vector<ObjCorner> sortedCorners(obj.corners.size());
+	std::vector<size_t> fill(groupStart.begin(), groupStart.end() - 1);
+	for (size_t triangle = 0; triangle < triangleCount; triangle++)
+	{
+		size_t target = fill[groups[triangle]]++;
+		std::copy(obj.corners.begin() + triangle * 3, obj.corners.begin() + triangle * 3 + 3, sortedCorners.begin() + target * 3);
+	}
 
-				int posIndex;
-				int normIndex;
+	// Corners that share position, texture coordinate and normal become one vertex
+	ObjVertexMap vertexMap(obj.positions.size());
+	std::vector<uint32_t> indices(sortedCorners.size());
+	for (size_t i = 0; i < sortedCorners.size(); i++)
+		indices[i] = vertexMap.insert(sortedCorners[i]);
 
-				for (int i = 0; i < 3; i++)
-				{
-					posIndex = v[i] - 1;
-					normIndex = n[i] - 1;
+	const std::vector<ObjCorner>& corners = vertexMap.getVertices();
+	indexCount = static_cast<int>(indices.size());
+	indexType = IndexTypeFor(corners.size());
 
-					Vertex vertex;
-					vertex.position = temp_positions[posIndex];
-					vertex.normal = temp_normals[normIndex];
+	std::vector<uint16_t> shortIndices;
+	const void* indexData = indices.data();
+	if (indexType == GL_UNSIGNED_SHORT)
+	{
+		shortIndices.assign(indices.begin(), indices.end());
+		indexData = shortIndices.data();
+	}
+	size_t indexBytes = indices.size() * IndexSize(indexType);
 
-					vertices.push_back(vertex);
-				}
-			}
-		}
+	// Corners that leave out a texture coordinate or normal get zeros
+	auto position = [&obj](const ObjCorner& corner) { return obj.positions[corner.position]; };
+	auto normal = [&obj](const ObjCorner& corner) { return corner.normal >= 0 ? obj.normals[corner.normal] : glm::vec3(0.0f); };
+	auto texCoord = [&obj](const ObjCorner& corner) { return corner.texCoord >= 0 ? obj.texCoords[corner.texCoord] : glm::vec2(0.0f); };
 
-		BufferLayout layout;
+	// Object files with texture coordinates get them as a third attribute
+	if (!obj.texCoords.empty())
+	{
+		struct VertexTexture
+		{
+			glm::vec3 position;
+			glm::vec3 normal;
+			glm::vec2 textures;
+		};
 
-		vao.generate();
-		vbo.generate(6);		// 6 floats per vertex: 3 for vertex positions and another 3 for normal vector
+		std::vector<VertexTexture> verticesTexture(corners.size());
+		for (size_t i = 0; i < corners.size(); i++)
+			verticesTexture[i] = { position(corners[i]), normal(corners[i]), texCoord(corners[i]) };
 
-		const void* vertexBuffer = vertices.data();
-		vbo.setBuffer(vertices.size() * 6 * sizeof(float), vertexBuffer);
+		// 8 floats per vertex: 3 for vertex positions, 3 for vertex normals and 2 for texture coordinates
+		static const std::vector<VertexAttribute> attributes = {
+			{ 0, 3, GL_FLOAT, GL_FALSE, false, 0 },		// Vertices
+			{ 1, 3, GL_FLOAT, GL_FALSE, false, 12 },	// Normals
+			{ 2, 2, GL_FLOAT, GL_FALSE, false, 24 }		// Texture coordinates
+		};
 
-		layout.setBufferLayout(vao, vbo, 3, BufferType::FLOAT);	// positions
-		layout.setBufferLayout(vao, vbo, 3, BufferType::FLOAT);	// normals
-		vertexCount = vertices.size();
+		geometry = GeometryArena::getInstance().allocate(attributes, sizeof(VertexTexture), verticesTexture.data(), verticesTexture.size(), indexData, indexBytes);
 	}
 
-	inputFileStream.close();
+	// Else, it is just a regular object file without any textures
+	else
+	{
+		struct Vertex
+		{
+			glm::vec3 position;
+			glm::vec3 normal;
+		};
 
-	//std::cout << "Finished loading!\n";
-	//std::cout << "Number of vertices: " << vertexCount << "\n";
-	//std::cout << "Size (bytes): " << vertexCount * sizeof(Vertex) << " bytes (" << std::fixed << std::setprecision(2) << (float)(vertexCount * sizeof(Vertex) / (1024.0f * 1024.0f)) << " MB)\n\n";
+		std::vector<Vertex> vertices(corners.size());
+		for (size_t i = 0; i < corners.size(); i++)
+			vertices[i] = { position(corners[i]), normal(corners[i]) };
+
+		// 6 floats per vertex: 3 for vertex positions and another 3 for normal vector
+		static const std::vector<VertexAttribute> attributes = {
+			{ 0, 3, GL_FLOAT, GL_FALSE, false, 0 },		// positions
+			{ 1, 3, GL_FLOAT, GL_FALSE, false, 12 }		// normals
+		};
+
+		geometry = GeometryArena::getInstance().allocate(attributes, sizeof(Vertex), vertices.data(), vertices.size(), indexData, indexBytes);
+	}
 
 	return true;
-}
\ No newline at end of file
+}
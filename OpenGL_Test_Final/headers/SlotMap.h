@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// Refers to an element of a SlotMap. The generation changes every time a slot is reused, so a handle to an erased
+// element never finds its successor. A default constructed handle is never valid.
+struct SlotHandle
+{
+	uint32_t index = 0;
+	uint32_t generation = 0;
+
+	bool operator==(const SlotHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const SlotHandle& other) const { return !(*this == other); }
+};
+
+// Generational slot map storing its elements as dense arrays, one per column (structure of arrays). Insert and erase
+// are O(1): erasing moves the last element into the hole, so the columns never have gaps and iterate linearly, and
+// only the slot the handle points at learns about the move. Handles stay valid until their element is erased,
+// wherever the element moves in the columns. Stale handles are rejected by the generation check.
+template<typename... Columns>
+class SlotMap
+{
+private:
+	static constexpr uint32_t NO_SLOT = ~0u;
+
+	struct Slot
+	{
+		uint32_t dense;			// Position in the columns while live, next free slot while free
+		uint32_t generation;	// Odd while live, even while free
+	};
+
+	std::tuple<std::vector<Columns>...> m_Columns;
+	std::vector<uint32_t> m_DenseToSlot;
+	std::vector<Slot> m_Slots;
+	uint32_t m_FreeSlot = NO_SLOT;
+
+public:
+	SlotHandle insert(Columns... values);
+
+	// Returns false if the handle is stale
+	bool erase(SlotHandle handle);
+
+	bool contains(SlotHandle handle) const;
+
+	// Column I of the element, nullptr if the handle is stale. Only valid until the next insert or erase.
+	template<size_t I>
+	auto* get(SlotHandle handle);
+
+	// The dense column, element i of every column belongs to the same element
+	template<size_t I>
+	auto& column() { return std::get<I>(m_Columns); }
+
+	template<size_t I>
+	const auto& column() const { return std::get<I>(m_Columns); }
+
+	// Handle of the element at position dense in the columns
+	SlotHandle getHandle(size_t dense) const;
+
+	// Position in the columns of the element in slot index (the index of its handle), which has to be live
+	size_t getDense(uint32_t index) const { return m_Slots[index].dense; }
+
+	size_t size() const { return m_DenseToSlot.size(); }
+	bool empty() const { return m_DenseToSlot.empty(); }
+
+	void reserve(size_t count);
+
+	// Erases everything, every handle handed out so far becomes stale
+	void clear();
+
+private:
+	// Position in the columns, NO_SLOT if the handle is stale
+	uint32_t Find(SlotHandle handle) const;
+};
+
+template<typename... Columns>
+SlotHandle SlotMap<Columns...>::insert(Columns... values)
+{
+	uint32_t index;
+	if (m_FreeSlot != NO_SLOT)
+	{
+		index = m_FreeSlot;
+		m_FreeSlot = m_Slots[index].dense;
+	}
+	else
+	{
+		index = static_cast<uint32_t>(m_Slots.size());
+		m_Slots.push_back({ 0, 0 });
+	}
+
+	Slot& slot = m_Slots[index];
+	slot.dense = static_cast<uint32_t>(m_DenseToSlot.size());
+	slot.generation++;
+
+	m_DenseToSlot.push_back(index);
+	std::apply([&](auto&... columns) { (columns.push_back(std::move(values)), ...); }, m_Columns);
+
+	return { index, slot.generation };
+}
+
+template<typename... Columns>
+bool SlotMap<Columns...>::erase(SlotHandle handle)
+{
+	uint32_t dense = Find(handle);
+	if (dense == NO_SLOT)
+		return false;
+
+	// The last element fills the hole
+	uint32_t last = static_cast<uint32_t>(m_DenseToSlot.size() - 1);
+	if (dense != last)
+	{
+		std::apply([&](auto&... columns) { ((columns[dense] = std::move(columns[last])), ...); }, m_Columns);
+		m_DenseToSlot[dense] = m_DenseToSlot[last];
+		m_Slots[m_DenseToSlot[dense]].dense = dense;
+	}
+
+	std::apply([](auto&... columns) { (columns.pop_back(), ...); }, m_Columns);
+	m_DenseToSlot.pop_back();
+
+	Slot& slot = m_Slots[handle.index];
+	slot.generation++;
+	slot.dense = m_FreeSlot;
+	m_FreeSlot = handle.index;
+	return true;
+}
+
+template<typename... Columns>
+bool SlotMap<Columns...>::contains(SlotHandle handle) const
+{
+	return Find(handle) != NO_SLOT;
+}
+
+template<typename... Columns>
+template<size_t I>
+auto* SlotMap<Columns...>::get(SlotHandle handle)
+{
+	uint32_t dense = Find(handle);
+	return dense == NO_SLOT ? nullptr : &std::get<I>(m_Columns)[dense];
+}
+
+template<typename... Columns>
+SlotHandle SlotMap<Columns...>::getHandle(size_t dense) const
+{
+	uint32_t index = m_DenseToSlot[dense];
+	return { index, m_Slots[index].generation };
+}
+
+template<typename... Columns>
+void SlotMap<Columns...>::reserve(size_t count)
+{
+	std::apply([count](auto&... columns) { (columns.reserve(count), ...); }, m_Columns);
+	m_DenseToSlot.reserve(count);
+	m_Slots.reserve(count);
+}
+
+template<typename... Columns>
+void SlotMap<Columns...>::clear()
+{
+	// Erasing from the back never moves anything
+	while (!m_DenseToSlot.empty())
+		erase(getHandle(m_DenseToSlot.size() - 1));
+}
+
+template<typename... Columns>
+uint32_t SlotMap<Columns...>::Find(SlotHandle handle) const
+{
+	// Live slots have odd generations, so the default handle with generation 0 never matches
+	if (handle.index >= m_Slots.size() || m_Slots[handle.index].generation != handle.generation || (handle.generation & 1) == 0)
+		return NO_SLOT;
+
+	return m_Slots[handle.index].dense;
+}
@@ -3,52 +3,118 @@
 #include <glad/glad.h>
 
 #include "stb_image_impl.h"
+#include "TextureResidency.h"
+#include "TextureBindings.h"
+#include "DSA.h"
 
 #include <iostream>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Creates a 2D texture with a full mip chain from decoded pixels and registers it with the residency manager.
+// Textures without a reloadable source get immutable storage with DSA and are never bound, the others are bound to be
+// edited so the residency manager can re-specify them later.
+unsigned int CreateTexture2D(const unsigned char* data, int width, int height, int components, const TextureSource& source, GLint wrapType, GLint minFilter, GLint magFilter);
+
+// Deletes a texture and drops it from the residency manager and the binding cache
+void DeleteTexture2D(unsigned int textureID);
 
 class Texture2D
 {
 private:
-	unsigned int m_TextureID;
-	int m_width, m_height;
-	unsigned char* data;
-	int m_nrChannels;
+	unsigned int m_TextureID = 0;
+	int m_width = 0, m_height = 0;
+	unsigned char* data = nullptr;
+	int m_nrChannels = 0;
+
+	// Filters the texture was loaded with, for sampler objects that replace its own parameters
+	GLint m_MinFilter = GL_LINEAR_MIPMAP_LINEAR;
+	GLint m_MagFilter = GL_LINEAR;
 
 public:
 	Texture2D() = default;
 
+	// Owns the GL texture, so it can be moved but not copied
+	Texture2D(const Texture2D&) = delete;
+	Texture2D& operator=(const Texture2D&) = delete;
+
+	Texture2D(Texture2D&& other) noexcept;
+	Texture2D& operator=(Texture2D&& other) noexcept;
+
+	~Texture2D();
+
 	void load(GLenum wrapType, GLint minFilter, GLint magFilter, const std::string textureFile, GLint internalFormat, GLenum format);
 
 	unsigned int getTextureID() const;
 
+	GLint getMinFilter() const { return m_MinFilter; }
+	GLint getMagFilter() const { return m_MagFilter; }
+
+	// Binds to the active unit, sampling with the texture's own parameters
 	void bindTexture() const;
 
+	// Binds to the given unit, sampling with a shared sampler object (0 for the texture's own parameters)
+	void bindTexture(unsigned int unit, unsigned int sampler) const;
+
 	void loadTexture(char const* path);
+
+	void free();
 };
 
-void Texture2D::load(GLenum wrapType, GLint minFilter, GLint magFilter, const std::string textureFile, GLint internalFormat, GLenum format)
+Texture2D::Texture2D(Texture2D&& other) noexcept
+	: m_TextureID(other.m_TextureID), m_width(other.m_width), m_height(other.m_height), data(nullptr), m_nrChannels(other.m_nrChannels),
+	  m_MinFilter(other.m_MinFilter), m_MagFilter(other.m_MagFilter)
+{
+	other.m_TextureID = 0;
+}
+
+Texture2D& Texture2D::operator=(Texture2D&& other) noexcept
 {
-	glGenTextures(1, &m_TextureID);
-	glBindTexture(GL_TEXTURE_2D, m_TextureID);
+	if (this != &other)
+	{
+		free();
+		std::swap(m_TextureID, other.m_TextureID);
+		m_width = other.m_width;
+		m_height = other.m_height;
+		m_nrChannels = other.m_nrChannels;
+		m_MinFilter = other.m_MinFilter;
+		m_MagFilter = other.m_MagFilter;
+	}
+	return *this;
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapType);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapType);
+Texture2D::~Texture2D()
+{
+	free();
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+void Texture2D::free()
+{
+	if (m_TextureID != 0)
+		DeleteTexture2D(m_TextureID);
 
-	stbi_set_flip_vertically_on_load(true);
+	m_TextureID = 0;
+}
+
+void Texture2D::load(GLenum wrapType, GLint minFilter, GLint magFilter, const std::string textureFile, GLint internalFormat, GLenum format)
+{
+	m_MinFilter = minFilter;
+	m_MagFilter = magFilter;
+
+	SetFlipVerticallyOnLoad(true);
 	data = stbi_load(textureFile.c_str(), &m_width, &m_height, &m_nrChannels, 0);
 
 	if (data)
 	{
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, m_width, m_height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		m_TextureID = CreateTexture2D(data, m_width, m_height, m_nrChannels, { textureFile, true, internalFormat, format }, wrapType, minFilter, magFilter);
 	}
 
 	else
 	{
 		std::cout << "Failed to load texture: " << textureFile << std::endl;
+		glGenTextures(1, &m_TextureID);
 	}
 
 	stbi_image_free(data);
@@ -61,14 +127,22 @@ unsigned int Texture2D::getTextureID() const
 
 void Texture2D::bindTexture() const
 {
-	glBindTexture(GL_TEXTURE_2D, m_TextureID);
+	TextureBindings& bindings = TextureBindings::getInstance();
+
+	TextureResidency::getInstance().touch(m_TextureID);
+	bindings.bind(bindings.getActiveUnit(), GL_TEXTURE_2D, m_TextureID, 0);
+}
+
+void Texture2D::bindTexture(unsigned int unit, unsigned int sampler) const
+{
+	TextureResidency::getInstance().touch(m_TextureID);
+	TextureBindings::getInstance().bind(unit, GL_TEXTURE_2D, m_TextureID, sampler);
 }
 
 void Texture2D::loadTexture(char const* path)
 {
-	glGenTextures(1, &m_TextureID);
-
 	int width, height, nrComponents;
+	bool flipped = GetFlipVerticallyOnLoad();
 	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
 	if (data)
 	{
@@ -82,14 +156,10 @@ void Texture2D::loadTexture(char const* path)
 		else
 			exit(-1);
 
-		glBindTexture(GL_TEXTURE_2D, m_TextureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		GLint wrap = format == GL_RGBA ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+		m_MinFilter = GL_LINEAR_MIPMAP_LINEAR;
+		m_MagFilter = GL_LINEAR;
+		m_TextureID = CreateTexture2D(data, width, height, nrComponents, { path, flipped, (GLint)format, format }, wrap, m_MinFilter, m_MagFilter);
 
 		stbi_image_free(data);
 	}
@@ -97,5 +167,55 @@ void Texture2D::loadTexture(char const* path)
 	{
 		std::cout << "Texture failed to load at path: " << path << std::endl;
 		stbi_image_free(data);
+		glGenTextures(1, &m_TextureID);
+	}
+}
+
+unsigned int CreateTexture2D(const unsigned char* data, int width, int height, int components, const TextureSource& source, GLint wrapType, GLint minFilter, GLint magFilter)
+{
+	unsigned int textureID;
+	TextureResidency& residency = TextureResidency::getInstance();
+
+	// The residency manager re-specifies the textures it downgrades, which immutable storage does not allow. Only
+	// textures it never evicts get it, so a budget set after loading still applies to everything else.
+	bool immutable = DSA::isAvailable() && !source.reloadable;
+
+	if (immutable)
+	{
+		GLsizei levels = 1 + static_cast<GLsizei>(std::log2(std::max(width, height)));
+
+		DSA::CreateTextures(GL_TEXTURE_2D, 1, &textureID);
+
+		DSA::TextureParameteri(textureID, GL_TEXTURE_WRAP_S, wrapType);
+		DSA::TextureParameteri(textureID, GL_TEXTURE_WRAP_T, wrapType);
+		DSA::TextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, minFilter);
+		DSA::TextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, magFilter);
+
+		DSA::TextureStorage2D(textureID, levels, DSA::sizedInternalFormat(source.internalFormat), width, height);
+		DSA::TextureSubImage2D(textureID, 0, 0, 0, width, height, source.format, GL_UNSIGNED_BYTE, data);
+		DSA::GenerateTextureMipmap(textureID);
 	}
+	else
+	{
+		glGenTextures(1, &textureID);
+		TextureBindings::getInstance().bindTexture(GL_TEXTURE_2D, textureID);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapType);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapType);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+
+		glTexImage2D(GL_TEXTURE_2D, 0, source.internalFormat, width, height, 0, source.format, GL_UNSIGNED_BYTE, data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	residency.registerTexture(textureID, width, height, components, source, immutable);
+	return textureID;
+}
+
+void DeleteTexture2D(unsigned int textureID)
+{
+	TextureResidency::getInstance().unregisterTexture(textureID);
+	TextureBindings::getInstance().forget(textureID);
+	glDeleteTextures(1, &textureID);
 }
\ No newline at end of file
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "Sampler.h"
+
+#include <cstdint>
+
+struct TextureBindingStats
+{
+	uint64_t activeTextureCalls = 0;
+	uint64_t activeTextureElided = 0;
+	uint64_t bindTextureCalls = 0;
+	uint64_t bindTextureElided = 0;
+	uint64_t bindSamplerCalls = 0;
+	uint64_t bindSamplerElided = 0;
+};
+
+// Remembers what is bound to every texture unit and skips glActiveTexture, glBindTexture and
+// glBindSampler calls that would not change anything. Every texture bind in the code base has to
+// go through here, otherwise the cache goes stale; call invalidate() after foreign GL code.
+// Texture units above MAX_UNITS are not supported.
+class TextureBindings
+{
+public:
+	static constexpr unsigned int MAX_UNITS = 32;
+
+private:
+	struct Unit
+	{
+		unsigned int texture2D = 0;
+		unsigned int textureCube = 0;
+		unsigned int sampler = 0;
+	};
+
+	Unit m_Units[MAX_UNITS];
+	unsigned int m_ActiveUnit = 0;
+	TextureBindingStats m_Stats;
+
+	// This is a singleton class
+	TextureBindings() {}
+
+public:
+	TextureBindings(TextureBindings const&) = delete;
+	void operator=(TextureBindings const&) = delete;
+
+	static TextureBindings& getInstance();
+
+	// Binds texture and sampler to a unit, only switching the active unit if the texture actually changes
+	void bind(unsigned int unit, GLenum target, unsigned int texture, unsigned int sampler);
+
+	// Binds a texture to the currently active unit, used when creating or editing textures
+	void bindTexture(GLenum target, unsigned int texture);
+
+	void bindSampler(unsigned int unit, unsigned int sampler);
+
+	void setActiveUnit(unsigned int unit);
+
+	unsigned int getActiveUnit() const { return m_ActiveUnit; }
+
+	unsigned int getBoundTexture(unsigned int unit, GLenum target) const;
+
+	// Drops a deleted texture from the cache, GL unbinds deleted textures on its own
+	void forget(unsigned int texture);
+
+	// Re-syncs the cache with GL, for use after GL calls that bypassed it
+	void invalidate();
+
+	const TextureBindingStats& getStats() const { return m_Stats; }
+
+	void resetStats() { m_Stats = TextureBindingStats(); }
+
+private:
+	unsigned int& Slot(unsigned int unit, GLenum target);
+};
+
+// Binding state belongs to a GL context and every context lives on its own thread, so each thread gets its own cache
+inline TextureBindings& TextureBindings::getInstance()
+{
+	static thread_local TextureBindings bindings;
+	return bindings;
+}
+
+void TextureBindings::bind(unsigned int unit, GLenum target, unsigned int texture, unsigned int sampler)
+{
+	unsigned int& slot = Slot(unit, target);
+
+	if (slot != texture)
+	{
+		setActiveUnit(unit);
+		glBindTexture(target, texture);
+		slot = texture;
+		m_Stats.bindTextureCalls++;
+	}
+	else
+	{
+		m_Stats.bindTextureElided++;
+	}
+
+	bindSampler(unit, sampler);
+}
+
+void TextureBindings::bindTexture(GLenum target, unsigned int texture)
+{
+	unsigned int& slot = Slot(m_ActiveUnit, target);
+
+	if (slot == texture)
+	{
+		m_Stats.bindTextureElided++;
+		return;
+	}
+
+	glBindTexture(target, texture);
+	slot = texture;
+	m_Stats.bindTextureCalls++;
+}
+
+void TextureBindings::bindSampler(unsigned int unit, unsigned int sampler)
+{
+	if (m_Units[unit].sampler == sampler)
+	{
+		m_Stats.bindSamplerElided++;
+		return;
+	}
+
+	glBindSampler(unit, sampler);
+	m_Units[unit].sampler = sampler;
+	m_Stats.bindSamplerCalls++;
+}
+
+void TextureBindings::setActiveUnit(unsigned int unit)
+{
+	if (m_ActiveUnit == unit)
+	{
+		m_Stats.activeTextureElided++;
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + unit);
+	m_ActiveUnit = unit;
+	m_Stats.activeTextureCalls++;
+}
+
+unsigned int TextureBindings::getBoundTexture(unsigned int unit, GLenum target) const
+{
+	return target == GL_TEXTURE_CUBE_MAP ? m_Units[unit].textureCube : m_Units[unit].texture2D;
+}
+
+void TextureBindings::forget(unsigned int texture)
+{
+	for (Unit& unit : m_Units)
+	{
+		if (unit.texture2D == texture)
+			unit.texture2D = 0;
+		if (unit.textureCube == texture)
+			unit.textureCube = 0;
+	}
+}
+
+// Reads the real bindings back from GL. This stalls, so only use it after code that bypassed the cache.
+void TextureBindings::invalidate()
+{
+	GLint value = 0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &value);
+	unsigned int activeUnit = value - GL_TEXTURE0;
+
+	for (unsigned int i = 0; i < MAX_UNITS; i++)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+
+		glGetIntegerv(GL_TEXTURE_BINDING_2D, &value);
+		m_Units[i].texture2D = value;
+		glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &value);
+		m_Units[i].textureCube = value;
+		glGetIntegerv(GL_SAMPLER_BINDING, &value);
+		m_Units[i].sampler = value;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + activeUnit);
+	m_ActiveUnit = activeUnit;
+}
+
+unsigned int& TextureBindings::Slot(unsigned int unit, GLenum target)
+{
+	return target == GL_TEXTURE_CUBE_MAP ? m_Units[unit].textureCube : m_Units[unit].texture2D;
+}
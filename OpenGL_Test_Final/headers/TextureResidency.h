@@ -0,0 +1,353 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "stb_image_impl.h"
+#include "TextureBindings.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Everything needed to re-create a texture from disk after it has been evicted
+struct TextureSource
+{
+	std::string path;
+	bool flipVertically = false;
+	GLint internalFormat = GL_RGBA;
+	GLenum format = GL_RGBA;
+	bool reloadable = true;		// False when path is not a file that can be decoded again, those are never evicted
+};
+
+struct TextureResidencyStats
+{
+	size_t residentBytes = 0;
+	size_t budgetBytes = 0;
+	size_t pinnedBytes = 0;			// Part of residentBytes the budget can not free, see registerTexture()
+	unsigned int textureCount = 0;
+	unsigned int evictedCount = 0;
+	uint64_t downgrades = 0;
+	uint64_t evictions = 0;
+	uint64_t reloads = 0;
+};
+
+// Keeps track of how much video memory the loaded 2D textures take and, once a budget is set,
+// frees the least recently used ones. Textures keep their GL name the whole time, so the ids
+// stored in Texture2D and Texture stay valid; an evicted texture is reloaded when it is bound again.
+class TextureResidency
+{
+private:
+	struct TextureRecord
+	{
+		TextureSource source;
+		int width = 0;
+		int height = 0;
+		int components = 0;
+		int droppedLevels = 0;		// Number of top mip levels currently not resident
+		bool evicted = false;
+		bool immutable = false;
+		size_t bytes = 0;			// Bytes currently resident (whole mip chain)
+		uint64_t lastUsedFrame = 0;
+	};
+
+	std::unordered_map<unsigned int, TextureRecord> m_Textures;
+
+	// Textures get registered from the loader thread too, everything else happens on the render thread
+	std::mutex m_Mutex;
+	TextureResidencyStats m_Stats;
+	uint64_t m_Frame = 0;
+
+	// Textures are never downgraded below this size on their smaller side
+	int m_MinDowngradeSize = 64;
+
+	// This is a singleton class
+	TextureResidency() {}
+
+public:
+	TextureResidency(TextureResidency const&) = delete;
+	void operator=(TextureResidency const&) = delete;
+
+	static TextureResidency& getInstance();
+
+	// A budget of 0 (default) disables eviction, textures are only tracked. It can be set at any time.
+	void setBudget(size_t bytes);
+
+	bool hasBudget() const { return m_Stats.budgetBytes != 0; }
+
+	// Immutable textures (DSA storage) and textures without a reloadable source are tracked but never downgraded or evicted
+	void registerTexture(unsigned int id, int width, int height, int components, const TextureSource& source, bool immutable = false);
+
+	void unregisterTexture(unsigned int id);
+
+	// Stamps the texture with the current frame, reloads it first if it is not fully resident.
+	// Call before binding the texture.
+	void touch(unsigned int id);
+
+	// Advances the frame counter and enforces the budget. Call once at the start of every frame.
+	void beginFrame();
+
+	TextureResidencyStats getStats() { std::lock_guard<std::mutex> lock(m_Mutex); return m_Stats; }
+
+	uint64_t getFrame() const { return m_Frame; }
+
+private:
+	void RemoveRecord(unsigned int id);
+
+	void EnforceBudget();
+
+	void Downgrade(unsigned int id, TextureRecord& record);
+
+	void Evict(unsigned int id, TextureRecord& record);
+
+	void Restore(unsigned int id, TextureRecord& record);
+
+	static size_t CalculateBytes(int width, int height, int components);
+};
+
+inline TextureResidency& TextureResidency::getInstance()
+{
+	static TextureResidency residency;
+	return residency;
+}
+
+void TextureResidency::setBudget(size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Stats.budgetBytes = bytes;
+
+	if (bytes != 0 && m_Stats.pinnedBytes > bytes)
+		std::cout << "WARNING::TEXTURE_RESIDENCY:: " << m_Stats.pinnedBytes << " bytes of textures can not be evicted, more than the budget of " << bytes << std::endl;
+
+	EnforceBudget();
+}
+
+void TextureResidency::registerTexture(unsigned int id, int width, int height, int components, const TextureSource& source, bool immutable)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	RemoveRecord(id);
+
+	TextureRecord record;
+	record.source = source;
+	record.width = width;
+	record.height = height;
+	record.components = components;
+	record.immutable = immutable;
+	record.bytes = CalculateBytes(width, height, components);
+	record.lastUsedFrame = m_Frame;
+
+	m_Stats.residentBytes += record.bytes;
+	if (immutable || !source.reloadable)
+		m_Stats.pinnedBytes += record.bytes;
+	m_Stats.textureCount++;
+
+	m_Textures.insert(std::make_pair(id, record));
+}
+
+void TextureResidency::unregisterTexture(unsigned int id)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	RemoveRecord(id);
+}
+
+void TextureResidency::RemoveRecord(unsigned int id)
+{
+	auto it = m_Textures.find(id);
+	if (it == m_Textures.end())
+		return;
+
+	m_Stats.residentBytes -= it->second.bytes;
+	if (it->second.immutable || !it->second.source.reloadable)
+		m_Stats.pinnedBytes -= it->second.bytes;
+	m_Stats.textureCount--;
+	if (it->second.evicted)
+		m_Stats.evictedCount--;
+
+	m_Textures.erase(it);
+}
+
+void TextureResidency::touch(unsigned int id)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto it = m_Textures.find(id);
+	if (it == m_Textures.end())
+		return;
+
+	TextureRecord& record = it->second;
+	record.lastUsedFrame = m_Frame;
+
+	if (record.evicted || record.droppedLevels > 0)
+	{
+		// Restoring binds the texture to the active unit, which may not be the unit it is about to be bound to
+		TextureBindings& bindings = TextureBindings::getInstance();
+		unsigned int previousTexture = bindings.getBoundTexture(bindings.getActiveUnit(), GL_TEXTURE_2D);
+
+		Restore(id, record);
+
+		bindings.bindTexture(GL_TEXTURE_2D, previousTexture);
+	}
+}
+
+void TextureResidency::beginFrame()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	m_Frame++;
+	EnforceBudget();
+}
+
+// Frees memory starting from the least recently used texture: first it loses its top mip levels
+// one at a time, and once it is as small as allowed it gets evicted completely.
+// Textures used in the last frame are left alone so that they do not bounce in and out every frame.
+void TextureResidency::EnforceBudget()
+{
+	if (m_Stats.budgetBytes == 0 || m_Stats.residentBytes <= m_Stats.budgetBytes)
+		return;
+
+	std::vector<std::pair<uint64_t, unsigned int>> candidates;
+	for (const auto& [id, record] : m_Textures)
+	{
+		if (!record.evicted && !record.immutable && record.source.reloadable && record.lastUsedFrame + 1 < m_Frame)
+			candidates.push_back(std::make_pair(record.lastUsedFrame, id));
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	// Eviction binds textures to the active unit, so restore whatever was bound there afterwards
+	TextureBindings& bindings = TextureBindings::getInstance();
+	unsigned int previousTexture = bindings.getBoundTexture(bindings.getActiveUnit(), GL_TEXTURE_2D);
+
+	for (const auto& [lastUsedFrame, id] : candidates)
+	{
+		TextureRecord& record = m_Textures[id];
+
+		while (!record.evicted && m_Stats.residentBytes > m_Stats.budgetBytes)
+		{
+			int width = record.width >> (record.droppedLevels + 1);
+			int height = record.height >> (record.droppedLevels + 1);
+
+			if (std::min(width, height) >= m_MinDowngradeSize)
+				Downgrade(id, record);
+			else
+				Evict(id, record);
+		}
+
+		if (m_Stats.residentBytes <= m_Stats.budgetBytes)
+			break;
+	}
+
+	bindings.bindTexture(GL_TEXTURE_2D, previousTexture);
+}
+
+// Replaces the base level with the current level 1, which halves the texture in both dimensions.
+// The image is read back from the GPU so the file does not have to be decoded again.
+void TextureResidency::Downgrade(unsigned int id, TextureRecord& record)
+{
+	int width = std::max(record.width >> (record.droppedLevels + 1), 1);
+	int height = std::max(record.height >> (record.droppedLevels + 1), 1);
+
+	std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * record.components);
+
+	TextureBindings::getInstance().bindTexture(GL_TEXTURE_2D, id);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 1, record.source.format, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, record.source.internalFormat, width, height, 0, record.source.format, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	size_t bytes = CalculateBytes(width, height, record.components);
+	m_Stats.residentBytes -= record.bytes - bytes;
+	record.bytes = bytes;
+	record.droppedLevels++;
+	m_Stats.downgrades++;
+}
+
+// Releases every level and leaves a single grey texel behind, so sampling an evicted texture is still valid
+void TextureResidency::Evict(unsigned int id, TextureRecord& record)
+{
+	const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+
+	TextureBindings::getInstance().bindTexture(GL_TEXTURE_2D, id);
+
+	int levels = 1 + static_cast<int>(std::log2(std::max(record.width, record.height)));
+	for (int level = levels - 1; level > 0; level--)
+		glTexImage2D(GL_TEXTURE_2D, level, record.source.internalFormat, 0, 0, 0, record.source.format, GL_UNSIGNED_BYTE, nullptr);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, record.source.internalFormat, 1, 1, 0, record.source.format, GL_UNSIGNED_BYTE, placeholder);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	m_Stats.residentBytes -= record.bytes;
+	record.bytes = 0;
+	record.evicted = true;
+	m_Stats.evictedCount++;
+	m_Stats.evictions++;
+}
+
+// Decodes the source file again and uploads the full mip chain
+void TextureResidency::Restore(unsigned int id, TextureRecord& record)
+{
+	int width, height, nrComponents;
+
+	// Decoded the way it was loaded, without changing how everything else gets decoded
+	bool flip = GetFlipVerticallyOnLoad();
+	SetFlipVerticallyOnLoad(record.source.flipVertically);
+	unsigned char* data = stbi_load(record.source.path.c_str(), &width, &height, &nrComponents, record.components);
+	SetFlipVerticallyOnLoad(flip);
+
+	if (!data)
+	{
+		std::cout << "Failed to reload texture: " << record.source.path << std::endl;
+		return;
+	}
+
+	TextureBindings::getInstance().bindTexture(GL_TEXTURE_2D, id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+	glTexImage2D(GL_TEXTURE_2D, 0, record.source.internalFormat, width, height, 0, record.source.format, GL_UNSIGNED_BYTE, data);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	stbi_image_free(data);
+
+	if (record.evicted)
+		m_Stats.evictedCount--;
+
+	size_t bytes = CalculateBytes(width, height, record.components);
+	m_Stats.residentBytes += bytes - record.bytes;
+
+	record.width = width;
+	record.height = height;
+	record.bytes = bytes;
+	record.droppedLevels = 0;
+	record.evicted = false;
+	m_Stats.reloads++;
+}
+
+// Size of the full mip chain. Drivers pad 3 component textures to 4 bytes per texel.
+size_t TextureResidency::CalculateBytes(int width, int height, int components)
+{
+	size_t texelSize = components == 3 ? 4 : static_cast<size_t>(components);
+	size_t bytes = 0;
+
+	while (true)
+	{
+		bytes += static_cast<size_t>(width) * height * texelSize;
+
+		if (width == 1 && height == 1)
+			break;
+
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+
+	return bytes;
+}
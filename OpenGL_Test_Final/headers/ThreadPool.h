@@ -0,0 +1,151 @@
+#pragma once
+
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+// Worker threads for CPU side work that splits into independent pieces (mesh processing, image decoding, ...).
+// parallelFor() blocks until every piece is done and the calling thread works on pieces too, so it can be
+// called from any thread, including from inside another parallelFor(). Workers never touch GL.
+class ThreadPool
+{
+private:
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_TaskAvailable;
+	std::deque<std::function<void()>> m_Tasks;
+	bool m_bStopping = false;
+
+	// This is a singleton class
+	ThreadPool();
+
+public:
+	ThreadPool(ThreadPool const&) = delete;
+	void operator=(ThreadPool const&) = delete;
+
+	static ThreadPool& getInstance();
+
+	// Calls function(begin, end) over [0, count) in ranges of at most grainSize elements
+	void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t grainSize = 1);
+
+	size_t getWorkerCount() const { return m_Workers.size(); }
+
+	~ThreadPool();
+
+private:
+	void WorkerThread();
+};
+
+inline ThreadPool& ThreadPool::getInstance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool()
+{
+	// The calling thread always helps out, so one core is left for it
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int workers = cores > 1 ? cores - 1 : 1;
+
+	for (unsigned int i = 0; i < workers; i++)
+		m_Workers.emplace_back(&ThreadPool::WorkerThread, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bStopping = true;
+	}
+	m_TaskAvailable.notify_all();
+
+	for (auto& worker : m_Workers)
+		worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t grainSize)
+{
+	if (count == 0)
+		return;
+
+	grainSize = std::max<size_t>(grainSize, 1);
+	size_t chunks = (count + grainSize - 1) / grainSize;
+
+	if (chunks == 1)
+	{
+		function(0, count);
+		return;
+	}
+
+	// Shared with the helper tasks, which may only get to run after this call has returned
+	struct State
+	{
+		std::atomic<size_t> nextChunk = 0;
+		std::atomic<size_t> doneChunks = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<State>();
+
+	auto work = [state, &function, count, grainSize, chunks]()
+	{
+		size_t chunk;
+		while ((chunk = state->nextChunk++) < chunks)
+		{
+			size_t begin = chunk * grainSize;
+			function(begin, std::min(begin + grainSize, count));
+
+			if (++state->doneChunks == chunks)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	size_t helpers = std::min(chunks - 1, m_Workers.size());
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (size_t i = 0; i < helpers; i++)
+		{
+			// Helpers that start after every chunk is taken return without touching function
+			m_Tasks.push_back(work);
+		}
+	}
+	m_TaskAvailable.notify_all();
+
+	work();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state, chunks]() { return state->doneChunks == chunks; });
+}
+
+void ThreadPool::WorkerThread()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_TaskAvailable.wait(lock, [this]() { return !m_Tasks.empty() || m_bStopping; });
+
+			if (m_bStopping && m_Tasks.empty())
+				return;
+
+			task = std::move(m_Tasks.front());
+			m_Tasks.pop_front();
+		}
+
+		task();
+	}
+}
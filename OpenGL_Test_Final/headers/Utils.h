@@ -10,6 +10,7 @@
 #include "IndexBuffer.h"
 #include "BufferLayout.h"
 #include "Texture2D.h"
+#include "Cubemap.h"
 #include "Shader.h"
 #include "Camera.h"
 
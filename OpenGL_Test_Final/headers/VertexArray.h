@@ -2,6 +2,11 @@
 
 #include <glad/glad.h>
 
+#include "DSA.h"
+#include "GLState.h"
+
+#include <utility>
+
 class VertexArray
 {
 private:
@@ -10,32 +15,82 @@ private:
 public:
 	VertexArray() = default;
 
+	// Owns the GL object, so it can be moved but not copied
+	VertexArray(const VertexArray&) = delete;
+	VertexArray& operator=(const VertexArray&) = delete;
+
+	VertexArray(VertexArray&& other) noexcept;
+	VertexArray& operator=(VertexArray&& other) noexcept;
+
+	~VertexArray();
+
 	void generate();
 
 	void bind() const;
 
 	void unbind() const;
 
-	void free() const;
+	void free();
+
+	const unsigned int getID() const;
 };
 
+VertexArray::VertexArray(VertexArray&& other) noexcept
+	: m_VertexArrayID(other.m_VertexArrayID)
+{
+	other.m_VertexArrayID = 0;
+}
+
+VertexArray& VertexArray::operator=(VertexArray&& other) noexcept
+{
+	if (this != &other)
+	{
+		free();
+		std::swap(m_VertexArrayID, other.m_VertexArrayID);
+	}
+	return *this;
+}
+
+VertexArray::~VertexArray()
+{
+	free();
+}
+
 void VertexArray::generate()
 {
+	if (DSA::isAvailable())
+	{
+		DSA::CreateVertexArrays(1, &m_VertexArrayID);
+		return;
+	}
+
 	glGenVertexArrays(1, &m_VertexArrayID);
-	glBindVertexArray(m_VertexArrayID);
+	GLState::getInstance().bindVertexArray(m_VertexArrayID);
 }
 
 void VertexArray::bind() const
 {
-	glBindVertexArray(m_VertexArrayID);
+	GLState::getInstance().bindVertexArray(m_VertexArrayID);
 }
 
 void VertexArray::unbind() const
 {
-	glBindVertexArray(0);
+	GLState::getInstance().bindVertexArray(0);
+}
+
+// Deleting is safe to repeat, the destructor calls this as well
+void VertexArray::free()
+{
+	if (m_VertexArrayID != 0)
+	{
+		GLState::getInstance().forgetVertexArray(m_VertexArrayID);
+		glDeleteVertexArrays(1, &m_VertexArrayID);
+	}
+
+	m_VertexArrayID = 0;
 }
 
-void VertexArray::free() const
+const unsigned int VertexArray::getID() const
 {
-	glDeleteVertexArrays(1, &m_VertexArrayID);
+	return m_VertexArrayID;
 }
\ No newline at end of file
@@ -2,6 +2,11 @@
 
 #include <glad/glad.h>
 
+#include "DSA.h"
+#include "GLState.h"
+
+#include <utility>
+
 template<typename T = float>
 class VertexBuffer
 {
@@ -14,6 +19,15 @@ public:
 
 	VertexBuffer() = default;
 
+	// Owns the GL buffer, so it can be moved but not copied
+	VertexBuffer(const VertexBuffer&) = delete;
+	VertexBuffer& operator=(const VertexBuffer&) = delete;
+
+	VertexBuffer(VertexBuffer&& other) noexcept;
+	VertexBuffer& operator=(VertexBuffer&& other) noexcept;
+
+	~VertexBuffer();
+
 	void generate(size_t vertexCount);
 
 	void bind() const;
@@ -26,37 +40,77 @@ public:
 
 	size_t getVertexCount() const;
 
-	void free() const;
+	void free();
 
 	const unsigned int getID() const;
 };
 
+template<typename T>
+VertexBuffer<T>::VertexBuffer(VertexBuffer&& other) noexcept
+	: m_VertexBufferID(other.m_VertexBufferID), m_BufferBytes(other.m_BufferBytes), m_VertexCount(other.m_VertexCount), typeSize(other.typeSize)
+{
+	other.m_VertexBufferID = 0;
+	other.m_BufferBytes = 0;
+	other.m_VertexCount = 0;
+}
+
+template<typename T>
+VertexBuffer<T>& VertexBuffer<T>::operator=(VertexBuffer&& other) noexcept
+{
+	if (this != &other)
+	{
+		free();
+		std::swap(m_VertexBufferID, other.m_VertexBufferID);
+		std::swap(m_BufferBytes, other.m_BufferBytes);
+		std::swap(m_VertexCount, other.m_VertexCount);
+		typeSize = other.typeSize;
+	}
+	return *this;
+}
+
+template<typename T>
+VertexBuffer<T>::~VertexBuffer()
+{
+	free();
+}
+
 template<typename T>
 void VertexBuffer<T>::generate(size_t vertexCount)
 {
 	m_VertexCount = vertexCount;
 
+	// With DSA the buffer is created without touching the GL_ARRAY_BUFFER binding
+	if (DSA::isAvailable())
+	{
+		DSA::CreateBuffers(1, &m_VertexBufferID);
+		return;
+	}
+
 	glGenBuffers(1, &m_VertexBufferID);
-	glBindBuffer(GL_ARRAY_BUFFER, m_VertexBufferID);
+	GLState::getInstance().bindBuffer(GL_ARRAY_BUFFER, m_VertexBufferID);
 }
 
 template<typename T>
 void VertexBuffer<T>::bind() const
 {
-	glBindBuffer(GL_ARRAY_BUFFER, m_VertexBufferID);
+	GLState::getInstance().bindBuffer(GL_ARRAY_BUFFER, m_VertexBufferID);
 }
 
 template<typename T>
 void VertexBuffer<T>::unbind() const
 {
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	GLState::getInstance().bindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 template<typename T>
 void VertexBuffer<T>::setBuffer(size_t bytes, const void* data)
 {
 	m_BufferBytes = bytes;
-	glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+
+	if (DSA::isAvailable())
+		DSA::NamedBufferData(m_VertexBufferID, bytes, data, GL_STATIC_DRAW);
+	else
+		glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
 }
 
 template<typename T>
@@ -71,10 +125,18 @@ size_t VertexBuffer<T>::getVertexCount() const
 	return m_VertexCount;
 }
 
+// Deleting is safe to repeat, the destructor calls this as well
 template<typename T>
-void VertexBuffer<T>::free() const
+void VertexBuffer<T>::free()
 {
-	glDeleteBuffers(1, &m_VertexBufferID);
+	if (m_VertexBufferID != 0)
+	{
+		GLState::getInstance().forgetBuffer(m_VertexBufferID);
+		glDeleteBuffers(1, &m_VertexBufferID);
+	}
+
+	m_VertexBufferID = 0;
+	m_BufferBytes = 0;
 }
 
 template<typename T>
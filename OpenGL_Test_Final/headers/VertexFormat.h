@@ -0,0 +1,243 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <cstdint>
+
+// One vertex attribute of a vertex format, at a byte offset inside the vertex
+struct VertexAttribute
+{
+	GLuint location;
+	GLint count;
+	GLenum type;
+	GLboolean normalized;
+	bool integer;			// Read as ivec/uvec in the shader instead of being converted to float
+	GLuint offset;
+};
+
+// How a mesh stores its vertices on the GPU. The attribute locations never change, only their encoding:
+//   0 position   vec3, always float
+//   1 normal     vec3 float, or vec2 octahedral (decode with decodeOctahedral())
+//   2 texcoords  vec2 float, half float or normalized 16 bit (normalized only works for UVs inside [0, 1])
+//   3 tangent    vec3 float, or vec4 float or packed 10_10_10_2 with the bitangent sign in w
+//   4 bitangent  vec3 float, absent when the tangent has a sign (decode with decodeBitangent())
+//   5 bone IDs   ivec4, only when the mesh is skinned
+//   6 weights    vec4, only when the mesh is skinned
+// Shaders that only read positions and texture coordinates work with every format unchanged. Locations 12 to 15 are
+// left free for a per instance model matrix (INSTANCE_MATRIX_LOCATION).
+struct VertexFormat
+{
+	enum class TexCoords : uint8_t { Float, Half, Unorm16 };
+	enum class Normals : uint8_t { Float, Octahedral };
+	enum class Tangents : uint8_t { Float, Packed, Float4 };
+
+	TexCoords texCoords = TexCoords::Float;
+	Normals normals = Normals::Float;
+	Tangents tangents = Tangents::Float;
+	bool skinned = true;
+
+	// The 88 byte Vertex struct uploaded as is
+	static VertexFormat full();
+
+	// 24 bytes per static vertex: half float UVs, octahedral normals and packed tangents
+	static VertexFormat compact();
+
+	// 48 bytes per static vertex, the float attributes of a glTF file: vec4 tangents with the bitangent sign in w
+	static VertexFormat gltf();
+
+	// True if the vertices are uploaded straight from the Vertex struct without packing
+	bool isFull() const;
+
+	unsigned int getStride() const;
+
+	std::vector<VertexAttribute> getAttributes() const;
+
+	// Packs the format into an integer for cache files
+	uint32_t getKey() const;
+
+	static VertexFormat fromKey(uint32_t key);
+
+	bool operator==(const VertexFormat& other) const { return getKey() == other.getKey(); }
+};
+
+inline VertexFormat VertexFormat::full()
+{
+	return VertexFormat();
+}
+
+inline VertexFormat VertexFormat::compact()
+{
+	VertexFormat format;
+	format.texCoords = TexCoords::Half;
+	format.normals = Normals::Octahedral;
+	format.tangents = Tangents::Packed;
+	return format;
+}
+
+inline VertexFormat VertexFormat::gltf()
+{
+	VertexFormat format;
+	format.tangents = Tangents::Float4;
+	format.skinned = false;
+	return format;
+}
+
+inline bool VertexFormat::isFull() const
+{
+	return texCoords == TexCoords::Float && normals == Normals::Float && tangents == Tangents::Float && skinned;
+}
+
+unsigned int VertexFormat::getStride() const
+{
+	// sizeof(Vertex), Mesh.h checks that the two stay in sync
+	if (isFull())
+		return 88;
+
+	unsigned int stride = 0;
+	for (const VertexAttribute& attribute : getAttributes())
+	{
+		switch (attribute.type)
+		{
+		case GL_FLOAT:
+		case GL_INT:					stride += 4 * attribute.count; break;
+		case GL_HALF_FLOAT:
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:			stride += 2 * attribute.count; break;
+		case GL_UNSIGNED_BYTE:			stride += attribute.count; break;
+		case GL_INT_2_10_10_10_REV:		stride += 4; break;
+		}
+	}
+
+	return stride;
+}
+
+std::vector<VertexAttribute> VertexFormat::getAttributes() const
+{
+	// The full format mirrors the Vertex struct in Mesh.h
+	if (isFull())
+	{
+		return {
+			{ 0, 3, GL_FLOAT, GL_FALSE, false, 0 },
+			{ 1, 3, GL_FLOAT, GL_FALSE, false, 12 },
+			{ 2, 2, GL_FLOAT, GL_FALSE, false, 24 },
+			{ 3, 3, GL_FLOAT, GL_FALSE, false, 32 },
+			{ 4, 3, GL_FLOAT, GL_FALSE, false, 44 },
+			{ 5, 4, GL_INT, GL_FALSE, true, 56 },
+			{ 6, 4, GL_FLOAT, GL_FALSE, false, 72 }
+		};
+	}
+
+	std::vector<VertexAttribute> attributes;
+	GLuint offset = 0;
+
+	attributes.push_back({ 0, 3, GL_FLOAT, GL_FALSE, false, offset });
+	offset += 12;
+
+	if (normals == Normals::Float)
+	{
+		attributes.push_back({ 1, 3, GL_FLOAT, GL_FALSE, false, offset });
+		offset += 12;
+	}
+	else
+	{
+		attributes.push_back({ 1, 2, GL_SHORT, GL_TRUE, false, offset });
+		offset += 4;
+	}
+
+	if (texCoords == TexCoords::Float)
+	{
+		attributes.push_back({ 2, 2, GL_FLOAT, GL_FALSE, false, offset });
+		offset += 8;
+	}
+	else
+	{
+		GLenum type = texCoords == TexCoords::Half ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT;
+		attributes.push_back({ 2, 2, type, GLboolean(texCoords == TexCoords::Unorm16), false, offset });
+		offset += 4;
+	}
+
+	if (tangents == Tangents::Float)
+	{
+		attributes.push_back({ 3, 3, GL_FLOAT, GL_FALSE, false, offset });
+		attributes.push_back({ 4, 3, GL_FLOAT, GL_FALSE, false, offset + 12 });
+		offset += 24;
+	}
+	else if (tangents == Tangents::Float4)
+	{
+		attributes.push_back({ 3, 4, GL_FLOAT, GL_FALSE, false, offset });
+		offset += 16;
+	}
+	else
+	{
+		attributes.push_back({ 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false, offset });
+		offset += 4;
+	}
+
+	// Four bone IDs in bytes (up to 256 bones) and four normalized byte weights
+	if (skinned)
+	{
+		attributes.push_back({ 5, 4, GL_UNSIGNED_BYTE, GL_FALSE, true, offset });
+		attributes.push_back({ 6, 4, GL_UNSIGNED_BYTE, GL_TRUE, false, offset + 4 });
+		offset += 8;
+	}
+
+	return attributes;
+}
+
+inline uint32_t VertexFormat::getKey() const
+{
+	return uint32_t(texCoords) | uint32_t(normals) << 2 | uint32_t(tangents) << 3 | uint32_t(skinned) << 5;
+}
+
+inline VertexFormat VertexFormat::fromKey(uint32_t key)
+{
+	VertexFormat format;
+	format.texCoords = TexCoords(key & 3);
+	format.normals = Normals((key >> 2) & 1);
+	format.tangents = Tangents((key >> 3) & 3);
+	format.skinned = ((key >> 5) & 1) != 0;
+	return format;
+}
+
+// GLSL helpers for the packed attributes, added to every vertex shader by Shader::load()
+inline const char* VERTEX_FORMAT_GLSL =
+	"vec3 decodeOctahedral(vec2 e)\n"
+	"{\n"
+	"	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+	"	if (n.z < 0.0)\n"
+	"		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+	"	return normalize(n);\n"
+	"}\n"
+	"vec3 decodeBitangent(vec3 normal, vec4 tangent)\n"
+	"{\n"
+	"	return cross(normal, tangent.xyz) * (tangent.w < 0.0 ? -1.0 : 1.0);\n"
+	"}\n";
+
+// First of the four locations of the per instance model matrix, past every vertex format attribute
+constexpr GLuint INSTANCE_MATRIX_LOCATION = 12;
+
+// Added after a vertex shader's "uniform mat4 matModel;". While instancedDraw is set, matModel reads the per instance
+// matrix instead of the uniform, so the same program draws one mesh or a whole instanced batch (see Renderer.h).
+// The macro is not expanded again inside its own replacement, the matModel there still names the uniform.
+inline const char* INSTANCING_GLSL =
+	"layout (location = 12) in mat4 instanceModel;\n"
+	"uniform bool instancedDraw;\n"
+	"#define matModel (instancedDraw ? instanceModel : matModel)\n";
+
+// Skinning against the palette AnimationSystem uploads, three rows of every joint's matrix per character
+inline const char* SKINNING_GLSL =
+	"uniform samplerBuffer bonePalette;\n"
+	"uniform int boneOffset;\n"
+	"mat4 boneMatrix(int joint)\n"
+	"{\n"
+	"	int texel = (boneOffset + joint) * 3;\n"
+	"	return transpose(mat4(texelFetch(bonePalette, texel), texelFetch(bonePalette, texel + 1), texelFetch(bonePalette, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));\n"
+	"}\n"
+	"mat4 skinMatrix(ivec4 joints, vec4 weights)\n"
+	"{\n"
+	"	float total = weights.x + weights.y + weights.z + weights.w;\n"
+	"	if (total <= 0.0)\n"
+	"		return mat4(1.0);\n"
+	"	return boneMatrix(joints.x) * weights.x + boneMatrix(joints.y) * weights.y + boneMatrix(joints.z) * weights.z + boneMatrix(joints.w) * weights.w;\n"
+	"}\n";
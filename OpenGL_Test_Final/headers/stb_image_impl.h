@@ -1,4 +1,23 @@
 #pragma once
 
 #define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
\ No newline at end of file
+#include "stb_image.h"
+
+// stb_image has no getter for its flip flag, so it is only set through here. This keeps a copy, so code that needs
+// the flag one way can put it back afterwards and textures can record how they were decoded.
+inline bool& FlipVerticallyOnLoadFlag()
+{
+	static bool flip = false;
+	return flip;
+}
+
+inline void SetFlipVerticallyOnLoad(bool flip)
+{
+	FlipVerticallyOnLoadFlag() = flip;
+	stbi_set_flip_vertically_on_load(flip);
+}
+
+inline bool GetFlipVerticallyOnLoad()
+{
+	return FlipVerticallyOnLoadFlag();
+}
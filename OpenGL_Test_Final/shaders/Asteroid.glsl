@@ -1,7 +1,7 @@
 #ifdef SHADER_VERTEX
 layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in mat4 instanceMatrix;
+layout (location = 12) in mat4 instanceMatrix;
 out vec2 TexCoords;
 
 uniform mat4 matProjection;
@@ -0,0 +1,57 @@
+#ifdef SHADER_VERTEX
+
+layout (location = 0) in vec3 vPos;
+layout (location = 1) in vec3 vNorm;
+layout (location = 2) in vec2 vTexCoords;
+layout (location = 5) in ivec4 vBoneIDs;
+layout (location = 6) in vec4 vWeights;
+
+out vec3 vNormal;
+out vec3 vFragPos;
+out vec2 vTexCoord;
+
+uniform mat4 matModel;
+uniform mat4 matView;
+uniform mat4 matProjection;
+
+void main()
+{
+	// Palette from AnimationSystem::bind(), see skinMatrix() in VertexFormat.h
+	mat4 matSkinnedModel = matModel * skinMatrix(vBoneIDs, vWeights);
+
+	gl_Position = matProjection * matView * matSkinnedModel * vec4(vPos, 1.0f);
+
+	vNormal = mat3(transpose(inverse(matSkinnedModel))) * vNorm;
+	vFragPos = vec3(matSkinnedModel * vec4(vPos, 1.0f));
+	vTexCoord = vTexCoords;
+}
+
+#endif
+
+#ifdef SHADER_FRAGMENT
+
+in vec3 vNormal;
+in vec3 vFragPos;
+in vec2 vTexCoord;
+
+out vec4 FragColor;
+
+uniform vec3 vViewPos;
+uniform vec3 vLightDirection;
+
+uniform sampler2D texture_diffuse1;
+
+void main()
+{
+	vec3 vNorm = normalize(vNormal);
+	vec3 vLightDir = normalize(-vLightDirection);
+	vec3 vColor = texture(texture_diffuse1, vTexCoord).rgb;
+
+	// Ambient and diffuse shading
+	float fDiff = max(dot(vNorm, vLightDir), 0.0f);
+	vec3 vResult = (0.2f + 0.8f * fDiff) * vColor;
+
+	FragColor = vec4(vResult, 1.0f);
+}
+
+#endif